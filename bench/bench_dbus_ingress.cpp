@@ -0,0 +1,515 @@
+// D-Bus ingress: the legacy Notify* path end to end. A private dbus-daemon is
+// started for each run and the portal is served on it from this process, with
+// null or recording devices at the end; several client connections then call
+// Notify* as fast as they can, waiting for each reply or not. With `churn` set,
+// that many more connections create, start, connect and close sessions back to
+// back meanwhile, so the latencies show whether control-plane work holds up
+// input.
+//
+//   cmake -B build -DBUILD_BENCHMARKS=ON && cmake --build build --target bench_dbus_ingress
+//   ./build/bench_dbus_ingress
+//
+// Every benchmark reports `calls_per_sec`; `p50_us`, `p99_us` and `p999_us`, the
+// time from a client sending a call to the portal emitting it on the output
+// device, sampled on every 16th call; and `portal_cpu_per_1k` / `bus_cpu_per_1k`,
+// CPU milliseconds per 1000 calls on the portal's D-Bus thread (which does all
+// of the Notify* work) and in the bus daemon. Runs with churn also report
+// `sessions_per_sec`, the session lifecycles completed alongside.
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "output_backend.h"
+#include "recording_backend.h"
+#include "wayland_virtual_pointer.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+const char* PORTAL_NAME = "org.freedesktop.impl.portal.desktop.hypr-remote";
+const char* PORTAL_PATH = "/org/freedesktop/portal/desktop";
+const char* PORTAL_INTERFACE = "org.freedesktop.impl.portal.RemoteDesktop";
+const char* SESSION_INTERFACE = "org.freedesktop.impl.portal.Session";
+
+constexpr size_t kCallsPerClient = 2048;
+constexpr size_t kTagEvery = 16;
+constexpr size_t kTagsPerClient = kCallsPerClient / kTagEvery;
+
+// Sampled calls are NotifyPointerButton with the button code carrying the
+// client and sample index, so the output device can tell which one it emitted
+constexpr uint32_t kTagBit = 0x40000000;
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class QuietStdout {
+public:
+    QuietStdout() : saved(std::cout.rdbuf(&sink)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    std::streambuf* saved;
+};
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double thread_cpu_ms(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) return 0;
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// dbus-daemon on a session bus of its own, for the length of one benchmark run
+class PrivateBus {
+public:
+    ~PrivateBus() { stop(); }
+
+    bool start() {
+        int out[2];
+        if (pipe2(out, O_CLOEXEC) != 0) return false;
+        pid = fork();
+        if (pid == 0) {
+            dup2(out[1], STDOUT_FILENO);
+            execlp("dbus-daemon", "dbus-daemon", "--session", "--nofork", "--print-address", nullptr);
+            _exit(127);
+        }
+        close(out[1]);
+        if (pid < 0) {
+            close(out[0]);
+            return false;
+        }
+
+        // The daemon prints its address once it is listening
+        std::string line;
+        char c;
+        while (read(out[0], &c, 1) == 1 && c != '\n') line += c;
+        close(out[0]);
+        if (line.empty()) {
+            stop();
+            return false;
+        }
+        address = line;
+        return true;
+    }
+
+    void stop() {
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+            pid = -1;
+        }
+    }
+
+    // User plus system CPU the daemon has used so far
+    double cpu_ms() const {
+        std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+        std::string content((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+        size_t end = content.rfind(')');
+        if (end == std::string::npos) return 0;
+
+        // Fields after the command name, starting with state (field 3); utime and
+        // stime are fields 14 and 15
+        std::vector<std::string> fields;
+        size_t pos = end + 2;
+        while (pos < content.size() && fields.size() < 13) {
+            size_t space = content.find(' ', pos);
+            fields.push_back(content.substr(pos, space - pos));
+            if (space == std::string::npos) break;
+            pos = space + 1;
+        }
+        if (fields.size() < 13) return 0;
+        double ticks = std::stod(fields[11]) + std::stod(fields[12]);
+        return ticks * 1e3 / sysconf(_SC_CLK_TCK);
+    }
+
+    std::string address;
+
+private:
+    pid_t pid = -1;
+};
+
+// Send and emit times for one client's sampled calls in the current batch
+struct alignas(64) Samples {
+    int64_t sent[kTagsPerClient];
+    int64_t emitted[kTagsPerClient];
+    std::atomic<size_t> arrived{0};
+};
+
+// The output pointer: Base's requests, plus the emit time of every sampled call
+template <typename Base>
+class StampingPointer : public Base {
+public:
+    template <typename... Args>
+    explicit StampingPointer(std::vector<std::unique_ptr<Samples>>& samples, Args&&... args)
+        : Base(std::forward<Args>(args)...), samples(samples) {}
+
+protected:
+    void emit_button(uint32_t time, uint32_t button, uint32_t state) override {
+        if (button & kTagBit) {
+            Samples& client = *samples[(button & ~kTagBit) >> 16];
+            client.emitted[button & 0xffff] = now_ns();
+            client.arrived.fetch_add(1, std::memory_order_release);
+        }
+        Base::emit_button(time, button, state);
+    }
+
+private:
+    std::vector<std::unique_ptr<Samples>>& samples;
+};
+
+// Requests go nowhere, as with the null backend
+class DroppingPointer : public WaylandVirtualPointer {
+protected:
+    void emit_motion(uint32_t, wl_fixed_t, wl_fixed_t) override {}
+    void emit_motion_absolute(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) override {}
+    void emit_button(uint32_t, uint32_t, uint32_t) override {}
+    void emit_axis(uint32_t, uint32_t, wl_fixed_t) override {}
+    void emit_axis_source(uint32_t) override {}
+    void emit_axis_discrete(uint32_t, uint32_t, wl_fixed_t, int32_t) override {}
+    void emit_axis_stop(uint32_t, uint32_t) override {}
+    void emit_frame() override {}
+    void flush() override {}
+};
+
+// One remote desktop client on its own bus connection, with a started session
+class NotifyClient {
+public:
+    explicit NotifyClient(size_t index) : index(index) {
+        std::string tag = "bench_" + std::to_string(index);
+        session = sdbus::ObjectPath(std::string(PORTAL_PATH) + "/session/" + tag);
+        request = sdbus::ObjectPath(std::string(PORTAL_PATH) + "/request/" + tag);
+    }
+
+    // CreateSession -> SelectDevices -> Start
+    bool connect() {
+        try {
+            portal = sdbus::createProxy(sdbus::createSessionBusConnection(), PORTAL_NAME, PORTAL_PATH);
+            uint32_t response = 1;
+            std::map<std::string, sdbus::Variant> results;
+            portal->callMethod("CreateSession").onInterface(PORTAL_INTERFACE)
+                .withArguments(request, session, std::string("bench"), options)
+                .storeResultsTo(response, results);
+            if (response != 0) return false;
+
+            std::map<std::string, sdbus::Variant> devices;
+            devices["types"] = sdbus::Variant(static_cast<uint32_t>(3)); // keyboard | pointer
+            portal->callMethod("SelectDevices").onInterface(PORTAL_INTERFACE)
+                .withArguments(request, session, std::string("bench"), devices)
+                .storeResultsTo(response, results);
+            if (response != 0) return false;
+
+            portal->callMethod("Start").onInterface(PORTAL_INTERFACE)
+                .withArguments(request, session, std::string("bench"), std::string(), options)
+                .storeResultsTo(response, results);
+            return response == 0;
+        } catch (const sdbus::Error& e) {
+            std::cerr << "Bench client " << index << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // kCallsPerClient calls: mostly motion, a key press and release every 8, and
+    // a sampled button every 16. The last call always waits for its reply, so
+    // nothing sent before it is still sitting in the connection.
+    bool send_batch(Samples& samples, bool reply) {
+        try {
+            for (size_t n = 0; n < kCallsPerClient; n++) {
+                bool last = n == kCallsPerClient - 1;
+                if (n % kTagEvery == kTagEvery - 1) {
+                    size_t sample = n / kTagEvery;
+                    samples.sent[sample] = now_ns();
+                    send("NotifyPointerButton", reply || last,
+                         static_cast<int32_t>(kTagBit | index << 16 | sample), static_cast<uint32_t>(1));
+                } else if (n % 8 == 3 || n % 8 == 7) {
+                    send("NotifyKeyboardKeycode", reply, static_cast<int32_t>(KEY_A),
+                         static_cast<uint32_t>(n % 8 == 3 ? 1 : 0));
+                } else {
+                    send("NotifyPointerMotion", reply, n & 1 ? 1.0 : -1.0, 0.5);
+                }
+            }
+            return true;
+        } catch (const sdbus::Error& e) {
+            std::cerr << "Bench client " << index << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+private:
+    size_t index;
+    sdbus::ObjectPath session;
+    sdbus::ObjectPath request;
+    std::map<std::string, sdbus::Variant> options;
+    std::unique_ptr<sdbus::IProxy> portal;
+
+    template <typename... Args>
+    void send(const char* method, bool reply, Args... args) {
+        auto invoker = portal->callMethod(method);
+        invoker.onInterface(PORTAL_INTERFACE).withArguments(session, options, args...);
+        if (!reply) invoker.dontExpectReply();
+    }
+};
+
+// Control-plane load: CreateSession -> SelectDevices -> Start -> ConnectToEIS ->
+// Close, over and over on a connection of its own, until stopped
+class SessionChurner {
+public:
+    explicit SessionChurner(size_t index) : index(index) {}
+
+    ~SessionChurner() { stop(); }
+
+    void start() {
+        thread = std::thread([this]() { run(); });
+    }
+
+    // After the cycle in progress; false if any cycle failed
+    bool stop() {
+        done = true;
+        if (thread.joinable()) thread.join();
+        return !failed;
+    }
+
+    uint64_t cycles() const { return completed.load(std::memory_order_relaxed); }
+
+private:
+    size_t index;
+    std::thread thread;
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> completed{0};
+
+    void run() {
+        try {
+            auto connection = sdbus::createSessionBusConnection();
+            auto portal = sdbus::createProxy(*connection, PORTAL_NAME, PORTAL_PATH);
+            const std::string app("bench-churn");
+            std::map<std::string, sdbus::Variant> options;
+            for (uint64_t n = 0; !done; n++) {
+                std::string tag = "churn_" + std::to_string(index) + "_" + std::to_string(n);
+                sdbus::ObjectPath session(std::string(PORTAL_PATH) + "/session/" + tag);
+                sdbus::ObjectPath request(std::string(PORTAL_PATH) + "/request/" + tag);
+                uint32_t response = 1;
+                std::map<std::string, sdbus::Variant> results;
+
+                portal->callMethod("CreateSession").onInterface(PORTAL_INTERFACE)
+                    .withArguments(request, session, app, options)
+                    .storeResultsTo(response, results);
+                if (response == 0) {
+                    portal->callMethod("SelectDevices").onInterface(PORTAL_INTERFACE)
+                        .withArguments(request, session, app, options)
+                        .storeResultsTo(response, results);
+                }
+                if (response == 0) {
+                    portal->callMethod("Start").onInterface(PORTAL_INTERFACE)
+                        .withArguments(request, session, app, std::string(), options)
+                        .storeResultsTo(response, results);
+                }
+                if (response != 0) {
+                    failed = true;
+                    return;
+                }
+
+                // The client's end is closed again right away, as a client giving up would
+                sdbus::UnixFd fd;
+                portal->callMethod("ConnectToEIS").onInterface(PORTAL_INTERFACE)
+                    .withArguments(session, app, options)
+                    .storeResultsTo(fd);
+                auto object = sdbus::createProxy(*connection, PORTAL_NAME, session);
+                object->callMethod("Close").onInterface(SESSION_INTERFACE);
+                completed.fetch_add(1, std::memory_order_relaxed);
+            }
+        } catch (const sdbus::Error& e) {
+            std::cerr << "Bench churner " << index << ": " << e.what() << std::endl;
+            failed = true;
+        }
+    }
+};
+
+double percentile(std::vector<int64_t>& values, double p) {
+    if (values.empty()) return 0;
+    size_t rank = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank] / 1e3;
+}
+
+void BM_DbusIngress(benchmark::State& state) {
+    const size_t clients = static_cast<size_t>(state.range(0));
+    const bool reply = state.range(1) != 0;
+    const bool record = state.range(2) != 0;
+    const size_t churners = static_cast<size_t>(state.range(3));
+    QuietStdout quiet;
+
+    PrivateBus bus;
+    if (!bus.start()) {
+        state.SkipWithError("could not start dbus-daemon");
+        return;
+    }
+    setenv("DBUS_SESSION_BUS_ADDRESS", bus.address.c_str(), 1);
+
+    // Output: the backend's keyboard and a pointer that stamps sampled calls
+    std::vector<std::unique_ptr<Samples>> samples;
+    for (size_t i = 0; i < clients; i++) samples.push_back(std::make_unique<Samples>());
+    auto backend = OutputBackend::create(record ? "record" : "null");
+    backend->init();
+    DevicePair devices = backend->create_pair();
+    RequestLog log; // only grows; the portal thread may still be flushing into it
+    std::unique_ptr<WaylandVirtualPointer> pointer;
+    if (record) {
+        pointer = std::make_unique<StampingPointer<RecordingVirtualPointer>>(samples, log);
+    } else {
+        pointer = std::make_unique<StampingPointer<DroppingPointer>>(samples);
+    }
+
+    LibEIHandler handler;
+    handler.pointer = pointer.get();
+    handler.keyboard = devices.keyboard.get();
+    Portal portal;
+    if (!portal.init(&handler)) {
+        state.SkipWithError("portal could not register on the private bus");
+        return;
+    }
+    std::thread portal_thread([&portal]() { portal.run(); });
+    clockid_t portal_clock;
+    pthread_getcpuclockid(portal_thread.native_handle(), &portal_clock);
+
+    std::vector<std::unique_ptr<NotifyClient>> remotes;
+    bool connected = true;
+    for (size_t i = 0; i < clients && connected; i++) {
+        remotes.push_back(std::make_unique<NotifyClient>(i));
+        connected = remotes.back()->connect();
+    }
+    if (!connected) state.SkipWithError("session setup failed");
+
+    std::vector<std::unique_ptr<SessionChurner>> churn;
+    for (size_t i = 0; i < churners && connected; i++) {
+        churn.push_back(std::make_unique<SessionChurner>(i));
+        churn.back()->start();
+    }
+    auto churn_start = std::chrono::steady_clock::now();
+
+    std::vector<int64_t> latencies;
+    uint64_t calls = 0;
+    double portal_cpu = 0;
+    double bus_cpu = 0;
+    for (auto _ : state) {
+        if (!connected) break;
+        for (auto& client : samples) client->arrived.store(0, std::memory_order_relaxed);
+        double portal_start = thread_cpu_ms(portal_clock);
+        double bus_start = bus.cpu_ms();
+
+        std::vector<std::thread> senders;
+        std::atomic<bool> failed{false};
+        for (size_t i = 0; i < clients; i++) {
+            senders.emplace_back([&, i]() {
+                if (!remotes[i]->send_batch(*samples[i], reply)) failed = true;
+            });
+        }
+        for (auto& sender : senders) sender.join();
+
+        // Every sampled call emitted means everything sent before it was too
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (auto& client : samples) {
+            while (client->arrived.load(std::memory_order_acquire) < kTagsPerClient) {
+                if (failed || std::chrono::steady_clock::now() > deadline) break;
+                std::this_thread::yield();
+            }
+        }
+        if (failed) {
+            state.SkipWithError("Notify* call failed");
+            break;
+        }
+        bool behind = false;
+        for (auto& client : samples) {
+            behind = behind || client->arrived.load(std::memory_order_acquire) < kTagsPerClient;
+        }
+        if (behind) {
+            state.SkipWithError("portal fell behind");
+            break;
+        }
+        for (auto& client : samples) {
+            for (size_t sample = 0; sample < kTagsPerClient; sample++) {
+                latencies.push_back(client->emitted[sample] - client->sent[sample]);
+            }
+        }
+
+        portal_cpu += thread_cpu_ms(portal_clock) - portal_start;
+        bus_cpu += bus.cpu_ms() - bus_start;
+        calls += clients * kCallsPerClient;
+    }
+
+    double churn_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - churn_start).count();
+    uint64_t churned = 0;
+    bool churn_ok = true;
+    for (auto& churner : churn) {
+        churn_ok = churner->stop() && churn_ok;
+        churned += churner->cycles();
+    }
+    if (!churn_ok) state.SkipWithError("session churn failed");
+
+    churn.clear();
+    remotes.clear();
+    portal.stop();
+    portal_thread.join();
+    portal.cleanup();
+    backend->cleanup();
+    bus.stop();
+    unsetenv("DBUS_SESSION_BUS_ADDRESS");
+
+    double thousands = calls / 1e3;
+    state.counters["calls_per_sec"] = benchmark::Counter(static_cast<double>(calls), benchmark::Counter::kIsRate);
+    state.counters["p50_us"] = percentile(latencies, 0.50);
+    state.counters["p99_us"] = percentile(latencies, 0.99);
+    state.counters["p999_us"] = percentile(latencies, 0.999);
+    state.counters["portal_cpu_per_1k"] = thousands > 0 ? portal_cpu / thousands : 0;
+    state.counters["bus_cpu_per_1k"] = thousands > 0 ? bus_cpu / thousands : 0;
+    if (churners > 0) {
+        state.counters["sessions_per_sec"] = churn_seconds > 0 ? churned / churn_seconds : 0;
+    }
+}
+
+// 1 to 8 client connections, with and without replies, into null and recording devices
+BENCHMARK(BM_DbusIngress)
+    ->ArgNames({"clients", "reply", "record", "churn"})
+    ->ArgsProduct({{1, 2, 4, 8}, {1, 0}, {0, 1}, {0}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// 2 clients while 0 to 4 connections churn sessions: the percentiles should not move
+BENCHMARK(BM_DbusIngress)
+    ->ArgNames({"clients", "reply", "record", "churn"})
+    ->ArgsProduct({{2}, {1, 0}, {0}, {0, 1, 4}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,146 @@
+// EIS ingress scaling: 1 to 64 clients connected at once, each sending pointer
+// motion as fast as it can through a real ConnectToEIS session into the output
+// scheduler, with null devices at the end. Sessions are served either by a
+// thread each (workers = 0) or by the EIS worker pool.
+//
+//   cmake -B build -DBUILD_BENCHMARKS=ON && cmake --build build --target bench_eis_scaling
+//   ./build/bench_eis_scaling
+//
+// Every benchmark reports `events_per_sec` (client frames decoded and translated
+// per second across all sessions) and `threads`, the EIS threads serving them.
+
+#include "portal.h"
+#include "session.h"
+#include "eis_workers.h"
+#include "output_backend.h"
+#include "output_scheduler.h"
+#include "remote_client.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kFramesPerClient = 2000;
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class QuietStdout {
+public:
+    QuietStdout() : saved(std::cout.rdbuf(&sink)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    std::streambuf* saved;
+};
+
+// Frames translated for one session, on its own cache line
+struct alignas(64) FrameCount {
+    std::atomic<uint64_t> frames{0};
+};
+
+void BM_EisScaling(benchmark::State& state) {
+    const size_t clients = static_cast<size_t>(state.range(0));
+    const size_t worker_count = static_cast<size_t>(state.range(1));
+    QuietStdout quiet;
+
+    auto backend = OutputBackend::create("null");
+    backend->init();
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    scheduler.start();
+    EisWorkers workers(worker_count, &scheduler);
+    if (worker_count > 0) workers.start();
+    Portal portal;
+
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<std::unique_ptr<RemoteClient>> remotes;
+    std::vector<FrameCount> counts(clients);
+    for (size_t i = 0; i < clients; i++) {
+        auto session = std::make_unique<Session>("/bench/session/" + std::to_string(i), "bench", nullptr);
+        session->attach_devices(scheduler.attach(session->handle(), backend->create_pair()));
+        InputTarget* target = &session->input();
+        FrameCount* count = &counts[i];
+        session->set_event_handler([&portal, target, count](struct eis_event* event) {
+            portal.handle_eis_event(*target, event);
+            if (eis_event_get_type(event) == EIS_EVENT_FRAME) {
+                count->frames.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+        int fd = session->connect_eis(worker_count > 0 ? &workers : nullptr);
+        auto remote = std::make_unique<RemoteClient>(fd);
+        if (fd < 0 || !remote->connect()) {
+            state.SkipWithError("EIS handshake failed");
+            session->close();
+            scheduler.detach(session->take_devices());
+            break;
+        }
+        sessions.push_back(std::move(session));
+        remotes.push_back(std::move(remote));
+    }
+
+    uint64_t delivered = 0;
+    bool behind = false;
+    for (auto _ : state) {
+        if (remotes.size() != clients || behind) break;
+
+        std::vector<uint64_t> expected(clients);
+        for (size_t i = 0; i < clients; i++) {
+            expected[i] = counts[i].frames.load() + kFramesPerClient;
+        }
+
+        std::vector<std::thread> senders;
+        for (auto& remote : remotes) {
+            senders.emplace_back([&remote]() { remote->motion(kFramesPerClient); });
+        }
+        for (auto& sender : senders) sender.join();
+
+        // Until every session has translated everything its client sent
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (size_t i = 0; i < clients && !behind; i++) {
+            while (counts[i].frames.load(std::memory_order_relaxed) < expected[i]) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    state.SkipWithError("sessions fell behind");
+                    behind = true;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        delivered += clients * kFramesPerClient;
+    }
+
+    for (auto& session : sessions) {
+        session->close();
+        scheduler.detach(session->take_devices());
+    }
+    remotes.clear();
+    workers.stop();
+    scheduler.stop();
+    backend->cleanup();
+
+    state.counters["events_per_sec"] = benchmark::Counter(static_cast<double>(delivered), benchmark::Counter::kIsRate);
+    state.counters["threads"] = static_cast<double>(worker_count > 0 ? worker_count : clients);
+}
+
+// Thread per session against 2, 4 and 8 workers, for 1 to 64 clients
+BENCHMARK(BM_EisScaling)
+    ->ArgNames({"clients", "workers"})
+    ->ArgsProduct({{1, 2, 4, 8, 16, 32, 64}, {0, 2, 4, 8}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,223 @@
+// Per-event cost of the input translation hot paths, measured against a
+// recording sink instead of a live wl_display.
+//
+//   cmake -B build -DBUILD_BENCHMARKS=ON && cmake --build build --target bench_translate
+//   ./build/bench_translate
+//
+// Every benchmark reports `ns_per_event` (time per translated input event) and
+// `allocs_per_event` (heap allocations made while translating it).
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "translator.h"
+#include "xkb.h"
+#include "recording_backend.h"
+#include "eis_pair.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <vector>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+// Count every allocation made while `counting` is set
+static std::atomic<bool> counting{false};
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+constexpr size_t kBatch = 64;
+
+// Swallows the portal's logging so the terminal is not part of the measurement;
+// the formatting cost itself is still paid.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class QuietStdout {
+public:
+    QuietStdout() : saved(std::cout.rdbuf(&sink)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    std::streambuf* saved;
+};
+
+class AllocationScope {
+public:
+    explicit AllocationScope(uint64_t& total) : total(total), start(allocations.load()) {
+        counting.store(true, std::memory_order_relaxed);
+    }
+    ~AllocationScope() {
+        counting.store(false, std::memory_order_relaxed);
+        total += allocations.load() - start;
+    }
+
+private:
+    uint64_t& total;
+    uint64_t start;
+};
+
+// Portal wired to recording devices, with a connected EIS client feeding it
+struct Harness {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+    LibEIHandler handler;
+    Portal portal;
+    EisTestPair pair{[this](struct eis_event* event) { portal.handle_eis_event(portal.shared_target(), event); }};
+
+    Harness() {
+        handler.pointer = &pointer;
+        handler.keyboard = &keyboard;
+        portal.set_libei_handler(&handler);
+    }
+};
+
+void report(benchmark::State& state, uint64_t events, uint64_t allocs, size_t requests) {
+    state.SetItemsProcessed(static_cast<int64_t>(events));
+    state.counters["ns_per_event"] = benchmark::Counter(static_cast<double>(events),
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["allocs_per_event"] = events ? static_cast<double>(allocs) / events : 0.0;
+    state.counters["requests_per_event"] = static_cast<double>(requests);
+}
+
+// Run `emit` kBatch times on the client, then time handle_eis_event over the
+// resulting server events. `events_per_emit` is the number of EIS events (including
+// the frame) each emission produces.
+template <typename Emit>
+void run_eis(benchmark::State& state, size_t events_per_emit, Emit emit) {
+    QuietStdout quiet;
+    Harness h;
+    if (!h.pair.connect()) {
+        state.SkipWithError("EIS handshake failed");
+        return;
+    }
+
+    std::vector<struct eis_event*> events;
+    events.reserve(kBatch * events_per_emit);
+    uint64_t translated = 0;
+    uint64_t allocs = 0;
+    size_t requests = 0;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < kBatch; i++) emit(h.pair, i);
+        if (!h.pair.receive(events, kBatch * events_per_emit)) {
+            state.SkipWithError("EIS events did not arrive");
+            break;
+        }
+        h.log.clear();
+        state.ResumeTiming();
+
+        {
+            AllocationScope scope(allocs);
+            for (auto* event : events) h.portal.handle_eis_event(h.portal.shared_target(), event);
+        }
+
+        state.PauseTiming();
+        translated += kBatch;
+        requests = h.log.entries.size() / kBatch;
+        EisTestPair::release(events);
+        state.ResumeTiming();
+    }
+
+    report(state, translated, allocs, requests);
+}
+
+void BM_EisPointerMotion(benchmark::State& state) {
+    run_eis(state, 2, [](EisTestPair& pair, size_t i) {
+        pair.motion(i & 1 ? 1.5 : -1.5, 0.5);
+    });
+}
+BENCHMARK(BM_EisPointerMotion);
+
+void BM_EisPointerButton(benchmark::State& state) {
+    run_eis(state, 2, [](EisTestPair& pair, size_t i) {
+        pair.button(BTN_LEFT, !(i & 1));
+    });
+}
+BENCHMARK(BM_EisPointerButton);
+
+void BM_EisScrollDelta(benchmark::State& state) {
+    run_eis(state, 2, [](EisTestPair& pair, size_t i) {
+        pair.scroll(0.0, i & 1 ? 1.0 : -1.0);
+    });
+}
+BENCHMARK(BM_EisScrollDelta);
+
+void BM_EisScrollDiscrete(benchmark::State& state) {
+    run_eis(state, 2, [](EisTestPair& pair, size_t i) {
+        pair.scroll_discrete(0, i & 1 ? 120 : -120);
+    });
+}
+BENCHMARK(BM_EisScrollDiscrete);
+
+void BM_EisKeyboardKey(benchmark::State& state) {
+    // Shift+A typed repeatedly: a modifier and a regular key, pressed and released
+    static const uint32_t keys[] = { KEY_LEFTSHIFT, KEY_A, KEY_A, KEY_LEFTSHIFT };
+    run_eis(state, 2, [](EisTestPair& pair, size_t i) {
+        pair.key(keys[i % 4], (i % 4) < 2);
+    });
+}
+BENCHMARK(BM_EisKeyboardKey);
+
+void BM_UpdateModifierState(benchmark::State& state) {
+    QuietStdout quiet;
+    ModifierState modifiers;
+    static const uint32_t keys[] = { KEY_LEFTSHIFT, KEY_A, KEY_A, KEY_LEFTSHIFT };
+    uint64_t events = 0;
+    uint64_t allocs = 0;
+
+    for (auto _ : state) {
+        AllocationScope scope(allocs);
+        for (size_t i = 0; i < kBatch; i++) {
+            Translation::update_modifier_state(modifiers, keys[i % 4], (i % 4) < 2);
+        }
+        events += kBatch;
+    }
+
+    report(state, events, allocs, 0);
+}
+BENCHMARK(BM_UpdateModifierState);
+
+void BM_KeycodeFromKeysym(benchmark::State& state) {
+    const auto keysym = static_cast<xkb_keysym_t>(state.range(0));
+    Xkb* xkb = Xkb::self();
+    uint64_t events = 0;
+    uint64_t allocs = 0;
+
+    for (auto _ : state) {
+        AllocationScope scope(allocs);
+        benchmark::DoNotOptimize(xkb->keycodeFromKeysym(keysym));
+        events++;
+    }
+
+    report(state, events, allocs, 0);
+}
+// A letter, Return, and EuroSign (KEY_EURO, near the end of the keycode range);
+// each is one binary search of the keymap's keysym index
+BENCHMARK(BM_KeycodeFromKeysym)->Arg(XKB_KEY_a)->Arg(XKB_KEY_Return)->Arg(XKB_KEY_EuroSign);
+
+} // namespace
+
+BENCHMARK_MAIN();
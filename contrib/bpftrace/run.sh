@@ -0,0 +1,30 @@
+#!/bin/sh
+# Run one of the bpftrace scripts in this directory against the portal binary:
+#
+#   sudo contrib/bpftrace/run.sh stage_latency.bt [path/to/xdg-desktop-portal-hypr-remote]
+#
+# The scripts name the binary as BINARY; it is substituted here so they work
+# wherever the portal is installed. The binary needs its probes compiled in
+# (built with <sys/sdt.h> available); check with `readelf -n <binary> | grep hypr_remote`.
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <script.bt> [binary]" >&2
+    exit 1
+fi
+
+script=$1
+[ -f "$script" ] || script="$(dirname "$0")/$script"
+
+binary=${2:-$(command -v xdg-desktop-portal-hypr-remote || true)}
+if [ -z "$binary" ]; then
+    for candidate in /usr/libexec/xdg-desktop-portal-hypr-remote /usr/lib/xdg-desktop-portal-hypr-remote; do
+        [ -x "$candidate" ] && binary=$candidate && break
+    done
+fi
+if [ -z "$binary" ]; then
+    echo "xdg-desktop-portal-hypr-remote not found, pass its path" >&2
+    exit 1
+fi
+
+exec bpftrace -e "$(sed "s|BINARY|$binary|g" "$script")"
@@ -0,0 +1,559 @@
+#include "clipboard.h"
+#include "debug_log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+// Pipe buffer asked for, so a large transfer needs fewer wakeups; the kernel
+// may grant less (fs.pipe-max-size)
+static const int PIPE_SIZE = 1 << 20;
+// Most one splice moves, and splices per transfer per wakeup, so one large
+// transfer cannot starve the others or the Wayland connection
+static const size_t SPLICE_CHUNK = 1 << 20;
+static const int SPLICE_ROUNDS = 8;
+
+struct Clipboard::Offer {
+    struct zwlr_data_control_offer_v1* offer = nullptr;
+    std::vector<std::string> mime_types;
+
+    ~Offer() {
+        if (offer) zwlr_data_control_offer_v1_destroy(offer);
+    }
+};
+
+// A close-on-exec pipe, as large as the kernel lets us have it
+static bool make_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        std::cerr << "Failed to create clipboard pipe: " << strerror(errno) << std::endl;
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+    return true;
+}
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = Clipboard::registry_global,
+    .global_remove = Clipboard::registry_global_remove,
+};
+
+const struct zwlr_data_control_device_v1_listener Clipboard::device_listener = {
+    .data_offer = [](void* data, struct zwlr_data_control_device_v1*, struct zwlr_data_control_offer_v1* offer) {
+        Clipboard* self = static_cast<Clipboard*>(data);
+        auto introduced = std::make_unique<Offer>();
+        introduced->offer = offer;
+        zwlr_data_control_offer_v1_add_listener(offer, &offer_listener, introduced.get());
+        self->offers[offer] = std::move(introduced);
+    },
+    .selection = [](void* data, struct zwlr_data_control_device_v1*, struct zwlr_data_control_offer_v1* offer) {
+        static_cast<Clipboard*>(data)->selection_changed(offer);
+    },
+    .finished = [](void* data, struct zwlr_data_control_device_v1*) {
+        Clipboard* self = static_cast<Clipboard*>(data);
+        std::cerr << "⚠️ Clipboard seat went away, no selection from now on" << std::endl;
+        zwlr_data_control_device_v1_destroy(self->device);
+        self->device = nullptr;
+        self->drop_selection();
+    },
+    .primary_selection = [](void* data, struct zwlr_data_control_device_v1*, struct zwlr_data_control_offer_v1* offer) {
+        // Not sent at version 1, which is all we bind; the portal has no primary selection
+        static_cast<Clipboard*>(data)->offers.erase(offer);
+    },
+};
+
+const struct zwlr_data_control_offer_v1_listener Clipboard::offer_listener = {
+    .offer = [](void* data, struct zwlr_data_control_offer_v1*, const char* mime_type) {
+        static_cast<Offer*>(data)->mime_types.emplace_back(mime_type);
+    },
+};
+
+const struct zwlr_data_control_source_v1_listener Clipboard::source_listener = {
+    .send = [](void* data, struct zwlr_data_control_source_v1* source, const char* mime_type, int32_t fd) {
+        Clipboard* self = static_cast<Clipboard*>(data);
+        if (source != self->source) {
+            close(fd);
+            return;
+        }
+        self->paste_requested(mime_type, fd);
+    },
+    .cancelled = [](void* data, struct zwlr_data_control_source_v1* source) {
+        static_cast<Clipboard*>(data)->source_cancelled(source);
+    },
+};
+
+Clipboard::Clipboard() = default;
+
+Clipboard::~Clipboard() {
+    cleanup();
+}
+
+bool Clipboard::init(int fd) {
+    display = fd >= 0 ? wl_display_connect_to_fd(fd) : wl_display_connect(nullptr);
+    if (!display) {
+        // libwayland has closed `fd` already
+        std::cerr << "Failed to connect to Wayland display for the clipboard" << std::endl;
+        return false;
+    }
+
+    registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, this);
+    wl_display_roundtrip(display);
+
+    if (!manager) {
+        std::cerr << "Compositor does not support wlr-data-control protocol" << std::endl;
+        cleanup();
+        return false;
+    }
+    if (!seat) {
+        std::cerr << "Compositor offers no seat for the clipboard" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    // The current selection comes with the device
+    device = zwlr_data_control_manager_v1_get_data_device(manager, seat);
+    zwlr_data_control_device_v1_add_listener(device, &device_listener, this);
+    wl_display_roundtrip(display);
+
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        std::cerr << "Failed to create clipboard eventfd: " << strerror(errno) << std::endl;
+        cleanup();
+        return false;
+    }
+
+    running = true;
+    thread = std::thread([this]() { run(); });
+
+    std::cout << "Clipboard connected: " << mime_types().size() << " type(s) on offer" << std::endl;
+    return true;
+}
+
+void Clipboard::cleanup() {
+    if (thread.joinable()) {
+        running = false;
+        uint64_t one = 1;
+        if (::write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to signal clipboard thread: " << strerror(errno) << std::endl;
+        }
+        thread.join();
+    }
+    // Jobs posted too late for the thread still own fds
+    run_jobs();
+
+    // Whoever is on the other end of a transfer sees it cut short
+    for (auto& transfer : transfers) {
+        close(transfer->from);
+        close(transfer->to);
+    }
+    transfers.clear();
+    active = 0;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (auto& [serial, paste] : pastes) close(paste.target);
+        pastes.clear();
+        published.clear();
+    }
+
+    offers.clear();
+    selection.reset();
+    if (source) {
+        zwlr_data_control_source_v1_destroy(source);
+        source = nullptr;
+        source_owner.clear();
+    }
+    if (device) {
+        zwlr_data_control_device_v1_destroy(device);
+        device = nullptr;
+    }
+    if (manager) {
+        zwlr_data_control_manager_v1_destroy(manager);
+        manager = nullptr;
+    }
+    if (seat) {
+        wl_seat_destroy(seat);
+        seat = nullptr;
+    }
+    if (registry) {
+        wl_registry_destroy(registry);
+        registry = nullptr;
+    }
+    if (display) {
+        wl_display_flush(display);
+        wl_display_disconnect(display);
+        display = nullptr;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+void Clipboard::set_handlers(OwnerHandler owner_handler, TransferHandler transfer_handler) {
+    post([this, owner_handler = std::move(owner_handler), transfer_handler = std::move(transfer_handler)]() {
+        on_owner = owner_handler;
+        on_transfer = transfer_handler;
+    });
+}
+
+std::vector<std::string> Clipboard::mime_types() const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return published;
+}
+
+Clipboard::Stats Clipboard::stats() const {
+    Stats stats;
+    stats.active = active;
+    stats.completed = completed;
+    stats.failed = failed;
+    stats.bytes = bytes;
+    return stats;
+}
+
+void Clipboard::run() {
+    const int display_fd = wl_display_get_fd(display);
+    std::vector<struct pollfd> fds;
+
+    while (running) {
+        if (connected) {
+            wl_display_dispatch_pending(display);
+            if (wl_display_flush(display) < 0 && errno != EAGAIN) lose_connection();
+        }
+
+        // Each transfer waits on one side: its source for more, or its
+        // destination for room. The destination is watched either way, so a
+        // reader that goes away is noticed while the source is quiet.
+        fds.clear();
+        fds.push_back({ .fd = connected ? display_fd : -1, .events = POLLIN, .revents = 0 });
+        fds.push_back({ .fd = wake_fd, .events = POLLIN, .revents = 0 });
+        for (const auto& transfer : transfers) {
+            fds.push_back({ .fd = transfer->output_full ? -1 : transfer->from, .events = POLLIN, .revents = 0 });
+            fds.push_back({ .fd = transfer->to, .events = short(transfer->output_full ? POLLOUT : 0), .revents = 0 });
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Clipboard poll error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        // Transfers first, while they still line up with what was polled;
+        // backwards, so ending one leaves the rest where they were
+        for (size_t i = transfers.size(); i-- > 0;) {
+            if (!fds[2 + 2 * i].revents && !fds[3 + 2 * i].revents) continue;
+            // Nobody reads any more: the rest has nowhere to go
+            if (fds[3 + 2 * i].revents & (POLLERR | POLLHUP)) transfers[i]->failed = true;
+            if (transfers[i]->failed || !pump(*transfers[i])) end_transfer(i);
+        }
+
+        if (connected && ((fds[0].revents & (POLLERR | POLLHUP)) ||
+                          ((fds[0].revents & POLLIN) && wl_display_dispatch(display) < 0))) {
+            lose_connection();
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            while (::read(wake_fd, &value, sizeof(value)) > 0) {}
+            run_jobs();
+        }
+    }
+}
+
+void Clipboard::run_jobs() {
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        ready.swap(jobs);
+    }
+    for (auto& job : ready) job();
+}
+
+void Clipboard::post(std::function<void()> job) {
+    if (!thread.joinable()) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(std::move(job));
+    }
+    uint64_t one = 1;
+    if (::write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to signal clipboard thread: " << strerror(errno) << std::endl;
+    }
+}
+
+void Clipboard::lose_connection() {
+    // Transfers only need their fds and run to the end; the selection is gone
+    std::cerr << "⚠️ Clipboard lost its Wayland connection" << std::endl;
+    connected = false;
+    drop_selection();
+}
+
+void Clipboard::drop_selection() {
+    offers.clear();
+    selection.reset();
+    if (source) {
+        zwlr_data_control_source_v1_destroy(source);
+        source = nullptr;
+        source_owner.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        published.clear();
+    }
+    if (on_owner) on_owner({}, "");
+}
+
+void Clipboard::selection_changed(struct zwlr_data_control_offer_v1* offer) {
+    selection.reset();
+    auto it = offers.find(offer);
+    if (it != offers.end()) {
+        selection = std::move(it->second);
+        offers.erase(it);
+    }
+    // Offers come right before the event that uses them; any others are stale
+    offers.clear();
+
+    std::vector<std::string> offered = selection ? selection->mime_types : std::vector<std::string>{};
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        published = offered;
+    }
+
+    // A source of ours is cancelled before anything replaces it, so while we
+    // still have one this is our own selection coming back
+    const std::string owner = source ? source_owner : std::string();
+    DEBUG_LOG("📋 Clipboard selection: " << offered.size() << " type(s) from "
+              << (owner.empty() ? std::string("another client") : owner));
+    if (on_owner) on_owner(offered, owner);
+}
+
+void Clipboard::paste_requested(const std::string& mime_type, int fd) {
+    if (!on_transfer) {
+        close(fd);
+        return;
+    }
+    uint32_t serial;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        serial = next_serial++;
+        if (!next_serial) next_serial = 1;
+        pastes[serial] = Paste{ source_owner, fd };
+    }
+    on_transfer(source_owner, mime_type, serial);
+}
+
+void Clipboard::source_cancelled(struct zwlr_data_control_source_v1* cancelled) {
+    // Pastes already asked for can still be written
+    zwlr_data_control_source_v1_destroy(cancelled);
+    if (cancelled == source) {
+        source = nullptr;
+        source_owner.clear();
+    }
+}
+
+void Clipboard::set_selection(const std::string& owner, std::vector<std::string> offered) {
+    post([this, owner, offered = std::move(offered)]() {
+        if (!device) return;
+
+        struct zwlr_data_control_source_v1* created = nullptr;
+        if (!offered.empty()) {
+            created = zwlr_data_control_manager_v1_create_data_source(manager);
+            for (const std::string& mime_type : offered) {
+                zwlr_data_control_source_v1_offer(created, mime_type.c_str());
+            }
+            zwlr_data_control_source_v1_add_listener(created, &source_listener, this);
+        }
+        // The compositor cancels the source this replaces, which destroys it then
+        zwlr_data_control_device_v1_set_selection(device, created);
+        source = created;
+        source_owner = created ? owner : std::string();
+        wl_display_flush(display);
+    });
+}
+
+int Clipboard::read(const std::string& owner, const std::string& mime_type) {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (std::find(published.begin(), published.end(), mime_type) == published.end()) return -1;
+    }
+
+    // The source writes into one pipe and the reader reads from the other;
+    // the clipboard thread splices between them
+    int reader[2], writer[2];
+    if (!make_pipe(reader)) return -1;
+    if (!make_pipe(writer)) {
+        close(reader[0]);
+        close(reader[1]);
+        return -1;
+    }
+
+    post([this, owner, mime_type, from = writer[0], source_end = writer[1], to = reader[1]]() {
+        // The selection may have changed on the way; the reader then gets nothing
+        bool offered = selection && std::find(selection->mime_types.begin(), selection->mime_types.end(),
+                                              mime_type) != selection->mime_types.end();
+        if (offered) {
+            zwlr_data_control_offer_v1_receive(selection->offer, mime_type.c_str(), source_end);
+            wl_display_flush(display);
+        }
+        close(source_end);
+        if (!offered) {
+            close(from);
+            close(to);
+            return;
+        }
+        start_transfer(owner, 0, from, to);
+    });
+    return reader[0];
+}
+
+int Clipboard::write(const std::string& owner, uint32_t serial) {
+    int target;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        auto it = pastes.find(serial);
+        if (it == pastes.end() || it->second.owner != owner) return -1;
+        target = it->second.target;
+        pastes.erase(it);
+    }
+
+    int fds[2];
+    if (!make_pipe(fds)) {
+        close(target);
+        return -1;
+    }
+    post([this, owner, serial, from = fds[0], target]() { start_transfer(owner, serial, from, target); });
+    return fds[1];
+}
+
+void Clipboard::write_done(const std::string& owner, uint32_t serial, bool success) {
+    // Done without ever asking for the fd: the pasting client gets nothing
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        auto it = pastes.find(serial);
+        if (it != pastes.end() && it->second.owner == owner) {
+            close(it->second.target);
+            pastes.erase(it);
+        }
+    }
+    // A good write ends by itself when the writer closes its end
+    if (!success) post([this, owner, serial]() { end_transfers(owner, serial); });
+}
+
+void Clipboard::release(const std::string& owner) {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (auto it = pastes.begin(); it != pastes.end();) {
+            if (it->second.owner != owner) {
+                ++it;
+                continue;
+            }
+            close(it->second.target);
+            it = pastes.erase(it);
+        }
+    }
+    post([this, owner]() {
+        end_transfers(owner, 0);
+        if (source && source_owner == owner && device) {
+            // Cancelling it comes back as the event that destroys it
+            zwlr_data_control_device_v1_set_selection(device, nullptr);
+            source = nullptr;
+            source_owner.clear();
+            wl_display_flush(display);
+        }
+    });
+}
+
+void Clipboard::start_transfer(std::string owner, uint32_t serial, int from, int to) {
+    set_nonblocking(from);
+    set_nonblocking(to);
+
+    auto transfer = std::make_unique<Transfer>();
+    transfer->owner = std::move(owner);
+    transfer->serial = serial;
+    transfer->from = from;
+    transfer->to = to;
+    transfers.push_back(std::move(transfer));
+    active = transfers.size();
+}
+
+bool Clipboard::pump(Transfer& transfer) {
+    for (int round = 0; round < SPLICE_ROUNDS; round++) {
+        ssize_t moved = splice(transfer.from, nullptr, transfer.to, nullptr, SPLICE_CHUNK,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            transfer.moved += moved;
+            bytes += moved;
+            continue;
+        }
+        // The writer closed its end and everything has gone through
+        if (moved == 0) return false;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) {
+            transfer.failed = true;
+            return false;
+        }
+        // Either the source has nothing yet or the destination is full: data
+        // still queued on our side says which one to wait for
+        int queued = 0;
+        transfer.output_full = ioctl(transfer.from, FIONREAD, &queued) == 0 && queued > 0;
+        return true;
+    }
+    // More to come; the other transfers get a turn first
+    transfer.output_full = false;
+    return true;
+}
+
+void Clipboard::end_transfer(size_t index) {
+    Transfer& transfer = *transfers[index];
+    close(transfer.from);
+    close(transfer.to);
+    if (transfer.failed) {
+        failed++;
+        std::cerr << "⚠️ Clipboard " << (transfer.serial ? "paste" : "read") << " for " << transfer.owner
+                  << " cut short after " << transfer.moved << " bytes" << std::endl;
+    } else {
+        completed++;
+        DEBUG_LOG("📋 Clipboard " << (transfer.serial ? "paste" : "read") << " for " << transfer.owner << ": "
+                  << transfer.moved << " bytes");
+    }
+    transfers.erase(transfers.begin() + index);
+    active = transfers.size();
+}
+
+void Clipboard::end_transfers(const std::string& owner, uint32_t serial) {
+    for (size_t i = transfers.size(); i-- > 0;) {
+        Transfer& transfer = *transfers[i];
+        if (transfer.owner != owner || (serial && transfer.serial != serial)) continue;
+        transfer.failed = true;
+        end_transfer(i);
+    }
+}
+
+void Clipboard::registry_global(void* data, struct wl_registry* registry,
+                                uint32_t name, const char* interface, uint32_t) {
+    Clipboard* self = static_cast<Clipboard*>(data);
+
+    // Version 1 of both: the selection is all the portal deals in
+    if (strcmp(interface, zwlr_data_control_manager_v1_interface.name) == 0) {
+        self->manager = static_cast<struct zwlr_data_control_manager_v1*>(
+            wl_registry_bind(registry, name, &zwlr_data_control_manager_v1_interface, 1));
+    } else if (strcmp(interface, wl_seat_interface.name) == 0 && !self->seat) {
+        self->seat = static_cast<struct wl_seat*>(wl_registry_bind(registry, name, &wl_seat_interface, 1));
+    }
+}
+
+void Clipboard::registry_global_remove(void*, struct wl_registry*, uint32_t) {
+    // A seat going away ends its data device, which says so itself (finished)
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <wayland-client.h>
+#include "wlr-data-control-unstable-v1-client-protocol.h"
+}
+
+// The seat's clipboard through wlr-data-control, on a Wayland connection and
+// thread of its own. Sessions read the selection and offer their own; the data
+// never passes through our memory: every transfer is a pair of file
+// descriptors joined by splice(), moved as each side is ready. A reader that
+// stops reading fills its pipe and the source then blocks on ours, so a
+// transfer of any size holds no more than two pipe buffers.
+//
+// Owners are session handles; "" is anyone outside the portal.
+class Clipboard {
+public:
+    // The selection changed: what it offers, and which session holds it
+    using OwnerHandler = std::function<void(const std::vector<std::string>& mime_types, const std::string& owner)>;
+    // Someone pastes `owner`'s selection: write(owner, serial) gets the fd for it
+    using TransferHandler = std::function<void(const std::string& owner, const std::string& mime_type, uint32_t serial)>;
+
+    // Transfers as counted so far (any thread)
+    struct Stats {
+        size_t active = 0;
+        uint64_t completed = 0;
+        uint64_t failed = 0;
+        uint64_t bytes = 0;
+    };
+
+    Clipboard();
+    ~Clipboard();
+
+    Clipboard(const Clipboard&) = delete;
+    Clipboard& operator=(const Clipboard&) = delete;
+
+    // Connect to the compositor (`fd`, or $WAYLAND_DISPLAY when -1) and start
+    // the clipboard thread; false without wlr-data-control or a seat
+    bool init(int fd = -1);
+    void cleanup();
+
+    // Where selection changes and paste requests go, on the clipboard thread.
+    // Any thread; takes effect before the next event.
+    void set_handlers(OwnerHandler on_owner, TransferHandler on_transfer);
+
+    // What the current selection offers (any thread)
+    std::vector<std::string> mime_types() const;
+
+    // Make `owner`'s data the selection, offered as `mime_types`; none clears it.
+    // Pastes come back through the transfer handler.
+    void set_selection(const std::string& owner, std::vector<std::string> mime_types);
+
+    // The read end of a pipe that will carry the selection as `mime_type`,
+    // owned by the caller; -1 if the selection does not offer it
+    int read(const std::string& owner, const std::string& mime_type);
+
+    // The write end of a pipe into paste `serial` of `owner`'s selection, owned
+    // by the caller; -1 if `owner` has no such paste waiting
+    int write(const std::string& owner, uint32_t serial);
+    // The writer is done; a failed write abandons the paste
+    void write_done(const std::string& owner, uint32_t serial, bool success);
+
+    // `owner` is gone: end its transfers and give up its selection
+    void release(const std::string& owner);
+
+    Stats stats() const;
+
+    // Registry callbacks (must be public)
+    static void registry_global(void* data, struct wl_registry* registry,
+                                uint32_t name, const char* interface, uint32_t version);
+    static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+
+private:
+    struct Offer;
+
+    // One splice pump: `from` (a pipe's read end) into `to`
+    struct Transfer {
+        std::string owner;
+        uint32_t serial = 0; // paste being written, 0 for a read
+        int from = -1;
+        int to = -1;
+        bool output_full = false; // waiting for `to` to drain rather than `from` to fill
+        bool failed = false;
+        uint64_t moved = 0;
+    };
+
+    // A paste waiting for its writer: the requesting client's fd
+    struct Paste {
+        std::string owner;
+        int target = -1;
+    };
+
+    struct wl_display* display = nullptr;
+    struct wl_registry* registry = nullptr;
+    struct wl_seat* seat = nullptr;
+    struct zwlr_data_control_manager_v1* manager = nullptr;
+    struct zwlr_data_control_device_v1* device = nullptr;
+
+    // Clipboard thread only
+    std::map<struct zwlr_data_control_offer_v1*, std::unique_ptr<Offer>> offers; // introduced, not yet selected
+    std::unique_ptr<Offer> selection;
+    struct zwlr_data_control_source_v1* source = nullptr; // ours, while it is the selection
+    std::string source_owner;
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    OwnerHandler on_owner;
+    TransferHandler on_transfer;
+    bool connected = true;
+
+    // Shared with callers on other threads
+    mutable std::mutex state_mutex;
+    std::vector<std::string> published;
+    std::map<uint32_t, Paste> pastes;
+    uint32_t next_serial = 1;
+
+    std::atomic<size_t> active{0};
+    std::atomic<uint64_t> completed{0}, failed{0}, bytes{0};
+
+    // Work for the clipboard thread from others, woken by `wake_fd`
+    std::thread thread;
+    std::mutex jobs_mutex;
+    std::deque<std::function<void()>> jobs;
+    int wake_fd = -1;
+    std::atomic<bool> running{false};
+
+    void run();
+    void run_jobs();
+    void lose_connection();
+    // No selection any more (seat or connection gone): drop offers and our source
+    void drop_selection();
+    // Run `job` on the clipboard thread (or here, before it runs)
+    void post(std::function<void()> job);
+
+    void selection_changed(struct zwlr_data_control_offer_v1* offer);
+    void paste_requested(const std::string& mime_type, int fd);
+    void source_cancelled(struct zwlr_data_control_source_v1* cancelled);
+
+    void start_transfer(std::string owner, uint32_t serial, int from, int to);
+    // Move what is ready; false once the transfer is over (`failed` says how)
+    bool pump(Transfer& transfer);
+    void end_transfer(size_t index);
+    void end_transfers(const std::string& owner, uint32_t serial);
+
+    static const struct zwlr_data_control_device_v1_listener device_listener;
+    static const struct zwlr_data_control_offer_v1_listener offer_listener;
+    static const struct zwlr_data_control_source_v1_listener source_listener;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <iostream>
+
+// Per-event tracing on the input hot path. Off by default: formatting and
+// flushing a line per event costs far more than forwarding the event itself,
+// and iostream formatting is free to allocate. Enabled with --debug or
+// HYPR_REMOTE_DEBUG=1.
+inline bool debug_logging = false;
+
+#define DEBUG_LOG(...) \
+    do { if (debug_logging) { std::cout << __VA_ARGS__ << std::endl; } } while (0)
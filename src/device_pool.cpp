@@ -0,0 +1,107 @@
+#include "device_pool.h"
+#include <iostream>
+
+DevicePool::DevicePool(size_t size) : size(size) {
+}
+
+DevicePool::~DevicePool() {
+    cleanup();
+}
+
+bool DevicePool::init(OutputBackend* output) {
+    backend = output;
+    stopping = false;
+    ready.reserve(size);
+
+    // Fill synchronously so the first sessions never wait
+    for (size_t i = 0; i < size; i++) {
+        DevicePair pair = backend->create_pair();
+        if (!pair) {
+            std::cerr << "Failed to pre-create virtual device pair" << std::endl;
+            cleanup();
+            return false;
+        }
+        ready.push_back(std::move(pair));
+    }
+    backend->sync();
+
+    refill_thread = std::thread([this]() { refill(); });
+    std::cout << "✓ Device pool ready with " << ready.size() << " " << backend->name()
+              << " device pairs" << std::endl;
+    return true;
+}
+
+void DevicePool::cleanup() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    refill_needed.notify_one();
+    if (refill_thread.joinable()) {
+        refill_thread.join();
+    }
+
+    ready.clear();
+    if (backend) {
+        backend->flush();
+        backend = nullptr;
+    }
+}
+
+DevicePair DevicePool::checkout() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ready.empty()) {
+            DevicePair pair = std::move(ready.back());
+            ready.pop_back();
+            refill_needed.notify_one();
+            return pair;
+        }
+        if (stopping || !backend) {
+            return DevicePair();
+        }
+    }
+
+    // Pool drained by a burst of sessions: pay the creation cost inline rather
+    // than sharing someone else's devices
+    std::cout << "⚠️ Device pool empty, creating virtual devices on demand" << std::endl;
+    DevicePair pair = backend->create_pair();
+    backend->flush();
+    return pair;
+}
+
+void DevicePool::release(DevicePair pair) {
+    // Destroying the devices queues their destroy requests; push them out now
+    pair = DevicePair();
+    if (backend) {
+        backend->flush();
+    }
+}
+
+size_t DevicePool::available() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ready.size();
+}
+
+void DevicePool::refill() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        refill_needed.wait(lock, [this]() { return stopping || ready.size() < size; });
+        if (stopping) break;
+
+        // Create outside the lock so checkout() stays constant time meanwhile
+        lock.unlock();
+        DevicePair pair = backend->create_pair();
+        // Make sure the output side has set the devices up before handing them out
+        backend->sync();
+        lock.lock();
+
+        if (!pair) {
+            std::cerr << "Failed to refill device pool" << std::endl;
+            // Don't spin on a backend that keeps refusing; wait for the next checkout
+            refill_needed.wait(lock);
+            continue;
+        }
+        ready.push_back(std::move(pair));
+    }
+}
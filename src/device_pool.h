@@ -0,0 +1,47 @@
+#pragma once
+
+#include "output_backend.h"
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps `size` pointer/keyboard pairs created (keymap uploaded) ahead of time so a
+// new session can take its own pair without waiting on the output backend. A
+// background thread tops the pool up again after each checkout. Released pairs
+// are destroyed rather than recycled, so no held button or modifier carries over
+// to the next session.
+class DevicePool {
+public:
+    explicit DevicePool(size_t size);
+    ~DevicePool();
+
+    DevicePool(const DevicePool&) = delete;
+    DevicePool& operator=(const DevicePool&) = delete;
+
+    // Fill the pool with pairs from `backend`, which must outlive the pool
+    bool init(OutputBackend* backend);
+    void cleanup();
+
+    // Take a ready pair in constant time. If the pool has run dry the pair is
+    // created on the spot; an empty pair means creation failed.
+    DevicePair checkout();
+
+    // Destroy a pair handed out by checkout()
+    void release(DevicePair pair);
+
+    size_t available();
+
+private:
+    size_t size;
+    OutputBackend* backend = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable refill_needed;
+    std::vector<DevicePair> ready;
+    bool stopping = false;
+    std::thread refill_thread;
+
+    void refill();
+};
@@ -0,0 +1,223 @@
+#include "ei_forwarder.h"
+#include "debug_log.h"
+#include "probes.h"
+#include <iostream>
+#include <cstring>
+
+static const enum ei_device_capability SLOT_CAPABILITIES[] = {
+    EI_DEVICE_CAP_POINTER,
+    EI_DEVICE_CAP_POINTER_ABSOLUTE,
+    EI_DEVICE_CAP_BUTTON,
+    EI_DEVICE_CAP_SCROLL,
+    EI_DEVICE_CAP_KEYBOARD,
+};
+
+EiForwarder::EiForwarder() = default;
+
+EiForwarder::~EiForwarder() {
+    release_devices();
+    if (context) {
+        ei_unref(context);
+    }
+}
+
+bool EiForwarder::connect(const std::string& socket, const std::string& name) {
+    context = ei_new_sender(this);
+    if (!context) {
+        std::cerr << "Failed to create EI sender context" << std::endl;
+        return false;
+    }
+
+    ei_configure_name(context, name.c_str());
+
+    int rc = ei_setup_backend_socket(context, socket.c_str());
+    if (rc != 0) {
+        std::cerr << "Failed to connect to EIS socket " << socket << ": " << strerror(-rc) << std::endl;
+        ei_unref(context);
+        context = nullptr;
+        return false;
+    }
+    return true;
+}
+
+int EiForwarder::fd() const {
+    return context ? ei_get_fd(context) : -1;
+}
+
+void EiForwarder::dispatch() {
+    if (!context) return;
+
+    ei_dispatch(context);
+
+    bool disconnected = false;
+    struct ei_event* event;
+    while ((event = ei_get_event(context)) != nullptr) {
+        switch (ei_event_get_type(event)) {
+            case EI_EVENT_CONNECT:
+                connected = true;
+                std::cout << "🔀 EIS passthrough connected to the compositor" << std::endl;
+                break;
+
+            case EI_EVENT_DISCONNECT:
+                disconnected = true;
+                break;
+
+            case EI_EVENT_SEAT_ADDED:
+                ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                          EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_POINTER_ABSOLUTE,
+                                          EI_DEVICE_CAP_BUTTON, EI_DEVICE_CAP_SCROLL,
+                                          EI_DEVICE_CAP_KEYBOARD, nullptr);
+                break;
+
+            case EI_EVENT_DEVICE_ADDED:
+                add_device(ei_event_get_device(event));
+                break;
+
+            case EI_EVENT_DEVICE_REMOVED:
+                remove_device(ei_event_get_device(event));
+                break;
+
+            case EI_EVENT_DEVICE_RESUMED: {
+                struct ei_device* device = ei_event_get_device(event);
+                set_resumed(device, true);
+                ei_device_start_emulating(device, ++sequence);
+                break;
+            }
+
+            case EI_EVENT_DEVICE_PAUSED:
+                set_resumed(ei_event_get_device(event), false);
+                break;
+
+            default:
+                break;
+        }
+        ei_event_unref(event);
+    }
+
+    // Drop the context so the hung-up fd leaves the caller's poll set; input is
+    // translated from here on
+    if (disconnected) {
+        std::cout << "🔀 EIS passthrough disconnected, falling back to translation" << std::endl;
+        connected = false;
+        release_devices();
+        ei_unref(context);
+        context = nullptr;
+    }
+}
+
+bool EiForwarder::forward(struct eis_event* event) {
+    struct ei_device* device;
+    Slot slot;
+
+    switch (eis_event_get_type(event)) {
+        case EIS_EVENT_POINTER_MOTION:
+            if (!(device = ready(slot = POINTER))) return false;
+            ei_device_pointer_motion(device, eis_event_pointer_get_dx(event), eis_event_pointer_get_dy(event));
+            break;
+
+        case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+            if (!(device = ready(slot = POINTER_ABSOLUTE))) return false;
+            ei_device_pointer_motion_absolute(device, eis_event_pointer_get_absolute_x(event),
+                                              eis_event_pointer_get_absolute_y(event));
+            break;
+
+        case EIS_EVENT_BUTTON_BUTTON:
+            if (!(device = ready(slot = BUTTON))) return false;
+            ei_device_button_button(device, eis_event_button_get_button(event), eis_event_button_get_is_press(event));
+            break;
+
+        case EIS_EVENT_SCROLL_DELTA:
+            if (!(device = ready(slot = SCROLL))) return false;
+            ei_device_scroll_delta(device, eis_event_scroll_get_dx(event), eis_event_scroll_get_dy(event));
+            break;
+
+        case EIS_EVENT_SCROLL_DISCRETE:
+            if (!(device = ready(slot = SCROLL))) return false;
+            ei_device_scroll_discrete(device, eis_event_scroll_get_discrete_dx(event),
+                                      eis_event_scroll_get_discrete_dy(event));
+            break;
+
+        case EIS_EVENT_SCROLL_STOP:
+            if (!(device = ready(slot = SCROLL))) return false;
+            ei_device_scroll_stop(device, eis_event_scroll_get_stop_x(event), eis_event_scroll_get_stop_y(event));
+            break;
+
+        case EIS_EVENT_SCROLL_CANCEL:
+            if (!(device = ready(slot = SCROLL))) return false;
+            ei_device_scroll_cancel(device, eis_event_scroll_get_stop_x(event), eis_event_scroll_get_stop_y(event));
+            break;
+
+        case EIS_EVENT_KEYBOARD_KEY:
+            if (!(device = ready(slot = KEYBOARD))) return false;
+            ei_device_keyboard_key(device, eis_event_keyboard_get_key(event), eis_event_keyboard_get_key_is_press(event));
+            break;
+
+        case EIS_EVENT_FRAME: {
+            // Close the frame on every device that received part of it, with the
+            // client's own timestamp
+            uint64_t time = eis_event_get_time(event);
+            bool framed = false;
+            for (int i = 0; i < SLOT_COUNT; i++) {
+                if (!targets[i].touched) continue;
+                bool seen = false;
+                for (int j = 0; j < i; j++) {
+                    if (targets[j].device == targets[i].device) seen = true;
+                }
+                if (!seen) {
+                    ei_device_frame(targets[i].device, time);
+                    framed = true;
+                }
+            }
+            for (auto& target : targets) target.touched = false;
+            if (framed) {
+                PROBE2(translate_done, PROBE_SOURCE_PASSTHROUGH, EIS_EVENT_FRAME);
+            }
+            return framed;
+        }
+
+        default:
+            return false;
+    }
+
+    for (auto& target : targets) {
+        if (target.device == targets[slot].device) target.touched = true;
+    }
+    DEBUG_LOG("🔀 EIS passthrough: forwarded event type " << eis_event_get_type(event));
+    PROBE2(translate_done, PROBE_SOURCE_PASSTHROUGH, eis_event_get_type(event));
+    return true;
+}
+
+struct ei_device* EiForwarder::ready(Slot slot) {
+    const Target& target = targets[slot];
+    return connected && target.resumed ? target.device : nullptr;
+}
+
+void EiForwarder::add_device(struct ei_device* device) {
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (!targets[i].device && ei_device_has_capability(device, SLOT_CAPABILITIES[i])) {
+            targets[i].device = ei_device_ref(device);
+        }
+    }
+}
+
+void EiForwarder::remove_device(struct ei_device* device) {
+    for (auto& target : targets) {
+        if (target.device == device) {
+            ei_device_unref(target.device);
+            target = Target{};
+        }
+    }
+}
+
+void EiForwarder::set_resumed(struct ei_device* device, bool resumed) {
+    for (auto& target : targets) {
+        if (target.device == device) target.resumed = resumed;
+    }
+}
+
+void EiForwarder::release_devices() {
+    for (auto& target : targets) {
+        if (target.device) ei_device_unref(target.device);
+        target = Target{};
+    }
+}
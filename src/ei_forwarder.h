@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+extern "C" {
+#include <libei.h>
+#include "libei-1.0/libeis.h"
+}
+
+// EIS passthrough for one client: a libei sender connected to the compositor's
+// own EIS socket, re-emitting the client's input on the compositor's devices
+// with the client's frames and timestamps intact instead of translating it to
+// virtual-pointer/keyboard requests. Events it cannot forward (handshake, or
+// input for a capability the compositor has not resumed) are left to the caller.
+// Not thread-safe; used from the session's EIS thread only.
+class EiForwarder {
+public:
+    EiForwarder();
+    ~EiForwarder();
+
+    EiForwarder(const EiForwarder&) = delete;
+    EiForwarder& operator=(const EiForwarder&) = delete;
+
+    // Connect to `socket` (a path, or a name relative to $XDG_RUNTIME_DIR). The
+    // handshake finishes asynchronously through dispatch().
+    bool connect(const std::string& socket, const std::string& name);
+
+    // Poll for POLLIN and call dispatch() when readable; -1 once disconnected
+    int fd() const;
+    void dispatch();
+
+    bool is_connected() const { return connected; }
+
+    // Re-emit an input or frame event from the client. Returns false if the
+    // event was not forwarded and should be handled some other way.
+    bool forward(struct eis_event* event);
+
+private:
+    // One compositor device per capability we forward to; a device offering
+    // several capabilities fills several slots
+    enum Slot { POINTER, POINTER_ABSOLUTE, BUTTON, SCROLL, KEYBOARD, SLOT_COUNT };
+
+    struct Target {
+        struct ei_device* device = nullptr;
+        bool resumed = false;
+        bool touched = false; // has events waiting for a frame
+    };
+
+    struct ei* context = nullptr;
+    bool connected = false;
+    uint32_t sequence = 0;
+    Target targets[SLOT_COUNT];
+
+    struct ei_device* ready(Slot slot);
+    void add_device(struct ei_device* device);
+    void remove_device(struct ei_device* device);
+    void set_resumed(struct ei_device* device, bool resumed);
+    void release_devices();
+};
@@ -0,0 +1,180 @@
+#include "eis_workers.h"
+#include "output_scheduler.h"
+#include "session.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+EisWorkers::EisWorkers(size_t count, OutputScheduler* scheduler) : scheduler(scheduler) {
+    for (size_t i = 0; i < std::max<size_t>(count, 1); i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+EisWorkers::~EisWorkers() {
+    stop();
+}
+
+bool EisWorkers::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return true;
+
+    for (auto& worker : workers) {
+        worker->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (worker->wake_fd < 0) {
+            std::cerr << "Failed to create eventfd: " << strerror(errno) << std::endl;
+            for (auto& created : workers) {
+                if (created->wake_fd >= 0) close(created->wake_fd);
+                created->wake_fd = -1;
+            }
+            return false;
+        }
+    }
+
+    running = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker& worker = *workers[i];
+        worker.thread = std::thread([this, &worker, i]() { run(worker, i); });
+    }
+    std::cout << "✓ " << workers.size() << " EIS worker threads started" << std::endl;
+    return true;
+}
+
+void EisWorkers::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) return;
+        running = false;
+        for (auto& worker : workers) wake(*worker);
+    }
+
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+        close(worker->wake_fd);
+        worker->wake_fd = -1;
+        worker->sessions.clear();
+    }
+    pinned.clear();
+}
+
+bool EisWorkers::add(Session& session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) return false;
+
+    auto least_loaded = std::min_element(workers.begin(), workers.end(), [](const auto& a, const auto& b) {
+        return a->sessions.size() < b->sessions.size();
+    });
+    Worker& worker = **least_loaded;
+    worker.sessions.push_back(&session);
+    pinned[&session] = &worker;
+    wake(worker);
+    std::cout << "📡 Session " << session.handle() << " served by EIS worker "
+              << (least_loaded - workers.begin()) << std::endl;
+    return true;
+}
+
+void EisWorkers::remove(Session& session) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = pinned.find(&session);
+    if (it == pinned.end()) return;
+    Worker& worker = *it->second;
+    pinned.erase(it);
+
+    auto& sessions = worker.sessions;
+    sessions.erase(std::remove(sessions.begin(), sessions.end(), &session), sessions.end());
+
+    // The worker may be polling or dispatching with the old list; the pass after
+    // this one no longer has the session
+    if (worker.in_pass && running) {
+        uint64_t pass = worker.passes;
+        wake(worker);
+        pass_done.wait(lock, [&]() { return worker.passes != pass || !worker.in_pass || !running; });
+    }
+}
+
+std::vector<size_t> EisWorkers::loads() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<size_t> result;
+    for (const auto& worker : workers) result.push_back(worker->sessions.size());
+    return result;
+}
+
+void EisWorkers::wake(Worker& worker) {
+    uint64_t one = 1;
+    if (write(worker.wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to wake EIS worker: " << strerror(errno) << std::endl;
+    }
+}
+
+void EisWorkers::run(Worker& worker, size_t index) {
+    if (scheduler) scheduler->bind_producer();
+
+    std::vector<Session*> serving;
+    std::vector<struct pollfd> fds;
+    std::vector<Session*> gone;
+    serving.reserve(64);
+    fds.reserve(1 + 2 * 64);
+    gone.reserve(64);
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running) break;
+            serving = worker.sessions;
+            worker.in_pass = true;
+        }
+
+        // fds[0] wakes us for session changes; then each session's client fd (EIS
+        // socket or shared ring doorbell) and, with passthrough, its forwarder's
+        fds.clear();
+        fds.push_back({ .fd = worker.wake_fd, .events = POLLIN, .revents = 0 });
+        for (Session* session : serving) {
+            fds.push_back({ .fd = session->input_fd(), .events = POLLIN, .revents = 0 });
+            fds.push_back({ .fd = session->forwarder_fd(), .events = POLLIN, .revents = 0 });
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+            std::cerr << "EIS worker " << index << " poll error: " << strerror(errno) << std::endl;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            while (read(worker.wake_fd, &value, sizeof(value)) > 0) {}
+        }
+
+        for (size_t i = 0; i < serving.size(); i++) {
+            const struct pollfd& eis = fds[1 + 2 * i];
+            const struct pollfd& forwarder = fds[2 + 2 * i];
+            if (!eis.revents && !forwarder.revents) continue;
+            if (!serving[i]->dispatch(forwarder.revents != 0)) {
+                gone.push_back(serving[i]);
+            }
+        }
+        if (scheduler) scheduler->end_producer_batches();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (Session* session : gone) {
+                auto& sessions = worker.sessions;
+                sessions.erase(std::remove(sessions.begin(), sessions.end(), session), sessions.end());
+            }
+        }
+        // Still inside the pass: remove() waits for it, so the session is alive
+        for (Session* session : gone) {
+            session->client_gone();
+        }
+        gone.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            worker.in_pass = false;
+            worker.passes++;
+        }
+        pass_done.notify_all();
+    }
+
+    if (scheduler) scheduler->unbind_producer();
+}
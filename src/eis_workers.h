@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class OutputScheduler;
+class Session;
+
+// A fixed set of threads serving the EIS side of every session, instead of a
+// thread per session. A session is pinned to the least loaded worker when it
+// connects; that worker alone reads, decodes and translates its input, so each
+// session's events stay in order while many clients spread over the cores.
+// With an output scheduler, every worker hands its frames to the single output
+// thread through its own ring (OutputScheduler::bind_producer()).
+class EisWorkers {
+public:
+    EisWorkers(size_t count, OutputScheduler* scheduler = nullptr);
+    ~EisWorkers();
+
+    EisWorkers(const EisWorkers&) = delete;
+    EisWorkers& operator=(const EisWorkers&) = delete;
+
+    bool start();
+    // Sessions still pinned are abandoned; close them first
+    void stop();
+
+    size_t size() const { return workers.size(); }
+
+    // Pin a connected session to a worker; false if the workers are not running
+    bool add(Session& session);
+
+    // Stop serving `session`. Returns once its worker no longer touches it, even
+    // if it was already dropped because its client left.
+    void remove(Session& session);
+
+    // Sessions currently pinned to each worker
+    std::vector<size_t> loads();
+
+private:
+    struct Worker {
+        std::thread thread;
+        int wake_fd = -1;
+        std::vector<Session*> sessions;
+        bool in_pass = false; // between taking the session list and finishing dispatch
+        uint64_t passes = 0;
+    };
+
+    OutputScheduler* scheduler;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::unordered_map<Session*, Worker*> pinned; // from add() until remove()
+    std::condition_variable pass_done;
+    bool running = false;
+
+    void run(Worker& worker, size_t index);
+    void wake(Worker& worker);
+};
@@ -0,0 +1,145 @@
+#include "flight_recorder.h"
+#include "xdg_dirs.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FlightRecorder::Slot* FlightRecorder::slots = nullptr;
+size_t FlightRecorder::mask = 0;
+std::atomic<uint64_t> FlightRecorder::head{0};
+
+namespace {
+
+// Where the crash handler dumps, fixed at install so the handler does no work
+// beyond copying the ring out
+char crash_path[512];
+
+const int CRASH_SIGNALS[] = { SIGSEGV, SIGABRT, SIGBUS, SIGILL, SIGFPE };
+
+bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+void on_crash(int sig) {
+    FlightRecorder::dump(crash_path);
+    // SA_RESETHAND put the default action back: die of the signal as before
+    raise(sig);
+}
+
+} // namespace
+
+void FlightRecorder::enable(size_t capacity) {
+    if (slots || capacity == 0) return;
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    slots = new Slot[size];
+    mask = size - 1;
+}
+
+void FlightRecorder::session_open(uint32_t session, const std::string& handle) {
+    Slot* slot = claim();
+    if (!slot) return;
+    FlightRecord& r = slot->record;
+    r.session = session;
+    r.kind = FlightRecord::SESSION_OPEN;
+    // Handles share their long prefix; the tail is what tells them apart
+    size_t length = std::min(handle.size(), sizeof(r.args));
+    memcpy(r.args, handle.data() + handle.size() - length, length);
+    publish(slot);
+}
+
+void FlightRecorder::session_close(uint32_t session) {
+    Slot* slot = claim();
+    if (!slot) return;
+    slot->record.session = session;
+    slot->record.kind = FlightRecord::SESSION_CLOSE;
+    publish(slot);
+}
+
+bool FlightRecorder::read(size_t index, FlightRecord& out) {
+    Slot& slot = slots[index];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before == 0) return false;
+    out = slot.record;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Overwritten while copying: the copy may be torn
+    return slot.sequence.load(std::memory_order_relaxed) == before && out.sequence == before;
+}
+
+std::vector<FlightRecord> FlightRecorder::snapshot() {
+    std::vector<FlightRecord> records;
+    if (!slots) return records;
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+    for (uint64_t i = begin; i < end; i++) {
+        FlightRecord record;
+        if (read(i & mask, record) && record.sequence == i + 1) records.push_back(record);
+    }
+    return records;
+}
+
+bool FlightRecorder::dump(const char* path) {
+    if (!slots || !path || !path[0]) return false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+
+    // The count is patched in at the end, once the torn records are known
+    FlightDumpHeader header;
+    memcpy(header.magic, FlightDumpHeader::MAGIC, sizeof(header.magic));
+    header.version = FlightDumpHeader::VERSION;
+    header.record_size = sizeof(FlightRecord);
+    header.count = 0;
+    bool ok = write_all(fd, &header, sizeof(header));
+
+    FlightRecord batch[64];
+    size_t batched = 0;
+    for (uint64_t i = begin; ok && i < end; i++) {
+        if (!read(i & mask, batch[batched]) || batch[batched].sequence != i + 1) continue;
+        header.count++;
+        if (++batched == sizeof(batch) / sizeof(batch[0])) {
+            ok = write_all(fd, batch, sizeof(batch));
+            batched = 0;
+        }
+    }
+    if (ok && batched) ok = write_all(fd, batch, batched * sizeof(FlightRecord));
+    if (ok) ok = pwrite(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header));
+    close(fd);
+    return ok;
+}
+
+void FlightRecorder::install_crash_handler(const std::string& path) {
+    if (path.empty() || path.size() >= sizeof(crash_path)) return;
+    memcpy(crash_path, path.c_str(), path.size() + 1);
+
+    struct sigaction action = {};
+    action.sa_handler = on_crash;
+    action.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    for (int sig : CRASH_SIGNALS) sigaction(sig, &action, nullptr);
+}
+
+std::string FlightRecorder::default_directory() {
+    std::string directory = xdg_directory(XdgDir::STATE);
+    if (directory.empty()) return "";
+    if (!make_directories(directory)) {
+        std::cerr << "Failed to create state directory " << directory << ": " << strerror(errno) << std::endl;
+        return "";
+    }
+    return directory;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "wayland_request.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+// One entry of the flight recorder, and of its dump file
+struct FlightRecord {
+    enum Kind : uint8_t {
+        EVENT,          // translated input: type is the InputEvent kind, source the ProbeSource
+        REQUEST,        // Wayland request sent: type is the WaylandRequest, time and args as recorded
+        SESSION_OPEN,   // args hold the tail of the session handle (up to 20 bytes, unterminated)
+        SESSION_CLOSE,
+    };
+
+    uint64_t sequence = 0;  // 1, 2, ... across all threads
+    uint64_t time_ns = 0;   // CLOCK_MONOTONIC
+    uint32_t session = 0;   // Session::id(), 0 for the shared devices
+    uint8_t kind = EVENT;
+    uint8_t source = 0;
+    uint8_t type = 0;
+    uint8_t pressed = 0;
+    uint32_t time = 0;      // REQUEST: the request's millisecond timestamp
+    // EVENT: code, then x and y as float bits; REQUEST: the request's arguments
+    uint32_t args[5] = {};
+};
+static_assert(sizeof(FlightRecord) == 48, "dump files hold 48-byte records");
+
+// Dump file: this header, then `count` FlightRecords, oldest first
+struct FlightDumpHeader {
+    static constexpr char MAGIC[8] = { 'H', 'R', 'F', 'L', 'I', 'G', 'H', 'T' };
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+};
+
+// Always-on record of the last few thousand translated events and Wayland
+// requests across all sessions, for working out after the fact what happened
+// to a stuck modifier or a lost click. Recording is a claim on a shared
+// counter and a handful of stores into a fixed ring, from any thread without
+// locks; old entries are overwritten. The ring is written to a file on a
+// fatal signal or on request (Diagnostics.DumpFlightRecorder).
+class FlightRecorder {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 16384;
+
+    // Keep the last `capacity` records (rounded up to a power of two); 0 keeps
+    // none. Once, before anything is recorded.
+    static void enable(size_t capacity);
+    static bool enabled() { return slots != nullptr; }
+
+    static void event(uint32_t session, uint8_t source, uint8_t type, bool pressed, uint32_t code, double x, double y) {
+        Slot* slot = claim();
+        if (!slot) return;
+        FlightRecord& r = slot->record;
+        r.session = session;
+        r.kind = FlightRecord::EVENT;
+        r.source = source;
+        r.type = type;
+        r.pressed = pressed;
+        r.args[0] = code;
+        r.args[1] = float_bits(x);
+        r.args[2] = float_bits(y);
+        publish(slot);
+    }
+
+    static void request(uint32_t session, WaylandRequest request, uint32_t time,
+                        uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0, uint32_t a4 = 0) {
+        Slot* slot = claim();
+        if (!slot) return;
+        FlightRecord& r = slot->record;
+        r.session = session;
+        r.kind = FlightRecord::REQUEST;
+        r.type = static_cast<uint8_t>(request);
+        r.time = time;
+        r.args[0] = a0;
+        r.args[1] = a1;
+        r.args[2] = a2;
+        r.args[3] = a3;
+        r.args[4] = a4;
+        publish(slot);
+    }
+
+    static void session_open(uint32_t session, const std::string& handle);
+    static void session_close(uint32_t session);
+
+    // The records still in the ring, oldest first; entries being written
+    // right now are left out
+    static std::vector<FlightRecord> snapshot();
+
+    // Write the ring to `path`. Async-signal-safe: no allocation or locks.
+    static bool dump(const char* path);
+
+    // On SIGSEGV, SIGABRT, SIGBUS, SIGILL and SIGFPE dump to `path` first, then
+    // die of the signal as before. The path is copied now.
+    static void install_crash_handler(const std::string& path);
+
+    // $XDG_STATE_HOME/hypr-remote (or ~/.local/state/...), created if needed; "" if there is none
+    static std::string default_directory();
+
+private:
+    // `sequence` is 0 while the record is being written, so a reader can
+    // tell a torn entry from a finished one
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        FlightRecord record;
+    };
+
+    static Slot* slots;
+    static size_t mask;
+    static std::atomic<uint64_t> head;
+
+    static Slot* claim() {
+        if (!slots) return nullptr;
+        uint64_t claimed = head.fetch_add(1, std::memory_order_relaxed);
+        Slot* slot = &slots[claimed & mask];
+        slot->sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->record = FlightRecord{};
+        slot->record.sequence = claimed + 1;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        slot->record.time_ns = uint64_t(now.tv_sec) * 1000000000ull + now.tv_nsec;
+        return slot;
+    }
+
+    static void publish(Slot* slot) {
+        slot->sequence.store(slot->record.sequence, std::memory_order_release);
+    }
+
+    static uint32_t float_bits(double value) {
+        float f = static_cast<float>(value);
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    // Copy slot `index` out if it holds a finished record
+    static bool read(size_t index, FlightRecord& out);
+};
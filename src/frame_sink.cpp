@@ -0,0 +1,51 @@
+#include "frame_sink.h"
+#include <algorithm>
+#include <cstring>
+
+void DamageHistory::add(const CaptureFrame& frame) {
+    if (frame.format != format || frame.sequence != latest + 1) {
+        format = frame.format;
+        oldest = frame.sequence;
+    }
+    Entry& entry = entries[frame.sequence % DEPTH];
+    entry.sequence = frame.sequence;
+    entry.damage.assign(frame.damage.begin(), frame.damage.end());
+    latest = frame.sequence;
+}
+
+void DamageHistory::since(uint64_t held, std::vector<DamageRect>& regions) const {
+    regions.clear();
+    if (held == latest) return;
+
+    // Older than we remember, from before the format changed, or never filled
+    if (held == 0 || held > latest || held < oldest || latest - held >= DEPTH) {
+        regions.push_back({ 0, 0, format.width, format.height });
+        return;
+    }
+    for (uint64_t sequence = held + 1; sequence <= latest; sequence++) {
+        const Entry& entry = entries[sequence % DEPTH];
+        regions.insert(regions.end(), entry.damage.begin(), entry.damage.end());
+    }
+}
+
+size_t copy_regions(const CaptureFrame& frame, const std::vector<DamageRect>& regions,
+                    uint8_t* dst, uint32_t dst_stride) {
+    const FrameFormat& format = frame.format;
+    size_t copied = 0;
+    for (const DamageRect& rect : regions) {
+        // The compositor's damage is clipped rather than trusted
+        if (rect.x >= format.width || rect.y >= format.height) continue;
+        uint32_t width = std::min(rect.width, format.width - rect.x);
+        uint32_t height = std::min(rect.height, format.height - rect.y);
+        size_t offset = size_t(rect.x) * FrameFormat::BYTES_PER_PIXEL;
+        size_t bytes = size_t(width) * FrameFormat::BYTES_PER_PIXEL;
+
+        for (uint32_t row = rect.y; row < rect.y + height; row++) {
+            // Damage is in buffer rows; the sink gets the image upright
+            uint32_t out = format.y_invert ? format.height - 1 - row : row;
+            memcpy(dst + size_t(out) * dst_stride + offset, frame.data + size_t(row) * format.stride + offset, bytes);
+        }
+        copied += bytes * height;
+    }
+    return copied;
+}
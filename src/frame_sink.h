@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A changed region of a captured frame, in buffer pixels
+struct DamageRect {
+    uint32_t x = 0, y = 0, width = 0, height = 0;
+
+    bool operator==(const DamageRect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+};
+
+// Pixel layout of a capture; changes only when the output's mode does. Always
+// four bytes per pixel (the 8888 and 2101010 formats), which is what
+// compositors offer for shm screencopy.
+struct FrameFormat {
+    static constexpr uint32_t BYTES_PER_PIXEL = 4;
+
+    uint32_t shm_format = 0; // wl_shm.format
+    uint32_t width = 0, height = 0, stride = 0;
+    bool y_invert = false;   // rows are stored bottom to top
+
+    bool operator==(const FrameFormat& other) const {
+        return shm_format == other.shm_format && width == other.width && height == other.height &&
+               stride == other.stride && y_invert == other.y_invert;
+    }
+    bool operator!=(const FrameFormat& other) const { return !(*this == other); }
+};
+
+// One captured frame: the whole image (valid only during deliver()) and what
+// changed since the frame before it. Frames are only delivered when something did.
+struct CaptureFrame {
+    const FrameFormat& format;
+    const uint8_t* data;
+    const std::vector<DamageRect>& damage;
+    uint64_t sequence;  // 1 for a capture's first frame, which is damaged all over
+    uint64_t time_ns;   // presentation time from the compositor
+};
+
+// Where a screen capture's frames go (a PipeWire stream, or a test's buffers).
+// Called from the capture thread only, except stream_node().
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    // The capture's format, before its first frame and whenever it changes;
+    // false if the sink cannot take it, which ends the capture
+    virtual bool configure(const FrameFormat& format) = 0;
+
+    virtual void deliver(const CaptureFrame& frame) = 0;
+
+    // The capture ended on the compositor's side (output gone, copies failing)
+    virtual void end() {}
+
+    // The PipeWire node clients open for this capture, waiting up to
+    // `timeout_ms` for the first frame to set it up; 0 if there is none
+    virtual uint32_t stream_node(int timeout_ms) { return 0; }
+};
+
+// A sink for a capture named `name` (the output), or nullptr if none can be made
+using SinkFactory = std::function<std::unique_ptr<FrameSink>(const std::string& name)>;
+
+// Damage of the last few frames, so a sink writing into a pool of buffers can
+// bring a buffer that last held frame N up to date by copying only what
+// changed since N. Pixels never change outside the union of these regions.
+class DamageHistory {
+public:
+    // Frames remembered; a buffer older than this gets a full copy
+    static constexpr size_t DEPTH = 16;
+
+    // Frame `frame.sequence` happened; a new format forgets everything before it
+    void add(const CaptureFrame& frame);
+
+    // Regions to copy into a buffer holding frame `held` (0 for none) to make
+    // it the latest one; the whole frame if `held` is too old or unknown
+    void since(uint64_t held, std::vector<DamageRect>& regions) const;
+
+private:
+    struct Entry {
+        uint64_t sequence = 0;
+        std::vector<DamageRect> damage;
+    };
+    Entry entries[DEPTH];
+    FrameFormat format;
+    uint64_t latest = 0;
+    uint64_t oldest = 0; // first frame of the current format
+};
+
+// Copy `regions` of `frame` into `dst` (same format, `dst_stride` bytes per
+// row), flipping rows if the frame is y-inverted; bytes copied
+size_t copy_regions(const CaptureFrame& frame, const std::vector<DamageRect>& regions,
+                    uint8_t* dst, uint32_t dst_stride);
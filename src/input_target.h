@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+class WaylandVirtualPointer;
+class WaylandVirtualKeyboard;
+class TransformSlot;
+
+// XKB modifier state as last sent to a virtual keyboard
+struct ModifierState {
+    uint32_t depressed = 0;
+    uint32_t latched = 0;
+    uint32_t locked = 0;
+    uint32_t group = 0;
+};
+
+// Keys and buttons held down and the code each press went out as, so its
+// release goes out the same way even if the transform changed in between
+struct HeldCodes {
+    static constexpr size_t MAX = 32;
+    struct Entry {
+        uint32_t input;
+        uint32_t output;
+    };
+    Entry entries[MAX];
+    size_t count = 0;
+
+    // `input` was pressed and sent as `output` (0 if it was swallowed); past
+    // MAX held codes the press is not tracked
+    void press(uint32_t input, uint32_t output) {
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].input == input) {
+                entries[i].output = output;
+                return;
+            }
+        }
+        if (count < MAX) entries[count++] = { input, output };
+    }
+
+    // Forget `input`, setting `output` to what its press went out as; false if
+    // it was not held
+    bool release(uint32_t input, uint32_t& output) {
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].input == input) {
+                output = entries[i].output;
+                entries[i] = entries[--count];
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// The frame a Translator is in the middle of for one target
+struct TranslationState {
+    uint32_t time = 0;            // stamped on every request of the frame
+    bool in_frame = false;
+    bool pointer_pending = false; // pointer requests sent since the last wl frame
+    int32_t discrete_x = 0;       // wheel movement short of a whole click, in 1/120ths
+    int32_t discrete_y = 0;
+    HeldCodes held;               // pressed keys and buttons, as remapped
+};
+
+// Where one client's input ends up: a virtual pointer/keyboard pair plus the
+// modifier state that belongs to that keyboard. Each session has its own, so
+// concurrent clients never share held buttons or modifiers, even when they
+// share the devices themselves.
+struct InputTarget {
+    WaylandVirtualPointer* pointer = nullptr;
+    WaylandVirtualKeyboard* keyboard = nullptr;
+    ModifierState modifiers;
+    TranslationState translation;
+    uint32_t session = 0;  // Session::id() for the flight recorder, 0 when shared
+    const TransformSlot* transform = nullptr;  // remapping and gain; none leaves input as it is
+    std::mutex* device_lock = nullptr;  // set when the devices are shared with other targets
+};
+
+// Held while writing to a target's devices; an empty lock unless they are shared
+inline std::unique_lock<std::mutex> lock_devices(const InputTarget& target) {
+    return target.device_lock ? std::unique_lock<std::mutex>(*target.device_lock) : std::unique_lock<std::mutex>();
+}
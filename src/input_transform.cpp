@@ -0,0 +1,144 @@
+#include "input_transform.h"
+#include "xdg_dirs.h"
+#include "translator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+InputTransform::InputTransform() : scroll_click(Translation::SCROLL_CLICK) {
+    for (uint32_t code = 0; code < CODE_COUNT; code++) keys[code] = static_cast<uint16_t>(code);
+    std::fill(gains, gains + GAIN_ENTRIES, 1.0f);
+}
+
+const InputTransform& InputTransform::identity() {
+    static const InputTransform transform;
+    return transform;
+}
+
+void InputTransform::set_gain_curve(const std::vector<std::pair<double, double>>& points) {
+    accelerated = false;
+    if (points.empty()) {
+        std::fill(gains, gains + GAIN_ENTRIES, 1.0f);
+        return;
+    }
+    size_t next = 0;
+    for (size_t i = 0; i < GAIN_ENTRIES; i++) {
+        double size = i * GAIN_STEP;
+        while (next < points.size() && points[next].first <= size) next++;
+        double gain;
+        if (next == 0) {
+            gain = points.front().second;
+        } else if (next == points.size()) {
+            gain = points.back().second;
+        } else {
+            const auto& [x0, g0] = points[next - 1];
+            const auto& [x1, g1] = points[next];
+            gain = g0 + (g1 - g0) * (size - x0) / (x1 - x0);
+        }
+        gains[i] = static_cast<float>(gain);
+        if (gains[i] != gains[0]) accelerated = true;
+    }
+}
+
+void TransformSlot::set(std::shared_ptr<const InputTransform> transform) {
+    if (transform.get() == active.load(std::memory_order_relaxed)) return;
+    active.store(transform.get());
+    // With nobody reading, nobody can still hold a table this replaced
+    if (readers.load() == 0) retained.clear();
+    if (transform) retained.push_back(std::move(transform));
+}
+
+std::string TransformConfig::default_path() {
+    std::string directory = xdg_directory(XdgDir::CONFIG);
+    return directory.empty() ? "" : directory + "/transforms.conf";
+}
+
+bool TransformConfig::load() {
+    if (path.empty()) return true;
+
+    std::ifstream in(path);
+    if (!in) {
+        fallback.reset();
+        apps.clear();
+        return true;
+    }
+
+    struct Section {
+        std::string app;  // empty for [default]
+        std::shared_ptr<InputTransform> transform = std::make_shared<InputTransform>();
+        std::vector<std::pair<double, double>> gain_points;
+    };
+    std::vector<Section> sections;
+
+    auto fail = [&](int number, const std::string& why) {
+        std::cerr << "⚠️ " << path << ":" << number << ": " << why << ", keeping the previous transforms" << std::endl;
+        return false;
+    };
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string directive;
+        if (!(fields >> directive)) continue;
+
+        if (directive == "[default]") {
+            sections.push_back({});
+            continue;
+        }
+        if (directive == "[app") {
+            std::string app;
+            if (!(fields >> app) || app.empty() || app.back() != ']') return fail(number, "expected [app <id>]");
+            app.pop_back();
+            sections.push_back({ app });
+            continue;
+        }
+        if (sections.empty()) return fail(number, "directive outside a section");
+        Section& section = sections.back();
+        InputTransform& transform = *section.transform;
+
+        if (directive == "key") {
+            uint32_t from, to;
+            if (!(fields >> from >> to) || from >= InputTransform::CODE_COUNT || to >= InputTransform::CODE_COUNT) {
+                return fail(number, "expected key <from> <to> below 768");
+            }
+            transform.keys[from] = static_cast<uint16_t>(to);
+        } else if (directive == "gain") {
+            double size, gain;
+            if (!(fields >> size >> gain) || size < 0 || gain <= 0 ||
+                (!section.gain_points.empty() && size <= section.gain_points.back().first)) {
+                return fail(number, "expected gain <size> <gain> with sizes increasing and gain above 0");
+            }
+            section.gain_points.emplace_back(size, gain);
+        } else if (directive == "scroll") {
+            if (!(fields >> transform.scroll_x >> transform.scroll_y)) return fail(number, "expected scroll <x> <y>");
+        } else if (directive == "scroll-click") {
+            if (!(fields >> transform.scroll_click) || transform.scroll_click <= 0) {
+                return fail(number, "expected scroll-click above 0");
+            }
+        } else {
+            return fail(number, "unknown directive " + directive);
+        }
+    }
+
+    fallback.reset();
+    apps.clear();
+    for (Section& section : sections) {
+        section.transform->set_gain_curve(section.gain_points);
+        if (section.app.empty()) {
+            fallback = section.transform;
+        } else {
+            apps[section.app] = section.transform;
+        }
+    }
+    std::cout << "✓ Input transforms: " << apps.size() << " app(s)" << (fallback ? " and a default" : "")
+              << " from " << path << std::endl;
+    return true;
+}
+
+std::shared_ptr<const InputTransform> TransformConfig::for_app(const std::string& app_id) const {
+    auto it = apps.find(app_id);
+    return it != apps.end() ? it->second : fallback;
+}
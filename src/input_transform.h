@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How one session's input is rewritten between ingress and the virtual
+// devices: keys and buttons through a flat remap table, relative motion
+// through a gain curve, scroll through per-axis multipliers. Immutable once
+// built; the identity transform changes nothing.
+struct InputTransform {
+    // Key and button codes the remap table covers (KEY_CNT); others pass as they are
+    static constexpr uint32_t CODE_COUNT = 0x300;
+    // The gain curve as a lookup table over motion size (length of one event's
+    // delta), GAIN_STEP logical pixels per entry; flat past the last one
+    static constexpr size_t GAIN_ENTRIES = 128;
+    static constexpr double GAIN_STEP = 0.5;
+
+    InputTransform();
+
+    // The remapped code; 0 means the key is swallowed
+    uint32_t key(uint32_t code) const { return code < CODE_COUNT ? keys[code] : code; }
+
+    // Gain for a relative motion of (dx, dy), interpolated between entries
+    double gain(double dx, double dy) const {
+        if (!accelerated) return gains[0];
+        double position = std::sqrt(dx * dx + dy * dy) / GAIN_STEP;
+        if (position >= GAIN_ENTRIES - 1) return gains[GAIN_ENTRIES - 1];
+        size_t i = static_cast<size_t>(position);
+        return gains[i] + (gains[i + 1] - gains[i]) * (position - i);
+    }
+
+    // Build the gain table from control points (motion size, gain), sorted by
+    // size; linear between points, flat outside them. No points means gain 1.
+    void set_gain_curve(const std::vector<std::pair<double, double>>& points);
+
+    static const InputTransform& identity();
+
+    uint16_t keys[CODE_COUNT];
+    float gains[GAIN_ENTRIES];
+    bool accelerated = false; // the table is not flat
+    // Multipliers for smooth scroll and wheel clicks; negative inverts the axis
+    double scroll_x = 1.0;
+    double scroll_y = 1.0;
+    // Axis value of one wheel click, Translation::SCROLL_CLICK unless configured
+    double scroll_click;
+};
+
+// A session's current transform, swapped whole while its input keeps flowing:
+// readers pin it with a counter and one load, no lock. Replaced tables are kept
+// while a reader on another thread may still hold one, and freed by the first
+// set() that finds no reader in flight.
+class TransformSlot {
+public:
+    TransformSlot() = default;
+    TransformSlot(const TransformSlot&) = delete;
+    TransformSlot& operator=(const TransformSlot&) = delete;
+
+    // The slot's transform (identity without a slot), valid while this lives
+    class Reader {
+    public:
+        explicit Reader(const TransformSlot* slot) : slot(slot) {
+            if (!slot) return;
+            // Counted before the load, so a set() that misses this reader is
+            // one whose table it cannot have loaded
+            slot->readers.fetch_add(1);
+            pinned = slot->active.load();
+        }
+        ~Reader() {
+            if (slot) slot->readers.fetch_sub(1, std::memory_order_release);
+        }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const InputTransform& transform() const { return pinned ? *pinned : InputTransform::identity(); }
+
+    private:
+        const TransformSlot* slot;
+        const InputTransform* pinned = nullptr;
+    };
+
+    // Publish `transform` (nullptr: back to identity); from one thread at a time
+    void set(std::shared_ptr<const InputTransform> transform);
+
+private:
+    std::atomic<const InputTransform*> active{nullptr};
+    mutable std::atomic<uint32_t> readers{0};
+    std::vector<std::shared_ptr<const InputTransform>> retained;
+};
+
+// Transforms from the config file, by app id. The file holds sections of
+// directives, one per line, `#` starting a comment:
+//
+//   [default]                  sessions whose app has no section, and the shared devices
+//   [app org.example.Client]   sessions of that app
+//   key 58 29                  remap code 58 (Caps Lock) to 29 (Left Ctrl); 0 swallows it
+//   gain 2 1.0                 control point of the gain curve: motion size, gain
+//   scroll 1.0 -1.0            horizontal and vertical scroll multipliers
+//   scroll-click 15            axis value of one wheel click
+//
+// Every section starts from the identity transform.
+class TransformConfig {
+public:
+    // $XDG_CONFIG_HOME/hypr-remote/transforms.conf, or ~/.config/...; empty if neither is known
+    static std::string default_path();
+
+    explicit TransformConfig(std::string path = default_path()) : path(std::move(path)) {}
+
+    // (Re)read the file. A missing file means no transforms; a malformed one
+    // is reported and leaves the previous transforms in place.
+    bool load();
+
+    // The transform for `app_id`'s sessions, nullptr if there is none
+    std::shared_ptr<const InputTransform> for_app(const std::string& app_id) const;
+
+    const std::string& file() const { return path; }
+
+private:
+    std::string path;
+    std::shared_ptr<const InputTransform> fallback;
+    std::map<std::string, std::shared_ptr<const InputTransform>> apps;
+};
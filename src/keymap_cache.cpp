@@ -0,0 +1,260 @@
+#include "keymap_cache.h"
+#include "xdg_dirs.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char MAGIC[8] = {'H', 'R', 'K', 'E', 'Y', 'M', 'A', 'P'};
+// Bump whenever the layout below or the way the index is built changes
+constexpr uint32_t FORMAT_VERSION = 1;
+
+// The offset between KEY_* numbering, and keycodes in the XKB evdev dataset
+constexpr uint32_t EVDEV_OFFSET = 8;
+
+// File layout: Header, the normalized text with its NUL, padding to 8 bytes,
+// then the index entries
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t data_stamp;
+    uint64_t checksum; // of everything after the header
+    uint32_t text_size; // including the NUL
+    uint32_t reserved;
+};
+
+size_t entries_offset(uint32_t text_size) {
+    return (sizeof(Header) + text_size + 7) & ~size_t(7);
+}
+
+// FNV-1a, 64 bit
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+const Header& header_of(const uint8_t* data) {
+    return *reinterpret_cast<const Header*>(data);
+}
+
+// Whether `size` bytes at `data` are a complete, intact image
+bool verify(const uint8_t* data, size_t size) {
+    if (size < sizeof(Header)) return false;
+    const Header& header = header_of(data);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION) return false;
+    if (header.text_size == 0) return false;
+    size_t expected = entries_offset(header.text_size) + size_t(header.entry_count) * sizeof(CompiledKeymap::Entry);
+    if (expected != size) return false;
+    if (data[sizeof(Header) + header.text_size - 1] != '\0') return false;
+    return fnv1a(data + sizeof(Header), size - sizeof(Header)) == header.checksum;
+}
+
+// Changes whenever a package update adds, removes or replaces XKB data files
+uint64_t stamp_include_paths(struct xkb_context* context) {
+    static const char* const SUBDIRS[] = {"", "/keycodes", "/types", "/compat", "/symbols", "/rules"};
+    uint64_t stamp = fnv1a(&FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    unsigned count = xkb_context_num_include_paths(context);
+    for (unsigned i = 0; i < count; i++) {
+        std::string path = xkb_context_include_path_get(context, i);
+        stamp = fnv1a(path.data(), path.size(), stamp);
+        for (const char* subdir : SUBDIRS) {
+            struct stat st;
+            if (stat((path + subdir).c_str(), &st) != 0) continue;
+            int64_t times[2] = {st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+            stamp = fnv1a(times, sizeof(times), stamp);
+        }
+    }
+    return stamp;
+}
+
+} // namespace
+
+CompiledKeymap::~CompiledKeymap() {
+    if (mapping) munmap(mapping, size);
+}
+
+std::unique_ptr<CompiledKeymap> CompiledKeymap::compile(struct xkb_context* context, std::string_view source) {
+    struct xkb_keymap* keymap = xkb_keymap_new_from_buffer(context, source.data(), source.size(),
+                                                           XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) return nullptr;
+
+    char* text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (!text) {
+        xkb_keymap_unref(keymap);
+        return nullptr;
+    }
+
+    // First match in keycode then level order wins, as a linear scan would find it
+    std::vector<Entry> index;
+    const xkb_layout_index_t layout = 0;
+    const xkb_keycode_t max = xkb_keymap_max_keycode(keymap);
+    for (xkb_keycode_t keycode = xkb_keymap_min_keycode(keymap); keycode < max; keycode++) {
+        if (keycode < EVDEV_OFFSET) continue;
+        xkb_level_index_t levels = xkb_keymap_num_levels_for_key(keymap, keycode, layout);
+        for (xkb_level_index_t level = 0; level < levels; level++) {
+            const xkb_keysym_t* syms;
+            int count = xkb_keymap_key_get_syms_by_level(keymap, keycode, layout, level, &syms);
+            for (int i = 0; i < count; i++) {
+                index.push_back({syms[i], static_cast<uint16_t>(keycode - EVDEV_OFFSET), static_cast<uint16_t>(level)});
+            }
+        }
+    }
+    std::stable_sort(index.begin(), index.end(), [](const Entry& a, const Entry& b) { return a.keysym < b.keysym; });
+    index.erase(std::unique(index.begin(), index.end(), [](const Entry& a, const Entry& b) {
+        return a.keysym == b.keysym;
+    }), index.end());
+
+    auto compiled = std::unique_ptr<CompiledKeymap>(new CompiledKeymap());
+    uint32_t text_size = static_cast<uint32_t>(strlen(text) + 1);
+    size_t offset = entries_offset(text_size);
+    compiled->owned.assign(offset + index.size() * sizeof(Entry), 0);
+    uint8_t* data = compiled->owned.data();
+    memcpy(data + sizeof(Header), text, text_size);
+    if (!index.empty()) memcpy(data + offset, index.data(), index.size() * sizeof(Entry));
+    free(text);
+    xkb_keymap_unref(keymap);
+
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.entry_count = static_cast<uint32_t>(index.size());
+    header.source_hash = fnv1a(source.data(), source.size());
+    header.source_size = source.size();
+    header.text_size = text_size;
+    header.checksum = fnv1a(data + sizeof(Header), compiled->owned.size() - sizeof(Header));
+    memcpy(data, &header, sizeof(header));
+
+    compiled->data = data;
+    compiled->size = compiled->owned.size();
+    return compiled;
+}
+
+std::string_view CompiledKeymap::text() const {
+    return std::string_view(reinterpret_cast<const char*>(data + sizeof(Header)), header_of(data).text_size - 1);
+}
+
+size_t CompiledKeymap::entries() const {
+    return header_of(data).entry_count;
+}
+
+const CompiledKeymap::Entry* CompiledKeymap::find(xkb_keysym_t keysym) const {
+    const Entry* begin = reinterpret_cast<const Entry*>(data + entries_offset(header_of(data).text_size));
+    const Entry* end = begin + entries();
+    const Entry* it = std::lower_bound(begin, end, keysym, [](const Entry& entry, xkb_keysym_t sym) {
+        return entry.keysym < sym;
+    });
+    return it != end && it->keysym == keysym ? it : nullptr;
+}
+
+std::string KeymapCache::default_directory() {
+    std::string directory = xdg_directory(XdgDir::CACHE);
+    return directory.empty() ? "" : directory + "/keymaps";
+}
+
+KeymapCache::KeymapCache(struct xkb_context* context, std::string directory)
+    : context(context), directory(std::move(directory)), data_stamp(stamp_include_paths(context)) {
+}
+
+std::string KeymapCache::path_for(std::string_view source) const {
+    if (directory.empty()) return "";
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.keymap",
+             static_cast<unsigned long long>(fnv1a(source.data(), source.size())));
+    return directory + "/" + name;
+}
+
+std::unique_ptr<CompiledKeymap> KeymapCache::load(std::string_view source) {
+    std::string path = path_for(source);
+    if (!path.empty()) {
+        if (auto cached = map(path, source)) {
+            std::cout << "🗝️ Keymap mapped from cache " << path << std::endl;
+            return cached;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto compiled = CompiledKeymap::compile(context, source);
+    if (!compiled) return nullptr;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    if (!path.empty() && store(path, *compiled)) {
+        std::cout << "🗝️ Keymap compiled in " << elapsed.count() << " ms, cached at " << path << std::endl;
+    } else {
+        std::cout << "🗝️ Keymap compiled in " << elapsed.count() << " ms" << std::endl;
+    }
+    return compiled;
+}
+
+std::unique_ptr<CompiledKeymap> KeymapCache::map(const std::string& path, std::string_view source) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return nullptr;
+
+    const uint8_t* data = static_cast<const uint8_t*>(mapping);
+    size_t size = static_cast<size_t>(st.st_size);
+    const Header& header = header_of(data);
+    if (!verify(data, size) || header.source_size != source.size() ||
+        header.source_hash != fnv1a(source.data(), source.size()) || header.data_stamp != data_stamp) {
+        std::cout << "🗝️ Cached keymap " << path << " is stale, rebuilding" << std::endl;
+        munmap(mapping, size);
+        return nullptr;
+    }
+
+    auto cached = std::unique_ptr<CompiledKeymap>(new CompiledKeymap());
+    cached->data = data;
+    cached->size = size;
+    cached->mapping = mapping;
+    return cached;
+}
+
+bool KeymapCache::store(const std::string& path, const CompiledKeymap& keymap) {
+    if (!make_directories(directory)) {
+        std::cerr << "Failed to create keymap cache directory " << directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // The stamp lives in the header, outside the checksum
+    Header header = header_of(keymap.data);
+    header.data_stamp = data_stamp;
+
+    // Written aside and renamed into place, so readers never see a partial file
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to write keymap cache " << temporary << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool written = write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+    size_t rest = keymap.size - sizeof(header);
+    written = written && write(fd, keymap.data + sizeof(header), rest) == static_cast<ssize_t>(rest);
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write keymap cache " << path << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <xkbcommon/xkbcommon.h>
+
+// A compiled keymap reduced to what the portal needs from it: the keymap as
+// normalized text (xkb_keymap_get_as_string) and a keysym -> keycode index.
+// It is either mapped straight from a cache file or built by compiling, in
+// the same layout either way.
+class CompiledKeymap {
+public:
+    // Keycodes are evdev (KEY_*) numbers; entries are sorted by keysym
+    struct Entry {
+        uint32_t keysym;
+        uint16_t keycode;
+        uint16_t level;
+    };
+
+    ~CompiledKeymap();
+
+    CompiledKeymap(const CompiledKeymap&) = delete;
+    CompiledKeymap& operator=(const CompiledKeymap&) = delete;
+
+    // Compile `source` (XKB text) and build the index; nullptr if it does not compile
+    static std::unique_ptr<CompiledKeymap> compile(struct xkb_context* context, std::string_view source);
+
+    // NUL-terminated; size() excludes the NUL
+    std::string_view text() const;
+
+    // First keycode/level producing `keysym`, scanning keycodes then levels in
+    // ascending order; nullptr if no key does
+    const Entry* find(xkb_keysym_t keysym) const;
+    size_t entries() const;
+
+    // Whether this came from the cache rather than the compiler
+    bool from_cache() const { return mapping != nullptr; }
+
+private:
+    friend class KeymapCache;
+
+    CompiledKeymap() = default;
+
+    // The whole cache file image, mapped or owned
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    void* mapping = nullptr;
+    std::vector<uint8_t> owned;
+};
+
+// Compiled keymaps on disk, one file per keymap named after a hash of its
+// source text, so a warm start maps the file instead of compiling. An entry
+// is rebuilt when it does not verify (truncated, corrupt, older format) or
+// when the XKB data it was compiled from has changed since.
+class KeymapCache {
+public:
+    // $XDG_CACHE_HOME/hypr-remote/keymaps, or ~/.cache/...; empty if neither is known
+    static std::string default_directory();
+
+    // An empty directory compiles every time and stores nothing
+    explicit KeymapCache(struct xkb_context* context, std::string directory = default_directory());
+
+    // The keymap for `source`, from the cache if it has a current entry,
+    // otherwise compiled and stored; nullptr if the source does not compile
+    std::unique_ptr<CompiledKeymap> load(std::string_view source);
+
+    // Where the entry for `source` lives (empty without a directory)
+    std::string path_for(std::string_view source) const;
+
+private:
+    struct xkb_context* context;
+    std::string directory;
+    uint64_t data_stamp; // of the XKB include paths this context compiles from
+
+    std::unique_ptr<CompiledKeymap> map(const std::string& path, std::string_view source);
+    bool store(const std::string& path, const CompiledKeymap& keymap);
+};
@@ -0,0 +1,176 @@
+#include "keymap_extension.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Highest keycode X11 clients can see (through Xwayland)
+static constexpr uint32_t X11_MAX_KEYCODE = 255;
+static constexpr uint32_t MIN_KEYCODE = 8;
+
+// Leading whitespace of the line starting at `pos` skipped
+static size_t skip_blanks(const std::string& text, size_t pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+    return pos;
+}
+
+KeymapExtension::KeymapExtension(std::string_view source) : base(source) {
+    // Normalized text has one section after the other, each ending in a "};" line
+    size_t keycodes = base.find("xkb_keycodes");
+    size_t symbols = base.find("xkb_symbols");
+    if (keycodes == std::string::npos || symbols == std::string::npos || symbols < keycodes) return;
+    size_t keycodes_close = base.find("\n};", keycodes);
+    size_t symbols_close = base.find("\n};", symbols);
+    if (keycodes_close == std::string::npos || symbols_close == std::string::npos || keycodes_close > symbols) return;
+
+    // Keycodes and names the keymap has already: "<NAME> = 9;", "alias <NAME> = <OTHER>;"
+    std::set<uint32_t> used;
+    std::set<std::string> names;
+    uint32_t highest = MIN_KEYCODE;
+    for (size_t line = base.find('\n', keycodes) + 1; line < keycodes_close; line = base.find('\n', line) + 1) {
+        size_t at = skip_blanks(base, line);
+        if (base.compare(at, 6, "alias ") == 0) at = skip_blanks(base, at + 6);
+        if (base.compare(at, 7, "maximum") == 0) {
+            size_t value = base.find_first_of("0123456789", at);
+            if (value == std::string::npos || value > base.find('\n', at)) continue;
+            maximum_at = value;
+            maximum = static_cast<uint32_t>(strtoul(base.c_str() + value, nullptr, 10));
+            maximum_length = base.find_first_not_of("0123456789", value) - value;
+            continue;
+        }
+        if (at >= base.size() || base[at] != '<') continue;
+        size_t name_end = base.find('>', at);
+        if (name_end == std::string::npos) continue;
+        names.insert(base.substr(at + 1, name_end - at - 1));
+
+        size_t value = skip_blanks(base, name_end + 1);
+        if (value < base.size() && base[value] == '=') value = skip_blanks(base, value + 1);
+        if (value < base.size() && base[value] >= '0' && base[value] <= '9') {
+            uint32_t keycode = static_cast<uint32_t>(strtoul(base.c_str() + value, nullptr, 10));
+            used.insert(keycode);
+            highest = std::max(highest, keycode);
+        }
+    }
+
+    // Free keycodes from the top of the X11 range down, then past the highest one
+    std::vector<uint32_t> spare;
+    for (uint32_t keycode = X11_MAX_KEYCODE; keycode > MIN_KEYCODE && spare.size() < SLOT_COUNT; keycode--) {
+        if (!used.count(keycode)) spare.push_back(keycode);
+    }
+    for (uint32_t keycode = std::max(highest, X11_MAX_KEYCODE) + 1; spare.size() < SLOT_COUNT; keycode++) {
+        spare.push_back(keycode);
+    }
+
+    char name[16];
+    for (size_t i = 0, n = 0; i < spare.size(); n++) {
+        snprintf(name, sizeof(name), "HR%02zu", n);
+        if (names.count(name)) continue;
+        Slot slot;
+        slot.name = name;
+        slot.keycode = spare[i++];
+        slots.push_back(slot);
+    }
+
+    keycodes_end = keycodes_close + 1;
+    symbols_end = symbols_close + 1;
+}
+
+KeymapExtension::Result KeymapExtension::assign(xkb_keysym_t keysym, uint32_t& keycode) {
+    Slot* victim = nullptr;
+    bool waiting = false;
+    for (Slot& slot : slots) {
+        if (slot.used && slot.keysym == keysym) {
+            slot.used = ++clock;
+            keycode = slot.keycode - EVDEV_OFFSET;
+            return Result::BOUND;
+        }
+        if (slot.pressed) continue;
+        // Rebinding a slot the pending keymap already binds would change what
+        // keys sent before it type
+        if (slot.pending) {
+            waiting = true;
+            continue;
+        }
+        if (!victim || slot.used < victim->used) victim = &slot;
+    }
+    if (!victim) return waiting ? Result::STALE : Result::NO_SLOT;
+
+    victim->keysym = keysym;
+    victim->used = ++clock;
+    victim->pending = true;
+    dirty = true;
+    keycode = victim->keycode - EVDEV_OFFSET;
+    return Result::REBOUND;
+}
+
+void KeymapExtension::key_state(uint32_t keycode, bool pressed) {
+    if (Slot* slot = find(keycode + EVDEV_OFFSET)) slot->pressed = pressed;
+}
+
+KeymapExtension::Slot* KeymapExtension::find(uint32_t keycode) {
+    for (Slot& slot : slots) {
+        if (slot.keycode == keycode) return &slot;
+    }
+    return nullptr;
+}
+
+size_t KeymapExtension::slots_bound() const {
+    return std::count_if(slots.begin(), slots.end(), [](const Slot& slot) { return slot.used != 0; });
+}
+
+std::string KeymapExtension::text() const {
+    if (!usable()) return base;
+
+    // Every slot is declared, bound or not, so the keycodes stay put from one
+    // upload to the next
+    std::string keycodes, symbols;
+    uint32_t highest = maximum;
+    char sym[64];
+    for (const Slot& slot : slots) {
+        keycodes += "\t<" + slot.name + "> = " + std::to_string(slot.keycode) + ";\n";
+        highest = std::max(highest, slot.keycode);
+        if (!slot.used) continue;
+        if (xkb_keysym_get_name(slot.keysym, sym, sizeof(sym)) < 0) continue;
+        symbols += "\tkey <" + slot.name + "> {\t[ " + sym + " ] };\n";
+    }
+
+    std::string out;
+    out.reserve(base.size() + keycodes.size() + symbols.size() + 8);
+    size_t from = 0;
+    if (maximum_at != std::string::npos) {
+        out.append(base, 0, maximum_at);
+        out += std::to_string(highest);
+        from = maximum_at + maximum_length;
+    }
+    out.append(base, from, keycodes_end - from);
+    out += keycodes;
+    out.append(base, keycodes_end, symbols_end - keycodes_end);
+    out += symbols;
+    out.append(base, symbols_end, std::string::npos);
+    return out;
+}
+
+int KeymapExtension::commit(uint32_t& size) {
+    // What is uploaded now is what the keys sent after it are typed with
+    for (Slot& slot : slots) slot.pending = false;
+    dirty = false;
+
+    std::string keymap = text();
+    int fd = memfd_create("keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        std::cerr << "Failed to create memfd" << std::endl;
+        return -1;
+    }
+    if (write(fd, keymap.c_str(), keymap.size() + 1) != static_cast<ssize_t>(keymap.size() + 1) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        std::cerr << "Failed to write keymap memfd" << std::endl;
+        close(fd);
+        return -1;
+    }
+    size = static_cast<uint32_t>(keymap.size() + 1);
+    return fd;
+}
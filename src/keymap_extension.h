@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <xkbcommon/xkbcommon.h>
+
+// Keysyms the keymap has no key for, typed through spare keycodes. The base
+// keymap (normalized text, see CompiledKeymap) gets SLOT_COUNT keycodes it does
+// not use, below 256 where it can so X11 clients see them too, and each keysym
+// asked for is bound to one of them; when all are bound the least recently used
+// one is rebound. Nothing is uploaded here: a change only marks the keymap
+// stale until commit(), so a burst of new keysyms is one upload.
+//
+// Not thread-safe; each virtual keyboard has its own.
+class KeymapExtension {
+public:
+    static constexpr size_t SLOT_COUNT = 32;
+
+    // What assign() found
+    enum class Result {
+        BOUND,    // `keycode` already types the keysym
+        REBOUND,  // `keycode` types it once the keymap is committed
+        STALE,    // every free slot was bound since the last commit: commit, then ask again
+        NO_SLOT,  // no slots at all, or every one is held down
+    };
+
+    explicit KeymapExtension(std::string_view base);
+
+    // Slots were found in the base keymap
+    bool usable() const { return !slots.empty(); }
+
+    // The evdev keycode that types `keysym`, binding a slot to it if it has none
+    Result assign(xkb_keysym_t keysym, uint32_t& keycode);
+
+    // Held slots are not rebound until they are released (evdev keycode; others are ignored)
+    void key_state(uint32_t keycode, bool pressed);
+
+    // Bindings changed since the last commit()
+    bool stale() const { return dirty; }
+    // The base keymap with every bound slot, as a sealed memfd holding the text
+    // NUL-terminated (owned by the caller; -1 on failure). The bindings it holds
+    // count as uploaded from here on.
+    int commit(uint32_t& size);
+
+    // The keymap text commit() would upload
+    std::string text() const;
+
+    size_t slots_bound() const;
+    uint32_t slot_keycode(size_t slot) const { return slots[slot].keycode - EVDEV_OFFSET; }
+
+private:
+    // KEY_* numbers are XKB evdev keycodes minus this
+    static constexpr uint32_t EVDEV_OFFSET = 8;
+
+    struct Slot {
+        std::string name;      // key name, without the brackets
+        uint32_t keycode = 0;  // XKB keycode
+        xkb_keysym_t keysym = XKB_KEY_NoSymbol;
+        uint64_t used = 0;     // LRU clock, 0 for never
+        bool pressed = false;
+        bool pending = false;  // bound since the last commit
+    };
+
+    std::string base;
+    // Where the keycode and symbol lines go in `base`, and its declared maximum
+    size_t keycodes_end = std::string::npos;
+    size_t symbols_end = std::string::npos;
+    size_t maximum_at = std::string::npos, maximum_length = 0;
+    uint32_t maximum = 0;
+
+    std::vector<Slot> slots;
+    uint64_t clock = 0;
+    bool dirty = false;
+
+    Slot* find(uint32_t keycode);
+};
@@ -1,18 +1,15 @@
 #include "libei_handler.h"
-#include "wayland_virtual_keyboard.h"
-#include "wayland_virtual_pointer.h"
+#include "ei_forwarder.h"
+#include "probes.h"
+#include "translator.h"
 #include <iostream>
-#include <chrono>
 #include <thread>
 #include <unistd.h>
-#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <cstring>
 #include <cerrno>
 
-extern "C" {
-#include <wayland-client-protocol.h>
-}
-
 LibEIHandler::LibEIHandler()
     : ei_context(nullptr), seat(nullptr), keyboard(nullptr), pointer(nullptr), running(false) {
 }
@@ -37,6 +34,14 @@ bool LibEIHandler::init(WaylandVirtualKeyboard* kb, WaylandVirtualPointer* ptr)
     // Configure the name for this context
     ei_configure_name(ei_context, "Hyprland Remote Desktop Portal");
     
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        std::cerr << "Failed to create eventfd: " << strerror(errno) << std::endl;
+        ei_unref(ei_context);
+        ei_context = nullptr;
+        return false;
+    }
+    
     std::cout << "EI receiver context created for portal file descriptor sharing" << std::endl;
     std::cout << "✓ LibEI Handler initialized successfully" << std::endl;
     return true;
@@ -54,6 +59,11 @@ void LibEIHandler::cleanup() {
         ei_unref(ei_context);
         ei_context = nullptr;
     }
+    
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
 }
 
 void LibEIHandler::run() {
@@ -71,19 +81,24 @@ void LibEIHandler::run() {
         return;
     }
     
+    struct pollfd fds[2] = {
+        { .fd = ei_fd, .events = POLLIN, .revents = 0 },
+        { .fd = wake_fd, .events = POLLIN, .revents = 0 },
+    };
+    
     while (running) {
-        // Use select to wait for events with timeout
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(ei_fd, &fds);
+        // Block until there is EI traffic or stop() is called
+        int result = poll(fds, 2, -1);
         
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 100000; // 100ms timeout
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error in poll(): " << strerror(errno) << std::endl;
+            break;
+        }
         
-        int result = select(ei_fd + 1, &fds, nullptr, nullptr, &timeout);
+        if (fds[1].revents & POLLIN) break;
         
-        if (result > 0 && FD_ISSET(ei_fd, &fds)) {
+        if (fds[0].revents & POLLIN) {
             // Dispatch events
             ei_dispatch(ei_context);
             struct ei_event* event;
@@ -91,11 +106,7 @@ void LibEIHandler::run() {
                 handle_event(event);
                 ei_event_unref(event);
             }
-        } else if (result < 0) {
-            std::cerr << "Error in select(): " << strerror(errno) << std::endl;
-            break;
         }
-        // If result == 0, it's just a timeout, continue the loop
     }
     
     std::cout << "LibEI Handler stopped processing events" << std::endl;
@@ -103,11 +114,30 @@ void LibEIHandler::run() {
 
 void LibEIHandler::stop() {
     running = false;
+    if (wake_fd >= 0) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to wake LibEI Handler: " << strerror(errno) << std::endl;
+        }
+    }
     std::cout << "LibEI Handler stop requested" << std::endl;
 }
 
+std::unique_ptr<EiForwarder> LibEIHandler::connect_forwarder(const std::string& name) {
+    if (passthrough_socket.empty()) {
+        return nullptr;
+    }
+    
+    auto forwarder = std::make_unique<EiForwarder>();
+    if (!forwarder->connect(passthrough_socket, name)) {
+        return nullptr;
+    }
+    return forwarder;
+}
+
 void LibEIHandler::handle_event(struct ei_event* event) {
     enum ei_event_type type = ei_event_get_type(event);
+    PROBE2(ei_ingress, type, type == EI_EVENT_FRAME ? ei_event_get_time(event) : 0);
     
     switch (type) {
         case EI_EVENT_CONNECT:
@@ -141,145 +171,24 @@ void LibEIHandler::handle_event(struct ei_event* event) {
             break;
             
         case EI_EVENT_POINTER_MOTION:
-            handle_pointer_event(event);
-            break;
-            
         case EI_EVENT_POINTER_MOTION_ABSOLUTE:
-            handle_pointer_event(event);
-            break;
-            
         case EI_EVENT_BUTTON_BUTTON:
-            handle_pointer_event(event);
-            break;
-            
         case EI_EVENT_SCROLL_DELTA:
         case EI_EVENT_SCROLL_DISCRETE:
-            handle_pointer_event(event);
-            break;
-            
+        case EI_EVENT_SCROLL_STOP:
+        case EI_EVENT_SCROLL_CANCEL:
         case EI_EVENT_KEYBOARD_KEY:
-            handle_keyboard_event(event);
-            break;
-            
         case EI_EVENT_FRAME:
-            // Frame events group related events together
-            // We can flush any pending events here
+            // The devices may have been swapped since the last event
+            target.pointer = pointer;
+            target.keyboard = keyboard;
+            Translator<EiSource>::translate(target, event);
             break;
             
         default:
             std::cout << "EI: Unhandled event type: " << type << std::endl;
             break;
     }
-}
-
-void LibEIHandler::handle_keyboard_event(struct ei_event* event) {
-    if (!keyboard) {
-        std::cout << "EI: Keyboard event received but no virtual keyboard available" << std::endl;
-        return;
-    }
-    
-    enum ei_event_type type = ei_event_get_type(event);
     
-    if (type == EI_EVENT_KEYBOARD_KEY) {
-        uint32_t keycode = ei_event_keyboard_get_key(event);
-        bool is_press = ei_event_keyboard_get_key_is_press(event);
-        
-        std::cout << "EI: Keyboard " << (is_press ? "press" : "release") << " keycode=" << keycode << std::endl;
-        
-        // Get current time for wayland events
-        uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count());
-        
-        // Forward to virtual keyboard
-        keyboard->send_key(time, keycode, is_press ? 1 : 0);
-    }
+    PROBE2(translate_done, PROBE_SOURCE_EI, type);
 }
-
-void LibEIHandler::handle_pointer_event(struct ei_event* event) {
-    if (!pointer) {
-        std::cout << "EI: Pointer event received but no virtual pointer available" << std::endl;
-        return;
-    }
-    
-    enum ei_event_type type = ei_event_get_type(event);
-    
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
-    
-    switch (type) {
-        case EI_EVENT_POINTER_MOTION: {
-            double dx = ei_event_pointer_get_dx(event);
-            double dy = ei_event_pointer_get_dy(event);
-            
-            std::cout << "EI: Pointer motion dx=" << dx << " dy=" << dy << std::endl;
-            
-            // Forward relative motion to virtual pointer
-            pointer->send_motion(time, dx, dy);
-            pointer->send_frame();
-            break;
-        }
-        
-        case EI_EVENT_POINTER_MOTION_ABSOLUTE: {
-            double x = ei_event_pointer_get_absolute_x(event);
-            double y = ei_event_pointer_get_absolute_y(event);
-            
-            std::cout << "EI: Pointer absolute motion x=" << x << " y=" << y << std::endl;
-            
-            // For absolute motion, we need screen dimensions
-            // For now, assume 1920x1080 - this should be dynamically determined
-            uint32_t screen_width = 1920;
-            uint32_t screen_height = 1080;
-            
-            pointer->send_motion_absolute(time, 
-                static_cast<uint32_t>(x), static_cast<uint32_t>(y),
-                screen_width, screen_height);
-            pointer->send_frame();
-            break;
-        }
-        
-        case EI_EVENT_BUTTON_BUTTON: {
-            uint32_t button = ei_event_button_get_button(event);
-            bool is_press = ei_event_button_get_is_press(event);
-            
-            std::cout << "EI: Button " << (is_press ? "press" : "release") << " button=" << button << std::endl;
-            
-            // Forward button event to virtual pointer
-            pointer->send_button(time, button, is_press ? 1 : 0);
-            pointer->send_frame();
-            break;
-        }
-        
-        case EI_EVENT_SCROLL_DELTA: {
-            double dx = ei_event_scroll_get_dx(event);
-            double dy = ei_event_scroll_get_dy(event);
-            
-            std::cout << "EI: Scroll delta dx=" << dx << " dy=" << dy << std::endl;
-            
-            // Send scroll events for both axes if non-zero
-            if (dx != 0.0) {
-                pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx, dy);
-            }
-            if (dy != 0.0) {
-                pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dy, dx);
-            }
-            pointer->send_frame();
-            break;
-        }
-        
-        case EI_EVENT_SCROLL_DISCRETE: {
-            int32_t dx = ei_event_scroll_get_discrete_dx(event);
-            int32_t dy = ei_event_scroll_get_discrete_dy(event);
-            
-            std::cout << "EI: Scroll discrete dx=" << dx << " dy=" << dy << std::endl;
-            
-            pointer->send_axis_discrete(time, dx, dy);
-            pointer->send_frame();
-            break;
-        }
-        
-        default:
-            std::cout << "EI: Unhandled pointer event type: " << type << std::endl;
-            break;
-    }
-} 
\ No newline at end of file
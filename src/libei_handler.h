@@ -1,9 +1,15 @@
 #pragma once
 
+#include "input_target.h"
+#include <atomic>
+#include <memory>
+#include <string>
+
 extern "C" {
 #include <libei.h>
 }
 
+class EiForwarder;
 class WaylandVirtualKeyboard;
 class WaylandVirtualPointer;
 
@@ -18,6 +24,14 @@ public:
     void stop();
     bool is_running() const { return running; }
     
+    // Compositor EIS socket (LIBEI_SOCKET) to pass sessions' input straight
+    // through to; empty keeps translating to virtual pointer/keyboard requests
+    void set_passthrough_socket(std::string socket) { passthrough_socket = std::move(socket); }
+    bool passthrough_enabled() const { return !passthrough_socket.empty(); }
+    
+    // A sender connected to the passthrough socket for one client, or nullptr
+    std::unique_ptr<EiForwarder> connect_forwarder(const std::string& name);
+    
     // Public access to ei_context for portal integration
     struct ei* ei_context;
     
@@ -27,11 +41,13 @@ public:
     
     // Public event handling for portal integration
     void handle_event(struct ei_event* event);
-    void handle_keyboard_event(struct ei_event* event);
-    void handle_pointer_event(struct ei_event* event);
     
 private:
     struct ei_seat* seat;
+    // The devices above with this stream's modifier and frame state
+    InputTarget target;
+    std::string passthrough_socket;
     
-    bool running;
+    std::atomic<bool> running;
+    int wake_fd = -1;
 }; 
\ No newline at end of file
@@ -1,56 +1,258 @@
 #include "portal.h"
+#include "clipboard.h"
+#include "device_pool.h"
+#include "eis_workers.h"
+#include "flight_recorder.h"
+#include "input_transform.h"
+#include "output_backend.h"
+#include "output_scheduler.h"
+#include "restore_store.h"
+#include "screencopy.h"
 #include "wayland_virtual_keyboard.h"
 #include "wayland_virtual_pointer.h"
 #include "libei_handler.h"
+#include "debug_log.h"
+#ifdef HAVE_PIPEWIRE
+#include "pipewire_stream.h"
+#endif
+#include <algorithm>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include <thread>
 #include <signal.h>
-#include <chrono>
 
-static bool running = true;
+// Virtual device pairs kept ready for new sessions (HYPR_REMOTE_DEVICE_POOL overrides)
+static const size_t DEFAULT_DEVICE_POOL_SIZE = 2;
 
-void signal_handler(int signal) {
-    std::cout << "\nReceived signal " << signal << ", shutting down..." << std::endl;
-    running = false;
+// Threads serving every session's EIS input, at most this many by default
+// (HYPR_REMOTE_EIS_WORKERS overrides, 0 gives each session a thread of its own)
+static const size_t DEFAULT_EIS_WORKERS = 4;
+
+// Per-session frames per second for pointer motion and scroll, with bursts of
+// RATE_BURST_SECONDS worth on top (HYPR_REMOTE_MOTION_RATE / HYPR_REMOTE_SCROLL_RATE
+// override, 0 lifts the limit)
+static const double DEFAULT_MOTION_RATE = 1000;
+static const double DEFAULT_SCROLL_RATE = 250;
+static const double RATE_BURST_SECONDS = 0.05;
+
+// Longest the output thread holds a flush for other sessions' frames to join it,
+// in microseconds (HYPR_REMOTE_FLUSH_WINDOW_US overrides, 0 flushes every round)
+static const double DEFAULT_FLUSH_WINDOW_US = 250;
+
+// Output backend from --backend=<spec> / --backend <spec>, else HYPR_REMOTE_BACKEND, else wayland
+static std::string backend_spec(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) {
+            return argv[i] + 10;
+        }
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            return argv[i + 1];
+        }
+    }
+    if (const char* env = getenv("HYPR_REMOTE_BACKEND")) {
+        return env;
+    }
+    return "wayland";
+}
+
+// Per-event logging is off unless --debug or HYPR_REMOTE_DEBUG asks for it
+static bool debug_requested(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0) {
+            return true;
+        }
+    }
+    return getenv("HYPR_REMOTE_DEBUG") != nullptr;
+}
+
+static double rate_from_env(const char* name, double fallback) {
+    if (const char* env = getenv(name)) {
+        return std::strtod(env, nullptr);
+    }
+    return fallback;
+}
+
+static OutputScheduler::Limits scheduler_limits() {
+    OutputScheduler::Limits limits;
+    limits.motion_rate = rate_from_env("HYPR_REMOTE_MOTION_RATE", DEFAULT_MOTION_RATE);
+    limits.scroll_rate = rate_from_env("HYPR_REMOTE_SCROLL_RATE", DEFAULT_SCROLL_RATE);
+    limits.motion_burst = std::max(1.0, limits.motion_rate * RATE_BURST_SECONDS);
+    limits.scroll_burst = std::max(1.0, limits.scroll_rate * RATE_BURST_SECONDS);
+    double window = std::clamp(rate_from_env("HYPR_REMOTE_FLUSH_WINDOW_US", DEFAULT_FLUSH_WINDOW_US), 0.0, 500.0);
+    limits.flush_window = std::chrono::microseconds(int64_t(window));
+    return limits;
 }
 
 int main(int argc, char* argv[]) {
-    // Set up signal handling
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    // Set up signal handling: block SIGINT/SIGTERM (and SIGHUP, which reloads the
+    // input transforms) in every thread (they inherit the mask) and collect them
+    // synchronously below, so nothing polls for shutdown
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    sigaddset(&shutdown_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+    // A clipboard reader that goes away mid-transfer is an EPIPE, not a signal
+    signal(SIGPIPE, SIG_IGN);
     
+    debug_logging = debug_requested(argc, argv);
     std::cout << "Hyprland Remote Desktop Portal starting..." << std::endl;
     
+    // Flight recorder: the last HYPR_REMOTE_FLIGHT_RECORDER events and requests
+    // (0 turns it off), dumped to the state directory on a crash or on request
+    size_t flight_records = FlightRecorder::DEFAULT_CAPACITY;
+    if (const char* env = getenv("HYPR_REMOTE_FLIGHT_RECORDER")) {
+        flight_records = std::strtoul(env, nullptr, 10);
+    }
+    std::string state_directory = FlightRecorder::default_directory();
+    if (flight_records > 0) {
+        FlightRecorder::enable(flight_records);
+        if (!state_directory.empty()) {
+            FlightRecorder::install_crash_handler(state_directory + "/flight-crash.bin");
+        }
+        std::cout << "✓ Flight recorder: last " << flight_records << " records" << std::endl;
+    }
+    
     // Initialize components
-    WaylandVirtualKeyboard waylandVK;
-    WaylandVirtualPointer waylandVP;
+    auto backend = OutputBackend::create(backend_spec(argc, argv));
+    if (!backend) {
+        return 1;
+    }
+    DevicePair sharedDevices;
     LibEIHandler libeiHandler;
     Portal portal;
     
-    // Initialize Wayland virtual keyboard
-    if (!waylandVK.init()) {
-        std::cerr << "Failed to initialize Wayland virtual keyboard" << std::endl;
+    size_t pool_size = DEFAULT_DEVICE_POOL_SIZE;
+    if (const char* env = getenv("HYPR_REMOTE_DEVICE_POOL")) {
+        pool_size = std::strtoul(env, nullptr, 10);
+    }
+    DevicePool devicePool(pool_size);
+    OutputScheduler::Limits limits = scheduler_limits();
+    OutputScheduler outputScheduler(limits);
+    
+    size_t worker_count = std::min<size_t>(DEFAULT_EIS_WORKERS, std::max(1u, std::thread::hardware_concurrency()));
+    if (const char* env = getenv("HYPR_REMOTE_EIS_WORKERS")) {
+        worker_count = std::strtoul(env, nullptr, 10);
+    }
+    EisWorkers eisWorkers(worker_count, &outputScheduler);
+    
+    // Initialize the output backend
+    if (!backend->init()) {
+        std::cerr << "Failed to initialize " << backend->name() << " output backend" << std::endl;
         return 1;
     }
-    std::cout << "✓ Virtual keyboard initialized" << std::endl;
+    std::cout << "✓ Output backend initialized: " << backend->name() << std::endl;
     
-    // Initialize Wayland virtual pointer
-    if (!waylandVP.init()) {
-        std::cerr << "Failed to initialize Wayland virtual pointer" << std::endl;
-        waylandVK.cleanup();
+    // Shared virtual pointer/keyboard for the LibEI receiver and sessions without their own
+    sharedDevices = backend->create_pair();
+    if (!sharedDevices) {
+        std::cerr << "Failed to create virtual pointer/keyboard" << std::endl;
+        backend->cleanup();
         return 1;
     }
-    std::cout << "✓ Virtual pointer initialized" << std::endl;
+    std::cout << "✓ Virtual pointer and keyboard initialized" << std::endl;
+    
+    // Every session's output, the shared devices' included, goes through one
+    // fair, rate-limited queue. The LibEI receiver has the "shared" flow to
+    // itself: sessions without their own pair and Notify* calls outside a
+    // session each get a flow alongside it (see Portal::create_session).
+    outputScheduler.start();
+    sharedDevices = outputScheduler.attach("shared", std::move(sharedDevices));
+    portal.set_output_scheduler(&outputScheduler);
+    std::cout << "✓ Output scheduler started: per-session motion " << limits.motion_rate << "/s, scroll "
+              << limits.scroll_rate << "/s (0 = unlimited)" << std::endl;
     
     // Initialize libei handler
-    if (!libeiHandler.init(&waylandVK, &waylandVP)) {
+    if (!libeiHandler.init(sharedDevices.keyboard.get(), sharedDevices.pointer.get())) {
         std::cerr << "Failed to initialize LibEI handler" << std::endl;
-        waylandVP.cleanup();
-        waylandVK.cleanup();
+        sharedDevices = outputScheduler.detach(std::move(sharedDevices));
+        outputScheduler.stop();
+        sharedDevices = DevicePair();
+        backend->cleanup();
         return 1;
     }
     std::cout << "✓ LibEI handler initialized" << std::endl;
     
+    // Forward EIS sessions straight to the compositor when it exposes an EIS socket
+    // (HYPR_REMOTE_EIS_PASSTHROUGH=0 keeps translating)
+    const char* passthrough = getenv("HYPR_REMOTE_EIS_PASSTHROUGH");
+    if (const char* socket = getenv("LIBEI_SOCKET"); socket && !(passthrough && strcmp(passthrough, "0") == 0)) {
+        libeiHandler.set_passthrough_socket(socket);
+        std::cout << "✓ EIS passthrough to " << socket << std::endl;
+    }
+    
+    // Per-session devices; without them every session shares the devices above
+    if (pool_size > 0 && devicePool.init(backend.get())) {
+        portal.set_device_pool(&devicePool);
+    } else {
+        std::cout << "⚠️ Device pool disabled, sessions will share one pointer/keyboard" << std::endl;
+    }
+    
+    // Spread session decoding over a few threads, each feeding the output scheduler
+    // through its own ring
+    if (worker_count > 0 && eisWorkers.start()) {
+        portal.set_eis_workers(&eisWorkers);
+    } else {
+        std::cout << "⚠️ EIS workers disabled, each session gets its own thread" << std::endl;
+    }
+    
+    // Restore tokens for returning clients; persistent ones are kept on disk
+    RestoreStore restoreStore;
+    portal.set_restore_store(&restoreStore);
+    std::cout << "✓ Restore tokens: " << restoreStore.size() << " persistent grant(s) loaded" << std::endl;
+    if (FlightRecorder::enabled() && !state_directory.empty()) {
+        portal.set_flight_dump_directory(state_directory);
+    }
+    
+    // Shared-memory input for trusted local clients, only when asked for (HYPR_REMOTE_SHARED_RING=1)
+    const char* shared_ring = getenv("HYPR_REMOTE_SHARED_RING");
+    if (shared_ring && strcmp(shared_ring, "1") == 0) {
+        portal.set_shared_ring(true);
+        std::cout << "✓ ConnectToSharedRing offered" << std::endl;
+    }
+    
+    // Key remapping, pointer gain and scroll settings per app; SIGHUP re-reads them
+    TransformConfig transformConfig;
+    transformConfig.load();
+    portal.set_transform_config(&transformConfig);
+    
+    // ScreenCast: wlr-screencopy frames out as PipeWire streams (HYPR_REMOTE_SCREENCAST=0 turns it off)
+    Screencopy screencopy;
+#ifdef HAVE_PIPEWIRE
+    PipeWire pipewire;
+#endif
+    const char* screencast = getenv("HYPR_REMOTE_SCREENCAST");
+    if (screencast && strcmp(screencast, "0") == 0) {
+        std::cout << "⚠️ ScreenCast disabled" << std::endl;
+    } else {
+#ifdef HAVE_PIPEWIRE
+        if (screencopy.init() && pipewire.init()) {
+            portal.set_screencast(&screencopy, [&pipewire](const std::string& name) { return pipewire.create_sink(name); });
+            std::cout << "✓ ScreenCast: " << screencopy.outputs().size() << " output(s)" << std::endl;
+        } else {
+            screencopy.cleanup();
+            std::cout << "⚠️ ScreenCast unavailable, offering RemoteDesktop only" << std::endl;
+        }
+#else
+        std::cout << "⚠️ ScreenCast unavailable: built without PipeWire" << std::endl;
+#endif
+    }
+    
+    // Clipboard: the seat's selection through wlr-data-control (HYPR_REMOTE_CLIPBOARD=0 turns it off)
+    Clipboard clipboard;
+    const char* clipboard_env = getenv("HYPR_REMOTE_CLIPBOARD");
+    if (clipboard_env && strcmp(clipboard_env, "0") == 0) {
+        std::cout << "⚠️ Clipboard disabled" << std::endl;
+    } else if (clipboard.init()) {
+        portal.set_clipboard(&clipboard);
+        std::cout << "✓ Clipboard ready" << std::endl;
+    } else {
+        std::cout << "⚠️ Clipboard unavailable" << std::endl;
+    }
+    
     // Start LibEI handler in background thread
     std::thread libei_thread([&libeiHandler]() {
         libeiHandler.run();
@@ -61,9 +263,21 @@ int main(int argc, char* argv[]) {
     // Initialize portal
     if (!portal.init(&libeiHandler)) {
         std::cerr << "Failed to initialize D-Bus portal" << std::endl;
+        portal.cleanup();
+        libeiHandler.stop();
+        libei_thread.join();
+        clipboard.cleanup();
+        screencopy.cleanup();
+#ifdef HAVE_PIPEWIRE
+        pipewire.cleanup();
+#endif
+        eisWorkers.stop();
+        devicePool.cleanup();
         libeiHandler.cleanup();
-        waylandVP.cleanup();
-        waylandVK.cleanup();
+        sharedDevices = outputScheduler.detach(std::move(sharedDevices));
+        outputScheduler.stop();
+        sharedDevices = DevicePair();
+        backend->cleanup();
         return 1;
     }
     std::cout << "✓ D-Bus portal initialized" << std::endl;
@@ -77,10 +291,13 @@ int main(int argc, char* argv[]) {
         portal.run();
     });
     
-    // Main loop - just wait for shutdown signal
-    while (running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Main thread just waits for a shutdown signal
+    int signal = 0;
+    while (sigwait(&shutdown_signals, &signal) == 0 && signal == SIGHUP) {
+        std::cout << "🔄 SIGHUP: reloading " << transformConfig.file() << std::endl;
+        portal.reload_transforms();
     }
+    std::cout << "\nReceived signal " << signal << ", shutting down..." << std::endl;
     
     std::cout << "\nShutting down components..." << std::endl;
     
@@ -97,10 +314,22 @@ int main(int argc, char* argv[]) {
     
     // Cleanup in reverse order
     portal.cleanup();
+    clipboard.cleanup();
+    screencopy.cleanup();
+#ifdef HAVE_PIPEWIRE
+    pipewire.cleanup();
+#endif
+    eisWorkers.stop();
+    devicePool.cleanup();
     libeiHandler.cleanup();
-    waylandVP.cleanup();
-    waylandVK.cleanup();
+    sharedDevices = outputScheduler.detach(std::move(sharedDevices));
+    outputScheduler.stop();
+    sharedDevices = DevicePair();
+    backend->cleanup();
     
+    OutputScheduler::Stats stats = outputScheduler.totals();
+    std::cout << "⏳ Output scheduler: " << stats.frames << " frames written, " << stats.merged << " merged, "
+              << stats.throttled << " rate-limit holds" << std::endl;
     std::cout << "✓ Shutdown complete" << std::endl;
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "output_backend.h"
+#include "recording_backend.h"
+#include "wayland_backend.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include <iostream>
+
+DevicePair::DevicePair() = default;
+DevicePair::DevicePair(std::unique_ptr<WaylandVirtualPointer> pointer, std::unique_ptr<WaylandVirtualKeyboard> keyboard)
+    : pointer(std::move(pointer)), keyboard(std::move(keyboard)) {
+}
+DevicePair::DevicePair(DevicePair&&) noexcept = default;
+DevicePair& DevicePair::operator=(DevicePair&&) noexcept = default;
+DevicePair::~DevicePair() = default;
+
+namespace {
+
+// Devices whose wire-level requests go nowhere; the translation in send_* still runs
+class NullVirtualPointer : public WaylandVirtualPointer {
+protected:
+    void emit_motion(uint32_t, wl_fixed_t, wl_fixed_t) override {}
+    void emit_motion_absolute(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) override {}
+    void emit_button(uint32_t, uint32_t, uint32_t) override {}
+    void emit_axis(uint32_t, uint32_t, wl_fixed_t) override {}
+    void emit_axis_source(uint32_t) override {}
+    void emit_axis_discrete(uint32_t, uint32_t, wl_fixed_t, int32_t) override {}
+    void emit_axis_stop(uint32_t, uint32_t) override {}
+    void emit_frame() override {}
+    void flush() override {}
+};
+
+class NullVirtualKeyboard : public WaylandVirtualKeyboard {
+protected:
+    void emit_key(uint32_t, uint32_t, uint32_t) override {}
+    void emit_modifiers(uint32_t, uint32_t, uint32_t, uint32_t) override {}
+    void flush() override {}
+};
+
+class NullBackend : public OutputBackend {
+public:
+    const char* name() const override { return "null"; }
+    bool init() override {
+        std::cout << "Null output backend: input is translated and dropped" << std::endl;
+        return true;
+    }
+    void cleanup() override {}
+    DevicePair create_pair() override {
+        return DevicePair(std::make_unique<NullVirtualPointer>(), std::make_unique<NullVirtualKeyboard>());
+    }
+};
+
+} // namespace
+
+std::unique_ptr<OutputBackend> OutputBackend::create(const std::string& spec) {
+    if (spec.empty() || spec == "wayland") {
+        return std::make_unique<WaylandBackend>();
+    }
+    if (spec == "null") {
+        return std::make_unique<NullBackend>();
+    }
+    if (spec == "record") {
+        return std::make_unique<RecordingBackend>();
+    }
+    if (spec.rfind("record:", 0) == 0) {
+        return std::make_unique<RecordingBackend>(spec.substr(7));
+    }
+    std::cerr << "Unknown output backend: " << spec << " (expected wayland, null, record or record:<path>)" << std::endl;
+    return nullptr;
+}
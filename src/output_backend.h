@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+class WaylandVirtualPointer;
+class WaylandVirtualKeyboard;
+
+// A virtual pointer and keyboard owned by one session (or the shared pair)
+struct DevicePair {
+    std::unique_ptr<WaylandVirtualPointer> pointer;
+    std::unique_ptr<WaylandVirtualKeyboard> keyboard;
+
+    DevicePair();
+    DevicePair(std::unique_ptr<WaylandVirtualPointer> pointer, std::unique_ptr<WaylandVirtualKeyboard> keyboard);
+    DevicePair(DevicePair&&) noexcept;
+    DevicePair& operator=(DevicePair&&) noexcept;
+    ~DevicePair();
+
+    explicit operator bool() const { return pointer && keyboard; }
+};
+
+// Where translated input goes. The translation logic lives in the device
+// classes' send_* methods; a backend decides what their wire-level emit_*
+// hooks do by handing out device subclasses:
+//
+//   wayland        virtual-pointer/keyboard protocols on the compositor (default)
+//   null           drop everything, for measuring ingress cost alone
+//   record         keep every request in memory
+//   record:<path>  append every request to <path> as binary records
+class OutputBackend {
+public:
+    virtual ~OutputBackend() = default;
+
+    // Backend for `spec` (see above), or nullptr if the spec is unknown
+    static std::unique_ptr<OutputBackend> create(const std::string& spec);
+
+    virtual const char* name() const = 0;
+    virtual bool init() = 0;
+    virtual void cleanup() = 0;
+
+    // A new device pair, or an empty pair on failure. Called from the device
+    // pool's refill thread as well as the main thread.
+    virtual DevicePair create_pair() = 0;
+
+    // Push out queued requests, e.g. for devices that were just destroyed
+    virtual void flush() {}
+
+    // Wait until the output side has processed everything sent so far
+    virtual void sync() {}
+};
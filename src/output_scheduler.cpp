@@ -0,0 +1,741 @@
+#include "output_scheduler.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include "debug_log.h"
+#include "probes.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// The ring the calling thread feeds, if bind_producer() gave it one
+struct ProducerBinding {
+    OutputScheduler* owner = nullptr;
+    void* producer = nullptr;
+};
+thread_local ProducerBinding producer_binding;
+
+// A flow that had something written this recently counts as active, and the
+// flush window waits for it
+const Clock::duration ACTIVE_SPAN = std::chrono::milliseconds(50);
+
+} // namespace
+
+struct OutputScheduler::Flow {
+    std::string name;
+    DevicePair devices; // the real ones, empty when written alongside another flow
+    WaylandVirtualPointer* pointer = nullptr;   // the real devices written to
+    WaylandVirtualKeyboard* keyboard = nullptr;
+    const WaylandVirtualPointer* pointer_stand_in = nullptr;
+    Batch open;         // pointer requests waiting for their frame
+    std::deque<Batch> queue;
+    TokenBucket motion;
+    TokenBucket scroll;
+    int64_t deficit = 0;
+    bool detaching = false;
+    bool wrote_pointer = false;
+    bool wrote_keyboard = false;
+    bool awaiting_flush = false;
+    Clock::time_point last_written;
+    Stats stats;
+};
+
+namespace {
+
+// Stand-ins handed to the session: every request goes to the flow's queue and
+// the flush only closes the batch, the output thread flushes the real devices
+class StandInPointer : public WaylandVirtualPointer {
+public:
+    StandInPointer(OutputScheduler& scheduler, OutputScheduler::Flow* flow) : scheduler(scheduler), flow(flow) {}
+
+protected:
+    using Request = OutputScheduler::Request;
+
+    void emit_motion(uint32_t time, wl_fixed_t dx, wl_fixed_t dy) override {
+        scheduler.queue(flow, { Request::Motion, time, { uint32_t(dx), uint32_t(dy) } });
+    }
+    void emit_motion_absolute(uint32_t time, uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent) override {
+        scheduler.queue(flow, { Request::MotionAbsolute, time, { x, y, x_extent, y_extent } });
+    }
+    void emit_button(uint32_t time, uint32_t button, uint32_t state) override {
+        scheduler.queue(flow, { Request::Button, time, { button, state } });
+    }
+    void emit_axis(uint32_t time, uint32_t axis, wl_fixed_t value) override {
+        scheduler.queue(flow, { Request::Axis, time, { axis, uint32_t(value) } });
+    }
+    void emit_axis_source(uint32_t axis_source) override {
+        scheduler.queue(flow, { Request::AxisSource, 0, { axis_source } });
+    }
+    void emit_axis_discrete(uint32_t time, uint32_t axis, wl_fixed_t value, int32_t discrete) override {
+        scheduler.queue(flow, { Request::AxisDiscrete, time, { axis, uint32_t(value), uint32_t(discrete) } });
+    }
+    void emit_axis_stop(uint32_t time, uint32_t axis) override {
+        scheduler.queue(flow, { Request::AxisStop, time, { axis } });
+    }
+    void emit_frame() override {
+        scheduler.queue(flow, { Request::Frame, 0, {} });
+    }
+    void flush() override {
+        scheduler.end_batch(flow);
+    }
+
+private:
+    OutputScheduler& scheduler;
+    OutputScheduler::Flow* flow;
+};
+
+class StandInKeyboard : public WaylandVirtualKeyboard {
+public:
+    StandInKeyboard(OutputScheduler& scheduler, OutputScheduler::Flow* flow) : scheduler(scheduler), flow(flow) {}
+
+protected:
+    using Request = OutputScheduler::Request;
+
+    void emit_key(uint32_t time, uint32_t key, uint32_t state) override {
+        scheduler.queue(flow, { Request::Key, time, { key, state } });
+    }
+    void emit_modifiers(uint32_t mods_depressed, uint32_t mods_latched,
+                        uint32_t mods_locked, uint32_t group) override {
+        scheduler.queue(flow, { Request::Modifiers, 0, { mods_depressed, mods_latched, mods_locked, group } });
+    }
+    void emit_keymap(int fd, uint32_t size) override {
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (copy < 0) {
+            std::cerr << "Failed to duplicate keymap fd: " << strerror(errno) << std::endl;
+            return;
+        }
+        scheduler.queue(flow, { Request::Keymap, 0, { uint32_t(copy), size } });
+    }
+    void flush() override {}
+
+private:
+    OutputScheduler& scheduler;
+    OutputScheduler::Flow* flow;
+};
+
+using Batch = OutputScheduler::Batch;
+using Call = OutputScheduler::Call;
+using Request = OutputScheduler::Request;
+
+// Close the fds of the keymaps in `batch`, which will not be written now;
+// write() skips a keymap whose fd is gone
+void close_keymap_fds(Batch& batch) {
+    for (size_t i = 0; i < batch.count; i++) {
+        Call& call = batch.calls[i];
+        if (call.request == Request::Keymap && int(call.args[0]) >= 0) {
+            close(int(call.args[0]));
+            call.args[0] = uint32_t(-1);
+        }
+    }
+}
+
+// A single motion (relative or absolute) or a run of axis requests, each
+// optionally followed by the frame; anything else is never limited or merged
+Batch::Kind classify(const Batch& batch) {
+    size_t motions = 0, axes = 0, frames = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        switch (batch.calls[i].request) {
+            case Request::Motion:
+            case Request::MotionAbsolute:
+                motions++;
+                break;
+            case Request::Axis:
+            case Request::AxisSource:
+            case Request::AxisDiscrete:
+            case Request::AxisStop:
+                axes++;
+                break;
+            case Request::Frame:
+                frames++;
+                break;
+            default:
+                return Batch::OTHER;
+        }
+    }
+    if (motions == 1 && axes == 0 && frames <= 1) return Batch::MOTION;
+    if (motions == 0 && axes > 0 && frames <= 1) return Batch::SCROLL;
+    return Batch::OTHER;
+}
+
+// Same requests in the same order, on the same axes and with the same source
+bool mergeable(const Batch& into, const Batch& from) {
+    if (into.kind != from.kind || into.kind == Batch::OTHER || into.count != from.count) return false;
+    for (size_t i = 0; i < into.count; i++) {
+        const auto& a = into.calls[i];
+        const auto& b = from.calls[i];
+        if (a.request != b.request) return false;
+        switch (a.request) {
+            case Request::Axis:
+            case Request::AxisSource:
+            case Request::AxisDiscrete:
+            case Request::AxisStop:
+                if (a.args[0] != b.args[0]) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+uint32_t add_fixed(uint32_t a, uint32_t b) {
+    return uint32_t(int32_t(a) + int32_t(b));
+}
+
+void merge(Batch& into, const Batch& from) {
+    for (size_t i = 0; i < into.count; i++) {
+        auto& a = into.calls[i];
+        const auto& b = from.calls[i];
+        switch (a.request) {
+            case Request::Motion:
+                a.args[0] = add_fixed(a.args[0], b.args[0]);
+                a.args[1] = add_fixed(a.args[1], b.args[1]);
+                break;
+            case Request::MotionAbsolute:
+                std::copy(b.args, b.args + 5, a.args);
+                break;
+            case Request::Axis:
+                a.args[1] = add_fixed(a.args[1], b.args[1]);
+                break;
+            case Request::AxisDiscrete:
+                a.args[1] = add_fixed(a.args[1], b.args[1]);
+                a.args[2] = add_fixed(a.args[2], b.args[2]);
+                break;
+            default:
+                break;
+        }
+        a.time = b.time;
+    }
+}
+
+} // namespace
+
+bool OutputScheduler::TokenBucket::take(Clock::time_point now) {
+    if (rate <= 0) return true;
+    double elapsed = std::chrono::duration<double>(now - updated).count();
+    tokens = std::min(burst, tokens + rate * elapsed);
+    updated = now;
+    if (tokens < 1) return false;
+    tokens -= 1;
+    return true;
+}
+
+Clock::duration OutputScheduler::TokenBucket::until_next() const {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - tokens) / rate));
+}
+
+OutputScheduler::OutputScheduler(const Limits& limits)
+    : limits(limits), next_flow(flows.end()), wake_at(Clock::time_point::max()),
+      flush_deadline(Clock::time_point::max()) {
+    pending.reserve(256);
+    unflushed.reserve(16);
+}
+
+OutputScheduler::~OutputScheduler() {
+    stop();
+}
+
+bool OutputScheduler::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return true;
+    running = true;
+    thread = std::thread([this]() { run(); });
+    return true;
+}
+
+void OutputScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    work.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    // Nothing is left waiting for a window that will not close, nor holding a
+    // keymap's fd for a round that may never come
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!in_round) flush_written();
+    drain_producers();
+    for (auto& flow : flows) {
+        release_keymaps(flow);
+    }
+}
+
+void OutputScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        lock.unlock();
+        bool wrote = dispatch_round();
+        lock.lock();
+        if (wrote) continue;
+
+        // Nothing to write: sleep until input arrives or a held frame's bucket
+        // refills. Producers only take the lock to wake us once we are idle.
+        idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producers_pending()) {
+            idle.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        auto ready = [this]() { return queued || !running; };
+        if (wake_at == Clock::time_point::max()) {
+            work.wait(lock, ready);
+        } else {
+            work.wait_until(lock, wake_at, ready);
+        }
+        idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+DevicePair OutputScheduler::attach(const std::string& name, DevicePair devices) {
+    if (!devices) return devices;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Flow& flow = add_flow(name, devices.pointer.get(), devices.keyboard.get());
+    flow.devices = std::move(devices);
+    return stand_ins_for(flow);
+}
+
+DevicePair OutputScheduler::attach_alongside(const std::string& name, const WaylandVirtualPointer* stand_in) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto owner = std::find_if(flows.begin(), flows.end(),
+                              [&](const Flow& flow) { return flow.pointer_stand_in == stand_in; });
+    if (owner == flows.end()) return {};
+
+    return stand_ins_for(add_flow(name, owner->pointer, owner->keyboard));
+}
+
+OutputScheduler::Flow& OutputScheduler::add_flow(const std::string& name, WaylandVirtualPointer* pointer,
+                                                 WaylandVirtualKeyboard* keyboard) {
+    Flow& flow = flows.emplace_back();
+    flow.name = name;
+    flow.pointer = pointer;
+    flow.keyboard = keyboard;
+    Clock::time_point now = Clock::now();
+    flow.motion = { limits.motion_rate, limits.motion_burst, limits.motion_burst, now };
+    flow.scroll = { limits.scroll_rate, limits.scroll_burst, limits.scroll_burst, now };
+    return flow;
+}
+
+DevicePair OutputScheduler::stand_ins_for(Flow& flow) {
+    DevicePair stand_ins(std::make_unique<StandInPointer>(*this, &flow), std::make_unique<StandInKeyboard>(*this, &flow));
+    flow.pointer_stand_in = stand_ins.pointer.get();
+    return stand_ins;
+}
+
+DevicePair OutputScheduler::detach(DevicePair stand_ins, Stats* stats) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = std::find_if(flows.begin(), flows.end(),
+                           [&](const Flow& flow) { return flow.pointer_stand_in == stand_ins.pointer.get(); });
+    if (it == flows.end()) return stand_ins;
+
+    // Write out the rest without limits; the session is gone, so nothing merges into it anymore
+    Flow& flow = *it;
+    flow.detaching = true;
+    drain_producers();
+    close_batch(flow);
+    if (running) {
+        queued = true;
+        work.notify_one();
+        drained.wait(lock, [&]() { return flow.queue.empty() && !in_round; });
+    } else {
+        while (!flow.queue.empty()) {
+            lock.unlock();
+            dispatch_round();
+            lock.lock();
+        }
+        drained.wait(lock, [&]() { return !in_round; });
+    }
+
+    // Its requests may still be waiting for the flush window
+    if (flow.awaiting_flush) {
+        if (flow.wrote_pointer) flow.pointer->flush();
+        if (flow.wrote_keyboard) flow.keyboard->flush();
+        flow.wrote_pointer = flow.wrote_keyboard = false;
+        flow.awaiting_flush = false;
+        unflushed.erase(std::find(unflushed.begin(), unflushed.end(), &flow));
+        if (unflushed.empty()) {
+            flush_deadline = Clock::time_point::max();
+            urgent_written = false;
+        }
+    }
+
+    // Whatever a producer handed over since is dropped with the flow
+    drain_producers();
+    release_keymaps(flow);
+
+    if (stats) *stats = flow.stats;
+    detached.frames += flow.stats.frames;
+    detached.merged += flow.stats.merged;
+    detached.throttled += flow.stats.throttled;
+    detached.released += flow.stats.released;
+
+    DevicePair devices = std::move(flow.devices);
+    bool was_next = next_flow == it;
+    it = flows.erase(it);
+    if (was_next) next_flow = it;
+    return devices;
+}
+
+OutputScheduler::Stats OutputScheduler::totals() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats sum = detached;
+    for (const auto& flow : flows) {
+        sum.frames += flow.stats.frames;
+        sum.merged += flow.stats.merged;
+        sum.throttled += flow.stats.throttled;
+        sum.released += flow.stats.released;
+    }
+    return sum;
+}
+
+bool OutputScheduler::flush_pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // The round in progress owns the window; what it writes waits for a flush
+    return in_round || !unflushed.empty();
+}
+
+void OutputScheduler::queue(Flow* flow, const Call& call) {
+    if (producer_binding.owner == this) {
+        produce(*static_cast<Producer*>(producer_binding.producer), flow, call);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (call.request == Request::Key || call.request == Request::Modifiers || call.request == Request::Keymap) {
+        // Anything the pointer sent before this goes first
+        close_batch(*flow);
+        Batch batch;
+        batch.calls[batch.count++] = call;
+        push(*flow, batch);
+        return;
+    }
+
+    flow->open.calls[flow->open.count++] = call;
+    if (call.request == Request::Frame || flow->open.count == Batch::MAX_CALLS) {
+        close_batch(*flow);
+    }
+}
+
+void OutputScheduler::end_batch(Flow* flow) {
+    if (producer_binding.owner == this) {
+        end_batches(*static_cast<Producer*>(producer_binding.producer), flow);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    close_batch(*flow);
+}
+
+void OutputScheduler::bind_producer() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(producers.begin(), producers.end(), [](const Producer& p) { return !p.bound; });
+    Producer& producer = it != producers.end() ? *it : producers.emplace_back();
+    producer.bound = true;
+    producer.open.reserve(16);
+    producer_binding = { this, &producer };
+}
+
+void OutputScheduler::unbind_producer() {
+    if (producer_binding.owner != this) return;
+    Producer& producer = *static_cast<Producer*>(producer_binding.producer);
+    end_batches(producer, nullptr);
+    producer_binding = {};
+
+    // What is still in the ring is drained as usual; the next bind reuses it
+    std::lock_guard<std::mutex> lock(mutex);
+    producer.bound = false;
+}
+
+void OutputScheduler::end_producer_batches() {
+    if (producer_binding.owner != this) return;
+    end_batches(*static_cast<Producer*>(producer_binding.producer), nullptr);
+}
+
+// Same rules as the locked path: pointer requests gather until the frame, a key,
+// modifiers or keymap request first closes the pointer batch and goes alone
+void OutputScheduler::produce(Producer& producer, Flow* flow, const Call& call) {
+    if (call.request == Request::Key || call.request == Request::Modifiers || call.request == Request::Keymap) {
+        end_batches(producer, flow);
+        Pending entry{ flow, {} };
+        entry.batch.calls[entry.batch.count++] = call;
+        send(producer, entry);
+        return;
+    }
+
+    auto it = std::find_if(producer.open.begin(), producer.open.end(),
+                           [flow](const Pending& entry) { return entry.flow == flow; });
+    if (it == producer.open.end()) {
+        it = producer.open.insert(producer.open.end(), Pending{ flow, {} });
+    }
+    Batch& batch = it->batch;
+    batch.calls[batch.count++] = call;
+    if (call.request == Request::Frame || batch.count == Batch::MAX_CALLS) {
+        batch.kind = classify(batch);
+        send(producer, *it);
+        producer.open.erase(it);
+    }
+}
+
+// Close the producer's open batch for `flow`, or all of them
+void OutputScheduler::end_batches(Producer& producer, Flow* flow) {
+    for (auto it = producer.open.begin(); it != producer.open.end();) {
+        if (flow && it->flow != flow) {
+            ++it;
+            continue;
+        }
+        it->batch.kind = classify(it->batch);
+        send(producer, *it);
+        it = producer.open.erase(it);
+    }
+}
+
+void OutputScheduler::send(Producer& producer, const Pending& entry) {
+    // A full ring means the output thread is behind; wait for it rather than drop
+    while (!producer.ring.push(entry)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued = true;
+        }
+        work.notify_one();
+        std::this_thread::yield();
+    }
+
+    // Pairs with the fence in run(): either we see it going idle, or it sees this entry
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued = true;
+            idle.store(false, std::memory_order_relaxed);
+        }
+        work.notify_one();
+    }
+}
+
+void OutputScheduler::drain_producers() {
+    Pending entry;
+    for (auto& producer : producers) {
+        while (producer.ring.pop(entry)) {
+            push(*entry.flow, entry.batch);
+        }
+    }
+}
+
+bool OutputScheduler::producers_pending() {
+    for (const auto& producer : producers) {
+        if (!producer.ring.empty()) return true;
+    }
+    return false;
+}
+
+void OutputScheduler::close_batch(Flow& flow) {
+    if (flow.open.count == 0) return;
+    flow.open.kind = classify(flow.open);
+    push(flow, flow.open);
+    flow.open.count = 0;
+}
+
+// Producers only ever hold pointer batches open, so the flow's own open batch
+// and queue are all a keymap can be waiting in once the rings are drained
+void OutputScheduler::release_keymaps(Flow& flow) {
+    close_keymap_fds(flow.open);
+    for (Batch& batch : flow.queue) {
+        close_keymap_fds(batch);
+    }
+}
+
+void OutputScheduler::push(Flow& flow, const Batch& batch) {
+    // Nothing at the tail of the queue has been written yet, so folding into it
+    // keeps the order
+    if (!flow.queue.empty() && mergeable(flow.queue.back(), batch)) {
+        merge(flow.queue.back(), batch);
+        flow.stats.merged++;
+    } else {
+        flow.queue.push_back(batch);
+    }
+    queued = true;
+    work.notify_one();
+}
+
+bool OutputScheduler::dispatch_round() {
+    Clock::time_point now;
+    size_t active_flows = 0;
+    bool window_ended;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (in_round) return false;
+        drain_producers();
+        queued = false;
+        wake_at = Clock::time_point::max();
+        if (flows.empty()) return false;
+
+        // Start each round one flow further along so no flow is always first
+        if (next_flow == flows.end()) next_flow = flows.begin();
+        now = Clock::now();
+        auto it = next_flow;
+        for (size_t i = 0; i < flows.size(); i++) {
+            collect(*it, now);
+            if (now - it->last_written < ACTIVE_SPAN) active_flows++;
+            if (++it == flows.end()) it = flows.begin();
+        }
+        ++next_flow;
+
+        window_ended = !unflushed.empty() && now >= flush_deadline;
+        if (pending.empty() && !window_ended) {
+            if (!unflushed.empty()) wake_at = std::min(wake_at, flush_deadline);
+            return false;
+        }
+        in_round = true;
+    }
+
+    // Written without the lock so sessions keep queueing meanwhile; detach()
+    // waits for the round to end before a flow goes away
+    for (const auto& entry : pending) {
+        write(entry);
+        if (!entry.flow->awaiting_flush) {
+            entry.flow->awaiting_flush = true;
+            unflushed.push_back(entry.flow);
+        }
+    }
+    pending.clear();
+
+    if (flush_now(active_flows, window_ended)) {
+        flush_written();
+    } else if (flush_deadline == Clock::time_point::max()) {
+        flush_deadline = now + limits.flush_window;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_round = false;
+        if (!unflushed.empty()) wake_at = std::min(wake_at, flush_deadline);
+    }
+    drained.notify_all();
+    return true;
+}
+
+// Whether the round just written goes out now or waits for more sessions'
+// frames to join it
+bool OutputScheduler::flush_now(size_t active_flows, bool window_ended) const {
+    if (window_ended || limits.flush_window.count() <= 0 || urgent_written) return true;
+    // Everyone who has been sending lately is in this flush already
+    return active_flows <= 1 || unflushed.size() >= active_flows;
+}
+
+void OutputScheduler::flush_written() {
+    for (Flow* flow : unflushed) {
+        if (flow->wrote_pointer) flow->pointer->flush();
+        if (flow->wrote_keyboard) flow->keyboard->flush();
+        flow->wrote_pointer = flow->wrote_keyboard = false;
+        flow->awaiting_flush = false;
+    }
+    unflushed.clear();
+    flush_deadline = Clock::time_point::max();
+    urgent_written = false;
+}
+
+void OutputScheduler::collect(Flow& flow, Clock::time_point now) {
+    if (flow.queue.empty()) {
+        flow.deficit = 0;
+        return;
+    }
+
+    // Credit a held head leaves unused is not saved up: released after a long
+    // hold, the flow still gets one quantum per round
+    flow.deficit = std::min<int64_t>(flow.deficit + limits.quantum, limits.quantum);
+    while (flow.deficit > 0 && !flow.queue.empty()) {
+        Batch& head = flow.queue.front();
+        if (head.kind != Batch::OTHER && !flow.detaching) {
+            TokenBucket& bucket = head.kind == Batch::MOTION ? flow.motion : flow.scroll;
+            if (!bucket.take(now)) {
+                bool exempt_behind = std::any_of(flow.queue.begin() + 1, flow.queue.end(),
+                                                 [](const Batch& batch) { return batch.kind == Batch::OTHER; });
+                if (!exempt_behind) {
+                    if (!head.held) {
+                        head.held = true;
+                        flow.stats.throttled++;
+                        PROBE2(throttled, flow.name.c_str(), head.kind);
+                        DEBUG_LOG("⏳ " << flow.name << ": " << (head.kind == Batch::MOTION ? "motion" : "scroll")
+                                  << " over its rate, merging until the next token");
+                    }
+                    wake_at = std::min(wake_at, now + bucket.until_next());
+                    break;
+                }
+                // Running into debt here is repaid before the next limited frame
+                bucket.tokens = std::max(bucket.tokens - 1, -bucket.burst);
+                flow.stats.released++;
+            }
+        }
+        pending.push_back({ &flow, head });
+        flow.last_written = now;
+        flow.queue.pop_front();
+        flow.deficit--;
+        flow.stats.frames++;
+    }
+    if (flow.queue.empty()) {
+        flow.deficit = 0;
+    }
+}
+
+void OutputScheduler::write(const Pending& entry) {
+    Flow& flow = *entry.flow;
+    WaylandVirtualPointer* pointer = flow.pointer;
+    WaylandVirtualKeyboard* keyboard = flow.keyboard;
+
+    for (size_t i = 0; i < entry.batch.count; i++) {
+        const Call& call = entry.batch.calls[i];
+        const uint32_t* a = call.args;
+        switch (call.request) {
+            case Request::Motion:
+                pointer->emit_motion(call.time, wl_fixed_t(a[0]), wl_fixed_t(a[1]));
+                break;
+            case Request::MotionAbsolute:
+                pointer->emit_motion_absolute(call.time, a[0], a[1], a[2], a[3]);
+                break;
+            case Request::Button:
+                pointer->emit_button(call.time, a[0], a[1]);
+                urgent_written = true;
+                break;
+            case Request::Axis:
+                pointer->emit_axis(call.time, a[0], wl_fixed_t(a[1]));
+                break;
+            case Request::AxisSource:
+                pointer->emit_axis_source(a[0]);
+                break;
+            case Request::AxisDiscrete:
+                pointer->emit_axis_discrete(call.time, a[0], wl_fixed_t(a[1]), int32_t(a[2]));
+                break;
+            case Request::AxisStop:
+                pointer->emit_axis_stop(call.time, a[0]);
+                break;
+            case Request::Frame:
+                pointer->emit_frame();
+                break;
+            case Request::Key:
+                keyboard->emit_key(call.time, a[0], a[1]);
+                flow.wrote_keyboard = true;
+                urgent_written = true;
+                continue;
+            case Request::Modifiers:
+                keyboard->emit_modifiers(a[0], a[1], a[2], a[3]);
+                flow.wrote_keyboard = true;
+                continue;
+            case Request::Keymap:
+                if (int(a[0]) < 0) continue;
+                keyboard->emit_keymap(int(a[0]), a[1]);
+                close(int(a[0]));
+                flow.wrote_keyboard = true;
+                continue;
+        }
+        flow.wrote_pointer = true;
+    }
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "output_backend.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The output stage shared by every session. attach() swaps a session's device
+// pair for stand-ins whose wire-level requests are queued per session (a flow)
+// instead of written; one output thread then writes them to the real devices,
+// taking up to `quantum` frames from each flow per round (deficit round-robin),
+// so a flooding client cannot starve the others or local input.
+//
+// Pointer motion and scroll frames are further limited by a per-flow token
+// bucket. A frame that finds the bucket empty is held, and newer frames of the
+// same kind merge into it (relative deltas and scroll values summed, absolute
+// positions replaced), so excess input is coalesced rather than dropped. Keys,
+// buttons and modifiers are never limited; a held frame queued ahead of one is
+// released with it to keep the order.
+//
+// With a flush window, the flush after a round is held back so frames other
+// sessions send shortly after share one compositor wakeup: written requests
+// stay in the connection buffer until every recently active session has had
+// something written, a key or button goes out, or the window runs out. With one
+// active session there is nothing to wait for and every round flushes.
+//
+// Requests made on a thread that called bind_producer() skip the lock: they are
+// assembled into frames on that thread and handed to the output thread through
+// the thread's own SPSC ring, in order.
+class OutputScheduler {
+public:
+    // Rates are frames per second per flow; 0 disables the limit
+    struct Limits {
+        double motion_rate = 0;
+        double motion_burst = 1;
+        double scroll_rate = 0;
+        double scroll_burst = 1;
+        uint32_t quantum = 32;
+        // Longest a written frame waits for its flush; 0 flushes every round
+        std::chrono::microseconds flush_window{0};
+    };
+
+    struct Stats {
+        uint64_t frames = 0;    // written to the real devices
+        uint64_t merged = 0;    // folded into a queued frame
+        uint64_t throttled = 0; // held back by the token bucket
+        uint64_t released = 0;  // held, then let through ahead of a key or button
+    };
+
+    explicit OutputScheduler(const Limits& limits);
+    ~OutputScheduler();
+
+    OutputScheduler(const OutputScheduler&) = delete;
+    OutputScheduler& operator=(const OutputScheduler&) = delete;
+
+    bool start();
+    // Stop the output thread; keymaps still queued have their fds closed and
+    // are skipped if a later detach() writes out the rest
+    void stop();
+
+    // Take `devices` over as a new flow named `name` and return the stand-ins to
+    // use in their place; an empty pair is returned as is
+    DevicePair attach(const std::string& name, DevicePair devices);
+
+    // A new flow named `name` that writes to the real devices of the flow behind
+    // `stand_in`, with its own open frame, buckets and share of each round, so
+    // sessions sharing one device pair cannot split each other's frames. Empty if
+    // there is no such flow; detach it before the flow it writes alongside.
+    DevicePair attach_alongside(const std::string& name, const WaylandVirtualPointer* stand_in);
+
+    // Write out what is still queued for the flow behind `stand_ins` and hand
+    // back its real devices (none for a flow attached alongside another), with
+    // the flow's counters in `stats` if given
+    DevicePair detach(DevicePair stand_ins, Stats* stats = nullptr);
+
+    // Run one round over all flows on the calling thread; false if nothing was
+    // written. The output thread does this; tests without it call it directly.
+    bool dispatch_round();
+
+    // Counters summed over live and detached flows
+    Stats totals();
+
+    // Whether written requests are waiting for the flush window to close (always
+    // while a round is being written)
+    bool flush_pending();
+
+    // Give the calling thread a ring of its own for the requests it makes, until
+    // unbind_producer() on the same thread. For long-lived threads that each own
+    // a fixed set of sessions (see EisWorkers); the output thread must be running.
+    void bind_producer();
+    void unbind_producer();
+
+    // Hand over the calling producer thread's unfinished frames, e.g. once it has
+    // read everything a client sent, so none is left open when a session goes away
+    void end_producer_batches();
+
+    // One wire-level request, arguments as the emit_* hooks take them; a
+    // keymap's fd is a duplicate owned by the call until it is written
+    enum class Request : uint8_t {
+        Motion, MotionAbsolute, Button, Axis, AxisSource, AxisDiscrete, AxisStop, Frame,
+        Key, Modifiers, Keymap,
+    };
+
+    struct Call {
+        Request request;
+        uint32_t time;
+        uint32_t args[5];
+    };
+
+    // The requests up to and including a pointer frame, or a single key,
+    // modifiers or keymap request
+    struct Batch {
+        enum Kind : uint8_t { MOTION, SCROLL, OTHER };
+        static const size_t MAX_CALLS = 8;
+
+        Kind kind = OTHER;
+        bool held = false;
+        uint8_t count = 0;
+        Call calls[MAX_CALLS];
+    };
+
+    struct Flow;
+
+    // Called by the stand-in devices: add a request to the flow's open batch,
+    // and close the batch on a flush so nothing sent before it waits for a frame
+    void queue(Flow* flow, const Call& call);
+    void end_batch(Flow* flow);
+
+private:
+    struct TokenBucket {
+        double rate = 0;
+        double burst = 1;
+        double tokens = 1;
+        std::chrono::steady_clock::time_point updated;
+
+        bool take(std::chrono::steady_clock::time_point now);
+        std::chrono::steady_clock::duration until_next() const;
+    };
+
+    struct Pending {
+        Flow* flow;
+        Batch batch;
+    };
+
+    struct Producer {
+        SpscRing<Pending, 1024> ring;
+        std::vector<Pending> open; // one unfinished pointer batch per flow
+        bool bound = false;
+    };
+
+    Limits limits;
+    std::mutex mutex;
+    std::condition_variable work;
+    std::condition_variable drained;
+    std::list<Flow> flows;
+    std::list<Flow>::iterator next_flow;
+    std::vector<Pending> pending;
+    std::list<Producer> producers;
+    std::atomic<bool> idle{false};
+    bool queued = false;
+    bool in_round = false;
+    bool running = false;
+    std::chrono::steady_clock::time_point wake_at;
+    std::thread thread;
+    Stats detached;
+
+    // The open flush window: flows written since the last flush, when the window
+    // ends and whether a key or button is among them. Touched by whoever runs
+    // the round, or under the lock between rounds.
+    std::vector<Flow*> unflushed;
+    std::chrono::steady_clock::time_point flush_deadline;
+    bool urgent_written = false;
+
+    void run();
+    Flow& add_flow(const std::string& name, WaylandVirtualPointer* pointer, WaylandVirtualKeyboard* keyboard);
+    DevicePair stand_ins_for(Flow& flow);
+    void close_batch(Flow& flow);
+    void release_keymaps(Flow& flow);
+    void push(Flow& flow, const Batch& batch);
+    void produce(Producer& producer, Flow* flow, const Call& call);
+    void send(Producer& producer, const Pending& entry);
+    void end_batches(Producer& producer, Flow* flow);
+    void drain_producers();
+    bool producers_pending();
+    void collect(Flow& flow, std::chrono::steady_clock::time_point now);
+    void write(const Pending& entry);
+    bool flush_now(size_t active_flows, bool window_ended) const;
+    void flush_written();
+};
@@ -0,0 +1,304 @@
+#include "pipewire_stream.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <spa/buffer/meta.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/pod/builder.h>
+
+extern "C" {
+#include <wayland-client-protocol.h>
+}
+
+namespace {
+// Buffers in a stream's pool: one being filled, the rest with the consumer
+constexpr int MIN_BUFFERS = 2;
+constexpr int MAX_BUFFERS = 8;
+// Damage rectangles carried per buffer; more are merged into their bounds
+constexpr uint32_t MAX_DAMAGE_META = 16;
+
+// wl_shm names formats by their little-endian word, SPA by their bytes in memory
+uint32_t spa_format(uint32_t shm_format) {
+    switch (shm_format) {
+        case WL_SHM_FORMAT_ARGB8888: return SPA_VIDEO_FORMAT_BGRA;
+        case WL_SHM_FORMAT_XRGB8888: return SPA_VIDEO_FORMAT_BGRx;
+        case WL_SHM_FORMAT_ABGR8888: return SPA_VIDEO_FORMAT_RGBA;
+        case WL_SHM_FORMAT_XBGR8888: return SPA_VIDEO_FORMAT_RGBx;
+        case WL_SHM_FORMAT_RGBA8888: return SPA_VIDEO_FORMAT_ABGR;
+        case WL_SHM_FORMAT_RGBX8888: return SPA_VIDEO_FORMAT_xBGR;
+        case WL_SHM_FORMAT_BGRA8888: return SPA_VIDEO_FORMAT_ARGB;
+        case WL_SHM_FORMAT_BGRX8888: return SPA_VIDEO_FORMAT_xRGB;
+        default: return SPA_VIDEO_FORMAT_UNKNOWN;
+    }
+}
+
+// Frames only come when the output changes, so the rate is variable
+const struct spa_pod* format_param(struct spa_pod_builder* builder, uint32_t video_format, const FrameFormat& format) {
+    struct spa_rectangle size = SPA_RECTANGLE(format.width, format.height);
+    struct spa_fraction rate = SPA_FRACTION(0, 1);
+    struct spa_fraction max_rate = SPA_FRACTION(60, 1);
+    struct spa_fraction min_rate = SPA_FRACTION(1, 1);
+    struct spa_fraction top_rate = SPA_FRACTION(360, 1);
+    return static_cast<const struct spa_pod*>(spa_pod_builder_add_object(builder,
+        SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+        SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+        SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+        SPA_FORMAT_VIDEO_format, SPA_POD_Id(video_format),
+        SPA_FORMAT_VIDEO_size, SPA_POD_Rectangle(&size),
+        SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&rate),
+        SPA_FORMAT_VIDEO_maxFramerate, SPA_POD_CHOICE_RANGE_Fraction(&max_rate, &min_rate, &top_rate)));
+}
+} // namespace
+
+PipeWire::~PipeWire() {
+    cleanup();
+}
+
+bool PipeWire::init() {
+    pw_init(nullptr, nullptr);
+
+    loop = pw_thread_loop_new("hypr-remote-pw", nullptr);
+    if (!loop) {
+        std::cerr << "❌ Failed to create PipeWire loop" << std::endl;
+        return false;
+    }
+    context = pw_context_new(pw_thread_loop_get_loop(loop), nullptr, 0);
+    if (!context || pw_thread_loop_start(loop) < 0) {
+        std::cerr << "❌ Failed to start PipeWire loop" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    pw_thread_loop_lock(loop);
+    core = pw_context_connect(context, nullptr, 0);
+    pw_thread_loop_unlock(loop);
+    if (!core) {
+        std::cerr << "❌ Failed to connect to PipeWire (is it running?)" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    std::cout << "✓ Connected to PipeWire" << std::endl;
+    return true;
+}
+
+void PipeWire::cleanup() {
+    if (!loop) return;
+
+    if (core) {
+        pw_thread_loop_lock(loop);
+        pw_core_disconnect(core);
+        pw_thread_loop_unlock(loop);
+        core = nullptr;
+    }
+    pw_thread_loop_stop(loop);
+    if (context) {
+        pw_context_destroy(context);
+        context = nullptr;
+    }
+    pw_thread_loop_destroy(loop);
+    loop = nullptr;
+    pw_deinit();
+}
+
+std::unique_ptr<FrameSink> PipeWire::create_sink(const std::string& name) {
+    if (!core) return nullptr;
+    return std::make_unique<PipeWireSink>(*this, name);
+}
+
+const struct pw_stream_events PipeWireSink::stream_events = [] {
+    struct pw_stream_events events = {};
+    events.version = PW_VERSION_STREAM_EVENTS;
+    events.state_changed = [](void* data, enum pw_stream_state, enum pw_stream_state state, const char* error) {
+        static_cast<PipeWireSink*>(data)->state_changed(state, error);
+    };
+    events.param_changed = [](void* data, uint32_t id, const struct spa_pod* param) {
+        if (id == SPA_PARAM_Format) static_cast<PipeWireSink*>(data)->format_changed(param);
+    };
+    events.add_buffer = [](void* data, struct pw_buffer* buffer) {
+        static_cast<PipeWireSink*>(data)->held[buffer] = 0;
+    };
+    events.remove_buffer = [](void* data, struct pw_buffer* buffer) {
+        static_cast<PipeWireSink*>(data)->held.erase(buffer);
+    };
+    return events;
+}();
+
+PipeWireSink::PipeWireSink(PipeWire& pipewire, std::string name)
+    : pipewire(pipewire), name(std::move(name)) {}
+
+PipeWireSink::~PipeWireSink() {
+    if (!stream) return;
+    pw_thread_loop_lock(pipewire.loop);
+    pw_stream_destroy(stream);
+    pw_thread_loop_unlock(pipewire.loop);
+}
+
+bool PipeWireSink::configure(const FrameFormat& frame_format) {
+    uint32_t wanted = spa_format(frame_format.shm_format);
+    if (wanted == SPA_VIDEO_FORMAT_UNKNOWN) {
+        std::cerr << "❌ " << name << ": no PipeWire format for wl_shm format 0x"
+                  << std::hex << frame_format.shm_format << std::dec << std::endl;
+        return false;
+    }
+
+    uint8_t storage[1024];
+    struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(storage, sizeof(storage));
+
+    pw_thread_loop_lock(pipewire.loop);
+    format = frame_format;
+    video_format = wanted;
+    const struct spa_pod* params[] = { format_param(&builder, video_format, format) };
+
+    bool ok = true;
+    if (stream) {
+        // Renegotiate; buffers of the old size go away through remove_buffer
+        pw_stream_update_params(stream, params, 1);
+    } else {
+        stream = pw_stream_new(pipewire.core, ("hypr-remote " + name).c_str(),
+                               pw_properties_new(PW_KEY_MEDIA_CLASS, "Video/Source", nullptr));
+        if (stream) {
+            pw_stream_add_listener(stream, &listener, &stream_events, this);
+            auto flags = static_cast<enum pw_stream_flags>(
+                PW_STREAM_FLAG_DRIVER | PW_STREAM_FLAG_MAP_BUFFERS | PW_STREAM_FLAG_ALLOC_BUFFERS);
+            ok = pw_stream_connect(stream, PW_DIRECTION_OUTPUT, PW_ID_ANY, flags, params, 1) >= 0;
+        } else {
+            ok = false;
+        }
+    }
+    pw_thread_loop_unlock(pipewire.loop);
+
+    if (!ok) std::cerr << "❌ Failed to create PipeWire stream for " << name << std::endl;
+    return ok;
+}
+
+void PipeWireSink::format_changed(const struct spa_pod* param) {
+    if (!param) return;
+
+    uint8_t storage[1024];
+    struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(storage, sizeof(storage));
+    int32_t size = static_cast<int32_t>(format.stride * format.height);
+
+    const struct spa_pod* params[3];
+    params[0] = static_cast<const struct spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+        SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(MIN_BUFFERS + 1, MIN_BUFFERS, MAX_BUFFERS),
+        SPA_PARAM_BUFFERS_blocks, SPA_POD_Int(1),
+        SPA_PARAM_BUFFERS_size, SPA_POD_Int(size),
+        SPA_PARAM_BUFFERS_stride, SPA_POD_Int(static_cast<int32_t>(format.stride)),
+        SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(1 << SPA_DATA_MemFd)));
+    params[1] = static_cast<const struct spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+        SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header))));
+    params[2] = static_cast<const struct spa_pod*>(spa_pod_builder_add_object(&builder,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+            sizeof(struct spa_meta_region) * MAX_DAMAGE_META,
+            sizeof(struct spa_meta_region),
+            sizeof(struct spa_meta_region) * MAX_DAMAGE_META)));
+
+    pw_stream_update_params(stream, params, 3);
+}
+
+void PipeWireSink::state_changed(enum pw_stream_state state, const char* error) {
+    streaming = state == PW_STREAM_STATE_STREAMING;
+    if (state == PW_STREAM_STATE_ERROR) {
+        std::cerr << "❌ PipeWire stream for " << name << " failed: " << (error ? error : "unknown") << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(node_mutex);
+    if (state == PW_STREAM_STATE_ERROR) {
+        failed = true;
+    } else if (!node && state >= PW_STREAM_STATE_PAUSED) {
+        node = pw_stream_get_node_id(stream);
+        std::cout << "📺 " << name << " is PipeWire node " << node << std::endl;
+    }
+    node_ready.notify_all();
+}
+
+uint32_t PipeWireSink::stream_node(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(node_mutex);
+    node_ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return node || failed; });
+    return failed ? 0 : node;
+}
+
+void PipeWireSink::deliver(const CaptureFrame& frame) {
+    history.add(frame);
+
+    pw_thread_loop_lock(pipewire.loop);
+    // Nobody is watching, or the consumer holds every buffer: this frame is
+    // skipped, and its damage stays in the history for the next one
+    struct pw_buffer* buffer = streaming ? pw_stream_dequeue_buffer(stream) : nullptr;
+    if (!buffer) {
+        pw_thread_loop_unlock(pipewire.loop);
+        return;
+    }
+
+    struct spa_buffer* spa = buffer->buffer;
+    struct spa_data& data = spa->datas[0];
+    if (!data.data || data.maxsize < format.stride * format.height) {
+        pw_stream_queue_buffer(stream, buffer);
+        pw_thread_loop_unlock(pipewire.loop);
+        return;
+    }
+
+    uint64_t& last = held[buffer];
+    history.since(last, regions);
+    copy_regions(frame, regions, static_cast<uint8_t*>(data.data), format.stride);
+    last = frame.sequence;
+
+    data.chunk->offset = 0;
+    data.chunk->size = format.stride * format.height;
+    data.chunk->stride = static_cast<int32_t>(format.stride);
+    data.chunk->flags = SPA_CHUNK_FLAG_NONE;
+
+    auto* header = static_cast<struct spa_meta_header*>(
+        spa_buffer_find_meta_data(spa, SPA_META_Header, sizeof(struct spa_meta_header)));
+    if (header) {
+        header->flags = 0;
+        header->offset = 0;
+        header->pts = static_cast<int64_t>(frame.time_ns);
+        header->dts_offset = 0;
+        header->seq = frame.sequence;
+    }
+
+    // The consumer's view: what changed since the buffer it got before this one
+    struct spa_meta* damage = spa_buffer_find_meta(spa, SPA_META_VideoDamage);
+    if (damage) {
+        history.since(queued, regions);
+        auto* first = static_cast<struct spa_meta_region*>(damage->data);
+        uint32_t room = damage->size / sizeof(struct spa_meta_region);
+        uint32_t count = 0;
+        if (regions.size() < room) {
+            for (const DamageRect& rect : regions) {
+                first[count++].region = SPA_REGION(static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y),
+                                                   rect.width, rect.height);
+            }
+        } else if (room > 0) {
+            uint32_t x1 = format.width, y1 = format.height, x2 = 0, y2 = 0;
+            for (const DamageRect& rect : regions) {
+                x1 = std::min(x1, rect.x);
+                y1 = std::min(y1, rect.y);
+                x2 = std::max(x2, rect.x + rect.width);
+                y2 = std::max(y2, rect.y + rect.height);
+            }
+            first[count++].region = SPA_REGION(static_cast<int32_t>(x1), static_cast<int32_t>(y1), x2 - x1, y2 - y1);
+        }
+        // A zero-sized region ends the list
+        if (count < room) first[count].region = SPA_REGION(0, 0, 0, 0);
+    }
+    queued = frame.sequence;
+
+    pw_stream_queue_buffer(stream, buffer);
+    pw_stream_trigger_process(stream);
+    pw_thread_loop_unlock(pipewire.loop);
+}
+
+void PipeWireSink::end() {
+    std::cout << "📺 Capture of " << name << " ended" << std::endl;
+    pw_thread_loop_lock(pipewire.loop);
+    if (stream) pw_stream_set_active(stream, false);
+    pw_thread_loop_unlock(pipewire.loop);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "frame_sink.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pipewire/pipewire.h>
+
+// The portal's PipeWire connection: one thread loop and core shared by every
+// ScreenCast stream. Only built with libpipewire (HAVE_PIPEWIRE).
+class PipeWire {
+public:
+    PipeWire() = default;
+    ~PipeWire();
+
+    PipeWire(const PipeWire&) = delete;
+    PipeWire& operator=(const PipeWire&) = delete;
+
+    bool init();
+    void cleanup();
+
+    // A video source stream for the capture of `name`, set up by its first frame
+    std::unique_ptr<FrameSink> create_sink(const std::string& name);
+
+private:
+    friend class PipeWireSink;
+
+    struct pw_thread_loop* loop = nullptr;
+    struct pw_context* context = nullptr;
+    struct pw_core* core = nullptr;
+};
+
+// One capture as a PipeWire Video/Source node. Each frame goes into the next
+// free buffer of the stream's pool, copying only what changed since that
+// buffer last held a frame, and carries the damage since the previous buffer
+// as SPA_META_VideoDamage.
+class PipeWireSink : public FrameSink {
+public:
+    PipeWireSink(PipeWire& pipewire, std::string name);
+    ~PipeWireSink() override;
+
+    bool configure(const FrameFormat& format) override;
+    void deliver(const CaptureFrame& frame) override;
+    void end() override;
+    uint32_t stream_node(int timeout_ms) override;
+
+private:
+    PipeWire& pipewire;
+    std::string name;
+
+    // Under the thread loop's lock
+    struct pw_stream* stream = nullptr;
+    struct spa_hook listener = {};
+    FrameFormat format;
+    uint32_t video_format = 0;
+    bool streaming = false;
+    std::unordered_map<struct pw_buffer*, uint64_t> held; // frame each buffer last got
+
+    // Capture thread only
+    DamageHistory history;
+    std::vector<DamageRect> regions;
+    uint64_t queued = 0; // last frame handed to the consumer
+
+    std::mutex node_mutex;
+    std::condition_variable node_ready;
+    uint32_t node = 0;
+    bool failed = false;
+
+    static const struct pw_stream_events stream_events;
+    void state_changed(enum pw_stream_state state, const char* error);
+    void format_changed(const struct spa_pod* param);
+};
@@ -1,20 +1,30 @@
 #include "portal.h"
+#include "clipboard.h"
 #include "libei_handler.h"
+#include "device_pool.h"
+#include "output_scheduler.h"
+#include "request.h"
+#include "restore_store.h"
+#include "screencopy.h"
+#include "session.h"
+#include "shared_ring.h"
+#include "translator.h"
+#include "ei_forwarder.h"
+#include "flight_recorder.h"
+#include "input_transform.h"
+#include "debug_log.h"
+#include "probes.h"
 #include "wayland_virtual_keyboard.h"
 #include "wayland_virtual_pointer.h"
+#include "xkb.h"
 #include <iostream>
-#include <thread>
-#include <chrono>
+#include <algorithm>
 #include <cstring>
 #include <cerrno>
+#include <ctime>
 #include <unistd.h>
-#include <sys/select.h>
-#include <sys/socket.h>
-#include <sys/un.h>
 #include <poll.h>
-#include <algorithm>
-#include <sys/mman.h>
-#include <fcntl.h>
+#include <sys/eventfd.h>
 
 extern "C" {
 #include <libei.h>
@@ -23,12 +33,52 @@ extern "C" {
 }
 
 static const char* PORTAL_INTERFACE = "org.freedesktop.impl.portal.RemoteDesktop";
+static const char* SCREENCAST_INTERFACE = "org.freedesktop.impl.portal.ScreenCast";
+static const char* CLIPBOARD_INTERFACE = "org.freedesktop.impl.portal.Clipboard";
+static const char* DIAGNOSTICS_INTERFACE = "org.freedesktop.impl.portal.desktop.hypr_remote.Diagnostics";
 static const char* PORTAL_PATH = "/org/freedesktop/portal/desktop";
 
+// ScreenCast source types and cursor modes (bitmasks in the portal API)
+static constexpr uint32_t SOURCE_MONITOR = 1;
+static constexpr uint32_t CURSOR_HIDDEN = 1;
+static constexpr uint32_t CURSOR_EMBEDDED = 2;
+// How long Start waits for a capture's first frame to bring up its stream
+static constexpr int STREAM_TIMEOUT_MS = 2000;
+// How often a flow waiting on the control thread checks whether it can go on
+static constexpr int CONTROL_POLL_MS = 5;
+
+// Request responses
+static constexpr uint32_t RESPONSE_SUCCESS = 0;
+static constexpr uint32_t RESPONSE_FAILED = 1;
+static constexpr uint32_t RESPONSE_ENDED = 2;  // the request was closed
+
+// Answer a method made under a Request: its response code and results
+static void send_response(sdbus::MethodCall& call, uint32_t response,
+                          const std::map<std::string, sdbus::Variant>& results = {}) {
+    auto reply = call.createReply();
+    reply << response;
+    reply << results;
+    reply.send();
+}
+
+// What a flow that failed answers (see Portal::exit_on_bus): a Request's
+// response, or an error for methods made without one
+static std::function<void()> fail_response(sdbus::MethodCall& call) {
+    return [&call]() { send_response(call, RESPONSE_FAILED); };
+}
+
+static std::function<void()> fail_error(sdbus::MethodCall& call) {
+    return [&call]() { call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Request failed")).send(); };
+}
+
 // Use development name if requested, otherwise use standard name
 static const char* PORTAL_NAME = "org.freedesktop.impl.portal.desktop.hypr-remote";
 
 Portal::Portal() : libei_handler(nullptr), running(false) {
+    input_queue.reserve(1024);
+    queued_targets.reserve(16);
+    shared_input.transform = &shared_transform;
+    shared_input.device_lock = &shared_devices_lock;
 }
 
 Portal::~Portal() {
@@ -36,7 +86,13 @@ Portal::~Portal() {
 }
 
 bool Portal::init(LibEIHandler* handler) {
-    libei_handler = handler;
+    set_libei_handler(handler);
+    
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        std::cerr << "Failed to create portal eventfd: " << strerror(errno) << std::endl;
+        return false;
+    }
     
     try {
         // Create D-Bus connection to SESSION bus (not system bus)
@@ -57,9 +113,6 @@ bool Portal::init(LibEIHandler* handler) {
         object->registerMethod(PORTAL_INTERFACE, "CreateSession", "oosa{sv}", "ua{sv}", 
                               [this](sdbus::MethodCall call) { CreateSession(std::move(call)); });
         
-        /* object->registerMethod(PORTAL_INTERFACE, "SelectSources", "oosa{sv}", "ua{sv}", 
-                              [this](sdbus::MethodCall call) { SelectSources(std::move(call)); }); */
-        
         object->registerMethod(PORTAL_INTERFACE, "SelectDevices", "oosa{sv}", "ua{sv}", 
                               [this](sdbus::MethodCall call) { SelectDevices(std::move(call)); });
         
@@ -85,7 +138,61 @@ bool Portal::init(LibEIHandler* handler) {
         // Modern EIS (Emulated Input Server) method - this is what deskflow actually uses!
         object->registerMethod(PORTAL_INTERFACE, "ConnectToEIS", "osa{sv}", "h", 
                               [this](sdbus::MethodCall call) { ConnectToEIS(std::move(call)); });
+        if (shared_ring_enabled) {
+            object->registerMethod(PORTAL_INTERFACE, "ConnectToSharedRing", "osa{sv}", "hh",
+                                  [this](sdbus::MethodCall call) { ConnectToSharedRing(std::move(call)); });
+        }
         object->registerProperty(PORTAL_INTERFACE, "version", "u", [](sdbus::PropertyGetReply& reply) -> void { reply << (uint)2; });
+        
+        // ScreenCast of whole monitors, when there is something to capture with
+        if (screencopy && sink_factory) {
+            object->registerMethod(SCREENCAST_INTERFACE, "CreateSession", "oosa{sv}", "ua{sv}",
+                                  [this](sdbus::MethodCall call) { CreateSession(std::move(call)); });
+            object->registerMethod(SCREENCAST_INTERFACE, "SelectSources", "oosa{sv}", "ua{sv}",
+                                  [this](sdbus::MethodCall call) { SelectSources(std::move(call)); });
+            object->registerMethod(SCREENCAST_INTERFACE, "Start", "oossa{sv}", "ua{sv}",
+                                  [this](sdbus::MethodCall call) { StartScreenCast(std::move(call)); });
+            object->registerProperty(SCREENCAST_INTERFACE, "AvailableSourceTypes", "u",
+                                    [](sdbus::PropertyGetReply& reply) -> void { reply << SOURCE_MONITOR; });
+            object->registerProperty(SCREENCAST_INTERFACE, "AvailableCursorModes", "u",
+                                    [](sdbus::PropertyGetReply& reply) -> void { reply << (CURSOR_HIDDEN | CURSOR_EMBEDDED); });
+            object->registerProperty(SCREENCAST_INTERFACE, "version", "u", [](sdbus::PropertyGetReply& reply) -> void { reply << (uint)2; });
+            std::cout << "Portal interface: " << SCREENCAST_INTERFACE << std::endl;
+        }
+        // Clipboard of the compositor's seat, for sessions that ask before Start
+        if (clipboard) {
+            object->registerMethod(CLIPBOARD_INTERFACE, "RequestClipboard", "oa{sv}", "",
+                                  [this](sdbus::MethodCall call) { RequestClipboard(std::move(call)); });
+            object->registerMethod(CLIPBOARD_INTERFACE, "SetSelection", "oa{sv}", "",
+                                  [this](sdbus::MethodCall call) { SetSelection(std::move(call)); });
+            object->registerMethod(CLIPBOARD_INTERFACE, "SelectionWrite", "ou", "h",
+                                  [this](sdbus::MethodCall call) { SelectionWrite(std::move(call)); });
+            object->registerMethod(CLIPBOARD_INTERFACE, "SelectionWriteDone", "oub", "",
+                                  [this](sdbus::MethodCall call) { SelectionWriteDone(std::move(call)); });
+            object->registerMethod(CLIPBOARD_INTERFACE, "SelectionRead", "os", "h",
+                                  [this](sdbus::MethodCall call) { SelectionRead(std::move(call)); });
+            object->registerSignal(CLIPBOARD_INTERFACE, "SelectionOwnerChanged", "oa{sv}");
+            object->registerSignal(CLIPBOARD_INTERFACE, "SelectionTransfer", "osu");
+            object->registerProperty(CLIPBOARD_INTERFACE, "version", "u", [](sdbus::PropertyGetReply& reply) -> void { reply << (uint)1; });
+            
+            // Both arrive on the clipboard thread; signals go out from this one
+            clipboard->set_handlers(
+                [this](const std::vector<std::string>& mime_types, const std::string& owner) {
+                    post_completion([this, mime_types, owner]() { emit_selection_owner_changed(mime_types, owner); });
+                },
+                [this](const std::string& owner, const std::string& mime_type, uint32_t serial) {
+                    post_completion([this, owner, mime_type, serial]() { emit_selection_transfer(owner, mime_type, serial); });
+                });
+            std::cout << "Portal interface: " << CLIPBOARD_INTERFACE << std::endl;
+        }
+        if (!flight_dump_directory.empty()) {
+            object->registerMethod(DIAGNOSTICS_INTERFACE, "DumpFlightRecorder", "", "s",
+                                  [this](sdbus::MethodCall call) { DumpFlightRecorder(std::move(call)); });
+        }
+        if (output_scheduler) {
+            object->registerMethod(DIAGNOSTICS_INTERFACE, "OutputStats", "", "a{st}",
+                                  [this](sdbus::MethodCall call) { OutputStats(std::move(call)); });
+        }
         // Finalize the object
         object->finishRegistration();
         
@@ -103,6 +210,28 @@ bool Portal::init(LibEIHandler* handler) {
 
 void Portal::cleanup() {
     running = false;
+    stop_control();
+    
+    // The clipboard outlives us and must not call back into a portal that is gone
+    if (clipboard) {
+        clipboard->set_handlers(nullptr, nullptr);
+    }
+    
+    // Flows still queued answer as failed if they must, and are freed
+    completions.clear();
+    exported.clear();
+    clipboard_sessions.clear();
+    
+    // Sessions unregister their D-Bus objects, so they go before the connection
+    for (auto& [handle, session] : sessions) {
+        end_session(*session);
+    }
+    sessions.clear();
+    if (notify_flow && output_scheduler) {
+        shared_input.pointer = nullptr;
+        shared_input.keyboard = nullptr;
+        output_scheduler->detach(std::move(notify_flow));
+    }
     
     if (object) {
         object.reset();
@@ -111,36 +240,311 @@ void Portal::cleanup() {
     if (connection) {
         connection.reset();
     }
+    
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
 }
 
 void Portal::run() {
     if (!connection) return;
     
     running = true;
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        control_stopping = false;
+    }
+    control_thread = std::thread([this]() { run_control(); });
     
-    std::cout << "🔄 Starting proper sdbus D-Bus event loop..." << std::endl;
+    std::cout << "🔄 Starting D-Bus event loop..." << std::endl;
     std::cout << "📡 Portal ready to receive D-Bus calls!" << std::endl;
     
+    // Our own poll loop around the sdbus connection, so other threads (EIS
+    // sessions, stop()) can wake it through wake_fd
     try {
-        // Use the official sdbus event loop 
-        // This will block and properly handle all incoming D-Bus method calls
-        connection->enterEventLoop();
+        while (running) {
+            auto poll_data = connection->getEventLoopPollData();
+            struct pollfd fds[2] = {
+                { .fd = poll_data.fd, .events = poll_data.events, .revents = 0 },
+                { .fd = wake_fd, .events = POLLIN, .revents = 0 },
+            };
+            
+            int timeout = -1;
+            if (poll_data.timeout_usec != UINT64_MAX) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                uint64_t now_usec = static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+                timeout = poll_data.timeout_usec > now_usec
+                    ? static_cast<int>((poll_data.timeout_usec - now_usec + 999) / 1000) : 0;
+            }
+            
+            if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+                std::cerr << "D-Bus poll error: " << strerror(errno) << std::endl;
+                break;
+            }
+            
+            if (fds[1].revents & POLLIN) {
+                uint64_t value;
+                while (read(wake_fd, &value, sizeof(value)) > 0) {}
+            }
+            
+            // Drain everything queued on the bus, then apply the Notify* input it
+            // carried as one batch
+            while (connection->processPendingRequest()) {}
+            apply_queued_input();
+            
+            // Answers from the control thread, then sessions leaving the bus
+            apply_completions();
+            reap_sessions();
+        }
     } catch (const sdbus::Error& e) {
         std::cerr << "D-Bus error in portal loop: " << e.what() << std::endl;
     }
     
+    // Let the control thread finish what it was given before the sessions go
+    stop_control();
     std::cout << "🛑 D-Bus event loop stopped" << std::endl;
 }
 
+void Portal::run_control() {
+    std::unique_lock<std::mutex> lock(control_mutex);
+    while (true) {
+        // Timed jobs that are due go behind what is already queued
+        auto now = std::chrono::steady_clock::now();
+        while (!control_timers.empty() && control_timers.begin()->first <= now) {
+            control_jobs.push_back(std::move(control_timers.begin()->second));
+            control_timers.erase(control_timers.begin());
+        }
+        if (control_jobs.empty()) {
+            if (control_stopping) break;
+            if (control_timers.empty()) {
+                control_ready.wait(lock);
+            } else {
+                control_ready.wait_until(lock, control_timers.begin()->first);
+            }
+            continue;
+        }
+        
+        std::function<void()> job = std::move(control_jobs.front());
+        control_jobs.pop_front();
+        lock.unlock();
+        try {
+            job();
+        } catch (const std::exception& e) {
+            std::cerr << "Error in portal control job: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+void Portal::stop_control() {
+    if (!control_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        control_stopping = true;
+    }
+    control_ready.notify_one();
+    control_thread.join();
+    
+    // Flows still waiting are dropped: they answer as failed and free what they held
+    control_timers.clear();
+}
+
+void Portal::post_control(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        control_jobs.push_back(std::move(job));
+    }
+    control_ready.notify_one();
+}
+
+void Portal::post_control_at(std::chrono::steady_clock::time_point due, std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        control_timers.emplace(due, std::move(job));
+    }
+    control_ready.notify_one();
+}
+
+void Portal::post_completion(std::function<void()> done) {
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        completions.push_back(std::move(done));
+    }
+    wake();
+}
+
+void Portal::apply_completions() {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        ready.swap(completions);
+    }
+    
+    // A caller that has left the bus only costs its own reply
+    for (auto& done : ready) {
+        try {
+            done();
+        } catch (const sdbus::Error& e) {
+            std::cerr << "Failed to answer portal call: " << e.what() << std::endl;
+        }
+    }
+}
+
+Hop Portal::on_control() {
+    return Hop{ [this](ResumeJob resume) { post_control(std::move(resume)); } };
+}
+
+Hop Portal::on_bus() {
+    return Hop{ [this](ResumeJob resume) { post_completion(std::move(resume)); } };
+}
+
+FlowExit Portal::exit_on_bus(std::function<void()> on_failure) {
+    return FlowExit{ on_bus().post, std::move(on_failure) };
+}
+
+Hop Portal::control_until(std::function<bool()> ready, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    return Hop{ [this, ready = std::move(ready), deadline](ResumeJob resume) {
+        post_control([this, ready, deadline, resume]() { resume_when(ready, deadline, resume); });
+    } };
+}
+
+void Portal::resume_when(std::function<bool()> ready, std::chrono::steady_clock::time_point deadline, ResumeJob resume) {
+    auto now = std::chrono::steady_clock::now();
+    if (ready() || now >= deadline) {
+        resume();
+        return;
+    }
+    auto next = std::min(now + std::chrono::milliseconds(CONTROL_POLL_MS), deadline);
+    post_control_at(next, [this, ready = std::move(ready), deadline, resume]() { resume_when(ready, deadline, resume); });
+}
+
 void Portal::stop() {
     running = false;
-    // Exit the sdbus event loop cleanly
-    if (connection) {
-        connection->leaveEventLoop();
+    wake();
+}
+
+void Portal::wake() {
+    if (wake_fd >= 0) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to wake portal loop: " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+void Portal::request_close(const std::string& handle, bool emit_closed) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending_close.emplace_back(handle, emit_closed);
+    }
+    wake();
+}
+
+void Portal::reap_sessions() {
+    std::vector<std::pair<std::string, bool>> closing;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        closing.swap(pending_close);
+    }
+    
+    for (const auto& [handle, emit_closed] : closing) {
+        auto it = exported.find(handle);
+        if (it == exported.end()) continue;
+        
+        // Off the bus first, so no Notify* call is routed to it while the
+        // control thread tears it down
+        Session* session = it->second;
+        exported.erase(it);
+        if (clipboard_sessions.erase(handle)) {
+            clipboard->release(handle);
+        }
+        if (emit_closed) {
+            session->emit_closed();
+        }
+        session->unexport_object();
+        post_control([this, handle]() { finish_session(handle); });
+    }
+}
+
+void Portal::finish_session(const std::string& handle) {
+    auto it = sessions.find(handle);
+    if (it == sessions.end()) return;
+    
+    end_session(*it->second);
+    sessions.erase(it);
+    std::cout << "📉 Active sessions: " << sessions.size() << std::endl;
+}
+
+void Portal::end_session(Session& session) {
+    session.close();
+    if (session.has_devices()) {
+        DevicePair devices = session.take_devices();
+        if (output_scheduler) {
+            OutputScheduler::Stats stats;
+            devices = output_scheduler->detach(std::move(devices), &stats);
+            if (stats.throttled) {
+                std::cout << "⏳ " << session.handle() << " was rate limited: " << stats.throttled
+                          << " holds, " << stats.merged << " frames merged, " << stats.frames << " written" << std::endl;
+            }
+        }
+        // A flow over the shared devices hands nothing back
+        if (devices && device_pool) {
+            devices.pointer->set_flight_session(0);
+            devices.keyboard->set_flight_session(0);
+            device_pool->release(std::move(devices));
+        }
+    }
+}
+
+void Portal::set_libei_handler(LibEIHandler* handler) {
+    libei_handler = handler;
+    if (notify_flow && output_scheduler) {
+        output_scheduler->detach(std::move(notify_flow));
     }
+    shared_input.pointer = handler ? handler->pointer : nullptr;
+    shared_input.keyboard = handler ? handler->keyboard : nullptr;
+    
+    // Notify* calls outside a session queue apart from the LibEI receiver
+    if (handler && output_scheduler) {
+        notify_flow = output_scheduler->attach_alongside("notify", handler->pointer);
+        if (notify_flow) {
+            shared_input.pointer = notify_flow.pointer.get();
+            shared_input.keyboard = notify_flow.keyboard.get();
+        }
+    }
+}
+
+void Portal::set_transform_config(TransformConfig* config) {
+    transform_config = config;
+    shared_transform.set(config ? config->for_app("") : nullptr);
+}
+
+void Portal::reload_transforms() {
+    if (!transform_config) return;
+    post_control([this]() {
+        if (!transform_config->load()) return;
+        // Each swap is one pointer store; sessions keep translating throughout
+        shared_transform.set(transform_config->for_app(""));
+        for (auto& [handle, session] : sessions) {
+            session->transform().set(transform_config->for_app(session->app()));
+        }
+        std::cout << "🔄 Input transforms reloaded for " << sessions.size() << " session(s)" << std::endl;
+    });
 }
 
-void Portal::CreateSession(sdbus::MethodCall call) {
+InputTarget& Portal::target_for(const std::string& session_handle) {
+    auto it = exported.find(session_handle);
+    if (it != exported.end()) {
+        return it->second->input();
+    }
+    return shared_target();
+}
+
+PortalFlow Portal::CreateSession(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_response(call));
     std::cout << "🔥 RemoteDesktop CreateSession called!" << std::endl;
     std::cout << "📋 FLOW: Step 1/4 - CreateSession" << std::endl;
     std::cout << "🎯 This indicates deskflow found our portal!" << std::endl;
@@ -163,53 +567,321 @@ void Portal::CreateSession(sdbus::MethodCall call) {
         }
     } catch (const std::exception& e) {
         std::cerr << "Error extracting CreateSession parameters: " << e.what() << std::endl;
-        auto reply = call.createReply();
-        reply << static_cast<uint32_t>(1); // Error
-        reply << std::map<std::string, sdbus::Variant>{};
-        reply.send();
-        return;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    
+    Request request(*connection, request_handle);
+    std::string handle = session_handle;
+    
+    // Devices and handlers are set up on the control thread; the object is
+    // exported and the reply sent back here
+    co_await on_control();
+    Session* session = nullptr;
+    try {
+        session = create_session(handle, app_id);
+    } catch (const std::exception& e) {
+        // Answered below, with the Request still ours to drop on the bus
+        std::cerr << "Failed to create session " << handle << ": " << e.what() << std::endl;
+    }
+    co_await on_bus();
+    
+    if (!session) {
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    if (request.closed()) {
+        post_control([this, handle]() { finish_session(handle); });
+        send_response(call, RESPONSE_ENDED);
+        co_return;
     }
+    try {
+        session->export_object(*connection, [this, handle]() { request_close(handle, false); });
+    } catch (const sdbus::Error& e) {
+        std::cerr << "Failed to export session object: " << e.what() << std::endl;
+        post_control([this, handle]() { finish_session(handle); });
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    exported[handle] = session;
     
     // Create session response
     std::map<std::string, sdbus::Variant> response;
-    response["session_handle"] = sdbus::Variant(session_handle);
-    
-    auto reply = call.createReply();
-    reply << static_cast<uint32_t>(0); // Success
-    reply << response;
-    reply.send();
+    response["session_handle"] = sdbus::Variant(sdbus::ObjectPath(handle));
+    send_response(call, RESPONSE_SUCCESS, response);
     
     std::cout << "✅ CreateSession completed successfully" << std::endl;
     std::cout << "📋 NEXT: Client should call SelectDevices or Start" << std::endl;
 }
 
-void Portal::SelectSources(sdbus::MethodCall call) {
-    std::cout << "🔥 RemoteDesktop SelectSources called!" << std::endl;
+Session* Portal::create_session(const std::string& handle, const std::string& app_id) {
+    if (sessions.count(handle)) {
+        std::cerr << "Session already exists: " << handle << std::endl;
+        return nullptr;
+    }
+    
+    auto session = std::make_unique<Session>(handle, app_id, nullptr);
+    if (device_pool) {
+        DevicePair devices = device_pool->checkout();
+        if (devices) {
+            // Before the scheduler wraps them: these are the devices that write
+            devices.pointer->set_flight_session(session->id());
+            devices.keyboard->set_flight_session(session->id());
+        }
+        if (devices && output_scheduler) {
+            devices = output_scheduler->attach(handle, std::move(devices));
+        }
+        if (devices) {
+            session->attach_devices(std::move(devices));
+        } else {
+            std::cerr << "⚠️ No pooled devices for " << handle << ", sharing the default devices" << std::endl;
+        }
+    }
+    if (!session->has_devices() && output_scheduler) {
+        // Its own flow over the shared devices, so another session's frame
+        // cannot close one this session has half sent
+        DevicePair devices = output_scheduler->attach_alongside(handle, shared_input.pointer);
+        if (devices) {
+            session->attach_devices(std::move(devices));
+        }
+    }
+    if (!session->has_devices()) {
+        session->share_devices(shared_input.pointer, shared_input.keyboard, &shared_devices_lock);
+    }
+    if (transform_config) {
+        session->transform().set(transform_config->for_app(app_id));
+    }
+    InputTarget* target = &session->input();
+    session->set_event_handler([this, target](struct eis_event* event) { handle_eis_event(*target, event); });
+    session->set_record_handler([this, target](const SharedRingRecord* records, size_t count) {
+        handle_ring_records(*target, records, count);
+    });
+    session->set_client_gone_handler([this](Session& s) { request_close(s.handle(), true); });
+    
+    Session* created = session.get();
+    sessions[handle] = std::move(session);
+    return created;
+}
+
+PortalFlow Portal::SelectSources(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_response(call));
+    std::cout << "🔥 ScreenCast SelectSources called!" << std::endl;
+    
+    // Extract parameters according to D-Bus signature "oosa{sv}"
+    sdbus::ObjectPath request_handle;
+    sdbus::ObjectPath session_handle;
+    std::string app_id;
+    std::map<std::string, sdbus::Variant> options;
+    
+    try {
+        call >> request_handle >> session_handle >> app_id >> options;
+        
+        std::cout << "Session handle: " << session_handle << std::endl;
+        std::cout << "Options received:" << std::endl;
+        for (const auto& option : options) {
+            std::cout << "  " << option.first << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting SelectSources parameters: " << e.what() << std::endl;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    
+    // Monitors are all there is; there is no picker, so Start takes the first
+    // output (or every output with `multiple`)
+    uint32_t types = SOURCE_MONITOR;
+    if (auto asked = options.find("types"); asked != options.end() && asked->second.containsValueOfType<uint32_t>()) {
+        types = asked->second.get<uint32_t>();
+    }
+    bool multiple = false;
+    if (auto asked = options.find("multiple"); asked != options.end() && asked->second.containsValueOfType<bool>()) {
+        multiple = asked->second.get<bool>();
+    }
+    uint32_t cursor_mode = CURSOR_HIDDEN;
+    if (auto asked = options.find("cursor_mode"); asked != options.end() && asked->second.containsValueOfType<uint32_t>()) {
+        if (asked->second.get<uint32_t>() == CURSOR_EMBEDDED) cursor_mode = CURSOR_EMBEDDED;
+    }
+    if (!(types & SOURCE_MONITOR)) {
+        std::cerr << "Only monitor sources are supported, not types " << types << std::endl;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    
+    Request request(*connection, request_handle);
+    std::string handle = session_handle;
+    
+    co_await on_control();
+    auto it = sessions.find(handle);
+    bool found = it != sessions.end();
+    if (found) {
+        Session::Selection& selection = it->second->selection();
+        selection.sources = SOURCE_MONITOR;
+        selection.multiple = multiple;
+        selection.cursor_mode = cursor_mode;
+    } else {
+        std::cerr << "Unknown session: " << handle << std::endl;
+    }
+    co_await on_bus();
+    
+    if (!found) {
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    send_response(call, request.closed() ? RESPONSE_ENDED : RESPONSE_SUCCESS);
+    std::cout << "✅ SelectSources completed for session: " << handle << std::endl;
+}
+
+sdbus::Variant Portal::streams_variant(const std::vector<StreamInfo>& streams) {
+    std::vector<sdbus::Struct<uint32_t, std::map<std::string, sdbus::Variant>>> described;
+    for (const auto& stream : streams) {
+        std::map<std::string, sdbus::Variant> properties;
+        properties["id"] = sdbus::Variant(stream.id);
+        properties["position"] = sdbus::Variant(sdbus::Struct<int32_t, int32_t>(stream.x, stream.y));
+        properties["size"] = sdbus::Variant(sdbus::Struct<int32_t, int32_t>(stream.width, stream.height));
+        properties["source_type"] = sdbus::Variant(SOURCE_MONITOR);
+        described.emplace_back(stream.node, std::move(properties));
+    }
+    return sdbus::Variant(described);
+}
+
+std::vector<std::unique_ptr<CaptureStream>> Portal::start_captures(Session& session) {
+    std::vector<std::unique_ptr<CaptureStream>> started;
+    if (!screencopy || !sink_factory || !session.streams().empty()) return started;
+    
+    std::vector<Screencopy::Output> outputs = screencopy->outputs();
+    if (!session.selection().multiple && outputs.size() > 1) outputs.resize(1);
+    
+    for (const Screencopy::Output& output : outputs) {
+        std::unique_ptr<FrameSink> sink = sink_factory(output.name);
+        if (!sink) continue;
+        std::unique_ptr<CaptureStream> stream =
+            screencopy->start(output.id, session.selection().cursor_mode == CURSOR_EMBEDDED, std::move(sink));
+        if (stream) started.push_back(std::move(stream));
+    }
+    return started;
+}
+
+bool Portal::streams_up(const std::vector<std::unique_ptr<CaptureStream>>& captures) {
+    for (const auto& stream : captures) {
+        if (!stream->sink().stream_node(0)) return false;
+    }
+    return true;
+}
+
+std::vector<Portal::StreamInfo> Portal::adopt_streams(const std::string& handle,
+                                                      std::vector<std::unique_ptr<CaptureStream>> captures) {
+    std::vector<StreamInfo> started;
+    auto it = sessions.find(handle);
+    if (it == sessions.end()) return started;
+    Session& session = *it->second;
+    
+    // Another call on the session may have got there first; its streams are the ones described
+    if (!session.streams().empty()) captures.clear();
+    for (auto& stream : captures) {
+        // The stream comes up with the first frame, which a fresh capture gets at once
+        if (!stream->sink().stream_node(0)) {
+            std::cerr << "❌ No PipeWire stream for " << stream->output().name << std::endl;
+            continue;
+        }
+        session.add_stream(std::move(stream));
+    }
+    
+    for (const auto& stream : session.streams()) {
+        const Screencopy::Output& output = stream->output();
+        StreamInfo info;
+        info.node = stream->sink().stream_node(0);
+        info.x = output.x;
+        info.y = output.y;
+        info.width = output.width;
+        info.height = output.height;
+        info.id = output.name.empty() ? std::to_string(output.id) : output.name;
+        started.push_back(std::move(info));
+    }
+    return started;
+}
+
+PortalFlow Portal::StartScreenCast(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_response(call));
+    std::cout << "🔥 ScreenCast Start called!" << std::endl;
     
-    // Extract parameters
+    // Extract parameters according to D-Bus signature "oossa{sv}"
+    sdbus::ObjectPath request_handle;
     sdbus::ObjectPath session_handle;
+    std::string app_id;
+    std::string parent_window;
     std::map<std::string, sdbus::Variant> options;
-    call >> session_handle >> options;
     
-    std::cout << "Session handle: " << session_handle << std::endl;
-    std::cout << "Options received:" << std::endl;
-    for (const auto& option : options) {
-        std::cout << "  " << option.first << std::endl;
+    try {
+        call >> request_handle >> session_handle >> app_id >> parent_window >> options;
+        std::cout << "Session handle: " << session_handle << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting Start parameters: " << e.what() << std::endl;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    
+    Request request(*connection, request_handle);
+    std::string handle = session_handle;
+    
+    // Captures start on the control thread, which serves other calls while
+    // their streams come up
+    co_await on_control();
+    std::vector<StreamInfo> streams;
+    try {
+        std::vector<std::unique_ptr<CaptureStream>> captures;
+        if (auto it = sessions.find(handle); it != sessions.end()) {
+            it->second->selection().sources = SOURCE_MONITOR;
+            captures = start_captures(*it->second);
+        }
+        co_await control_until([&]() { return request.closed() || streams_up(captures); }, STREAM_TIMEOUT_MS);
+        streams = adopt_streams(handle, std::move(captures));
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to start screen cast for " << handle << ": " << e.what() << std::endl;
+    }
+    co_await on_bus();
+    
+    if (request.closed()) {
+        send_response(call, RESPONSE_ENDED);
+        co_return;
+    }
+    if (streams.empty()) {
+        std::cerr << "No screen cast streams for " << handle << std::endl;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
     }
     
-    // Response - allow all sources
     std::map<std::string, sdbus::Variant> response;
-    response["types"] = sdbus::Variant(static_cast<uint32_t>(7)); // keyboard | pointer | touchscreen
+    response["streams"] = streams_variant(streams);
+    send_response(call, RESPONSE_SUCCESS, response);
     
-    auto reply = call.createReply();
-    reply << static_cast<uint32_t>(0); // Success
-    reply << response;
-    reply.send();
+    std::cout << "✅ ScreenCast started for session: " << handle << " (" << streams.size() << " streams)" << std::endl;
+}
+
+// restore_data as this backend issues it: (vendor, version, token)
+static const char RESTORE_DATA_VENDOR[] = "hypr-remote";
+static constexpr uint32_t RESTORE_DATA_VERSION = 1;
+
+// The restore token in SelectDevices options, given directly or as our restore_data; "" if none
+static std::string restore_token_of(const std::map<std::string, sdbus::Variant>& options) {
+    using RestoreData = sdbus::Struct<std::string, uint32_t, sdbus::Variant>;
     
-    std::cout << "✅ SelectSources completed for session: " << session_handle << std::endl;
+    auto token = options.find("restore_token");
+    if (token != options.end() && token->second.containsValueOfType<std::string>()) {
+        return token->second.get<std::string>();
+    }
+    auto data = options.find("restore_data");
+    if (data != options.end() && data->second.containsValueOfType<RestoreData>()) {
+        RestoreData restore = data->second.get<RestoreData>();
+        if (std::get<0>(restore) == RESTORE_DATA_VENDOR && std::get<1>(restore) == RESTORE_DATA_VERSION &&
+            std::get<2>(restore).containsValueOfType<std::string>()) {
+            return std::get<2>(restore).get<std::string>();
+        }
+    }
+    return "";
 }
 
-void Portal::SelectDevices(sdbus::MethodCall call) {
+PortalFlow Portal::SelectDevices(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_response(call));
     std::cout << "🔥 RemoteDesktop SelectDevices called!" << std::endl;
     std::cout << "📋 FLOW: Step 2/4 - SelectDevices" << std::endl;
     
@@ -231,31 +903,75 @@ void Portal::SelectDevices(sdbus::MethodCall call) {
         }
     } catch (const std::exception& e) {
         std::cerr << "Error extracting SelectDevices parameters: " << e.what() << std::endl;
-        auto reply = call.createReply();
-        reply << static_cast<uint32_t>(1); // Error
-        reply << std::map<std::string, sdbus::Variant>{};
-        reply.send();
-        return;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
     }
     
-    // Response - allow all devices
-    std::map<std::string, sdbus::Variant> response;
-    response["types"] = sdbus::Variant(static_cast<uint32_t>(7)); // keyboard | pointer | touchscreen
+    // Allow whatever is asked for (all devices by default); a valid restore
+    // token brings back what the app had selected last time instead
+    Session::Selection requested;
+    if (auto types = options.find("types"); types != options.end() && types->second.containsValueOfType<uint32_t>()) {
+        if (uint32_t asked = types->second.get<uint32_t>() & 7) requested.types = asked;
+    }
+    if (auto mode = options.find("persist_mode"); mode != options.end() && mode->second.containsValueOfType<uint32_t>()) {
+        requested.persist_mode = std::min(mode->second.get<uint32_t>(), RestoreStore::PERSIST_PERSISTENT);
+    }
+    std::string token = restore_token_of(options);
     
-    auto reply = call.createReply();
-    reply << static_cast<uint32_t>(0); // Success
-    reply << response;
-    reply.send();
+    Request request(*connection, request_handle);
+    std::string handle = session_handle;
+    
+    // The token is redeemed on the control thread, which may write the store
+    co_await on_control();
+    auto it = sessions.find(handle);
+    bool found = it != sessions.end();
+    uint32_t types = requested.types;
+    if (found) {
+        Session::Selection& selection = it->second->selection();
+        selection = requested;
+        if (!token.empty() && restore_store && !request.closed()) {
+            try {
+                if (auto grant = restore_store->redeem(token, app_id)) {
+                    selection.types = grant->types;
+                    selection.restored = true;
+                    std::cout << "♻️ Restored device selection for " << handle << " from its restore token" << std::endl;
+                } else {
+                    std::cout << "⚠️ Restore token not valid for " << (app_id.empty() ? "this client" : app_id)
+                              << ", selecting devices afresh" << std::endl;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to redeem restore token for " << handle << ": " << e.what() << std::endl;
+            }
+        }
+        types = selection.types;
+    } else {
+        std::cerr << "Unknown session: " << handle << std::endl;
+    }
+    co_await on_bus();
+    
+    if (!found) {
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    if (request.closed()) {
+        send_response(call, RESPONSE_ENDED);
+        co_return;
+    }
     
-    std::cout << "✅ SelectDevices completed for session: " << session_handle << std::endl;
+    std::map<std::string, sdbus::Variant> response;
+    response["types"] = sdbus::Variant(types); // keyboard | pointer | touchscreen
+    send_response(call, RESPONSE_SUCCESS, response);
+    
+    std::cout << "✅ SelectDevices completed for session: " << handle << std::endl;
     std::cout << "📋 NEXT: Client should call Start" << std::endl;
 }
 
-void Portal::Start(sdbus::MethodCall call) {
+PortalFlow Portal::Start(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_response(call));
     std::cout << "🔥 RemoteDesktop Start called - This is where the magic happens!" << std::endl;
     std::cout << "📋 FLOW: Step 3/4 - Start session" << std::endl;
     std::cout << "🎯 If you see this, deskflow is following the portal flow correctly!" << std::endl;
-
+    
     // Extract parameters according to D-Bus signature "oossa{sv}"
     sdbus::ObjectPath request_handle;
     sdbus::ObjectPath session_handle;
@@ -276,194 +992,279 @@ void Portal::Start(sdbus::MethodCall call) {
         }
     } catch (const std::exception& e) {
         std::cerr << "Error extracting Start parameters: " << e.what() << std::endl;
-        auto reply = call.createReply();
-        reply << static_cast<uint32_t>(1); // Error
-        reply << std::map<std::string, sdbus::Variant>{};
-        reply.send();
-        return;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
     }
     
     // Check if we have a working LibEI handler
     if (!libei_handler) {
         std::cerr << "No LibEI handler available for remote session" << std::endl;
-        auto reply = call.createReply();
-        reply << static_cast<uint32_t>(1); // Error
-        reply << std::map<std::string, sdbus::Variant>{};
-        reply.send();
-        return;
+        send_response(call, RESPONSE_FAILED);
+        co_return;
     }
     
     std::cout << "✅ Using existing LibEI handler for input processing" << std::endl;
     
-    // Start the remote desktop session
-    std::map<std::string, sdbus::Variant> response;
-    response["devices"] = sdbus::Variant(static_cast<uint32_t>(7)); // keyboard | pointer | touchscreen
-    
-    auto reply = call.createReply();
-    reply << static_cast<uint32_t>(0); // Success
-    reply << response;
-    reply.send();
+    Request request(*connection, request_handle);
+    std::string handle = session_handle;
     
-    std::cout << "Start completed - remote desktop session active for session: " << session_handle << std::endl;
+    // A restored session's EIS server and its screens are set up on the control thread
+    co_await on_control();
+    Session::Selection selection;
+    std::vector<StreamInfo> streams;
+    std::string token;
+    bool failed = false;
+    try {
+        auto it = sessions.find(handle);
+        Session* session = it != sessions.end() ? it->second.get() : nullptr;
+        if (session) selection = session->selection();
+        
+        // A restored client has been through this before and will connect: have
+        // its EIS server running already, so ConnectToEIS only hands it over
+        if (session && selection.restored) {
+            session->selection().restored = false;
+            const InputTarget& target = session->input();
+            if (target.pointer && target.keyboard) {
+                int client_fd = start_eis(*session, app_id);
+                if (client_fd >= 0) {
+                    session->hold_client_fd(client_fd);
+                    std::cout << "♻️ EIS server ready ahead of ConnectToEIS for " << handle << std::endl;
+                }
+            }
+        }
+        
+        // Screens selected through ScreenCast SelectSources on this session; other
+        // calls are served while their streams come up
+        std::vector<std::unique_ptr<CaptureStream>> captures;
+        if (session && selection.sources) captures = start_captures(*session);
+        co_await control_until([&]() { return request.closed() || streams_up(captures); }, STREAM_TIMEOUT_MS);
+        if (selection.sources) streams = adopt_streams(handle, std::move(captures));
+        
+        // The next token for sessions that asked to persist: directly for callers
+        // of this interface, and as restore_data for the portal frontend to keep.
+        // Not for a request that was closed, which would never pass it on.
+        if (sessions.count(handle) && restore_store && selection.persist_mode != RestoreStore::PERSIST_NONE &&
+            !request.closed()) {
+            token = restore_store->issue(app_id, selection.types, selection.persist_mode);
+        }
+    } catch (const std::exception& e) {
+        // Answered below, with the Request still ours to drop on the bus
+        std::cerr << "Failed to start session " << handle << ": " << e.what() << std::endl;
+        failed = true;
+    }
+    co_await on_bus();
+    
+    if (failed) {
+        send_response(call, RESPONSE_FAILED);
+        co_return;
+    }
+    if (request.closed()) {
+        send_response(call, RESPONSE_ENDED);
+        co_return;
+    }
+    
+    // Start the remote desktop session
+    std::map<std::string, sdbus::Variant> response;
+    response["devices"] = sdbus::Variant(selection.types); // keyboard | pointer | touchscreen
+    if (!streams.empty()) response["streams"] = streams_variant(streams);
+    if (clipboard_sessions.count(handle)) response["clipboard_enabled"] = sdbus::Variant(true);
+    if (!token.empty()) {
+        response["restore_token"] = sdbus::Variant(token);
+        response["restore_data"] = sdbus::Variant(sdbus::Struct<std::string, uint32_t, sdbus::Variant>(
+            RESTORE_DATA_VENDOR, RESTORE_DATA_VERSION, sdbus::Variant(token)));
+        response["persist_mode"] = sdbus::Variant(selection.persist_mode);
+    }
+    send_response(call, RESPONSE_SUCCESS, response);
+    
+    std::cout << "Start completed - remote desktop session active for session: " << handle << std::endl;
     std::cout << "LibEI handler ready for input processing" << std::endl;
     std::cout << "📋 NEXT: Client should now call ConnectToEIS for modern input" << std::endl;
 }
 
 void Portal::NotifyPointerMotion(sdbus::MethodCall call) {
-    std::cout << "🖱️ NotifyPointerMotion called!" << std::endl;
-    std::cout << "📋 FLOW: Step 4/4 - Input events (Mouse Motion)" << std::endl;
-    std::cout << "🎯 DESKFLOW IS USING LEGACY NOTIFY METHODS!" << std::endl;
+    DEBUG_LOG("🖱️ NotifyPointerMotion called!");
+    DEBUG_LOG("📋 FLOW: Step 4/4 - Input events (Mouse Motion)");
+    DEBUG_LOG("🎯 DESKFLOW IS USING LEGACY NOTIFY METHODS!");
     
-    // Extract parameters
-    sdbus::ObjectPath session_handle;
-    std::map<std::string, sdbus::Variant> options;
+    // Extract parameters into the reused buffers
+    sdbus::ObjectPath& session_handle = notify_session;
+    notify_options.clear();
     double dx, dy;
-    call >> session_handle >> options >> dx >> dy;
+    call >> session_handle >> notify_options >> dx >> dy;
+    PROBE2(dbus_ingress, "NotifyPointerMotion", session_handle.c_str());
     
-    std::cout << "Session: " << session_handle << ", Motion: dx=" << dx << ", dy=" << dy << std::endl;
+    DEBUG_LOG("Session: " << session_handle << ", Motion: dx=" << dx << ", dy=" << dy);
     
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    queue_input({ QueuedInput::POINTER_MOTION, &target_for(session_handle), dx, dy });
     
-    // Forward to virtual pointer via libei handler's virtual pointer
-    if (libei_handler && libei_handler->pointer) {
-        libei_handler->pointer->send_motion(time, dx, dy);
-        libei_handler->pointer->send_frame();
-        std::cout << "✅ Motion forwarded to virtual pointer" << std::endl;
-    } else {
-        std::cout << "❌ No virtual pointer available" << std::endl;
+    // Callers sending with NO_REPLY_EXPECTED get no empty reply to drop
+    if (!call.doesntExpectReply()) {
+        call.createReply().send();
     }
-    
-    auto reply = call.createReply();
-    reply.send();
 }
 
 void Portal::NotifyPointerButton(sdbus::MethodCall call) {
-    std::cout << "🖱️ NotifyPointerButton called!" << std::endl;
+    DEBUG_LOG("🖱️ NotifyPointerButton called!");
     
-    // Extract parameters
-    sdbus::ObjectPath session_handle;
-    std::map<std::string, sdbus::Variant> options;
+    // Extract parameters into the reused buffers
+    sdbus::ObjectPath& session_handle = notify_session;
+    notify_options.clear();
     int32_t button;
     uint32_t state;
-    call >> session_handle >> options >> button >> state;
+    call >> session_handle >> notify_options >> button >> state;
+    PROBE2(dbus_ingress, "NotifyPointerButton", session_handle.c_str());
     
-    std::cout << "Session: " << session_handle << ", Button: " << button << ", State: " << state << std::endl;
+    DEBUG_LOG("Session: " << session_handle << ", Button: " << button << ", State: " << state);
     
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    queue_input({ QueuedInput::POINTER_BUTTON, &target_for(session_handle), 0, 0, button, state });
     
-    // Forward to virtual pointer
-    if (libei_handler && libei_handler->pointer) {
-        libei_handler->pointer->send_button(time, static_cast<uint32_t>(button), state);
-        libei_handler->pointer->send_frame();
-        std::cout << "✅ Button event forwarded to virtual pointer" << std::endl;
-    } else {
-        std::cout << "❌ No virtual pointer available" << std::endl;
+    if (!call.doesntExpectReply()) {
+        call.createReply().send();
     }
-    
-    auto reply = call.createReply();
-    reply.send();
 }
 
 void Portal::NotifyKeyboardKeycode(sdbus::MethodCall call) {
-    std::cout << "⌨️ NotifyKeyboardKeycode called!" << std::endl;
+    DEBUG_LOG("⌨️ NotifyKeyboardKeycode called!");
     
-    // Extract parameters
-    sdbus::ObjectPath session_handle;
-    std::map<std::string, sdbus::Variant> options;
+    // Extract parameters into the reused buffers
+    sdbus::ObjectPath& session_handle = notify_session;
+    notify_options.clear();
     int32_t keycode;
     uint32_t state;
-    call >> session_handle >> options >> keycode >> state;
+    call >> session_handle >> notify_options >> keycode >> state;
+    PROBE2(dbus_ingress, "NotifyKeyboardKeycode", session_handle.c_str());
     
-    std::cout << "Session: " << session_handle << ", Keycode: " << keycode << ", State: " << state << std::endl;
+    DEBUG_LOG("Session: " << session_handle << ", Keycode: " << keycode << ", State: " << state);
     
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    queue_input({ QueuedInput::KEYBOARD_KEYCODE, &target_for(session_handle), 0, 0, keycode, state });
     
-    // Forward to virtual keyboard
-    if (libei_handler && libei_handler->keyboard) {
-        libei_handler->keyboard->send_key(time, static_cast<uint32_t>(keycode), state);
-        std::cout << "✅ Key event forwarded to virtual keyboard" << std::endl;
-    } else {
-        std::cout << "❌ No virtual keyboard available" << std::endl;
+    if (!call.doesntExpectReply()) {
+        call.createReply().send();
     }
-    
-    auto reply = call.createReply();
-    reply.send();
 }
 
 void Portal::NotifyKeyboardKeysym(sdbus::MethodCall call) {
-    std::cout << "⌨️ NotifyKeyboardKeysym called!" << std::endl;
+    DEBUG_LOG("⌨️ NotifyKeyboardKeysym called!");
 
-    // Extract parameters
-    sdbus::ObjectPath session_handle;
-    std::map<std::string, sdbus::Variant> options;
+    // Extract parameters into the reused buffers
+    sdbus::ObjectPath& session_handle = notify_session;
+    notify_options.clear();
     int32_t keysym;
     uint32_t state;
-    call >> session_handle >> options >> keysym >> state;
+    call >> session_handle >> notify_options >> keysym >> state;
+    PROBE2(dbus_ingress, "NotifyKeyboardKeysym", session_handle.c_str());
 
-    std::cout << "Session: " << session_handle << ", Keysym: " << keysym << ", State: " << state << std::endl;
+    DEBUG_LOG("Session: " << session_handle << ", Keysym: " << keysym << ", State: " << state);
 
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    queue_input({ QueuedInput::KEYBOARD_KEYSYM, &target_for(session_handle), 0, 0, keysym, state });
 
-    // Forward to virtual keyboard
-    if (libei_handler && libei_handler->keyboard) {
-        libei_handler->keyboard->send_keysym(time, static_cast<uint32_t>(keysym), state);
-        std::cout << "✅ Keysym event forwarded to virtual keyboard" << std::endl;
-    } else {
-        std::cout << "❌ No virtual keyboard available" << std::endl;
+    if (!call.doesntExpectReply()) {
+        call.createReply().send();
     }
-
-    auto reply = call.createReply();
-    reply.send();
 }
 
 void Portal::NotifyPointerAxis(sdbus::MethodCall call) {
-    std::cout << "🖱️ NotifyPointerAxis called!" << std::endl;
+    DEBUG_LOG("🖱️ NotifyPointerAxis called!");
     
-    // Extract parameters
-    sdbus::ObjectPath session_handle;
-    std::map<std::string, sdbus::Variant> options;
+    // Extract parameters into the reused buffers
+    sdbus::ObjectPath& session_handle = notify_session;
+    notify_options.clear();
     double dx, dy;
-    call >> session_handle >> options >> dx >> dy;
+    call >> session_handle >> notify_options >> dx >> dy;
+    PROBE2(dbus_ingress, "NotifyPointerAxis", session_handle.c_str());
     
-    std::cout << "Session: " << session_handle << ", Axis: dx=" << dx << ", dy=" << dy << std::endl;
+    DEBUG_LOG("Session: " << session_handle << ", Axis: dx=" << dx << ", dy=" << dy);
     
-    // Get current time for wayland events
-    uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now().time_since_epoch()).count());
+    queue_input({ QueuedInput::POINTER_AXIS, &target_for(session_handle), dx, dy });
     
-    // Forward to virtual pointer with proper Wayland scroll protocol
-    if (libei_handler && libei_handler->pointer) {
-        // Set axis source for legacy scroll events
-        libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-        
-        // Send scroll events for both axes if non-zero
-        if (dx != 0.0) {
-            libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx, dy);
-            libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL);
+    if (!call.doesntExpectReply()) {
+        call.createReply().send();
+    }
+}
+
+void Portal::notify_pointer_motion(InputTarget& target, double dx, double dy) {
+    Translator<NotifySource>::apply(target, { InputEvent::MOTION, false, 0, dx, dy });
+    PROBE2(translate_done, PROBE_SOURCE_DBUS, PROBE_NOTIFY_POINTER_MOTION);
+}
+
+void Portal::notify_pointer_button(InputTarget& target, int32_t button, uint32_t state) {
+    Translator<NotifySource>::apply(target, { InputEvent::BUTTON, state != 0, static_cast<uint32_t>(button) });
+    PROBE2(translate_done, PROBE_SOURCE_DBUS, PROBE_NOTIFY_POINTER_BUTTON);
+}
+
+void Portal::notify_keyboard_keycode(InputTarget& target, int32_t keycode, uint32_t state) {
+    Translator<NotifySource>::apply(target, { InputEvent::KEY, state != 0, static_cast<uint32_t>(keycode) });
+    PROBE2(translate_done, PROBE_SOURCE_DBUS, PROBE_NOTIFY_KEYBOARD_KEYCODE);
+}
+
+void Portal::notify_keyboard_keysym(InputTarget& target, int32_t keysym, uint32_t state) {
+    Translator<NotifySource>::apply(target, { InputEvent::KEYSYM, state != 0, static_cast<uint32_t>(keysym) });
+    PROBE2(translate_done, PROBE_SOURCE_DBUS, PROBE_NOTIFY_KEYBOARD_KEYSYM);
+}
+
+void Portal::notify_pointer_axis(InputTarget& target, double dx, double dy) {
+    Translator<NotifySource>::apply(target, { InputEvent::SCROLL, false, 0, dx, dy });
+    PROBE2(translate_done, PROBE_SOURCE_DBUS, PROBE_NOTIFY_POINTER_AXIS);
+}
+
+void Portal::queue_input(const QueuedInput& input) {
+    if (input.kind == QueuedInput::POINTER_MOTION) {
+        for (auto it = input_queue.rbegin(); it != input_queue.rend(); ++it) {
+            if (it->target != input.target) continue;
+            if (it->kind == QueuedInput::POINTER_MOTION) {
+                it->dx += input.dx;
+                it->dy += input.dy;
+                return;
+            }
+            break;
         }
-        if (dy != 0.0) {
-            libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dx, dy);
-            libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_VERTICAL_SCROLL);
+    }
+    input_queue.push_back(input);
+}
+
+void Portal::apply_queued_input() {
+    if (input_queue.empty()) return;
+    
+    for (const auto& input : input_queue) {
+        InputTarget& target = *input.target;
+        auto devices_locked = lock_devices(target);
+        if (std::find(queued_targets.begin(), queued_targets.end(), &target) == queued_targets.end()) {
+            queued_targets.push_back(&target);
+            if (target.pointer) target.pointer->begin_deferred_flush();
+            if (target.keyboard) target.keyboard->begin_deferred_flush();
+        }
+        
+        switch (input.kind) {
+            case QueuedInput::POINTER_MOTION:
+                notify_pointer_motion(target, input.dx, input.dy);
+                break;
+            case QueuedInput::POINTER_BUTTON:
+                notify_pointer_button(target, input.code, input.state);
+                break;
+            case QueuedInput::KEYBOARD_KEYCODE:
+                notify_keyboard_keycode(target, input.code, input.state);
+                break;
+            case QueuedInput::KEYBOARD_KEYSYM:
+                notify_keyboard_keysym(target, input.code, input.state);
+                break;
+            case QueuedInput::POINTER_AXIS:
+                notify_pointer_axis(target, input.dx, input.dy);
+                break;
         }
-        libei_handler->pointer->send_frame();
-        std::cout << "✅ Legacy axis event forwarded with proper scroll protocol" << std::endl;
-    } else {
-        std::cout << "❌ No virtual pointer available" << std::endl;
     }
     
-    auto reply = call.createReply();
-    reply.send();
+    for (InputTarget* target : queued_targets) {
+        auto devices_locked = lock_devices(*target);
+        if (target->pointer) target->pointer->end_deferred_flush();
+        if (target->keyboard) target->keyboard->end_deferred_flush();
+    }
+    DEBUG_LOG("📦 Applied " << input_queue.size() << " queued Notify* calls");
+    input_queue.clear();
+    queued_targets.clear();
 }
 
-void Portal::ConnectToEIS(sdbus::MethodCall call) {
+PortalFlow Portal::ConnectToEIS(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_error(call));
     std::cout << "🔥 RemoteDesktop ConnectToEIS called!" << std::endl;
     std::cout << "📋 FLOW: Step 5/5 - Connect to EIS (Modern approach!)" << std::endl;
     std::cout << "🎯 THIS IS THE KEY METHOD! Deskflow uses this for input!" << std::endl;
@@ -485,237 +1286,327 @@ void Portal::ConnectToEIS(sdbus::MethodCall call) {
     } catch (const std::exception& e) {
         std::cerr << "Error extracting ConnectToEIS parameters: " << e.what() << std::endl;
         call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
-        return;
+        co_return;
     }
     
-    if (!libei_handler || !libei_handler->keyboard || !libei_handler->pointer) {
-        std::cerr << "Virtual devices not available" << std::endl;
-        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Virtual devices not available")).send();
-        return;
+    // The EIS server (and the compositor's EIS socket, with passthrough) is set
+    // up on the control thread; only the fd comes back here
+    std::string handle = session_handle;
+    co_await on_control();
+    int client_fd = -1;
+    const char* error = "org.freedesktop.portal.Error.Failed";
+    const char* message = nullptr;
+    if (auto it = sessions.find(handle); it == sessions.end()) {
+        std::cerr << "Unknown session: " << handle << std::endl;
+        error = "org.freedesktop.portal.Error.NotFound";
+        message = "Unknown session";
+    } else {
+        Session& session = *it->second;
+        const InputTarget& target = session.input();
+        if (!target.keyboard || !target.pointer) {
+            std::cerr << "Virtual devices not available" << std::endl;
+            message = "Virtual devices not available";
+        } else {
+            // Restored sessions have theirs running already
+            client_fd = session.take_client_fd();
+            if (client_fd < 0) {
+                client_fd = start_eis(session, app_id);
+            }
+            if (client_fd < 0) {
+                message = "Failed to start EIS server";
+            }
+        }
     }
+    co_await on_bus();
     
-    // Create a socket pair - one end for deskflow, one end for our EIS server
-    int socket_pair[2];
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socket_pair) == -1) {
-        std::cerr << "Error creating socket pair: " << strerror(errno) << std::endl;
-        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to create socket pair")).send();
-        return;
+    if (client_fd < 0) {
+        call.createErrorReply(sdbus::Error(error, message)).send();
+        co_return;
     }
     
-    int client_fd = socket_pair[0];  // This goes to deskflow
-    int server_fd = socket_pair[1];  // This stays with us for EIS server
+    // The message keeps its own duplicate; ours is closed when unix_fd goes out of scope
+    sdbus::UnixFd unix_fd{client_fd, sdbus::adopt_fd};
     
-    std::cout << "✅ Created socket pair - client_fd: " << client_fd << ", server_fd: " << server_fd << std::endl;
+    // Return the client file descriptor to deskflow
+    auto reply = call.createReply();
+    reply << unix_fd;
+    reply.send();
+    
+    std::cout << "✅ ConnectToEIS completed - socket fd sent to deskflow" << std::endl;
+    std::cout << "📡 EIS server is running for session " << handle << std::endl;
+}
+
+PortalFlow Portal::ConnectToSharedRing(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_error(call));
+    std::cout << "🔥 RemoteDesktop ConnectToSharedRing called!" << std::endl;
+    
+    sdbus::ObjectPath session_handle;
+    std::string app_id;
+    std::map<std::string, sdbus::Variant> options;
+    uint32_t capacity = SharedRing::DEFAULT_CAPACITY;
     
-    // Start a thread to run a proper EIS server
-    std::thread([this, server_fd]() {
-        std::cout << "📡 Starting proper EIS server thread..." << std::endl;
+    try {
+        call >> session_handle >> app_id >> options;
         
-        // Create EIS server context (similar to hyprland-eis)
-        struct eis* eis_context = eis_new(nullptr);
-        if (!eis_context) {
-            std::cerr << "Failed to create EIS server context" << std::endl;
-            close(server_fd);
-            return;
+        auto it = options.find("capacity");
+        if (it != options.end()) {
+            capacity = it->second.get<uint32_t>();
         }
-        
-        // Set up logging (optional, for debugging)
-        // eis_log_set_priority(eis_context, EIS_LOG_PRIORITY_DEBUG);
-        
-        std::cout << "✅ EIS server context created" << std::endl;
-        
-        // Create a temporary socket and immediately connect our FD to it
-        // This is a workaround since libeis may not support direct FD setup
-        
-        // Alternative approach: Create a proper EIS server socket and handle the connection
-        char socket_path[256];
-        snprintf(socket_path, sizeof(socket_path), "/tmp/hypr-portal-eis-%d", getpid());
-        
-        // Setup EIS backend with temporary socket
-        int rc = eis_setup_backend_socket(eis_context, socket_path);
-        if (rc != 0) {
-            std::cerr << "Failed to setup EIS backend socket: " << strerror(errno) << std::endl;
-            eis_unref(eis_context);
-            close(server_fd);
-            return;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting ConnectToSharedRing parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        co_return;
+    }
+    
+    std::string handle = session_handle;
+    co_await on_control();
+    int memfd = -1, doorbell = -1;
+    const char* error = "org.freedesktop.portal.Error.Failed";
+    const char* message = nullptr;
+    if (auto it = sessions.find(handle); it == sessions.end()) {
+        std::cerr << "Unknown session: " << handle << std::endl;
+        error = "org.freedesktop.portal.Error.NotFound";
+        message = "Unknown session";
+    } else {
+        Session& session = *it->second;
+        const InputTarget& target = session.input();
+        if (!target.keyboard || !target.pointer) {
+            std::cerr << "Virtual devices not available" << std::endl;
+            message = "Virtual devices not available";
+        } else if (!session.connect_ring(capacity, memfd, doorbell, eis_workers)) {
+            // Ring records are always translated here; there is no passthrough for them
+            message = "Failed to create shared ring";
         }
-        
-        std::cout << "✅ EIS backend socket created at: " << socket_path << std::endl;
-        
-        // Now we need to bridge between our socket_pair and the EIS socket
-        // Start a bridge thread to forward data between them
-        std::thread bridge_thread([server_fd, socket_path]() {
-            std::cout << "🌉 Starting socket bridge..." << std::endl;
-            
-            // Connect to the EIS socket
-            int eis_sock = socket(AF_UNIX, SOCK_STREAM, 0);
-            if (eis_sock == -1) {
-                std::cerr << "Failed to create bridge socket" << std::endl;
-                return;
-            }
-            
-            struct sockaddr_un addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sun_family = AF_UNIX;
-            strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
-            
-            // Wait a bit for the EIS server to start
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            
-            if (connect(eis_sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-                std::cerr << "Failed to connect to EIS socket: " << strerror(errno) << std::endl;
-                close(eis_sock);
-                return;
-            }
-            
-            std::cout << "✅ Bridge connected to EIS socket" << std::endl;
-            
-            // Bridge data bidirectionally between server_fd and eis_sock
-            fd_set read_fds;
-            char buffer[4096];
-            
-            // Make sockets non-blocking for better performance
-            int flags = fcntl(server_fd, F_GETFL, 0);
-            fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
-            flags = fcntl(eis_sock, F_GETFL, 0);
-            fcntl(eis_sock, F_SETFL, flags | O_NONBLOCK);
-            
-            while (true) {
-                FD_ZERO(&read_fds);
-                FD_SET(server_fd, &read_fds);
-                FD_SET(eis_sock, &read_fds);
-                
-                int max_fd = std::max(server_fd, eis_sock);
-                struct timeval timeout = {0, 100000}; // 100ms timeout for better responsiveness
-                
-                int activity = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-                
-                if (activity < 0) {
-                    std::cerr << "Bridge select error: " << strerror(errno) << std::endl;
-                    break;
-                }
-                
-                if (activity == 0) continue; // timeout
-                
-                // Forward data from deskflow (server_fd) to EIS server (eis_sock)
-                if (FD_ISSET(server_fd, &read_fds)) {
-                    ssize_t bytes = read(server_fd, buffer, sizeof(buffer));
-                    if (bytes <= 0) {
-                        if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                            std::cout << "Deskflow disconnected from bridge" << std::endl;
-                            break;
-                        }
-                    } else {
-                        if (write(eis_sock, buffer, bytes) != bytes) {
-                            std::cerr << "Failed to forward data to EIS server" << std::endl;
-                            break;
-                        }
-                        //std::cout << "🔄 Forwarded " << bytes << " bytes from deskflow to EIS" << std::endl;
-                    }
-                }
-                
-                // Forward data from EIS server (eis_sock) to deskflow (server_fd)
-                if (FD_ISSET(eis_sock, &read_fds)) {
-                    ssize_t bytes = read(eis_sock, buffer, sizeof(buffer));
-                    if (bytes <= 0) {
-                        if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                            std::cout << "EIS server disconnected from bridge" << std::endl;
-                            break;
-                        }
-                    } else {
-                        if (write(server_fd, buffer, bytes) != bytes) {
-                            std::cerr << "Failed to forward data to deskflow" << std::endl;
-                            break;
-                        }
-                        //std::cout << "🔄 Forwarded " << bytes << " bytes from EIS to deskflow" << std::endl;
-                    }
-                }
-            }
-            
-            std::cout << "🌉 Socket bridge stopped" << std::endl;
-            close(eis_sock);
-        });
-        bridge_thread.detach();
-        
-        // Run the EIS server event loop (adapted from hyprland-eis)
-        std::cout << "🚀 Starting EIS server event loop..." << std::endl;
-        
-        bool stop = false;
-        struct pollfd fds = {
-            .fd = eis_get_fd(eis_context),
-            .events = POLLIN,
-            .revents = 0,
-        };
-        
-        while (!stop) {
-            int nevents = poll(&fds, 1, 100); // Reduced timeout to 100ms for better responsiveness
-            if (nevents == -1) {
-                std::cerr << "EIS poll error: " << strerror(errno) << std::endl;
-                break;
-            }
-            
-            if (nevents == 0) continue; // timeout
-            
-            // Process all pending EIS events in one go - this is crucial for scroll
-            eis_dispatch(eis_context);
-            
-            // Handle ALL events in the queue immediately
-            struct eis_event* event;
-            int event_count = 0;
-            while ((event = eis_get_event(eis_context)) != nullptr) {
-                event_count++;
-                //std::cout << "🎯 EIS: Processing event " << event_count << " type=" << eis_event_get_type(event) << std::endl;
-                
-                // Handle EIS events and forward to virtual devices
-                handle_eis_event(event);
-                eis_event_unref(event);
-            }
-            
-            if (event_count > 0) {
-                std::cout << "📊 EIS: Processed " << event_count << " events in this cycle" << std::endl;
-            }
+    }
+    co_await on_bus();
+    
+    if (message) {
+        call.createErrorReply(sdbus::Error(error, message)).send();
+        co_return;
+    }
+    
+    sdbus::UnixFd ring_fd{memfd, sdbus::adopt_fd};
+    sdbus::UnixFd doorbell_fd{doorbell, sdbus::adopt_fd};
+    
+    auto reply = call.createReply();
+    reply << ring_fd << doorbell_fd;
+    reply.send();
+    
+    std::cout << "✅ ConnectToSharedRing completed - ring sent for session " << handle << std::endl;
+}
+
+void Portal::RequestClipboard(sdbus::MethodCall call) {
+    std::cout << "🔥 Clipboard RequestClipboard called!" << std::endl;
+    
+    sdbus::ObjectPath session_handle;
+    std::map<std::string, sdbus::Variant> options;
+    try {
+        call >> session_handle >> options;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting RequestClipboard parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        return;
+    }
+    
+    if (!exported.count(session_handle)) {
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.NotFound", "Unknown session")).send();
+        return;
+    }
+    clipboard_sessions.insert(session_handle);
+    call.createReply().send();
+    std::cout << "📋 Clipboard enabled for session " << session_handle << std::endl;
+}
+
+void Portal::SetSelection(sdbus::MethodCall call) {
+    sdbus::ObjectPath session_handle;
+    std::map<std::string, sdbus::Variant> options;
+    std::vector<std::string> mime_types;
+    try {
+        call >> session_handle >> options;
+        auto it = options.find("mime_types");
+        if (it != options.end()) {
+            mime_types = it->second.get<std::vector<std::string>>();
         }
-        
-        std::cout << "📡 EIS server thread stopped" << std::endl;
-        unlink(socket_path); // Clean up socket file
-        eis_unref(eis_context);
-        close(server_fd);
-    }).detach();
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting SetSelection parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        return;
+    }
     
-    // Return the client file descriptor to deskflow
+    if (!clipboard_sessions.count(session_handle)) {
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.NotAllowed", "Clipboard not enabled")).send();
+        return;
+    }
+    clipboard->set_selection(session_handle, std::move(mime_types));
+    call.createReply().send();
+}
+
+void Portal::SelectionWrite(sdbus::MethodCall call) {
+    sdbus::ObjectPath session_handle;
+    uint32_t serial;
+    try {
+        call >> session_handle >> serial;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting SelectionWrite parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        return;
+    }
+    
+    // Only the pipe is made here; the data is spliced on the clipboard thread
+    int fd = clipboard_sessions.count(session_handle) ? clipboard->write(session_handle, serial) : -1;
+    if (fd < 0) {
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.NotFound", "No such transfer")).send();
+        return;
+    }
+    sdbus::UnixFd unix_fd{fd, sdbus::adopt_fd};
     auto reply = call.createReply();
+    reply << unix_fd;
+    reply.send();
+}
+
+void Portal::SelectionWriteDone(sdbus::MethodCall call) {
+    sdbus::ObjectPath session_handle;
+    uint32_t serial;
+    bool success;
+    try {
+        call >> session_handle >> serial >> success;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting SelectionWriteDone parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        return;
+    }
     
-    // Create a unix file descriptor object and pass it to the client
-    sdbus::UnixFd unix_fd{client_fd};
+    if (clipboard_sessions.count(session_handle)) {
+        clipboard->write_done(session_handle, serial, success);
+    }
+    call.createReply().send();
+}
+
+void Portal::SelectionRead(sdbus::MethodCall call) {
+    sdbus::ObjectPath session_handle;
+    std::string mime_type;
+    try {
+        call >> session_handle >> mime_type;
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting SelectionRead parameters: " << e.what() << std::endl;
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.Failed", "Failed to extract parameters")).send();
+        return;
+    }
+    
+    int fd = clipboard_sessions.count(session_handle) ? clipboard->read(session_handle, mime_type) : -1;
+    if (fd < 0) {
+        call.createErrorReply(sdbus::Error("org.freedesktop.portal.Error.NotFound", "The selection does not offer that type")).send();
+        return;
+    }
+    sdbus::UnixFd unix_fd{fd, sdbus::adopt_fd};
+    auto reply = call.createReply();
     reply << unix_fd;
     reply.send();
+}
+
+void Portal::emit_selection_owner_changed(const std::vector<std::string>& mime_types, const std::string& owner) {
+    for (const std::string& handle : clipboard_sessions) {
+        std::map<std::string, sdbus::Variant> options;
+        options["mime_types"] = sdbus::Variant(mime_types);
+        options["session_is_owner"] = sdbus::Variant(handle == owner);
+        
+        auto signal = object->createSignal(CLIPBOARD_INTERFACE, "SelectionOwnerChanged");
+        signal << sdbus::ObjectPath(handle) << options;
+        object->emitSignal(signal);
+    }
+}
+
+void Portal::emit_selection_transfer(const std::string& owner, const std::string& mime_type, uint32_t serial) {
+    // The owner may have gone while the paste was on its way
+    if (!clipboard_sessions.count(owner)) {
+        clipboard->write_done(owner, serial, false);
+        return;
+    }
+    auto signal = object->createSignal(CLIPBOARD_INTERFACE, "SelectionTransfer");
+    signal << sdbus::ObjectPath(owner) << mime_type << serial;
+    object->emitSignal(signal);
+}
+
+PortalFlow Portal::DumpFlightRecorder(sdbus::MethodCall call) {
+    co_await exit_on_bus(fail_error(call));
+    // Writing a few hundred kilobytes is control-plane work, not D-Bus thread work
+    co_await on_control();
+    const char* message = nullptr;
+    std::string path;
+    if (!FlightRecorder::enabled()) {
+        message = "The flight recorder is off";
+    } else {
+        path = flight_dump_directory + "/flight-" + std::to_string(time(nullptr)) + ".bin";
+        if (!FlightRecorder::dump(path.c_str())) {
+            std::cerr << "Failed to write flight recorder dump " << path << ": " << strerror(errno) << std::endl;
+            message = "Failed to write the dump";
+        }
+    }
+    co_await on_bus();
     
-    std::cout << "✅ ConnectToEIS completed - socket fd sent to deskflow" << std::endl;
-    std::cout << "🎯 Deskflow can now send EIS events through fd " << client_fd << std::endl;
-    std::cout << "📡 Proper EIS server thread is running with socket bridge" << std::endl;
+    if (message) {
+        call.createErrorReply(sdbus::Error("org.freedesktop.DBus.Error.Failed", message)).send();
+        co_return;
+    }
+    auto reply = call.createReply();
+    reply << path;
+    reply.send();
+    std::cout << "🛩️ Flight recorder dumped to " << path << std::endl;
 }
 
-void Portal::handle_eis_event(struct eis_event* event) {
-    enum eis_event_type type = eis_event_get_type(event);
+void Portal::OutputStats(sdbus::MethodCall call) {
+    OutputScheduler::Stats stats = output_scheduler->totals();
+    std::map<std::string, uint64_t> counters = {
+        {"frames", stats.frames},
+        {"merged", stats.merged},
+        {"throttled", stats.throttled},
+        {"released", stats.released},
+    };
+    auto reply = call.createReply();
+    reply << counters;
+    reply.send();
+}
+
+int Portal::start_eis(Session& session, const std::string& app_id) {
+    // With a compositor EIS socket, input skips translation and goes straight through
+    if (libei_handler && libei_handler->passthrough_enabled()) {
+        auto forwarder = libei_handler->connect_forwarder(app_id.empty() ? "hypr-remote" : app_id);
+        if (forwarder) {
+            session.attach_forwarder(std::move(forwarder));
+            std::cout << "🔀 EIS passthrough enabled for session " << session.handle() << std::endl;
+        } else {
+            std::cerr << "⚠️ EIS passthrough unavailable, translating input for " << session.handle() << std::endl;
+        }
+    }
     
-    // Log all events for debugging
-    const char* event_name = "UNKNOWN";
+    // Start the session's EIS server; we get the client's end of its socket back
+    return session.connect_eis(eis_workers);
+}
+
+// Static names so tracing an event never builds a string
+static const char* eis_event_name(enum eis_event_type type) {
     switch (type) {
-        case EIS_EVENT_CLIENT_CONNECT: event_name = "CLIENT_CONNECT"; break;
-        case EIS_EVENT_CLIENT_DISCONNECT: event_name = "CLIENT_DISCONNECT"; break;
-        case EIS_EVENT_SEAT_BIND: event_name = "SEAT_BIND"; break;
-        case EIS_EVENT_DEVICE_START_EMULATING: event_name = "DEVICE_START_EMULATING"; break;
-        case EIS_EVENT_DEVICE_STOP_EMULATING: event_name = "DEVICE_STOP_EMULATING"; break;
-        case EIS_EVENT_POINTER_MOTION: event_name = "POINTER_MOTION"; break;
-        case EIS_EVENT_POINTER_MOTION_ABSOLUTE: event_name = "POINTER_MOTION_ABSOLUTE"; break;
-        case EIS_EVENT_BUTTON_BUTTON: event_name = "BUTTON_BUTTON"; break;
-        case EIS_EVENT_SCROLL_DELTA: event_name = "SCROLL_DELTA"; break;
-        case EIS_EVENT_SCROLL_DISCRETE: event_name = "SCROLL_DISCRETE"; break;
-        case EIS_EVENT_KEYBOARD_KEY: event_name = "KEYBOARD_KEY"; break;
-        case EIS_EVENT_FRAME: event_name = "FRAME"; break;
-        default: event_name = "UNKNOWN"; break;
-    }
-    //std::cout << "🔥 EIS EVENT: " << event_name << " (type=" << type << ")" << std::endl;
+        case EIS_EVENT_CLIENT_CONNECT: return "CLIENT_CONNECT";
+        case EIS_EVENT_CLIENT_DISCONNECT: return "CLIENT_DISCONNECT";
+        case EIS_EVENT_SEAT_BIND: return "SEAT_BIND";
+        case EIS_EVENT_DEVICE_START_EMULATING: return "DEVICE_START_EMULATING";
+        case EIS_EVENT_DEVICE_STOP_EMULATING: return "DEVICE_STOP_EMULATING";
+        case EIS_EVENT_POINTER_MOTION: return "POINTER_MOTION";
+        case EIS_EVENT_POINTER_MOTION_ABSOLUTE: return "POINTER_MOTION_ABSOLUTE";
+        case EIS_EVENT_BUTTON_BUTTON: return "BUTTON_BUTTON";
+        case EIS_EVENT_SCROLL_DELTA: return "SCROLL_DELTA";
+        case EIS_EVENT_SCROLL_DISCRETE: return "SCROLL_DISCRETE";
+        case EIS_EVENT_KEYBOARD_KEY: return "KEYBOARD_KEY";
+        case EIS_EVENT_FRAME: return "FRAME";
+        default: return "UNKNOWN";
+    }
+}
+
+void Portal::handle_eis_event(InputTarget& target, struct eis_event* event) {
+    auto devices_locked = lock_devices(target);
+    enum eis_event_type type = eis_event_get_type(event);
+    
+    DEBUG_LOG("🔥 EIS EVENT: " << eis_event_name(type) << " (type=" << type << ")");
     
     switch (type) {
         case EIS_EVENT_CLIENT_CONNECT: {
@@ -733,6 +1624,7 @@ void Portal::handle_eis_event(struct eis_event* event) {
             eis_seat_configure_capability(seat, EIS_DEVICE_CAP_BUTTON);
             eis_seat_configure_capability(seat, EIS_DEVICE_CAP_SCROLL);
             eis_seat_add(seat);
+            eis_seat_unref(seat); // the client keeps the seat alive
             
             std::cout << "💺 EIS: Seat added for client with capabilities" << std::endl;
             break;
@@ -756,45 +1648,36 @@ void Portal::handle_eis_event(struct eis_event* event) {
             
             // Set pointer region (screen size)
             struct eis_region* region = eis_device_new_region(pointer);
-            eis_region_set_size(region, 1920, 1080); // TODO: Get actual screen size
+            eis_region_set_size(region, Translation::REGION_WIDTH, Translation::REGION_HEIGHT);
             eis_region_add(region);
+            eis_region_unref(region);
             
             eis_device_add(pointer);
             eis_device_resume(pointer);
+            eis_device_unref(pointer); // the seat keeps added devices alive
             
             // Add keyboard device with proper keymap setup
             struct eis_device* keyboard = eis_seat_new_device(seat);
             eis_device_configure_name(keyboard, "Hyprland Portal Keyboard");
             eis_device_configure_capability(keyboard, EIS_DEVICE_CAP_KEYBOARD);
             
-            // Set up a basic keymap for proper modifier key handling
-            // This is crucial for key combinations like Meta+Enter to work
-            const char* keymap_str = 
-                "xkb_keymap {\n"
-                "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
-                "xkb_types     { include \"complete\" };\n"
-                "xkb_compat    { include \"complete\" };\n"
-                "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
-                "xkb_geometry  { include \"pc(pc105)\" };\n"
-                "};\n";
-                
-            // Create a memory file for the keymap
-            size_t keymap_size = strlen(keymap_str);
-            int memfd = memfd_create("keymap", MFD_CLOEXEC);
-            if (memfd >= 0) {
-                if (write(memfd, keymap_str, keymap_size) == (ssize_t)keymap_size) {
-                    struct eis_keymap* keymap = eis_device_new_keymap(keyboard, 
-                        EIS_KEYMAP_TYPE_XKB, memfd, keymap_size);
-                    if (keymap) {
-                        eis_keymap_add(keymap);
-                        std::cout << "🗝️ EIS: Keymap configured for proper modifier handling" << std::endl;
-                    }
+            // The portal's keymap, for proper modifier key handling (crucial for
+            // key combinations like Meta+Enter). Every bind shares Xkb's sealed
+            // memfd, already compiled and normalized; libeis sends its own copy.
+            Xkb* xkb = Xkb::self();
+            if (xkb->keymap_fd() >= 0) {
+                struct eis_keymap* keymap = eis_device_new_keymap(keyboard,
+                    EIS_KEYMAP_TYPE_XKB, xkb->keymap_fd(), xkb->keymap_text().size());
+                if (keymap) {
+                    eis_keymap_add(keymap);
+                    eis_keymap_unref(keymap);
+                    std::cout << "🗝️ EIS: Keymap configured for proper modifier handling" << std::endl;
                 }
-                close(memfd);
             }
             
             eis_device_add(keyboard);
             eis_device_resume(keyboard);
+            eis_device_unref(keyboard);
             
             std::cout << "🖱️ EIS: Pointer and keyboard devices added with enhanced features" << std::endl;
             break;
@@ -812,256 +1695,27 @@ void Portal::handle_eis_event(struct eis_event* event) {
             break;
         }
         
-        case EIS_EVENT_POINTER_MOTION: {
-            double dx = eis_event_pointer_get_dx(event);
-            double dy = eis_event_pointer_get_dy(event);
-            
-            std::cout << "🖱️ EIS: Pointer motion dx=" << dx << " dy=" << dy << std::endl;
-            
-            // Forward to virtual pointer
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_motion(time, dx, dy);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Motion forwarded to virtual pointer" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_POINTER_MOTION_ABSOLUTE: {
-            double x = eis_event_pointer_get_absolute_x(event);
-            double y = eis_event_pointer_get_absolute_y(event);
-            
-            std::cout << "🖱️ EIS: Pointer absolute motion x=" << x << " y=" << y << std::endl;
-            
-            // Forward to virtual pointer  
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_motion_absolute(time, 
-                    static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1920, 1080);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Absolute motion forwarded to virtual pointer" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_BUTTON_BUTTON: {
-            uint32_t button = eis_event_button_get_button(event);
-            bool is_press = eis_event_button_get_is_press(event);
-            
-            std::cout << "🖱️ EIS: Button " << (is_press ? "press" : "release") << " button=" << button << std::endl;
-            
-            // Forward to virtual pointer
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                libei_handler->pointer->send_button(time, button, is_press ? 1 : 0);
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Button event forwarded to virtual pointer" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_SCROLL_DELTA: {
-            double dx = eis_event_scroll_get_dx(event);
-            double dy = eis_event_scroll_get_dy(event);
-            
-            std::cout << "🖱️ EIS: Scroll delta dx=" << dx << " dy=" << dy << std::endl;
-            
-            // Debug: Check if we have the required components
-            std::cout << "🔍 DEBUG: libei_handler=" << (libei_handler ? "YES" : "NO") 
-                      << ", pointer=" << (libei_handler && libei_handler->pointer ? "YES" : "NO") << std::endl;
-            
-            // Forward to virtual pointer with proper Wayland scroll protocol
-            if (libei_handler && libei_handler->pointer) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                
-                std::cout << "🎯 Sending scroll events with time=" << time << std::endl;
-                
-                // Set axis source - wheel is the most common source for EIS scroll events
-                libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-                    
-                // Scale the scroll values appropriately for Wayland
-                double scale_factor = 15.0; // Good default for smooth scrolling
-                
-                if (dx != 0.0) {
-                    std::cout << "🔄 Sending horizontal scroll: " << (dx * scale_factor) << std::endl;
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, dx * scale_factor, dy);
-                    // Send axis stop to complete the scroll event
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL);
-                }
-                if (dy != 0.0) {
-                    std::cout << "🔄 Sending vertical scroll: " << (dy * scale_factor) << std::endl;
-                    libei_handler->pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL, dx * scale_factor, dy);
-                    // Send axis stop to complete the scroll event  
-                    libei_handler->pointer->send_axis_stop(time, WL_POINTER_AXIS_VERTICAL_SCROLL);
-                }
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Scroll delta forwarded with proper axis protocol" << std::endl;
-            } else {
-                std::cout << "❌ Cannot forward scroll - missing virtual pointer!" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_SCROLL_DISCRETE: {
-            int32_t dx = eis_event_scroll_get_discrete_dx(event);
-            int32_t dy = eis_event_scroll_get_discrete_dy(event);
-            
-            if (dx == 0 && dy == 0) {
-                break;
-                // Assume this is a vertical scroll event and give it a default value
-                //dy = -1; // Negative = scroll up (standard)
-                //std::cout << "🔄 Discrete values are 0, assuming vertical scroll step: dy=" << dy << std::endl;
-            }
-
-            std::cout << "🖱️ EIS: Scroll discrete dx=" << dx << " dy=" << dy << std::endl;
-            
-            // If discrete values are 0, assume vertical scroll with 1 step (common case)
-                        
-            // Forward discrete scroll if we have actual values (now that we fixed 0,0 case)
-            if (libei_handler && libei_handler->pointer && (dx != 0 || dy != 0)) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                    
-                // Set axis source for discrete scroll (wheel clicks)
-                libei_handler->pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
-                
-                // Use standard scroll value per click - simple and effective
-                double scroll_value = 15.0;
-                int axis = dx == 0 ? WL_POINTER_AXIS_VERTICAL_SCROLL : WL_POINTER_AXIS_HORIZONTAL_SCROLL;
-                libei_handler->pointer->send_axis_discrete(time, dx, dy);
-                // libei_handler->pointer->send_axis_stop(time, axis);
-            
-                libei_handler->pointer->send_frame();
-                std::cout << "✅ Scroll discrete forwarded (steps=" << dx << "," << dy << ")" << std::endl;
-            } else {
-                std::cout << "❌ No scroll to forward (dx=" << dx << " dy=" << dy << ") or no pointer available" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_KEYBOARD_KEY: {
-            uint32_t keycode = eis_event_keyboard_get_key(event);
-            bool is_press = eis_event_keyboard_get_key_is_press(event);
-            
-            std::cout << "⌨️ EIS: Keyboard " << (is_press ? "press" : "release") << " keycode=" << keycode << std::endl;
-            
-            // Debug: Check if we have the required components
-            std::cout << "🔍 DEBUG: libei_handler=" << (libei_handler ? "YES" : "NO") 
-                      << ", keyboard=" << (libei_handler && libei_handler->keyboard ? "YES" : "NO") << std::endl;
-            
-            // Forward to virtual keyboard with immediate modifier updates
-            if (libei_handler && libei_handler->keyboard) {
-                uint32_t time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::steady_clock::now().time_since_epoch()).count());
-                    
-                std::cout << "🎯 Processing key event with time=" << time << std::endl;
-                
-                // Update modifier state BEFORE sending the key event (using raw keycode)
-                update_modifier_state(keycode, is_press);
-                
-                std::cout << "🔧 Current modifier state: depressed=" << modifier_state_depressed 
-                         << ", latched=" << modifier_state_latched << ", locked=" << modifier_state_locked << std::endl;
-                
-                // Send modifier state first - this is crucial for key combinations like Meta+Enter
-                libei_handler->keyboard->send_modifiers(modifier_state_depressed, 
-                                                      modifier_state_latched,
-                                                      modifier_state_locked, 
-                                                      modifier_state_group);
-                
-                // Send the actual key event with the raw keycode (no conversion needed!)
-                libei_handler->keyboard->send_key(time, keycode, is_press ? 1 : 0);
-                
-                // Send modifiers again after the key event to ensure state consistency
-                libei_handler->keyboard->send_modifiers(modifier_state_depressed, 
-                                                      modifier_state_latched,
-                                                      modifier_state_locked, 
-                                                      modifier_state_group);
-                                                      
-                std::cout << "✅ Key " << keycode << " (" << (is_press ? "pressed" : "released") 
-                         << ") forwarded with modifier state: " << modifier_state_depressed << std::endl;
-            } else {
-                std::cout << "❌ Cannot forward key - missing virtual keyboard!" << std::endl;
-            }
-            break;
-        }
-        
-        case EIS_EVENT_FRAME:
-            // Frame events group related events together - just log for now
-            std::cout << "📸 EIS: Frame event" << std::endl;
-            break;
-            
         default:
-            std::cout << "❓ EIS: Unhandled event type: " << type << std::endl;
+            // Input events and frames
+            Translator<EisSource>::translate(target, event);
             break;
     }
+    
+    PROBE2(translate_done, PROBE_SOURCE_EIS, type);
 }
 
-void Portal::update_modifier_state(uint32_t keycode, bool is_press) {
-    // EIS uses raw Linux input keycodes (NOT XKB keycodes with +8 offset)
-    // These are the standard Linux input event keycodes
-    bool is_modifier = false;
-    uint32_t modifier_mask = 0;
+void Portal::handle_ring_records(InputTarget& target, const SharedRingRecord* records, size_t count) {
+    // A whole batch goes out in one flush, however many frames it holds
+    auto devices_locked = lock_devices(target);
+    if (target.pointer) target.pointer->begin_deferred_flush();
+    if (target.keyboard) target.keyboard->begin_deferred_flush();
     
-    switch (keycode) {
-        case 42:  // Shift_L (raw keycode 42)
-        case 54:  // Shift_R (raw keycode 54)
-            is_modifier = true;
-            modifier_mask = MOD_SHIFT;
-            std::cout << "🔧 Detected SHIFT key: " << keycode << std::endl;
-            break;
-            
-        case 29:  // Control_L (raw keycode 29)
-        case 97:  // Control_R (raw keycode 97)
-            is_modifier = true;
-            modifier_mask = MOD_CTRL;
-            std::cout << "🔧 Detected CTRL key: " << keycode << std::endl;
-            break;
-            
-        case 56:  // Alt_L (raw keycode 56)
-        case 100: // Alt_R (raw keycode 100)
-            is_modifier = true;
-            modifier_mask = MOD_ALT;
-            std::cout << "🔧 Detected ALT key: " << keycode << std::endl;
-            break;
-            
-        case 125: // Super_L (raw keycode 125) - Meta/Windows key
-        case 126: // Super_R (raw keycode 126)
-            is_modifier = true;
-            modifier_mask = MOD_META;
-            std::cout << "🔧 Detected META/SUPER key: " << keycode << std::endl;
-            break;
-            
-        case 58:  // Caps_Lock (raw keycode 58)
-            // Caps lock is special - toggle on press only
-            if (is_press) {
-                modifier_state_locked ^= MOD_CAPS; // Toggle caps lock state
-                std::cout << "🔒 Caps Lock toggled: " << (modifier_state_locked & MOD_CAPS ? "ON" : "OFF") << std::endl;
-            }
-            return;
-            
-        case 69:  // Num_Lock (raw keycode 69)
-            // Num lock is special - toggle on press only
-            if (is_press) {
-                modifier_state_locked ^= MOD_NUM; // Toggle num lock state
-                std::cout << "🔢 Num Lock toggled: " << (modifier_state_locked & MOD_NUM ? "ON" : "OFF") << std::endl;
-            }
-            return;
+    for (size_t i = 0; i < count; i++) {
+        Translator<SharedRingSource>::translate(target, &records[i]);
     }
     
-    if (is_modifier) {
-        if (is_press) {
-            modifier_state_depressed |= modifier_mask;
-            std::cout << "🔧 Modifier pressed: " << modifier_mask << " (state: " << modifier_state_depressed << ")" << std::endl;
-        } else {
-            modifier_state_depressed &= ~modifier_mask;
-            std::cout << "🔧 Modifier released: " << modifier_mask << " (state: " << modifier_state_depressed << ")" << std::endl;
-        }
-    } else {
-        std::cout << "🔍 Non-modifier key: " << keycode << std::endl;
-    }
-} 
\ No newline at end of file
+    if (target.pointer) target.pointer->end_deferred_flush();
+    if (target.keyboard) target.keyboard->end_deferred_flush();
+    
+    PROBE2(translate_done, PROBE_SOURCE_RING, count);
+}
@@ -1,13 +1,41 @@
 #pragma once
 
+#include "frame_sink.h"
+#include "input_target.h"
+#include "input_transform.h"
+#include "output_backend.h"
+#include "portal_flow.h"
 #include <sdbus-c++/sdbus-c++.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include "libei-1.0/libeis.h"
 }
 
+class CaptureStream;
+class Clipboard;
+class DevicePool;
+class EisWorkers;
 class LibEIHandler;
+class OutputScheduler;
+class RestoreStore;
+class Screencopy;
+class Session;
+class TransformConfig;
+struct SharedRingRecord;
 
 class Portal {
 public:
@@ -16,36 +44,233 @@ public:
     
     bool init(LibEIHandler* handler);
     void cleanup();
+    // Serve D-Bus until stop(). This thread is the data plane: it decodes and
+    // applies Notify* input, routes calls and sends replies. Session setup and
+    // teardown run on a control thread started here, so they never stall input;
+    // calls that set sessions up are flows that hop between the two, so any
+    // number of them can be under way at once.
     void run();
     void stop();
     
+    // Wire up input forwarding without exporting the D-Bus object (benchmarks and tests).
+    // The handler's devices become the shared target, so set them first.
+    void set_libei_handler(LibEIHandler* handler);
+    
+    // Sessions take their own devices from the pool; without one they share the
+    // LibEI handler's devices
+    void set_device_pool(DevicePool* pool) { device_pool = pool; }
+    
+    // Route each session's pooled devices through the scheduler's fair queueing
+    // and rate limits; Diagnostics.OutputStats reports its counters. Before init().
+    void set_output_scheduler(OutputScheduler* scheduler) { output_scheduler = scheduler; }
+    
+    // Serve ConnectToEIS sessions on these worker threads; without them each
+    // session gets a thread of its own
+    void set_eis_workers(EisWorkers* workers) { eis_workers = workers; }
+    
+    // Issue restore tokens to sessions that ask to persist, and let returning
+    // clients skip device selection; without a store persist_mode is ignored
+    void set_restore_store(RestoreStore* store) { restore_store = store; }
+    
+    // Offer the ScreenCast interface, capturing with `capture` into sinks from
+    // `sinks` (PipeWire streams); without it only RemoteDesktop is exported.
+    // Before init().
+    void set_screencast(Screencopy* capture, SinkFactory sinks) {
+        screencopy = capture;
+        sink_factory = std::move(sinks);
+    }
+    
+    // Offer the Clipboard interface over `board`'s selection; without it sessions
+    // get no clipboard. Before init().
+    void set_clipboard(Clipboard* board) { clipboard = board; }
+    
+    // Rewrite each session's input with the config's transform for its app; the
+    // shared devices get the default one
+    void set_transform_config(TransformConfig* config);
+    // Re-read the transform config and swap every live session's transform in
+    // place (on the control thread; input is not paused). Any thread.
+    void reload_transforms();
+    
+    // Offer ConnectToSharedRing, shared-memory input for trusted local clients;
+    // off unless asked for. Before init().
+    void set_shared_ring(bool enabled) { shared_ring_enabled = enabled; }
+    
+    // Export Diagnostics.DumpFlightRecorder, writing dumps into `directory`;
+    // without it the method is not offered. Before init().
+    void set_flight_dump_directory(std::string directory) { flight_dump_directory = std::move(directory); }
+    
+    // The shared devices (LibEI handler's) with the portal-wide modifier state
+    InputTarget& shared_target() { return shared_input; }
+    
+    // Translation hot paths (see Translator), public so they can be driven without a D-Bus session
+    void handle_eis_event(InputTarget& target, struct eis_event* event);
+    void handle_ring_records(InputTarget& target, const SharedRingRecord* records, size_t count);
+    
+    // Input forwarding behind the legacy Notify* methods, after unmarshalling
+    void notify_pointer_motion(InputTarget& target, double dx, double dy);
+    void notify_pointer_button(InputTarget& target, int32_t button, uint32_t state);
+    void notify_keyboard_keycode(InputTarget& target, int32_t keycode, uint32_t state);
+    void notify_keyboard_keysym(InputTarget& target, int32_t keysym, uint32_t state);
+    void notify_pointer_axis(InputTarget& target, double dx, double dy);
+    
+    // A Notify* call as unmarshalled. The D-Bus handlers only queue these; the
+    // queue is applied once all pending D-Bus messages have been drained.
+    struct QueuedInput {
+        enum Kind { POINTER_MOTION, POINTER_BUTTON, KEYBOARD_KEYCODE, KEYBOARD_KEYSYM, POINTER_AXIS };
+        Kind kind;
+        InputTarget* target;
+        double dx = 0, dy = 0;  // motion, axis
+        int32_t code = 0;       // button, keycode, keysym
+        uint32_t state = 0;
+    };
+    
+    // A motion merges into the target's last queued call if that is a motion too,
+    // so a run of motions becomes one Wayland frame; nothing else is reordered
+    void queue_input(const QueuedInput& input);
+    // Apply the queue in order, flushing each touched device once at the end
+    void apply_queued_input();
+    
 private:
     std::unique_ptr<sdbus::IConnection> connection;
     std::unique_ptr<sdbus::IObject> object;
     LibEIHandler* libei_handler;
-    bool running;
+    DevicePool* device_pool = nullptr;
+    OutputScheduler* output_scheduler = nullptr;
+    EisWorkers* eis_workers = nullptr;
+    RestoreStore* restore_store = nullptr;
+    Screencopy* screencopy = nullptr;
+    Clipboard* clipboard = nullptr;
+    TransformConfig* transform_config = nullptr;
+    SinkFactory sink_factory;
+    std::string flight_dump_directory;
+    bool shared_ring_enabled = false;
+    std::atomic<bool> running;
+    
+    // Wakes run() from other threads (stop, sessions ending, control jobs done)
+    int wake_fd = -1;
     
-    // Modifier state tracking for proper key combination handling
-    uint32_t modifier_state_depressed = 0;
-    uint32_t modifier_state_latched = 0;
-    uint32_t modifier_state_locked = 0;
-    uint32_t modifier_state_group = 0;
+    // Live sessions by handle; only touched on the control thread (and by
+    // cleanup() once both threads have stopped)
+    std::map<std::string, std::unique_ptr<Session>> sessions;
     
-    // XKB modifier masks for common modifiers
-    static constexpr uint32_t MOD_SHIFT = 1 << 0;
-    static constexpr uint32_t MOD_CAPS = 1 << 1;
-    static constexpr uint32_t MOD_CTRL = 1 << 2;
-    static constexpr uint32_t MOD_ALT = 1 << 3;
-    static constexpr uint32_t MOD_NUM = 1 << 4;
-    static constexpr uint32_t MOD_META = 1 << 6; // Super/Windows key
+    // Sessions whose object is on the bus, for routing Notify* input and Close;
+    // D-Bus thread only. A session is exported after the control thread has set
+    // it up and unexported before it is handed back to be torn down.
+    std::map<std::string, Session*> exported;
     
-    void update_modifier_state(uint32_t keycode, bool is_press);
+    // Exported sessions that asked for the clipboard (D-Bus thread only)
+    std::set<std::string> clipboard_sessions;
+    
+    // Sessions to tear down: handle and whether to emit Closed
+    std::mutex pending_mutex;
+    std::vector<std::pair<std::string, bool>> pending_close;
+    
+    // Control plane: session setup and teardown (devices, EIS servers, the
+    // compositor's EIS socket, restore tokens on disk) run here in order. Jobs
+    // never touch the D-Bus connection or sdbus types; they answer through
+    // completions, which run() applies on the D-Bus thread. Timed jobs wait in
+    // control_timers until they are due, leaving the thread to the others.
+    std::thread control_thread;
+    std::mutex control_mutex;
+    std::condition_variable control_ready;
+    std::deque<std::function<void()>> control_jobs;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> control_timers;
+    bool control_stopping = false;
+    
+    std::mutex completion_mutex;
+    std::vector<std::function<void()>> completions;
+    
+    void wake();
+    void request_close(const std::string& handle, bool emit_closed);
+    void reap_sessions();
+    void end_session(Session& session);
+    
+    void run_control();
+    void stop_control();
+    void post_control(std::function<void()> job);
+    void post_control_at(std::chrono::steady_clock::time_point due, std::function<void()> job);
+    void post_completion(std::function<void()> done);
+    void apply_completions();
+    
+    // Where a flow continues (see PortalFlow): on the control thread, on the
+    // D-Bus thread, or on the control thread once `ready` holds or `timeout_ms`
+    // has passed, checked every few ms without holding the thread up
+    Hop on_control();
+    Hop on_bus();
+    Hop control_until(std::function<bool()> ready, int timeout_ms);
+    void resume_when(std::function<bool()> ready, std::chrono::steady_clock::time_point deadline, ResumeJob resume);
+    // Awaited first by every flow: it ends on the D-Bus thread, where
+    // `on_failure` answers its call if it threw or was dropped at shutdown
+    FlowExit exit_on_bus(std::function<void()> on_failure);
+    
+    // Control thread: a new session with its devices and handlers, nullptr if
+    // the handle is taken; and the end of one that has left the bus
+    Session* create_session(const std::string& handle, const std::string& app_id);
+    void finish_session(const std::string& handle);
+    
+    // Start the session's EIS server (through the compositor's EIS when passthrough
+    // is on) and return the client's end, or -1
+    int start_eis(Session& session, const std::string& app_id);
+    
+    // A started ScreenCast stream as the response's `streams` describes it
+    struct StreamInfo {
+        uint32_t node = 0;
+        int32_t x = 0, y = 0, width = 0, height = 0;
+        std::string id;
+    };
+    // Control thread: start capturing what the session selected, unless it
+    // already is; the captures' streams come up with their first frames
+    std::vector<std::unique_ptr<CaptureStream>> start_captures(Session& session);
+    static bool streams_up(const std::vector<std::unique_ptr<CaptureStream>>& captures);
+    // Control thread: give the session the captures whose stream came up and
+    // describe all of its streams; empty if it has none (or has gone)
+    std::vector<StreamInfo> adopt_streams(const std::string& handle, std::vector<std::unique_ptr<CaptureStream>> captures);
+    // The `streams` of a Start response: a(ua{sv}) of node id and properties
+    static sdbus::Variant streams_variant(const std::vector<StreamInfo>& streams);
+    
+    // The session's input, or the shared target for an unknown one (D-Bus thread)
+    InputTarget& target_for(const std::string& session_handle);
+    
+    // Shared devices and their modifier state, for Notify* calls outside a
+    // session; sessions without a pooled pair write to the same devices, each
+    // with its own state and, behind the output scheduler, its own flow
+    // (without one they take turns under shared_devices_lock)
+    InputTarget shared_input;
+    DevicePair notify_flow; // shared_input's stand-ins behind the output scheduler
+    std::mutex shared_devices_lock;
+    TransformSlot shared_transform;
+    
+    // Unmarshalling buffers reused by the Notify* handlers (D-Bus thread only), so
+    // steady-state calls stop allocating once the strings have grown to size
+    sdbus::ObjectPath notify_session;
+    std::map<std::string, sdbus::Variant> notify_options;
+    
+    // Queued Notify* input and the targets it touches, reused between batches
+    std::vector<QueuedInput> input_queue;
+    std::vector<InputTarget*> queued_targets;
     
     // D-Bus method handlers
-    void CreateSession(sdbus::MethodCall call);
-    void SelectSources(sdbus::MethodCall call);
-    void SelectDevices(sdbus::MethodCall call);
-    void Start(sdbus::MethodCall call);
+    PortalFlow CreateSession(sdbus::MethodCall call);
+    PortalFlow SelectDevices(sdbus::MethodCall call);
+    PortalFlow Start(sdbus::MethodCall call);
+    
+    // ScreenCast methods (CreateSession is shared with RemoteDesktop)
+    PortalFlow SelectSources(sdbus::MethodCall call);
+    PortalFlow StartScreenCast(sdbus::MethodCall call);
+    
+    // Clipboard methods, and its signals to the sessions that use it
+    void RequestClipboard(sdbus::MethodCall call);
+    void SetSelection(sdbus::MethodCall call);
+    void SelectionWrite(sdbus::MethodCall call);
+    void SelectionWriteDone(sdbus::MethodCall call);
+    void SelectionRead(sdbus::MethodCall call);
+    void emit_selection_owner_changed(const std::vector<std::string>& mime_types, const std::string& owner);
+    void emit_selection_transfer(const std::string& owner, const std::string& mime_type, uint32_t serial);
+    
+    // Diagnostics: write the flight recorder to a new file and return its path
+    PortalFlow DumpFlightRecorder(sdbus::MethodCall call);
+    // Diagnostics: the output scheduler's counters so far, live and detached flows
+    void OutputStats(sdbus::MethodCall call);
     
     // Input notification methods - these are called by remote clients to send input events
     void NotifyPointerMotion(sdbus::MethodCall call);
@@ -55,8 +280,8 @@ private:
     void NotifyPointerAxis(sdbus::MethodCall call);
     
     // Modern EIS (Emulated Input Server) method
-    void ConnectToEIS(sdbus::MethodCall call);
+    PortalFlow ConnectToEIS(sdbus::MethodCall call);
     
-    // EIS event handling
-    void handle_eis_event(struct eis_event* event);
+    // The same input over a shared-memory ring, for clients on this machine
+    PortalFlow ConnectToSharedRing(sdbus::MethodCall call);
 };  
\ No newline at end of file
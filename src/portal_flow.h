@@ -0,0 +1,159 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+// Portal method calls written as coroutines. A flow starts running inside the
+// D-Bus handler and moves between threads by awaiting a Hop: it suspends, the
+// Hop posts a job that resumes it on the other thread, and the handler (or the
+// job it was resumed from) returns at once. Nothing waits for a flow; it frees
+// itself when it returns.
+//
+//     PortalFlow Portal::Method(sdbus::MethodCall call) {
+//         co_await exit_on_bus(...);  // end on the D-Bus thread, answering a failure
+//         ...unmarshal...
+//         co_await on_control();      // set up on the control thread
+//         ...
+//         co_await on_bus();          // reply on the D-Bus thread
+//     }
+//
+// Flows own what they hold across a hop (the call, its Request). One that holds
+// sdbus objects awaits a FlowExit first, so its frame is destroyed on the D-Bus
+// thread and its call is answered even if it throws.
+
+struct PortalFlow {
+    struct promise_type;
+};
+
+using FlowHandle = std::coroutine_handle<PortalFlow::promise_type>;
+
+// Resumes a suspended flow when called, or with `finish`, ends one that has
+// returned: a flow that failed answers its call, then its frame is destroyed.
+// A job that is dropped without being called (a queue cleared at shutdown)
+// answers and destroys the flow instead, on the thread that drops it, so a
+// flow that can never finish neither leaks nor leaves its caller waiting.
+class ResumeJob {
+public:
+    explicit ResumeJob(FlowHandle handle, bool finish = false) : state(std::make_shared<State>(handle, finish)) {}
+
+    void operator()() const;
+
+private:
+    struct State {
+        FlowHandle handle;
+        bool finish;
+        State(FlowHandle h, bool f) : handle(h), finish(f) {}
+        ~State();
+    };
+    std::shared_ptr<State> state;
+};
+
+struct PortalFlow::promise_type {
+    // Where the flow ends and what it answers when it fails (see FlowExit);
+    // without them it ends wherever it returns and answers nothing
+    std::function<void(ResumeJob)> end_on;
+    std::function<void()> on_failure;
+    bool failed = false;
+
+    struct FinalHop {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(FlowHandle handle) noexcept;
+        void await_resume() const noexcept {}
+    };
+
+    PortalFlow get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    FinalHop final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    // Logged here; the call is answered where the flow ends
+    void unhandled_exception() noexcept {
+        failed = true;
+        try {
+            std::rethrow_exception(std::current_exception());
+        } catch (const std::exception& e) {
+            std::cerr << "Error in portal request: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Unknown error in portal request" << std::endl;
+        }
+    }
+
+    // Answer the call with the flow's failure, once
+    void answer_failure() noexcept {
+        if (!failed || !on_failure) return;
+        try {
+            std::exchange(on_failure, nullptr)();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to answer portal call: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Failed to answer portal call" << std::endl;
+        }
+    }
+};
+
+// co_await first thing in a flow: it then ends on the thread `end_on` posts to,
+// where its frame (and every sdbus object in it) is destroyed, and a flow that
+// throws answers with `on_failure` there first
+struct FlowExit {
+    std::function<void(ResumeJob)> end_on;
+    std::function<void()> on_failure;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(FlowHandle handle) noexcept {
+        handle.promise().end_on = std::move(end_on);
+        handle.promise().on_failure = std::move(on_failure);
+        return false;
+    }
+    void await_resume() const noexcept {}
+};
+
+inline void ResumeJob::operator()() const {
+    FlowHandle handle = std::exchange(state->handle, nullptr);
+    if (!handle) return;
+    if (!state->finish) {
+        handle.resume();
+        return;
+    }
+    handle.promise().answer_failure();
+    handle.destroy();
+}
+
+inline ResumeJob::State::~State() {
+    if (!handle) return;
+    // Cut short, it never got to answer
+    if (!finish) handle.promise().failed = true;
+    handle.promise().answer_failure();
+    handle.destroy();
+}
+
+inline void PortalFlow::promise_type::FinalHop::await_suspend(FlowHandle handle) noexcept {
+    promise_type& promise = handle.promise();
+    if (!promise.end_on) {
+        handle.destroy();
+        return;
+    }
+    // A job that cannot be posted is dropped, which ends the flow here instead
+    std::function<void(ResumeJob)> end_on = std::move(promise.end_on);
+    try {
+        end_on(ResumeJob(handle, true));
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to end portal request: " << e.what() << std::endl;
+    }
+}
+
+// co_await to continue wherever `post` runs its job
+struct Hop {
+    std::function<void(ResumeJob)> post;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(FlowHandle handle) {
+        // The flow may be resumed, and finish, before post returns: nothing in
+        // its frame (this Hop included) is touched after the job is out
+        std::function<void(ResumeJob)> post_job = std::move(post);
+        post_job(ResumeJob(handle));
+    }
+    void await_resume() const noexcept {}
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+// USDT (systemtap-style) static tracepoints under the `hypr_remote` provider,
+// for bpftrace/perf. An unattached probe is a single nop; its arguments are
+// evaluated but only described in an ELF note, so keep them cheap. Without
+// <sys/sdt.h> (or with -DHYPR_REMOTE_NO_PROBES) they compile to nothing.
+//
+//   eis_ingress(type, session, client_time_us)  EIS event read on a session thread
+//   ei_ingress(type, client_time_us)             EI event read by the LibEI handler
+//   dbus_ingress(method, session)                Notify* call unmarshalled
+//   ring_ingress(session, count)                 batch of shared ring records copied out
+//   translate_done(source, type)                 event handed to the output side;
+//                                                type is the EIS/EI event type, or
+//                                                the ProbeNotify for D-Bus
+//   wayland_flush(bytes, error)                  wl_display_flush result and errno
+//   capture_frame(output, rects, sequence)       screencopy frame with damage handed to its sink
+//   throttled(session, kind)                     a session's motion (0) or scroll (1)
+//                                                frame held by its rate limit
+//   session_create(session, app_id)
+//   session_destroy(session)
+//
+// Client timestamps are only known on frames and are 0 otherwise. See
+// contrib/bpftrace for scripts built on these.
+
+#if defined(__has_include) && !defined(HYPR_REMOTE_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HYPR_REMOTE_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef HYPR_REMOTE_HAVE_PROBES
+#define PROBE1(name, a) DTRACE_PROBE1(hypr_remote, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(hypr_remote, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(hypr_remote, name, a, b, c)
+#else
+#define PROBE1(name, a) do { (void)(a); } while (0)
+#define PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define PROBE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+#endif
+
+// Where a translate_done event came from
+enum ProbeSource {
+    PROBE_SOURCE_EIS = 0,
+    PROBE_SOURCE_EI = 1,
+    PROBE_SOURCE_DBUS = 2,
+    PROBE_SOURCE_PASSTHROUGH = 3,
+    PROBE_SOURCE_RING = 4, // type is the batch's record count
+};
+
+// translate_done type for the Notify* methods
+enum ProbeNotify {
+    PROBE_NOTIFY_POINTER_MOTION = 0,
+    PROBE_NOTIFY_POINTER_BUTTON = 1,
+    PROBE_NOTIFY_KEYBOARD_KEYCODE = 2,
+    PROBE_NOTIFY_KEYBOARD_KEYSYM = 3,
+    PROBE_NOTIFY_POINTER_AXIS = 4,
+};
@@ -0,0 +1,62 @@
+#include "recording_backend.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+RecordingBackend::RecordingBackend(std::string path) : path(std::move(path)) {
+}
+
+RecordingBackend::~RecordingBackend() {
+    cleanup();
+}
+
+bool RecordingBackend::init() {
+    if (!path.empty()) {
+        file = fopen(path.c_str(), "we");
+        if (!file) {
+            std::cerr << "Failed to open recording file " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::cout << "Recording output backend writing to " << path << std::endl;
+    } else {
+        std::cout << "Recording output backend keeping requests in memory" << std::endl;
+    }
+    return true;
+}
+
+void RecordingBackend::cleanup() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pairs) {
+        size_t recorded = finished;
+        for (const RequestLog* log : live) recorded += log->total();
+        std::cout << "📼 Recorded " << recorded << " requests from " << pairs << " device pairs" << std::endl;
+    }
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+DevicePair RecordingBackend::create_pair() {
+    // The last device of the pair to go frees the log, keeping only its count
+    std::shared_ptr<RequestLog> log(file ? new RequestLog(0, file) : new RequestLog(), [this](RequestLog* log) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished += log->total();
+        live.erase(log);
+        delete log;
+    });
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        live.insert(log.get());
+        pairs++;
+    }
+    return DevicePair(std::make_unique<RecordingVirtualPointer>(log),
+                      std::make_unique<RecordingVirtualKeyboard>(log));
+}
+
+size_t RecordingBackend::total() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t recorded = finished;
+    for (const RequestLog* log : live) recorded += log->total();
+    return recorded;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "output_backend.h"
+#include "wayland_request.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Preallocated request log shared by a recording pointer/keyboard pair. Recording
+// never allocates until the reserve is used up, so it does not skew allocation
+// counts. With a file, entries are appended to it (stdio-buffered) instead of
+// being kept in memory.
+class RequestLog {
+public:
+    explicit RequestLog(size_t reserve = 1 << 16, FILE* file = nullptr) : file(file) {
+        if (!file) entries.reserve(reserve);
+    }
+
+    void record(WaylandRequest request, uint32_t time = 0,
+                uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0, uint32_t a4 = 0) {
+        RecordedRequest entry{request, time, {a0, a1, a2, a3, a4}};
+        if (file) {
+            fwrite(&entry, sizeof(entry), 1, file);
+            written++;
+        } else {
+            entries.push_back(entry);
+        }
+    }
+
+    void clear() { entries.clear(); }
+
+    size_t count(WaylandRequest request) const {
+        size_t n = 0;
+        for (const auto& entry : entries) {
+            if (entry.request == request) n++;
+        }
+        return n;
+    }
+
+    // Requests that reach the compositor, i.e. everything except flushes
+    size_t requests() const { return entries.size() - flushes(); }
+    size_t flushes() const { return count(WaylandRequest::Flush); }
+
+    // Everything recorded so far, in memory or on file
+    size_t total() const { return file ? written : entries.size(); }
+
+    std::vector<RecordedRequest> entries;
+
+private:
+    FILE* file;
+    size_t written = 0;
+};
+
+class RecordingVirtualPointer : public WaylandVirtualPointer {
+public:
+    explicit RecordingVirtualPointer(RequestLog& log) : log(log) {}
+    // Keeps the log alive for as long as either device of the pair
+    explicit RecordingVirtualPointer(std::shared_ptr<RequestLog> owned) : log(*owned), owned(std::move(owned)) {}
+
+protected:
+    void emit_motion(uint32_t time, wl_fixed_t dx, wl_fixed_t dy) override {
+        log.record(WaylandRequest::PointerMotion, time, dx, dy);
+    }
+    void emit_motion_absolute(uint32_t time, uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent) override {
+        log.record(WaylandRequest::PointerMotionAbsolute, time, x, y, x_extent, y_extent);
+    }
+    void emit_button(uint32_t time, uint32_t button, uint32_t state) override {
+        log.record(WaylandRequest::PointerButton, time, button, state);
+    }
+    void emit_axis(uint32_t time, uint32_t axis, wl_fixed_t value) override {
+        log.record(WaylandRequest::PointerAxis, time, axis, value);
+    }
+    void emit_axis_source(uint32_t axis_source) override {
+        log.record(WaylandRequest::PointerAxisSource, 0, axis_source);
+    }
+    void emit_axis_discrete(uint32_t time, uint32_t axis, wl_fixed_t value, int32_t discrete) override {
+        log.record(WaylandRequest::PointerAxisDiscrete, time, axis, value, discrete);
+    }
+    void emit_axis_stop(uint32_t time, uint32_t axis) override {
+        log.record(WaylandRequest::PointerAxisStop, time, axis);
+    }
+    void emit_frame() override {
+        log.record(WaylandRequest::PointerFrame);
+    }
+    void flush() override {
+        log.record(WaylandRequest::Flush);
+    }
+
+private:
+    RequestLog& log;
+    std::shared_ptr<RequestLog> owned;
+};
+
+class RecordingVirtualKeyboard : public WaylandVirtualKeyboard {
+public:
+    explicit RecordingVirtualKeyboard(RequestLog& log) : log(log) {}
+    explicit RecordingVirtualKeyboard(std::shared_ptr<RequestLog> owned) : log(*owned), owned(std::move(owned)) {}
+
+protected:
+    void emit_key(uint32_t time, uint32_t key, uint32_t state) override {
+        log.record(WaylandRequest::KeyboardKey, time, key, state);
+    }
+    void emit_modifiers(uint32_t mods_depressed, uint32_t mods_latched,
+                        uint32_t mods_locked, uint32_t group) override {
+        log.record(WaylandRequest::KeyboardModifiers, 0, mods_depressed, mods_latched, mods_locked, group);
+    }
+    void emit_keymap(int, uint32_t size) override {
+        log.record(WaylandRequest::KeyboardKeymap, 0, size);
+    }
+    void flush() override {
+        log.record(WaylandRequest::Flush);
+    }
+
+private:
+    RequestLog& log;
+    std::shared_ptr<RequestLog> owned;
+};
+
+// Output backend that records instead of emitting: every pair logs to its own
+// RequestLog, either kept in memory or appended to one shared file. A log goes
+// with its pair; what it recorded is folded into the backend's total.
+class RecordingBackend : public OutputBackend {
+public:
+    // An empty path keeps the requests in memory
+    explicit RecordingBackend(std::string path = "");
+    ~RecordingBackend() override;
+
+    const char* name() const override { return "record"; }
+    bool init() override;
+    void cleanup() override;
+    DevicePair create_pair() override;
+
+    // Requests recorded across all pairs
+    size_t total();
+
+private:
+    std::string path;
+    FILE* file = nullptr;
+
+    std::mutex mutex;
+    std::unordered_set<const RequestLog*> live;
+    size_t finished = 0;
+    size_t pairs = 0;
+};
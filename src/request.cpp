@@ -0,0 +1,21 @@
+#include "request.h"
+#include <iostream>
+
+static const char* REQUEST_INTERFACE = "org.freedesktop.impl.portal.Request";
+
+Request::Request(sdbus::IConnection& connection, const std::string& handle) : request_handle(handle) {
+    // A call that cannot be closed still goes ahead
+    try {
+        object = sdbus::createObject(connection, request_handle);
+        object->registerMethod(REQUEST_INTERFACE, "Close", "", "",
+                               [this](sdbus::MethodCall call) {
+                                   closed_by_client.store(true, std::memory_order_release);
+                                   call.createReply().send();
+                                   std::cout << "🚪 Request closed: " << request_handle << std::endl;
+                               });
+        object->finishRegistration();
+    } catch (const sdbus::Error& e) {
+        std::cerr << "Failed to export request object " << request_handle << ": " << e.what() << std::endl;
+        object.reset();
+    }
+}
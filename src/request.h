@@ -0,0 +1,26 @@
+#pragma once
+
+#include <sdbus-c++/sdbus-c++.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+// The org.freedesktop.impl.portal.Request a method call is made under. It is on
+// the bus for as long as the call runs, so the frontend can Close it when the
+// app gives up; the flow sees closed() and answers with response 2 instead of
+// finishing. Created and destroyed on the D-Bus thread; closed() from any.
+class Request {
+public:
+    Request(sdbus::IConnection& connection, const std::string& handle);
+
+    Request(const Request&) = delete;
+    Request& operator=(const Request&) = delete;
+
+    const std::string& handle() const { return request_handle; }
+    bool closed() const { return closed_by_client.load(std::memory_order_acquire); }
+
+private:
+    std::string request_handle;
+    std::unique_ptr<sdbus::IObject> object;
+    std::atomic<bool> closed_by_client{false};
+};
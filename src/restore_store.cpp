@@ -0,0 +1,140 @@
+#include "restore_store.h"
+#include "xdg_dirs.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// First line of the file; bump the version when the line format changes
+constexpr char HEADER[] = "# hypr-remote restore tokens v1";
+
+constexpr size_t TOKEN_BYTES = 16;
+
+std::string new_token() {
+    unsigned char bytes[TOKEN_BYTES];
+    size_t filled = 0;
+    while (filled < sizeof(bytes)) {
+        ssize_t n = getrandom(bytes + filled, sizeof(bytes) - filled, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return "";
+        }
+        filled += static_cast<size_t>(n);
+    }
+
+    static const char HEX[] = "0123456789abcdef";
+    std::string token;
+    token.reserve(2 * sizeof(bytes));
+    for (unsigned char byte : bytes) {
+        token += HEX[byte >> 4];
+        token += HEX[byte & 0xf];
+    }
+    return token;
+}
+
+} // namespace
+
+std::string RestoreStore::default_path() {
+    std::string directory = xdg_directory(XdgDir::STATE);
+    return directory.empty() ? "" : directory + "/restore-tokens";
+}
+
+RestoreStore::RestoreStore(std::string path) : path(std::move(path)) {
+    load();
+}
+
+std::string RestoreStore::issue(const std::string& app_id, uint32_t types, uint32_t persist_mode) {
+    if (persist_mode != PERSIST_TRANSIENT && persist_mode != PERSIST_PERSISTENT) return "";
+    if (app_id.find('\n') != std::string::npos) return "";
+
+    std::string token = new_token();
+    if (token.empty()) {
+        std::cerr << "Failed to generate a restore token: " << strerror(errno) << std::endl;
+        return "";
+    }
+
+    if (grants.size() >= MAX_GRANTS) {
+        auto oldest = std::min_element(grants.begin(), grants.end(), [](const auto& a, const auto& b) {
+            return a.second.issued < b.second.issued;
+        });
+        grants.erase(oldest);
+    }
+    grants[token] = { app_id, types, persist_mode, static_cast<uint64_t>(time(nullptr)) };
+
+    if (persist_mode == PERSIST_PERSISTENT) save();
+    return token;
+}
+
+std::optional<RestoreStore::Grant> RestoreStore::redeem(const std::string& token, const std::string& app_id) {
+    auto it = grants.find(token);
+    if (it == grants.end() || it->second.app_id != app_id) return std::nullopt;
+
+    Grant grant = std::move(it->second);
+    grants.erase(it);
+    if (grant.persist_mode == PERSIST_PERSISTENT) save();
+    return grant;
+}
+
+void RestoreStore::load() {
+    if (path.empty()) return;
+
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != HEADER) return;
+
+    // token, persist mode, types, issued, then the app id (possibly empty) to the end of the line
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string token;
+        Grant grant;
+        if (!(fields >> token >> grant.persist_mode >> grant.types >> grant.issued)) continue;
+        if (token.size() != 2 * TOKEN_BYTES || grant.persist_mode != PERSIST_PERSISTENT) continue;
+        if (fields.peek() == ' ') fields.get();
+        std::getline(fields, grant.app_id);
+        grants[token] = std::move(grant);
+    }
+}
+
+bool RestoreStore::save() {
+    if (path.empty()) return false;
+
+    std::string directory = path.substr(0, path.rfind('/'));
+    if (!directory.empty() && !make_directories(directory)) {
+        std::cerr << "Failed to create restore token directory " << directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::string contents = std::string(HEADER) + "\n";
+    for (const auto& [token, grant] : grants) {
+        if (grant.persist_mode != PERSIST_PERSISTENT) continue;
+        contents += token + " " + std::to_string(grant.persist_mode) + " " + std::to_string(grant.types) + " " +
+                    std::to_string(grant.issued) + " " + grant.app_id + "\n";
+    }
+
+    // Written aside and renamed into place, readable by the user only
+    std::string temporary = path + ".tmp." + std::to_string(getpid());
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to write restore tokens " << temporary << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write restore tokens " << path << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+// Restore tokens handed out by Start for sessions that asked to persist
+// (SelectDevices persist_mode). A token is good for one restore by the same
+// app: redeeming it gives back what the session had selected, and the
+// restored session's Start issues the next token. Persistent grants (mode 2)
+// are kept on disk so they survive portal restarts; transient ones (mode 1)
+// only live as long as the portal. Used from the portal's control thread only.
+class RestoreStore {
+public:
+    // SelectDevices persist_mode values
+    static constexpr uint32_t PERSIST_NONE = 0;
+    static constexpr uint32_t PERSIST_TRANSIENT = 1;
+    static constexpr uint32_t PERSIST_PERSISTENT = 2;
+
+    // Grants kept at most; the oldest go first
+    static constexpr size_t MAX_GRANTS = 64;
+
+    struct Grant {
+        std::string app_id;
+        uint32_t types = 0;        // device types the session had selected
+        uint32_t persist_mode = PERSIST_NONE;
+        uint64_t issued = 0;       // seconds since the epoch
+    };
+
+    // $XDG_STATE_HOME/hypr-remote/restore-tokens, or ~/.local/state/...; empty if neither is known
+    static std::string default_path();
+
+    // An empty path keeps every grant in memory
+    explicit RestoreStore(std::string path = default_path());
+
+    // A new token for `app_id`; PERSIST_NONE issues nothing and returns ""
+    std::string issue(const std::string& app_id, uint32_t types, uint32_t persist_mode);
+
+    // The grant behind `token` if it was issued to `app_id`, used up in the process
+    std::optional<Grant> redeem(const std::string& token, const std::string& app_id);
+
+    size_t size() const { return grants.size(); }
+
+private:
+    std::string path;
+    std::map<std::string, Grant> grants; // by token
+
+    void load();
+    bool save();
+};
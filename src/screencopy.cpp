@@ -0,0 +1,505 @@
+#include "screencopy.h"
+#include "probes.h"
+#include <algorithm>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+// Copies failing in a row before a capture is given up on
+static const int MAX_FAILURES = 3;
+
+struct Screencopy::Head {
+    Screencopy* owner = nullptr;
+    struct wl_output* output = nullptr;
+    uint32_t version = 0;
+    Output info;
+    bool announced = false; // first done event seen
+};
+
+struct Screencopy::Capture {
+    Screencopy* owner = nullptr;
+    uint64_t id = 0;
+    Head* head = nullptr;
+    bool overlay_cursor = false;
+    FrameSink* sink = nullptr;
+
+    struct zwlr_screencopy_frame_v1* frame = nullptr;
+    bool shm_offered = false;
+    FrameFormat offered;       // this frame's shm parameters
+    FrameFormat buffer_format; // what `buffer` was created for
+    FrameFormat format;        // what the sink is configured for
+    bool configured = false;
+    bool full_copy = true;     // next copy without waiting for damage
+    std::vector<DamageRect> damage;
+
+    struct wl_buffer* buffer = nullptr;
+    void* data = nullptr;
+    size_t size = 0;
+
+    uint64_t sequence = 0;
+    int failures = 0;
+    bool ended = false;
+};
+
+static const struct wl_registry_listener registry_listener = {
+    .global = Screencopy::registry_global,
+    .global_remove = Screencopy::registry_global_remove,
+};
+
+const struct wl_output_listener Screencopy::output_listener = {
+    .geometry = [](void* data, struct wl_output*, int32_t x, int32_t y, int32_t, int32_t, int32_t,
+                   const char*, const char*, int32_t) {
+        Head* head = static_cast<Head*>(data);
+        head->info.x = x;
+        head->info.y = y;
+    },
+    .mode = [](void* data, struct wl_output*, uint32_t flags, int32_t width, int32_t height, int32_t) {
+        if (!(flags & WL_OUTPUT_MODE_CURRENT)) return;
+        Head* head = static_cast<Head*>(data);
+        head->info.width = width;
+        head->info.height = height;
+    },
+    .done = [](void* data, struct wl_output*) {
+        Head* head = static_cast<Head*>(data);
+        head->announced = true;
+        head->owner->outputs_changed = true;
+    },
+    .scale = [](void*, struct wl_output*, int32_t) {},
+    .name = [](void* data, struct wl_output*, const char* name) {
+        static_cast<Head*>(data)->info.name = name;
+    },
+    .description = [](void*, struct wl_output*, const char*) {},
+};
+
+const struct zwlr_screencopy_frame_v1_listener Screencopy::frame_listener = {
+    .buffer = [](void* data, struct zwlr_screencopy_frame_v1*, uint32_t format, uint32_t width, uint32_t height,
+                 uint32_t stride) {
+        Capture* capture = static_cast<Capture*>(data);
+        capture->shm_offered = true;
+        capture->offered = FrameFormat{ format, width, height, stride, false };
+        // Before version 3 there is no buffer_done; this is all we get
+        if (capture->owner->manager_version < 3) capture->owner->copy_frame(*capture);
+    },
+    .flags = [](void* data, struct zwlr_screencopy_frame_v1*, uint32_t flags) {
+        static_cast<Capture*>(data)->offered.y_invert = flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT;
+    },
+    .ready = [](void* data, struct zwlr_screencopy_frame_v1*, uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
+        uint64_t seconds = (uint64_t(sec_hi) << 32) | sec_lo;
+        Capture* capture = static_cast<Capture*>(data);
+        capture->owner->frame_ready(*capture, seconds * 1000000000ull + nsec);
+    },
+    .failed = [](void* data, struct zwlr_screencopy_frame_v1*) {
+        Capture* capture = static_cast<Capture*>(data);
+        capture->owner->frame_failed(*capture);
+    },
+    .damage = [](void* data, struct zwlr_screencopy_frame_v1*, uint32_t x, uint32_t y, uint32_t width,
+                 uint32_t height) {
+        static_cast<Capture*>(data)->damage.push_back({ x, y, width, height });
+    },
+    .linux_dmabuf = [](void*, struct zwlr_screencopy_frame_v1*, uint32_t, uint32_t, uint32_t) {},
+    .buffer_done = [](void* data, struct zwlr_screencopy_frame_v1*) {
+        Capture* capture = static_cast<Capture*>(data);
+        capture->owner->copy_frame(*capture);
+    },
+};
+
+Screencopy::Screencopy() = default;
+
+Screencopy::~Screencopy() {
+    cleanup();
+}
+
+bool Screencopy::init(int fd) {
+    display = fd >= 0 ? wl_display_connect_to_fd(fd) : wl_display_connect(nullptr);
+    if (!display) {
+        // libwayland has closed `fd` already
+        std::cerr << "Failed to connect to Wayland display for screen capture" << std::endl;
+        return false;
+    }
+
+    registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, this);
+    // Globals, then the outputs' own events
+    wl_display_roundtrip(display);
+    wl_display_roundtrip(display);
+
+    if (!manager) {
+        std::cerr << "Compositor does not support wlr-screencopy protocol" << std::endl;
+        cleanup();
+        return false;
+    }
+    if (!shm) {
+        std::cerr << "Compositor does not offer wl_shm" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0) {
+        std::cerr << "Failed to create screencopy eventfd: " << strerror(errno) << std::endl;
+        cleanup();
+        return false;
+    }
+
+    publish_outputs();
+    running = true;
+    thread = std::thread([this]() { run(); });
+
+    std::cout << "Screencopy connected: " << heads.size() << " output(s), protocol version "
+              << manager_version << std::endl;
+    return true;
+}
+
+void Screencopy::cleanup() {
+    if (thread.joinable()) {
+        running = false;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to signal screencopy thread: " << strerror(errno) << std::endl;
+        }
+        thread.join();
+    }
+
+    // Streams still alive only lose their compositor side here
+    for (auto& capture : captures) {
+        if (capture->frame) zwlr_screencopy_frame_v1_destroy(capture->frame);
+        if (capture->buffer) wl_buffer_destroy(capture->buffer);
+        if (capture->data) munmap(capture->data, capture->size);
+    }
+    captures.clear();
+    for (auto& head : heads) {
+        if (head->version >= WL_OUTPUT_RELEASE_SINCE_VERSION) wl_output_release(head->output);
+        else wl_output_destroy(head->output);
+    }
+    heads.clear();
+
+    if (manager) {
+        zwlr_screencopy_manager_v1_destroy(manager);
+        manager = nullptr;
+    }
+    if (shm) {
+        wl_shm_destroy(shm);
+        shm = nullptr;
+    }
+    if (registry) {
+        wl_registry_destroy(registry);
+        registry = nullptr;
+    }
+    if (display) {
+        wl_display_flush(display);
+        wl_display_disconnect(display);
+        display = nullptr;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+std::vector<Screencopy::Output> Screencopy::outputs() const {
+    std::lock_guard<std::mutex> lock(outputs_mutex);
+    return published;
+}
+
+void Screencopy::publish_outputs() {
+    outputs_changed = false;
+    std::vector<Output> current;
+    for (const auto& head : heads) {
+        if (head->announced) current.push_back(head->info);
+    }
+    std::lock_guard<std::mutex> lock(outputs_mutex);
+    published = std::move(current);
+}
+
+void Screencopy::run() {
+    const int display_fd = wl_display_get_fd(display);
+    struct pollfd fds[2] = {
+        { .fd = display_fd, .events = POLLIN, .revents = 0 },
+        { .fd = wake_fd, .events = POLLIN, .revents = 0 },
+    };
+
+    while (running) {
+        if (connected) {
+            wl_display_dispatch_pending(display);
+            if (wl_display_flush(display) < 0 && errno != EAGAIN) lose_connection();
+        }
+        // Output changes arrive along with frames; publish them as they come
+        if (outputs_changed) publish_outputs();
+
+        fds[0].fd = connected ? display_fd : -1;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Screencopy poll error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (connected && ((fds[0].revents & (POLLERR | POLLHUP)) ||
+                          ((fds[0].revents & POLLIN) && wl_display_dispatch(display) < 0))) {
+            lose_connection();
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(wake_fd, &value, sizeof(value)) > 0) {}
+
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            while (!jobs.empty()) {
+                auto job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                job();
+                lock.lock();
+                jobs_run++;
+            }
+            jobs_done.notify_all();
+        }
+    }
+}
+
+void Screencopy::lose_connection() {
+    // The thread keeps serving jobs so streams can still be torn down
+    std::cerr << "⚠️ Screencopy lost its Wayland connection, ending every capture" << std::endl;
+    connected = false;
+    for (auto& capture : captures) end_capture(*capture);
+}
+
+void Screencopy::call(std::function<void()> job) {
+    if (!thread.joinable()) {
+        job();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    jobs.push_back(std::move(job));
+    uint64_t ticket = ++jobs_posted;
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to signal screencopy thread: " << strerror(errno) << std::endl;
+    }
+    jobs_done.wait(lock, [&]() { return jobs_run >= ticket; });
+}
+
+std::unique_ptr<CaptureStream> Screencopy::start(uint32_t output_id, bool overlay_cursor,
+                                                 std::unique_ptr<FrameSink> sink) {
+    if (!sink) return nullptr;
+
+    uint64_t id = 0;
+    Output source;
+    FrameSink* target = sink.get();
+    call([&]() {
+        auto head = std::find_if(heads.begin(), heads.end(), [&](const auto& h) { return h->info.id == output_id; });
+        if (head == heads.end() || !connected) return;
+
+        auto capture = std::make_unique<Capture>();
+        capture->owner = this;
+        capture->id = id = next_capture++;
+        capture->head = head->get();
+        capture->overlay_cursor = overlay_cursor;
+        capture->sink = target;
+        source = (*head)->info;
+        request_frame(*capture);
+        captures.push_back(std::move(capture));
+    });
+    if (!id) {
+        std::cerr << "No output " << output_id << " to capture" << std::endl;
+        return nullptr;
+    }
+
+    std::cout << "🖥️ Capturing " << (source.name.empty() ? "output" : source.name) << " (" << source.width
+              << "x" << source.height << ")" << std::endl;
+    return std::unique_ptr<CaptureStream>(new CaptureStream(*this, id, source, std::move(sink)));
+}
+
+void Screencopy::stop(uint64_t id) {
+    call([&]() {
+        auto it = std::find_if(captures.begin(), captures.end(), [&](const auto& c) { return c->id == id; });
+        if (it == captures.end()) return;
+
+        Capture& capture = **it;
+        if (capture.frame) zwlr_screencopy_frame_v1_destroy(capture.frame);
+        if (capture.buffer) wl_buffer_destroy(capture.buffer);
+        if (capture.data) munmap(capture.data, capture.size);
+        captures.erase(it);
+        if (display) wl_display_flush(display);
+    });
+}
+
+void Screencopy::request_frame(Capture& capture) {
+    capture.shm_offered = false;
+    capture.damage.clear();
+    capture.frame = zwlr_screencopy_manager_v1_capture_output(manager, capture.overlay_cursor ? 1 : 0,
+                                                              capture.head->output);
+    zwlr_screencopy_frame_v1_add_listener(capture.frame, &frame_listener, &capture);
+}
+
+bool Screencopy::ensure_buffer(Capture& capture) {
+    FrameFormat wanted = capture.offered;
+    wanted.y_invert = false;
+    if (capture.buffer && wanted == capture.buffer_format) return true;
+
+    if (capture.buffer) wl_buffer_destroy(capture.buffer);
+    if (capture.data) munmap(capture.data, capture.size);
+    capture.buffer = nullptr;
+    capture.data = nullptr;
+
+    capture.size = size_t(wanted.stride) * wanted.height;
+    int fd = memfd_create("hypr-remote-screencopy", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, capture.size) != 0) {
+        std::cerr << "Failed to create screencopy buffer: " << strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, capture.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map screencopy buffer: " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    struct wl_shm_pool* pool = wl_shm_create_pool(shm, fd, capture.size);
+    capture.buffer = wl_shm_pool_create_buffer(pool, 0, wanted.width, wanted.height, wanted.stride,
+                                               wanted.shm_format);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    capture.data = data;
+
+    // A fresh buffer holds nothing yet, so its first copy must be whole
+    capture.buffer_format = wanted;
+    capture.full_copy = true;
+    return true;
+}
+
+void Screencopy::copy_frame(Capture& capture) {
+    if (!capture.frame) return;
+    if (!capture.shm_offered) {
+        std::cerr << "⚠️ Compositor offers no shm buffer for screen capture" << std::endl;
+        end_capture(capture);
+        return;
+    }
+    if (!ensure_buffer(capture)) {
+        end_capture(capture);
+        return;
+    }
+
+    // Without damage tracking (version 1) every frame is a full one
+    capture.damage.clear();
+    if (capture.full_copy || manager_version < 2) {
+        zwlr_screencopy_frame_v1_copy(capture.frame, capture.buffer);
+    } else {
+        zwlr_screencopy_frame_v1_copy_with_damage(capture.frame, capture.buffer);
+    }
+}
+
+void Screencopy::frame_ready(Capture& capture, uint64_t time_ns) {
+    zwlr_screencopy_frame_v1_destroy(capture.frame);
+    capture.frame = nullptr;
+    capture.failures = 0;
+
+    if (!capture.configured || capture.offered != capture.format) {
+        if (!capture.sink->configure(capture.offered)) {
+            std::cerr << "⚠️ Screen capture sink cannot take format " << capture.offered.shm_format << std::endl;
+            end_capture(capture);
+            return;
+        }
+        capture.format = capture.offered;
+        capture.configured = true;
+    }
+    const FrameFormat& format = capture.format;
+
+    if (capture.full_copy || manager_version < 2) {
+        capture.damage.assign(1, DamageRect{ 0, 0, format.width, format.height });
+        capture.full_copy = false;
+    }
+
+    // copy_with_damage only completes on damage, but an empty report is not worth a frame
+    if (!capture.damage.empty()) {
+        CaptureFrame frame{ capture.format, static_cast<const uint8_t*>(capture.data), capture.damage,
+                            ++capture.sequence, time_ns };
+        PROBE3(capture_frame, capture.head->info.name.c_str(), capture.damage.size(), frame.sequence);
+        capture.sink->deliver(frame);
+    }
+    request_frame(capture);
+}
+
+void Screencopy::frame_failed(Capture& capture) {
+    zwlr_screencopy_frame_v1_destroy(capture.frame);
+    capture.frame = nullptr;
+
+    // The next copy cannot rely on what the buffer held
+    capture.full_copy = true;
+    if (++capture.failures >= MAX_FAILURES) {
+        std::cerr << "⚠️ Screen capture of " << capture.head->info.name << " keeps failing, ending it" << std::endl;
+        end_capture(capture);
+        return;
+    }
+    request_frame(capture);
+}
+
+void Screencopy::end_capture(Capture& capture) {
+    if (capture.ended) return;
+    capture.ended = true;
+    if (capture.frame) {
+        zwlr_screencopy_frame_v1_destroy(capture.frame);
+        capture.frame = nullptr;
+    }
+    capture.sink->end();
+}
+
+void Screencopy::remove_head(uint32_t id) {
+    auto it = std::find_if(heads.begin(), heads.end(), [&](const auto& h) { return h->info.id == id; });
+    if (it == heads.end()) return;
+
+    for (auto& capture : captures) {
+        if (capture->head == it->get()) end_capture(*capture);
+    }
+    Head& head = **it;
+    if (head.version >= WL_OUTPUT_RELEASE_SINCE_VERSION) wl_output_release(head.output);
+    else wl_output_destroy(head.output);
+    for (auto& capture : captures) {
+        if (capture->head == it->get()) capture->head = nullptr;
+    }
+    heads.erase(it);
+    outputs_changed = true;
+}
+
+void Screencopy::registry_global(void* data, struct wl_registry* registry,
+                                 uint32_t name, const char* interface, uint32_t version) {
+    Screencopy* self = static_cast<Screencopy*>(data);
+
+    if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) == 0) {
+        self->manager_version = std::min(version, 3u);
+        self->manager = static_cast<struct zwlr_screencopy_manager_v1*>(
+            wl_registry_bind(registry, name, &zwlr_screencopy_manager_v1_interface, self->manager_version));
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        self->shm = static_cast<struct wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        auto head = std::make_unique<Head>();
+        head->owner = self;
+        head->version = std::min(version, 4u);
+        head->info.id = name;
+        head->output = static_cast<struct wl_output*>(
+            wl_registry_bind(registry, name, &wl_output_interface, head->version));
+        wl_output_add_listener(head->output, &output_listener, head.get());
+        // Before version 2 there is no done event; the first roundtrip will do
+        if (head->version < 2) head->announced = true;
+        self->heads.push_back(std::move(head));
+    }
+}
+
+void Screencopy::registry_global_remove(void* data, struct wl_registry*, uint32_t name) {
+    static_cast<Screencopy*>(data)->remove_head(name);
+}
+
+CaptureStream::CaptureStream(Screencopy& owner, uint64_t id, Screencopy::Output source,
+                             std::unique_ptr<FrameSink> sink)
+    : owner(owner), id(id), source(std::move(source)), frame_sink(std::move(sink)) {
+}
+
+CaptureStream::~CaptureStream() {
+    // The capture thread lets go of the sink before it is destroyed
+    owner.stop(id);
+}
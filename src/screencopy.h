@@ -0,0 +1,129 @@
+#pragma once
+
+#include "frame_sink.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <wayland-client.h>
+#include "wlr-screencopy-unstable-v1-client-protocol.h"
+}
+
+class CaptureStream;
+
+// Screen capture through wlr-screencopy, on a Wayland connection and thread of
+// its own so a slow copy never holds up input. Each capture asks the
+// compositor for its next frame with copy_with_damage, which only completes
+// once something on the output has changed, into one shm buffer it reuses;
+// the frame and its damage then go to the capture's FrameSink.
+class Screencopy {
+public:
+    // A monitor as the compositor describes it
+    struct Output {
+        uint32_t id = 0;     // registry name, stable while the output exists
+        std::string name;    // connector ("DP-1"), or "" before wl_output v4
+        int32_t x = 0, y = 0;
+        int32_t width = 0, height = 0; // current mode, pixels
+    };
+
+    Screencopy();
+    ~Screencopy();
+
+    Screencopy(const Screencopy&) = delete;
+    Screencopy& operator=(const Screencopy&) = delete;
+
+    // Connect to the compositor (`fd`, or $WAYLAND_DISPLAY when -1) and start
+    // the capture thread; false if it has no screencopy or no wl_shm
+    bool init(int fd = -1);
+    void cleanup();
+
+    // Outputs known so far (any thread)
+    std::vector<Output> outputs() const;
+
+    // Capture output `id` into `sink` until the stream is destroyed; nullptr
+    // if there is no such output. `overlay_cursor` paints the cursor in.
+    std::unique_ptr<CaptureStream> start(uint32_t id, bool overlay_cursor, std::unique_ptr<FrameSink> sink);
+
+    // Registry and wl_output callbacks (must be public)
+    static void registry_global(void* data, struct wl_registry* registry,
+                                uint32_t name, const char* interface, uint32_t version);
+    static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+
+private:
+    friend class CaptureStream;
+    struct Capture;
+    struct Head;
+
+    struct wl_display* display = nullptr;
+    struct wl_registry* registry = nullptr;
+    struct wl_shm* shm = nullptr;
+    struct zwlr_screencopy_manager_v1* manager = nullptr;
+    uint32_t manager_version = 0;
+
+    // Capture thread only, apart from `outputs_mutex`-guarded copies in `published`
+    std::vector<std::unique_ptr<Head>> heads;
+    std::vector<std::unique_ptr<Capture>> captures;
+    uint64_t next_capture = 1;
+    bool outputs_changed = false;
+    bool connected = true;
+
+    mutable std::mutex outputs_mutex;
+    std::vector<Output> published;
+
+    // Work for the capture thread from others, woken by `wake_fd`
+    std::thread thread;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_done;
+    std::deque<std::function<void()>> jobs;
+    uint64_t jobs_posted = 0, jobs_run = 0;
+    int wake_fd = -1;
+    std::atomic<bool> running{false};
+
+    void run();
+    void lose_connection();
+    // Run `job` on the capture thread and wait for it
+    void call(std::function<void()> job);
+
+    void publish_outputs();
+    void remove_head(uint32_t id);
+
+    void request_frame(Capture& capture);
+    void copy_frame(Capture& capture);
+    void frame_ready(Capture& capture, uint64_t time_ns);
+    void frame_failed(Capture& capture);
+    void end_capture(Capture& capture);
+    void stop(uint64_t id);
+    bool ensure_buffer(Capture& capture);
+
+    static const struct zwlr_screencopy_frame_v1_listener frame_listener;
+    static const struct wl_output_listener output_listener;
+};
+
+// A running capture; destroying it stops the capture and then its sink
+class CaptureStream {
+public:
+    ~CaptureStream();
+
+    CaptureStream(const CaptureStream&) = delete;
+    CaptureStream& operator=(const CaptureStream&) = delete;
+
+    const Screencopy::Output& output() const { return source; }
+    FrameSink& sink() { return *frame_sink; }
+
+private:
+    friend class Screencopy;
+    CaptureStream(Screencopy& owner, uint64_t id, Screencopy::Output source, std::unique_ptr<FrameSink> sink);
+
+    Screencopy& owner;
+    uint64_t id;
+    Screencopy::Output source;
+    std::unique_ptr<FrameSink> frame_sink;
+};
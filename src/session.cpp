@@ -0,0 +1,300 @@
+#include "session.h"
+#include "ei_forwarder.h"
+#include "eis_workers.h"
+#include "flight_recorder.h"
+#include "probes.h"
+#include "screencopy.h"
+#include "shared_ring.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+std::atomic<uint32_t> Session::next_id{1};
+
+static const char* SESSION_INTERFACE = "org.freedesktop.impl.portal.Session";
+
+Session::Session(std::string handle, std::string app_id, EventHandler on_event)
+    : session_handle(std::move(handle)), app_id(std::move(app_id)), on_event(std::move(on_event)),
+      session_id(next_id.fetch_add(1, std::memory_order_relaxed)) {
+    target.session = session_id;
+    target.transform = &transform_slot;
+    PROBE2(session_create, session_handle.c_str(), this->app_id.c_str());
+    FlightRecorder::session_open(session_id, session_handle);
+}
+
+Session::~Session() {
+    close();
+}
+
+void Session::export_object(sdbus::IConnection& connection, std::function<void()> on_close) {
+    object = sdbus::createObject(connection, session_handle);
+    object->registerMethod(SESSION_INTERFACE, "Close", "", "",
+                           [on_close](sdbus::MethodCall call) {
+                               call.createReply().send();
+                               on_close();
+                           });
+    object->registerSignal(SESSION_INTERFACE, "Closed", "");
+    object->registerProperty(SESSION_INTERFACE, "version", "u",
+                             [](sdbus::PropertyGetReply& reply) { reply << (uint32_t)1; });
+    object->finishRegistration();
+}
+
+int Session::connect_eis(EisWorkers* workers) {
+    if (closed || eis_context || ring) {
+        std::cerr << "Session " << session_handle << " already has an EIS connection" << std::endl;
+        return -1;
+    }
+
+    eis_context = eis_new(nullptr);
+    if (!eis_context) {
+        std::cerr << "Failed to create EIS server context" << std::endl;
+        return -1;
+    }
+
+    // The fd backend hands out one end of a socketpair per client, so there is
+    // no socket path to clean up and no bridge between sockets
+    if (eis_setup_backend_fd(eis_context) != 0) {
+        std::cerr << "Failed to setup EIS fd backend" << std::endl;
+        eis_unref(eis_context);
+        eis_context = nullptr;
+        return -1;
+    }
+
+    int client_fd = eis_backend_fd_add_client(eis_context);
+    if (client_fd < 0) {
+        std::cerr << "Failed to add EIS client: " << strerror(-client_fd) << std::endl;
+        eis_unref(eis_context);
+        eis_context = nullptr;
+        return -1;
+    }
+
+    if (!serve(workers)) {
+        ::close(client_fd);
+        eis_unref(eis_context);
+        eis_context = nullptr;
+        return -1;
+    }
+    return client_fd;
+}
+
+bool Session::connect_ring(uint32_t capacity, int& memfd, int& doorbell, EisWorkers* workers) {
+    if (closed || eis_context || ring) {
+        std::cerr << "Session " << session_handle << " already has an EIS connection" << std::endl;
+        return false;
+    }
+
+    auto created = std::make_unique<SharedRing>();
+    if (!created->create(capacity)) {
+        return false;
+    }
+
+    // The client gets its own descriptions of both; ours stay with the ring
+    memfd = fcntl(created->memfd(), F_DUPFD_CLOEXEC, 0);
+    doorbell = fcntl(created->doorbell(), F_DUPFD_CLOEXEC, 0);
+    if (memfd < 0 || doorbell < 0) {
+        std::cerr << "Failed to duplicate shared ring fds: " << strerror(errno) << std::endl;
+        if (memfd >= 0) ::close(memfd);
+        if (doorbell >= 0) ::close(doorbell);
+        return false;
+    }
+
+    ring = std::move(created);
+    if (!serve(workers)) {
+        ::close(memfd);
+        ::close(doorbell);
+        ring.reset();
+        return false;
+    }
+    return true;
+}
+
+bool Session::serve(EisWorkers* workers) {
+    if (workers) {
+        if (!workers->add(*this)) return false;
+        this->workers = workers;
+        return true;
+    }
+
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stop_fd < 0) {
+        std::cerr << "Failed to create eventfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    eis_thread = std::thread([this]() { run_eis(); });
+    return true;
+}
+
+void Session::run_eis() {
+    std::cout << "📡 EIS server thread started for " << session_handle << std::endl;
+
+    struct pollfd fds[3] = {
+        { .fd = input_fd(), .events = POLLIN, .revents = 0 },
+        { .fd = stop_fd, .events = POLLIN, .revents = 0 },
+        { .fd = -1, .events = POLLIN, .revents = 0 },
+    };
+
+    bool gone = false;
+    while (!gone) {
+        // The forwarder drops its fd once the compositor side hangs up
+        fds[2].fd = forwarder_fd();
+        
+        // No timeout: the thread only wakes for client traffic or close()
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "EIS poll error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) break;
+
+        gone = !dispatch(fds[2].revents != 0);
+    }
+
+    std::cout << "📡 EIS server thread stopped for " << session_handle << std::endl;
+
+    if (gone) {
+        client_gone();
+    }
+}
+
+int Session::input_fd() const {
+    if (ring) return ring->doorbell();
+    return eis_context ? eis_get_fd(eis_context) : -1;
+}
+
+int Session::forwarder_fd() const {
+    return forwarder ? forwarder->fd() : -1;
+}
+
+bool Session::dispatch(bool forwarder_ready) {
+    // Shared ring records skip EIS entirely, a batch per handler call
+    if (ring) {
+        return ring->drain([this](const SharedRingRecord* records, size_t count) {
+            PROBE2(ring_ingress, session_handle.c_str(), count);
+            on_records(records, count);
+        });
+    }
+
+    if (forwarder_ready && forwarder) {
+        forwarder->dispatch();
+    }
+
+    // Process all pending EIS events in one go - this is crucial for scroll
+    eis_dispatch(eis_context);
+
+    bool connected = true;
+    struct eis_event* event;
+    while ((event = eis_get_event(eis_context)) != nullptr) {
+        enum eis_event_type type = eis_event_get_type(event);
+        PROBE3(eis_ingress, type, session_handle.c_str(),
+               type == EIS_EVENT_FRAME ? eis_event_get_time(event) : 0);
+        if (type == EIS_EVENT_CLIENT_DISCONNECT) {
+            connected = false;
+        }
+        // A frame goes to both sides, since either may hold part of it
+        bool forwarded = forwarder && forwarder->forward(event);
+        if (!forwarded || type == EIS_EVENT_FRAME) {
+            on_event(event);
+        }
+        eis_event_unref(event);
+    }
+    return connected;
+}
+
+void Session::client_gone() {
+    if (on_client_gone) {
+        on_client_gone(*this);
+    }
+}
+
+void Session::attach_forwarder(std::unique_ptr<EiForwarder> forwarder) {
+    this->forwarder = std::move(forwarder);
+}
+
+void Session::attach_devices(DevicePair pair) {
+    devices = std::move(pair);
+    target = InputTarget{ devices.pointer.get(), devices.keyboard.get(), ModifierState{} };
+    target.session = session_id;
+    target.transform = &transform_slot;
+}
+
+void Session::share_devices(WaylandVirtualPointer* pointer, WaylandVirtualKeyboard* keyboard, std::mutex* lock) {
+    target = InputTarget{ pointer, keyboard, ModifierState{} };
+    target.session = session_id;
+    target.transform = &transform_slot;
+    target.device_lock = lock;
+}
+
+DevicePair Session::take_devices() {
+    target = InputTarget{};
+    target.session = session_id;
+    target.transform = &transform_slot;
+    return std::move(devices);
+}
+
+void Session::emit_closed() {
+    if (!object) return;
+    auto signal = object->createSignal(SESSION_INTERFACE, "Closed");
+    object->emitSignal(signal);
+}
+
+void Session::add_stream(std::unique_ptr<CaptureStream> stream) {
+    captures.push_back(std::move(stream));
+}
+
+void Session::hold_client_fd(int fd) {
+    if (held_client_fd >= 0) ::close(held_client_fd);
+    held_client_fd = fd;
+}
+
+int Session::take_client_fd() {
+    int fd = held_client_fd;
+    held_client_fd = -1;
+    return fd;
+}
+
+void Session::close() {
+    if (closed.exchange(true)) return;
+
+    // A connection prepared for a client that never asked for it
+    hold_client_fd(-1);
+    captures.clear();
+
+    if (workers) {
+        workers->remove(*this);
+        workers = nullptr;
+    }
+
+    if (eis_thread.joinable()) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to signal EIS thread: " << strerror(errno) << std::endl;
+        }
+        eis_thread.join();
+    }
+
+    forwarder.reset();
+
+    if (eis_context) {
+        eis_unref(eis_context);
+        eis_context = nullptr;
+    }
+    ring.reset();
+
+    if (stop_fd >= 0) {
+        ::close(stop_fd);
+        stop_fd = -1;
+    }
+
+    object.reset();
+    PROBE1(session_destroy, session_handle.c_str());
+    FlightRecorder::session_close(session_id);
+    std::cout << "🧹 Session " << session_handle << " closed" << std::endl;
+}
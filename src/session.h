@@ -0,0 +1,166 @@
+#pragma once
+
+#include "output_backend.h"
+#include "input_target.h"
+#include "input_transform.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "libei-1.0/libeis.h"
+}
+
+// A RemoteDesktop session from CreateSession until Close or client disconnect.
+// Owns the EIS server started by ConnectToEIS or the shared ring from
+// ConnectToSharedRing (with a thread unless EisWorkers serve it), the exported
+// org.freedesktop.impl.portal.Session object and, when a device pool is
+// available, its own virtual pointer/keyboard pair; close() releases all of it
+// except the devices, which go back via take_devices(). ScreenCast captures
+// started for it end with it too.
+class CaptureStream;
+class EiForwarder;
+class EisWorkers;
+class SharedRing;
+struct SharedRingRecord;
+
+class Session {
+public:
+    using EventHandler = std::function<void(struct eis_event*)>;
+    using ClientGoneHandler = std::function<void(Session&)>;
+    using RecordHandler = std::function<void(const SharedRingRecord*, size_t)>;
+
+    Session(std::string handle, std::string app_id, EventHandler on_event);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    const std::string& handle() const { return session_handle; }
+    const std::string& app() const { return app_id; }
+    // Small number naming the session in the flight recorder, unique for the process
+    uint32_t id() const { return session_id; }
+
+    // Export the Session interface (Close method, Closed signal) at the session handle.
+    // `on_close` runs on the D-Bus thread when the client calls Close.
+    void export_object(sdbus::IConnection& connection, std::function<void()> on_close);
+    // Take the object off the bus again, on the D-Bus thread, before close()
+    // runs on another one
+    void unexport_object() { object.reset(); }
+
+    // Pass input straight through to the compositor's EIS; events the forwarder
+    // does not take still go to the event handler. Only before connect_eis().
+    void attach_forwarder(std::unique_ptr<EiForwarder> forwarder);
+    bool has_forwarder() const { return static_cast<bool>(forwarder); }
+
+    // Replace the EIS event handler; only before connect_eis()
+    void set_event_handler(EventHandler handler) { on_event = std::move(handler); }
+    
+    // Where shared ring records go, a batch at a time; only before connect_ring()
+    void set_record_handler(RecordHandler handler) { on_records = std::move(handler); }
+    
+    // Called from the EIS thread once the EIS client has disconnected and the
+    // session is no longer served. Must not call close() itself.
+    void set_client_gone_handler(ClientGoneHandler handler) { on_client_gone = std::move(handler); }
+
+    // Start the EIS server for this session and return the client's end of the
+    // connection (owned by the caller), or -1 on failure. With `workers` the
+    // session is served by one of their threads rather than a thread of its own.
+    int connect_eis(EisWorkers* workers = nullptr);
+
+    // Instead of EIS: create a shared ring of `capacity` records and serve it
+    // the same way. `memfd` and `doorbell` get the client's copies of its fds
+    // (owned by the caller); false on failure.
+    bool connect_ring(uint32_t capacity, int& memfd, int& doorbell, EisWorkers* workers = nullptr);
+
+    // The EIS thread's side: fds to poll for POLLIN (the client's EIS socket or
+    // ring doorbell, and the forwarder's, -1 when there is none), and one pass
+    // over whatever arrived. dispatch() returns false once the client has
+    // disconnected; the thread then stops serving the session and calls
+    // client_gone().
+    int input_fd() const;
+    int forwarder_fd() const;
+    bool dispatch(bool forwarder_ready);
+    void client_gone();
+
+    // What SelectDevices settled on, directly or from a restore token
+    struct Selection {
+        uint32_t types = 7; // keyboard | pointer | touchscreen
+        uint32_t persist_mode = 0;
+        bool restored = false;
+        // ScreenCast SelectSources: monitors only, one unless `multiple`
+        uint32_t sources = 0;
+        bool multiple = false;
+        uint32_t cursor_mode = 1; // hidden
+    };
+    Selection& selection() { return selected; }
+
+    // Captures serving the session's ScreenCast streams (control thread)
+    void add_stream(std::unique_ptr<CaptureStream> stream);
+    const std::vector<std::unique_ptr<CaptureStream>>& streams() const { return captures; }
+
+    // Keep the client's end of an EIS connection started ahead of ConnectToEIS
+    // (restored sessions); take_client_fd() hands it out once, -1 if there is none
+    void hold_client_fd(int fd);
+    int take_client_fd();
+
+    // Give the session its own devices; input() then targets them
+    void attach_devices(DevicePair pair);
+    // Or have input() write to devices other sessions write to as well, one at a
+    // time under `lock`; the modifier and frame state stay the session's own
+    void share_devices(WaylandVirtualPointer* pointer, WaylandVirtualKeyboard* keyboard, std::mutex* lock);
+    bool has_devices() const { return static_cast<bool>(devices); }
+    // Hand the devices back (after close()) so the pool can destroy them
+    DevicePair take_devices();
+    
+    // Per-session devices and modifier state, used from the EIS thread
+    InputTarget& input() { return target; }
+    
+    // The session's input transform, swappable while input flows (control thread)
+    TransformSlot& transform() { return transform_slot; }
+    
+    // Emit the Closed signal (session ended by us rather than by the client)
+    void emit_closed();
+
+    // Stop serving EIS (joining the session's thread or leaving its worker) and
+    // release the context, sockets and D-Bus object (if still exported).
+    // Idempotent; must not be called from the EIS thread.
+    void close();
+
+    bool is_closed() const { return closed; }
+
+private:
+    std::string session_handle;
+    std::string app_id;
+    EventHandler on_event;
+    ClientGoneHandler on_client_gone;
+    RecordHandler on_records;
+    uint32_t session_id;
+    static std::atomic<uint32_t> next_id;
+
+    std::unique_ptr<sdbus::IObject> object;
+    
+    DevicePair devices;
+    TransformSlot transform_slot;
+    InputTarget target;
+    std::unique_ptr<EiForwarder> forwarder;
+    Selection selected;
+    std::vector<std::unique_ptr<CaptureStream>> captures;
+
+    struct eis* eis_context = nullptr;
+    std::unique_ptr<SharedRing> ring;
+    int held_client_fd = -1;
+    int stop_fd = -1;
+    std::thread eis_thread;
+    EisWorkers* workers = nullptr;
+    std::atomic<bool> closed{false};
+
+    // Serve the connected client on `workers`, or on a thread of our own
+    bool serve(EisWorkers* workers);
+    void run_eis();
+};
@@ -0,0 +1,127 @@
+#include "shared_ring.h"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+namespace {
+
+// Polls of an empty ring before going idle on the doorbell, about a
+// microsecond; none on a single CPU, where the client cannot run meanwhile
+const int IDLE_SPINS = std::thread::hardware_concurrency() > 1 ? 256 : 0;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+SharedRing::~SharedRing() {
+    if (mapping) munmap(mapping, mapped);
+    if (memory_fd >= 0) close(memory_fd);
+    if (doorbell_fd >= 0) close(doorbell_fd);
+}
+
+bool SharedRing::create(uint32_t requested) {
+    capacity = MIN_CAPACITY;
+    while (capacity < std::min(requested, MAX_CAPACITY)) capacity <<= 1;
+    mapped = SharedRingHeader::RECORDS_OFFSET + size_t(capacity) * sizeof(SharedRingRecord);
+
+    // Sealed at its size, so the client cannot shrink it under our mapping
+    memory_fd = memfd_create("hypr-remote-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memory_fd < 0 || ftruncate(memory_fd, mapped) != 0 ||
+        fcntl(memory_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        std::cerr << "Failed to create shared ring memory: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    mapping = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        std::cerr << "Failed to map shared ring: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    doorbell_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (doorbell_fd < 0) {
+        std::cerr << "Failed to create shared ring doorbell: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Fresh memfd pages are zero: indices at 0, not closed. We start out idle,
+    // so the first record rings.
+    header = static_cast<SharedRingHeader*>(mapping);
+    records = reinterpret_cast<SharedRingRecord*>(static_cast<char*>(mapping) + SharedRingHeader::RECORDS_OFFSET);
+    header->capacity = capacity;
+    header->record_size = sizeof(SharedRingRecord);
+    header->version = SharedRingHeader::VERSION;
+    header->consumer_waiting.store(1, std::memory_order_relaxed);
+    header->magic = SharedRingHeader::MAGIC;
+    return true;
+}
+
+void SharedRing::ring_doorbell() {
+    uint64_t one = 1;
+    if (write(doorbell_fd, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Failed to ring shared ring doorbell: " << strerror(errno) << std::endl;
+    }
+}
+
+bool SharedRing::drain(const Handler& handler) {
+    uint64_t value;
+    while (read(doorbell_fd, &value, sizeof(value)) > 0) {}
+
+    const uint32_t mask = capacity - 1;
+    size_t taken = 0;
+    int spun = 0;
+    while (true) {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t available = header->tail.load(std::memory_order_acquire) - head;
+        if (available > capacity) {
+            std::cerr << "⚠️ Shared ring client wrote past the end of its ring, dropping it" << std::endl;
+            return false;
+        }
+
+        if (available == 0) {
+            if (header->closed.load(std::memory_order_acquire)) return false;
+
+            // A client streaming events usually has the next one on its way;
+            // waiting a moment for it is far cheaper than a doorbell each
+            if (spun < IDLE_SPINS) {
+                spun++;
+                cpu_relax();
+                continue;
+            }
+
+            // Going idle: ask for the doorbell, then look once more for a record
+            // published before the client could see the request
+            header->consumer_waiting.store(1, std::memory_order_seq_cst);
+            if (header->tail.load(std::memory_order_seq_cst) == head) return true;
+            header->consumer_waiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (taken >= MAX_PER_DRAIN) {
+            // More is waiting: come back to it after the worker's other sessions
+            ring_doorbell();
+            return true;
+        }
+
+        // Copied out before use, since the client can write the shared pages at any time
+        size_t count = std::min<uint64_t>(available, BATCH);
+        for (size_t i = 0; i < count; i++) {
+            batch[i] = records[(head + i) & mask];
+        }
+        header->head.store(head + count, std::memory_order_release);
+        handler(batch, count);
+        taken += count;
+        spun = 0;
+    }
+}
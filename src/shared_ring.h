@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Shared-memory input for co-located clients (ConnectToSharedRing). The portal
+// creates a memfd holding a SharedRingHeader and, RECORDS_OFFSET bytes in,
+// `capacity` fixed-size records, plus an eventfd doorbell. The client maps the
+// memfd and is the ring's only producer; the portal is its only consumer.
+//
+// For clients not using SharedRingProducer, the protocol is:
+//  - write records at tail % capacity, then store the new tail (release)
+//  - then, if consumer_waiting is set, exchange it with 0 and if it was still
+//    set write a uint64_t 1 to the doorbell; no syscall while the portal is busy
+//  - never let tail run more than `capacity` past head; the portal ends the
+//    session of a ring that does
+//  - set `closed` and ring the doorbell when done; the portal ends the session
+//    once the records before it have been applied
+//
+// Records are framed like EIS: everything up to a FRAME record is one Wayland
+// frame, stamped with one time.
+
+struct SharedRingRecord {
+    // Same values as InputEvent::Kind
+    enum Kind : uint8_t {
+        NONE,             // ignored
+        MOTION,           // x, y: relative motion
+        MOTION_ABSOLUTE,  // x, y: position within the pointer region
+        BUTTON,           // code: BTN_*, pressed
+        SCROLL,           // x, y: smooth scroll in logical pixels
+        SCROLL_DISCRETE,  // x, y: wheel movement in 1/120ths of a click
+        SCROLL_STOP,      // x, y: nonzero for each axis that stopped
+        KEY,              // code: KEY_*, pressed
+        KEYSYM,           // code: XKB keysym, pressed
+        FRAME,            // end of a group of events that happened together
+    };
+
+    uint8_t kind = NONE;
+    uint8_t pressed = 0;
+    uint16_t reserved = 0;
+    uint32_t code = 0;
+    double x = 0, y = 0;
+};
+static_assert(sizeof(SharedRingRecord) == 24, "the record size is part of the wire format");
+
+struct SharedRingHeader {
+    static constexpr uint32_t MAGIC = 0x31525248; // "HRR1"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t RECORDS_OFFSET = 4096;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;    // records, a power of two
+    uint32_t record_size; // sizeof(SharedRingRecord)
+
+    // Each side's index on a cache line of its own, and the doorbell flag on a
+    // third, which both sides write
+    alignas(64) std::atomic<uint64_t> tail;  // client
+    std::atomic<uint32_t> closed;
+    alignas(64) std::atomic<uint64_t> head;  // portal
+    alignas(64) std::atomic<uint32_t> consumer_waiting;
+};
+static_assert(sizeof(SharedRingHeader) <= SharedRingHeader::RECORDS_OFFSET, "header must fit before the records");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indices must be lock-free to be shared");
+
+// The portal's side: creates the ring and drains it in batches. Used from the
+// one thread serving the session.
+class SharedRing {
+public:
+    static constexpr uint32_t DEFAULT_CAPACITY = 4096;
+    static constexpr uint32_t MIN_CAPACITY = 64;
+    static constexpr uint32_t MAX_CAPACITY = 1 << 16;
+
+    // Records copied out and handed over at a time, and at most per drain() so
+    // one busy client cannot hold a worker from its other sessions
+    static constexpr size_t BATCH = 256;
+    static constexpr size_t MAX_PER_DRAIN = 16 * BATCH;
+
+    using Handler = std::function<void(const SharedRingRecord* records, size_t count)>;
+
+    SharedRing() = default;
+    ~SharedRing();
+
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+
+    // A sealed memfd of `capacity` records (rounded up to a power of two and
+    // clamped) and its doorbell
+    bool create(uint32_t capacity);
+
+    // Poll this for POLLIN, then drain()
+    int doorbell() const { return doorbell_fd; }
+    int memfd() const { return memory_fd; }
+
+    // Hand everything published so far to `handler`; false once the client has
+    // closed the ring or broken the protocol, and the session should end
+    bool drain(const Handler& handler);
+
+private:
+    int memory_fd = -1;
+    int doorbell_fd = -1;
+    void* mapping = nullptr;
+    size_t mapped = 0;
+    SharedRingHeader* header = nullptr;
+    SharedRingRecord* records = nullptr;
+    uint32_t capacity = 0;
+    SharedRingRecord batch[BATCH];
+
+    void ring_doorbell();
+};
+
+// The client's side, header-only so clients need nothing but this file: map a
+// ring from ConnectToSharedRing and publish records into it. Used from one
+// thread at a time.
+class SharedRingProducer {
+public:
+    SharedRingProducer() = default;
+    ~SharedRingProducer() { detach(); }
+
+    SharedRingProducer(const SharedRingProducer&) = delete;
+    SharedRingProducer& operator=(const SharedRingProducer&) = delete;
+
+    // Take both fds and map the ring; false (fds closed) if it is not one
+    bool attach(int memfd, int doorbell) {
+        detach();
+        memory_fd = memfd;
+        doorbell_fd = doorbell;
+
+        // magic, version, capacity, record_size
+        uint32_t fields[4];
+        if (pread(memfd, fields, sizeof(fields), 0) != sizeof(fields) || fields[0] != SharedRingHeader::MAGIC ||
+            fields[1] != SharedRingHeader::VERSION || fields[3] != sizeof(SharedRingRecord) ||
+            fields[2] == 0 || (fields[2] & (fields[2] - 1)) != 0) {
+            detach();
+            return false;
+        }
+        uint32_t capacity = fields[2];
+
+        mapped = SharedRingHeader::RECORDS_OFFSET + size_t(capacity) * sizeof(SharedRingRecord);
+        void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (memory == MAP_FAILED) {
+            mapped = 0;
+            detach();
+            return false;
+        }
+        header = static_cast<SharedRingHeader*>(memory);
+        records = reinterpret_cast<SharedRingRecord*>(static_cast<char*>(memory) + SharedRingHeader::RECORDS_OFFSET);
+        mask = capacity - 1;
+        tail = header->tail.load(std::memory_order_relaxed);
+        cached_head = header->head.load(std::memory_order_acquire);
+        return true;
+    }
+
+    // Publish one record; false if the ring is full (the portal is behind)
+    bool push(const SharedRingRecord& record) { return push(&record, 1) == 1; }
+
+    // Publish all of `records` or, if they do not fit, none (a whole frame)
+    bool push_all(const SharedRingRecord* items, size_t count) {
+        return space(count) >= count && push(items, count) == count;
+    }
+
+    // Publish as many of `records` as fit, all at once; how many that was
+    size_t push(const SharedRingRecord* items, size_t count) {
+        if (!header) return 0;
+        uint64_t free = space(count);
+        size_t n = count < free ? count : free;
+        for (size_t i = 0; i < n; i++) records[(tail + i) & mask] = items[i];
+        tail += n;
+        if (n) publish();
+        return n;
+    }
+
+    // Tell the portal we are done; the session ends after what was published
+    void close() {
+        if (!header) return;
+        header->closed.store(1, std::memory_order_release);
+        uint64_t one = 1;
+        ssize_t written = write(doorbell_fd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void detach() {
+        if (header) munmap(header, mapped);
+        if (memory_fd >= 0) ::close(memory_fd);
+        if (doorbell_fd >= 0) ::close(doorbell_fd);
+        header = nullptr;
+        records = nullptr;
+        mapped = 0;
+        memory_fd = doorbell_fd = -1;
+    }
+
+private:
+    SharedRingHeader* header = nullptr;
+    SharedRingRecord* records = nullptr;
+    size_t mapped = 0;
+    int memory_fd = -1;
+    int doorbell_fd = -1;
+    uint32_t mask = 0;
+    uint64_t tail = 0;
+    uint64_t cached_head = 0;
+
+    // Free records, looking at the portal's head again only if fewer than `wanted`
+    uint64_t space(size_t wanted) {
+        if (!header) return 0;
+        uint64_t free = size_t(mask) + 1 - (tail - cached_head);
+        if (free < wanted) {
+            cached_head = header->head.load(std::memory_order_acquire);
+            free = size_t(mask) + 1 - (tail - cached_head);
+        }
+        return free;
+    }
+
+    void publish() {
+        // Sequentially consistent with the portal's "waiting, then look again",
+        // so either it sees the tail or we see it waiting
+        header->tail.store(tail, std::memory_order_seq_cst);
+        if (header->consumer_waiting.load(std::memory_order_seq_cst) &&
+            header->consumer_waiting.exchange(0, std::memory_order_seq_cst)) {
+            uint64_t one = 1;
+            while (write(doorbell_fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+        }
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed-size single-producer/single-consumer ring. push() is only called from
+// one thread and pop() from one (other) thread; neither blocks or allocates.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    bool push(const T& item) {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - cached_head == Capacity) {
+            cached_head = head_index.load(std::memory_order_acquire);
+            if (tail - cached_head == Capacity) return false;
+        }
+        items[tail & (Capacity - 1)] = item;
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == cached_tail) {
+            cached_tail = tail_index.load(std::memory_order_acquire);
+            if (head == cached_tail) return false;
+        }
+        item = items[head & (Capacity - 1)];
+        head_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: whether anything is waiting, without taking it
+    bool empty() const {
+        return head_index.load(std::memory_order_relaxed) == tail_index.load(std::memory_order_acquire);
+    }
+
+private:
+    // Producer and consumer indices on their own cache lines, each with the
+    // side's last view of the other so the shared line is read only when needed
+    alignas(64) std::atomic<size_t> tail_index{0};
+    size_t cached_head = 0;
+    alignas(64) std::atomic<size_t> head_index{0};
+    size_t cached_tail = 0;
+    alignas(64) T items[Capacity];
+};
@@ -0,0 +1,99 @@
+#include "translator.h"
+#include "debug_log.h"
+#include <chrono>
+
+namespace {
+
+// XKB modifier masks for common modifiers
+constexpr uint32_t MOD_SHIFT = 1 << 0;
+constexpr uint32_t MOD_CAPS = 1 << 1;
+constexpr uint32_t MOD_CTRL = 1 << 2;
+constexpr uint32_t MOD_ALT = 1 << 3;
+constexpr uint32_t MOD_NUM = 1 << 4;
+constexpr uint32_t MOD_META = 1 << 6; // Super/Windows key
+
+} // namespace
+
+uint32_t Translation::now() {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint32_t Translation::remap(TranslationState& state, const InputTransform& transform, const InputEvent& input) {
+    uint32_t code = 0;
+    if (input.pressed) {
+        code = transform.key(input.code);
+        state.held.press(input.code, code);
+    } else if (!state.held.release(input.code, code)) {
+        code = transform.key(input.code);
+    }
+    return code;
+}
+
+int32_t Translation::discrete_clicks(int32_t& remainder, int32_t delta) {
+    if ((remainder < 0) != (delta < 0)) remainder = 0;
+    remainder += delta;
+    int32_t clicks = remainder / DISCRETE_CLICK;
+    remainder -= clicks * DISCRETE_CLICK;
+    return clicks;
+}
+
+bool Translation::update_modifier_state(ModifierState& modifiers, uint32_t keycode, bool is_press) {
+    // Raw Linux input keycodes (NOT XKB keycodes with +8 offset), which is what
+    // EI, EIS and NotifyKeyboardKeycode all carry
+    uint32_t modifier_mask = 0;
+
+    switch (keycode) {
+        case 42:  // Shift_L (raw keycode 42)
+        case 54:  // Shift_R (raw keycode 54)
+            modifier_mask = MOD_SHIFT;
+            DEBUG_LOG("🔧 Detected SHIFT key: " << keycode);
+            break;
+
+        case 29:  // Control_L (raw keycode 29)
+        case 97:  // Control_R (raw keycode 97)
+            modifier_mask = MOD_CTRL;
+            DEBUG_LOG("🔧 Detected CTRL key: " << keycode);
+            break;
+
+        case 56:  // Alt_L (raw keycode 56)
+        case 100: // Alt_R (raw keycode 100)
+            modifier_mask = MOD_ALT;
+            DEBUG_LOG("🔧 Detected ALT key: " << keycode);
+            break;
+
+        case 125: // Super_L (raw keycode 125) - Meta/Windows key
+        case 126: // Super_R (raw keycode 126)
+            modifier_mask = MOD_META;
+            DEBUG_LOG("🔧 Detected META/SUPER key: " << keycode);
+            break;
+
+        case 58:  // Caps_Lock (raw keycode 58)
+            // Caps lock is special - toggle on press only
+            if (!is_press) return false;
+            modifiers.locked ^= MOD_CAPS;
+            DEBUG_LOG("🔒 Caps Lock toggled: " << (modifiers.locked & MOD_CAPS ? "ON" : "OFF"));
+            return true;
+
+        case 69:  // Num_Lock (raw keycode 69)
+            // Num lock is special - toggle on press only
+            if (!is_press) return false;
+            modifiers.locked ^= MOD_NUM;
+            DEBUG_LOG("🔢 Num Lock toggled: " << (modifiers.locked & MOD_NUM ? "ON" : "OFF"));
+            return true;
+
+        default:
+            DEBUG_LOG("🔍 Non-modifier key: " << keycode);
+            return false;
+    }
+
+    uint32_t before = modifiers.depressed;
+    if (is_press) {
+        modifiers.depressed |= modifier_mask;
+        DEBUG_LOG("🔧 Modifier pressed: " << modifier_mask << " (state: " << modifiers.depressed << ")");
+    } else {
+        modifiers.depressed &= ~modifier_mask;
+        DEBUG_LOG("🔧 Modifier released: " << modifier_mask << " (state: " << modifiers.depressed << ")");
+    }
+    return modifiers.depressed != before;
+}
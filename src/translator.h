@@ -0,0 +1,356 @@
+#pragma once
+
+#include "flight_recorder.h"
+#include "input_target.h"
+#include "input_transform.h"
+#include "probes.h"
+#include "shared_ring.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include <cmath>
+#include <cstdint>
+
+extern "C" {
+#include <libei.h>
+#include "libei-1.0/libeis.h"
+#include <wayland-client-protocol.h>
+}
+
+// One input event as every ingress path reduces it, whatever it arrived as.
+// 24 bytes and no pointers; the fields used depend on the kind.
+struct InputEvent {
+    enum Kind : uint8_t {
+        NONE,             // nothing to forward
+        MOTION,           // x, y: relative motion
+        MOTION_ABSOLUTE,  // x, y: position within the pointer region
+        BUTTON,           // code: BTN_*, pressed
+        SCROLL,           // x, y: smooth scroll in logical pixels
+        SCROLL_DISCRETE,  // x, y: wheel movement in 1/120ths of a click
+        SCROLL_STOP,      // x, y: nonzero for each axis that stopped
+        KEY,              // code: KEY_*, pressed
+        KEYSYM,           // code: XKB keysym, pressed
+        FRAME,            // end of a group of events that happened together
+    };
+
+    Kind kind = NONE;
+    bool pressed = false;
+    uint32_t code = 0;
+    double x = 0, y = 0;
+};
+
+// What translation does the same way for every source: timestamps, scroll
+// units, the pointer region and modifier tracking
+class Translation {
+public:
+    // Size of the pointer region absolute motion is relative to
+    // TODO: Get actual screen size
+    static constexpr uint32_t REGION_WIDTH = 1920;
+    static constexpr uint32_t REGION_HEIGHT = 1080;
+
+    // Axis value of one logical pixel of smooth scroll, and of one wheel click
+    // unless the target's transform says otherwise
+    static constexpr double SCROLL_SCALE = 1.0;
+    static constexpr double SCROLL_CLICK = 15.0;
+    // Discrete scroll arrives in 1/120ths of a click (high-resolution wheels)
+    static constexpr int32_t DISCRETE_CLICK = 120;
+
+    // Millisecond timestamp for Wayland requests
+    static uint32_t now();
+
+    // Whole clicks once `delta` (1/120ths) is added to what `remainder` kept from
+    // earlier events on the axis, leaving the rest in it; turning the wheel the
+    // other way drops what was kept
+    static int32_t discrete_clicks(int32_t& remainder, int32_t delta);
+
+    // The code a key or button event goes out as (0 to swallow it): a press
+    // through the transform, a release as its press went out
+    static uint32_t remap(TranslationState& state, const InputTransform& transform, const InputEvent& input);
+
+    // Track `keycode` (KEY_*) in `modifiers`; whether the state changed
+    static bool update_modifier_state(ModifierState& modifiers, uint32_t keycode, bool is_press);
+};
+
+// libei receiver events (LibEIHandler)
+struct EiSource {
+    using Event = struct ei_event;
+    static constexpr bool has_frames = true;
+    static constexpr ProbeSource probe_source = PROBE_SOURCE_EI;
+
+    static InputEvent decode(struct ei_event* event) {
+        InputEvent input;
+        switch (ei_event_get_type(event)) {
+            case EI_EVENT_POINTER_MOTION:
+                input = { InputEvent::MOTION, false, 0, ei_event_pointer_get_dx(event), ei_event_pointer_get_dy(event) };
+                break;
+            case EI_EVENT_POINTER_MOTION_ABSOLUTE:
+                input = { InputEvent::MOTION_ABSOLUTE, false, 0,
+                          ei_event_pointer_get_absolute_x(event), ei_event_pointer_get_absolute_y(event) };
+                break;
+            case EI_EVENT_BUTTON_BUTTON:
+                input = { InputEvent::BUTTON, ei_event_button_get_is_press(event), ei_event_button_get_button(event) };
+                break;
+            case EI_EVENT_SCROLL_DELTA:
+                input = { InputEvent::SCROLL, false, 0, ei_event_scroll_get_dx(event), ei_event_scroll_get_dy(event) };
+                break;
+            case EI_EVENT_SCROLL_DISCRETE:
+                input = { InputEvent::SCROLL_DISCRETE, false, 0, double(ei_event_scroll_get_discrete_dx(event)),
+                          double(ei_event_scroll_get_discrete_dy(event)) };
+                break;
+            case EI_EVENT_SCROLL_STOP:
+            case EI_EVENT_SCROLL_CANCEL:
+                input = { InputEvent::SCROLL_STOP, false, 0, double(ei_event_scroll_get_stop_x(event)),
+                          double(ei_event_scroll_get_stop_y(event)) };
+                break;
+            case EI_EVENT_KEYBOARD_KEY:
+                input = { InputEvent::KEY, ei_event_keyboard_get_key_is_press(event), ei_event_keyboard_get_key(event) };
+                break;
+            case EI_EVENT_FRAME:
+                input.kind = InputEvent::FRAME;
+                break;
+            default:
+                break;
+        }
+        return input;
+    }
+};
+
+// libeis events from ConnectToEIS clients (Portal::handle_eis_event)
+struct EisSource {
+    using Event = struct eis_event;
+    static constexpr bool has_frames = true;
+    static constexpr ProbeSource probe_source = PROBE_SOURCE_EIS;
+
+    static InputEvent decode(struct eis_event* event) {
+        InputEvent input;
+        switch (eis_event_get_type(event)) {
+            case EIS_EVENT_POINTER_MOTION:
+                input = { InputEvent::MOTION, false, 0, eis_event_pointer_get_dx(event), eis_event_pointer_get_dy(event) };
+                break;
+            case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+                input = { InputEvent::MOTION_ABSOLUTE, false, 0,
+                          eis_event_pointer_get_absolute_x(event), eis_event_pointer_get_absolute_y(event) };
+                break;
+            case EIS_EVENT_BUTTON_BUTTON:
+                input = { InputEvent::BUTTON, eis_event_button_get_is_press(event), eis_event_button_get_button(event) };
+                break;
+            case EIS_EVENT_SCROLL_DELTA:
+                input = { InputEvent::SCROLL, false, 0, eis_event_scroll_get_dx(event), eis_event_scroll_get_dy(event) };
+                break;
+            case EIS_EVENT_SCROLL_DISCRETE:
+                input = { InputEvent::SCROLL_DISCRETE, false, 0, double(eis_event_scroll_get_discrete_dx(event)),
+                          double(eis_event_scroll_get_discrete_dy(event)) };
+                break;
+            case EIS_EVENT_SCROLL_STOP:
+            case EIS_EVENT_SCROLL_CANCEL:
+                input = { InputEvent::SCROLL_STOP, false, 0, double(eis_event_scroll_get_stop_x(event)),
+                          double(eis_event_scroll_get_stop_y(event)) };
+                break;
+            case EIS_EVENT_KEYBOARD_KEY:
+                input = { InputEvent::KEY, eis_event_keyboard_get_key_is_press(event), eis_event_keyboard_get_key(event) };
+                break;
+            case EIS_EVENT_FRAME:
+                input.kind = InputEvent::FRAME;
+                break;
+            default:
+                break;
+        }
+        return input;
+    }
+};
+
+// Notify* calls, unmarshalled straight into events; every call is a frame of its own
+struct NotifySource {
+    using Event = const InputEvent;
+    static constexpr bool has_frames = false;
+    static constexpr ProbeSource probe_source = PROBE_SOURCE_DBUS;
+
+    static InputEvent decode(const InputEvent* event) { return *event; }
+};
+
+// Shared ring records (ConnectToSharedRing), framed like EIS. The client wrote
+// them, so anything out of range is dropped rather than trusted: unknown kinds,
+// coordinates that are not finite, absolute positions outside the pointer
+// region, key and button codes past the remap table and wheel movement too
+// large to count in clicks.
+struct SharedRingSource {
+    using Event = const SharedRingRecord;
+    static constexpr bool has_frames = true;
+    static constexpr ProbeSource probe_source = PROBE_SOURCE_RING;
+
+    // Largest wheel movement one record may carry, in 1/120ths of a click
+    static constexpr double MAX_DISCRETE = 1 << 20;
+
+    static InputEvent decode(const SharedRingRecord* record) {
+        InputEvent input;
+        if (record->kind > SharedRingRecord::FRAME || !std::isfinite(record->x) || !std::isfinite(record->y)) {
+            return input;
+        }
+        switch (record->kind) {
+            case SharedRingRecord::MOTION_ABSOLUTE:
+                if (record->x < 0 || record->x >= Translation::REGION_WIDTH ||
+                    record->y < 0 || record->y >= Translation::REGION_HEIGHT) {
+                    return input;
+                }
+                break;
+            case SharedRingRecord::BUTTON:
+            case SharedRingRecord::KEY:
+                if (record->code >= InputTransform::CODE_COUNT) return input;
+                break;
+            case SharedRingRecord::SCROLL_DISCRETE:
+                if (std::fabs(record->x) > MAX_DISCRETE || std::fabs(record->y) > MAX_DISCRETE) return input;
+                break;
+            default:
+                break;
+        }
+        input.kind = static_cast<InputEvent::Kind>(record->kind);
+        input.pressed = record->pressed != 0;
+        input.code = record->code;
+        input.x = record->x;
+        input.y = record->y;
+        return input;
+    }
+};
+static_assert(int(SharedRingRecord::MOTION) == int(InputEvent::MOTION) &&
+              int(SharedRingRecord::KEYSYM) == int(InputEvent::KEYSYM) &&
+              int(SharedRingRecord::FRAME) == int(InputEvent::FRAME),
+              "ring record kinds are InputEvent kinds");
+
+// The translation core, specialized per source at compile time: the source
+// decodes its native event into an InputEvent, and everything from there on
+// (timestamps, scroll scaling, modifiers, frames) is this one code path.
+//
+// Sources with frames of their own get one Wayland frame per source frame, all
+// stamped with the time of its first event; for the rest each event is a frame.
+// The frame in progress lives in the target, so each stream needs its own.
+// The target's transform (key remapping, pointer gain, scroll direction and
+// scale) is applied here too, after decoding, whatever the source.
+// Every event goes into the flight recorder under the target's session.
+template <typename Source>
+class Translator {
+public:
+    static void translate(InputTarget& target, typename Source::Event* event) {
+        apply(target, Source::decode(event));
+    }
+
+    static void apply(InputTarget& target, const InputEvent& input);
+};
+
+template <typename Source>
+void Translator<Source>::apply(InputTarget& target, const InputEvent& input) {
+    TranslationState& state = target.translation;
+    WaylandVirtualPointer* pointer = target.pointer;
+    WaylandVirtualKeyboard* keyboard = target.keyboard;
+    TransformSlot::Reader reading(target.transform);
+    const InputTransform& transform = reading.transform();
+
+    if (input.kind == InputEvent::NONE) return;
+    FlightRecorder::event(target.session, Source::probe_source, input.kind, input.pressed, input.code, input.x, input.y);
+    if (input.kind == InputEvent::FRAME) {
+        if (state.pointer_pending && pointer) pointer->send_frame();
+        state.in_frame = false;
+        state.pointer_pending = false;
+        return;
+    }
+
+    if (!state.in_frame) {
+        state.time = Translation::now();
+        state.in_frame = true;
+    }
+    uint32_t time = state.time;
+
+    switch (input.kind) {
+        case InputEvent::MOTION: {
+            if (!pointer) break;
+            double gain = transform.gain(input.x, input.y);
+            pointer->send_motion(time, input.x * gain, input.y * gain);
+            state.pointer_pending = true;
+            break;
+        }
+
+        case InputEvent::MOTION_ABSOLUTE:
+            if (!pointer) break;
+            pointer->send_motion_absolute(time, static_cast<uint32_t>(input.x), static_cast<uint32_t>(input.y),
+                                          Translation::REGION_WIDTH, Translation::REGION_HEIGHT);
+            state.pointer_pending = true;
+            break;
+
+        case InputEvent::BUTTON: {
+            uint32_t button = Translation::remap(state, transform, input);
+            if (!pointer || !button) break;
+            pointer->send_button(time, button, input.pressed ? 1 : 0);
+            state.pointer_pending = true;
+            break;
+        }
+
+        case InputEvent::SCROLL:
+            if (!pointer || (input.x == 0.0 && input.y == 0.0)) break;
+            pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
+            if (input.x != 0.0) {
+                pointer->send_axis(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL,
+                                   input.x * Translation::SCROLL_SCALE * transform.scroll_x);
+            }
+            if (input.y != 0.0) {
+                pointer->send_axis(time, WL_POINTER_AXIS_VERTICAL_SCROLL,
+                                   input.y * Translation::SCROLL_SCALE * transform.scroll_y);
+            }
+            state.pointer_pending = true;
+            break;
+
+        case InputEvent::SCROLL_DISCRETE: {
+            if (!pointer || (input.x == 0.0 && input.y == 0.0)) break;
+            pointer->send_axis_source(WL_POINTER_AXIS_SOURCE_WHEEL);
+            // High-resolution wheels move a fraction of a click at a time: the
+            // scroll goes out as it comes, a click count only once one is whole
+            auto scroll = [&](uint32_t axis, double delta, int32_t& remainder, double direction) {
+                double value = delta * transform.scroll_click * direction / Translation::DISCRETE_CLICK;
+                int32_t clicks = Translation::discrete_clicks(remainder, static_cast<int32_t>(delta));
+                if (clicks) {
+                    pointer->send_axis_discrete(time, axis, value, direction < 0 ? -clicks : clicks);
+                } else {
+                    pointer->send_axis(time, axis, value);
+                }
+            };
+            if (input.x != 0.0) scroll(WL_POINTER_AXIS_HORIZONTAL_SCROLL, input.x, state.discrete_x, transform.scroll_x);
+            if (input.y != 0.0) scroll(WL_POINTER_AXIS_VERTICAL_SCROLL, input.y, state.discrete_y, transform.scroll_y);
+            state.pointer_pending = true;
+            break;
+        }
+
+        case InputEvent::SCROLL_STOP:
+            if (!pointer || (input.x == 0.0 && input.y == 0.0)) break;
+            if (input.x != 0.0) {
+                pointer->send_axis_stop(time, WL_POINTER_AXIS_HORIZONTAL_SCROLL);
+                state.discrete_x = 0;
+            }
+            if (input.y != 0.0) {
+                pointer->send_axis_stop(time, WL_POINTER_AXIS_VERTICAL_SCROLL);
+                state.discrete_y = 0;
+            }
+            state.pointer_pending = true;
+            break;
+
+        case InputEvent::KEY: {
+            uint32_t key = Translation::remap(state, transform, input);
+            if (!keyboard || !key) break;
+            // The key first, then the modifiers it changed, as a real keyboard reports them
+            keyboard->send_key(time, key, input.pressed ? 1 : 0);
+            if (Translation::update_modifier_state(target.modifiers, key, input.pressed)) {
+                keyboard->send_modifiers(target.modifiers.depressed, target.modifiers.latched,
+                                         target.modifiers.locked, target.modifiers.group);
+            }
+            break;
+        }
+
+        case InputEvent::KEYSYM:
+            if (!keyboard) break;
+            keyboard->send_keysym(time, input.code, input.pressed ? 1 : 0);
+            break;
+
+        default:
+            break;
+    }
+
+    if constexpr (!Source::has_frames) {
+        apply(target, InputEvent{ InputEvent::FRAME });
+    }
+}
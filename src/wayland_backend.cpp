@@ -0,0 +1,142 @@
+#include "wayland_backend.h"
+#include "wayland_virtual_keyboard.h"
+#include "wayland_virtual_pointer.h"
+#include "xkb.h"
+#include "probes.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <cerrno>
+
+static const struct wl_registry_listener registry_listener = {
+    .global = WaylandBackend::registry_global,
+    .global_remove = WaylandBackend::registry_global_remove,
+};
+
+WaylandBackend::WaylandBackend()
+    : display(nullptr), registry(nullptr), seat(nullptr),
+      pointer_manager(nullptr), keyboard_manager(nullptr), keymap_fd(-1), keymap_size(0) {
+}
+
+WaylandBackend::~WaylandBackend() {
+    cleanup();
+}
+
+bool WaylandBackend::init() {
+    display = wl_display_connect(nullptr);
+    if (!display) {
+        std::cerr << "Failed to connect to Wayland display" << std::endl;
+        return false;
+    }
+
+    registry = wl_display_get_registry(display);
+    if (!registry) {
+        std::cerr << "Failed to get Wayland registry" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    wl_registry_add_listener(registry, &registry_listener, this);
+    wl_display_roundtrip(display);
+
+    if (!pointer_manager) {
+        std::cerr << "Compositor does not support wlr-virtual-pointer protocol" << std::endl;
+        cleanup();
+        return false;
+    }
+    if (!keyboard_manager) {
+        std::cerr << "Compositor does not support virtual-keyboard protocol" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    // One keymap memfd for every keyboard; keysym lookups use the same map
+    keymap_fd = WaylandVirtualKeyboard::create_keymap_fd(keymap_size);
+    if (keymap_fd < 0) {
+        std::cerr << "Failed to setup keymap" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    std::cout << "Wayland output backend connected" << std::endl;
+    return true;
+}
+
+void WaylandBackend::cleanup() {
+    if (keymap_fd >= 0) {
+        close(keymap_fd);
+        keymap_fd = -1;
+    }
+    if (keyboard_manager) {
+        zwp_virtual_keyboard_manager_v1_destroy(keyboard_manager);
+        keyboard_manager = nullptr;
+    }
+    if (pointer_manager) {
+        zwlr_virtual_pointer_manager_v1_destroy(pointer_manager);
+        pointer_manager = nullptr;
+    }
+    if (seat) {
+        wl_seat_destroy(seat);
+        seat = nullptr;
+    }
+    if (registry) {
+        wl_registry_destroy(registry);
+        registry = nullptr;
+    }
+    if (display) {
+        wl_display_flush(display);
+        wl_display_disconnect(display);
+        display = nullptr;
+    }
+}
+
+DevicePair WaylandBackend::create_pair() {
+    if (!display) return DevicePair();
+
+    auto pointer = std::make_unique<WaylandVirtualPointer>();
+    if (!pointer->init(display, seat, pointer_manager)) {
+        return DevicePair();
+    }
+
+    auto keyboard = std::make_unique<WaylandVirtualKeyboard>();
+    if (!keyboard->init(display, seat, keyboard_manager, keymap_fd, keymap_size)) {
+        return DevicePair();
+    }
+
+    return DevicePair(std::move(pointer), std::move(keyboard));
+}
+
+void WaylandBackend::flush() {
+    if (display) {
+        int sent = wl_display_flush(display);
+        PROBE2(wayland_flush, sent, sent < 0 ? errno : 0);
+    }
+}
+
+void WaylandBackend::sync() {
+    if (display) {
+        wl_display_roundtrip(display);
+    }
+}
+
+void WaylandBackend::registry_global(void* data, struct wl_registry* registry,
+                                     uint32_t name, const char* interface, uint32_t version) {
+    WaylandBackend* self = static_cast<WaylandBackend*>(data);
+
+    if (strcmp(interface, zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
+        self->pointer_manager = static_cast<struct zwlr_virtual_pointer_manager_v1*>(
+            wl_registry_bind(registry, name, &zwlr_virtual_pointer_manager_v1_interface,
+                           std::min(version, 2u)));
+    } else if (strcmp(interface, zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+        self->keyboard_manager = static_cast<struct zwp_virtual_keyboard_manager_v1*>(
+            wl_registry_bind(registry, name, &zwp_virtual_keyboard_manager_v1_interface, 1));
+    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
+        self->seat = static_cast<struct wl_seat*>(
+            wl_registry_bind(registry, name, &wl_seat_interface, 1));
+    }
+}
+
+void WaylandBackend::registry_global_remove(void* data, struct wl_registry* registry, uint32_t name) {
+    // Handle global removal if needed
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "output_backend.h"
+#include <cstdint>
+
+extern "C" {
+#include <wayland-client.h>
+#include "wlr-virtual-pointer-unstable-v1-client-protocol.h"
+#include "virtual-keyboard-unstable-v1-client-protocol.h"
+}
+
+// Virtual input on the compositor. Every pair shares one Wayland connection, and
+// each keyboard gets its keymap from a single shared memfd.
+class WaylandBackend : public OutputBackend {
+public:
+    WaylandBackend();
+    ~WaylandBackend() override;
+
+    const char* name() const override { return "wayland"; }
+    bool init() override;
+    void cleanup() override;
+    DevicePair create_pair() override;
+    void flush() override;
+    void sync() override;
+
+    // Registry callback functions (must be public)
+    static void registry_global(void* data, struct wl_registry* registry,
+                              uint32_t name, const char* interface, uint32_t version);
+    static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+
+private:
+    struct wl_display* display;
+    struct wl_registry* registry;
+    struct wl_seat* seat;
+    struct zwlr_virtual_pointer_manager_v1* pointer_manager;
+    struct zwp_virtual_keyboard_manager_v1* keyboard_manager;
+    int keymap_fd;
+    uint32_t keymap_size;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Every wire-level request the virtual devices can put on the Wayland socket,
+// plus the flushes that push them to the compositor.
+enum class WaylandRequest : uint8_t {
+    PointerMotion,
+    PointerMotionAbsolute,
+    PointerButton,
+    PointerAxis,
+    PointerAxisSource,
+    PointerAxisDiscrete,
+    PointerAxisStop,
+    PointerFrame,
+    KeyboardKey,
+    KeyboardModifiers,
+    Flush,
+    KeyboardKeymap, // args: size
+};
+
+// One request as the record: backend writes it to file, and as the flight
+// recorder keeps it
+struct RecordedRequest {
+    WaylandRequest request;
+    uint32_t time;
+    uint32_t args[5];
+};
@@ -1,142 +1,25 @@
 #include "wayland_virtual_keyboard.h"
+#include "xkb.h"
+#include "keymap_extension.h"
+#include "flight_recorder.h"
+#include "probes.h"
 #include <iostream>
 #include <cstring>
-#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <memory>
-#include <optional>
 #include <xkbcommon/xkbcommon.h>
 #include <linux/input-event-codes.h>
-
-// Taken almost wholesale from https://github.com/KDE/xdg-desktop-portal-kde/blob/master/src/waylandintegration.cpp#L450
-namespace
-{
-struct XKBStateDeleter {
-    void operator()(struct xkb_state *state) const
-    {
-        return xkb_state_unref(state);
-    }
-};
-struct XKBKeymapDeleter {
-    void operator()(struct xkb_keymap *keymap) const
-    {
-        return xkb_keymap_unref(keymap);
-    }
-};
-struct XKBContextDeleter {
-    void operator()(struct xkb_context *context) const
-    {
-        return xkb_context_unref(context);
-    }
-};
-using ScopedXKBState = std::unique_ptr<struct xkb_state, XKBStateDeleter>;
-using ScopedXKBKeymap = std::unique_ptr<struct xkb_keymap, XKBKeymapDeleter>;
-using ScopedXKBContext = std::unique_ptr<struct xkb_context, XKBContextDeleter>;
-}
-class Xkb
-{
-public:
-    struct Code {
-        const uint32_t level;
-        const uint32_t code;
-    };
-    std::optional<Code> keycodeFromKeysym(xkb_keysym_t keysym)
-    {
-        /* The offset between KEY_* numbering, and keycodes in the XKB evdev
-         * dataset. */
-        static const uint EVDEV_OFFSET = 8;
-
-        auto layout = xkb_state_serialize_layout(m_state.get(), XKB_STATE_LAYOUT_EFFECTIVE);
-        const xkb_keycode_t max = xkb_keymap_max_keycode(m_keymap.get());
-        for (xkb_keycode_t keycode = xkb_keymap_min_keycode(m_keymap.get()); keycode < max; keycode++) {
-            uint levelCount = xkb_keymap_num_levels_for_key(m_keymap.get(), keycode, layout);
-            for (uint currentLevel = 0; currentLevel < levelCount; currentLevel++) {
-                const xkb_keysym_t *syms;
-                uint num_syms = xkb_keymap_key_get_syms_by_level(m_keymap.get(), keycode, layout, currentLevel, &syms);
-                for (uint sym = 0; sym < num_syms; sym++) {
-                    if (syms[sym] == keysym) {
-                        return Code{currentLevel, keycode - EVDEV_OFFSET};
-                    }
-                }
-            }
-        }
-        return {};
-    }
-
-    void keyboard_keymap(uint32_t format, int32_t fd, uint32_t size)
-    {
-        if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
-            std::cerr << "unknown keymap format:" << format;
-            close(fd);
-            return;
-        }
-
-        char *map_str = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
-        if (map_str == MAP_FAILED) {
-            close(fd);
-            return;
-        }
-
-        m_keymap.reset(xkb_keymap_new_from_string(m_ctx.get(), map_str, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS));
-        munmap(map_str, size);
-        close(fd);
-
-        if (m_keymap)
-            m_state.reset(xkb_state_new(m_keymap.get()));
-        else
-            m_state.reset(nullptr);
-    }
-
-    static Xkb *self()
-    {
-        static Xkb self;
-        return &self;
-    }
-
-private:
-    Xkb()
-    {
-        m_ctx.reset(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
-        if (!m_ctx) {
-            std::cerr << "Failed to create xkb context" << std::endl;
-            return;
-        }
-        m_keymap.reset(xkb_keymap_new_from_names(m_ctx.get(), nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS));
-        if (!m_keymap) {
-            std::cerr << "Failed to create the keymap" << std::endl;
-            return;
-        }
-        m_state.reset(xkb_state_new(m_keymap.get()));
-        if (!m_state) {
-            std::cerr << "Failed to create the xkb state" << std::endl;
-            return;
-        }
-    }
-
-    ScopedXKBContext m_ctx;
-    ScopedXKBKeymap m_keymap;
-    ScopedXKBState m_state;
-};
+#include <algorithm>
+#include <cerrno>
 
 static const struct wl_registry_listener registry_listener = {
     .global = WaylandVirtualKeyboard::registry_global,
     .global_remove = WaylandVirtualKeyboard::registry_global_remove,
 };
 
-// Basic US QWERTY keymap
-static const char keymap_str[] =
-    "xkb_keymap {\n"
-    "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
-    "xkb_types     { include \"complete\" };\n"
-    "xkb_compat    { include \"complete\" };\n"
-    "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
-    "xkb_geometry  { include \"pc(pc104)\" };\n"
-    "};\n";
-
 WaylandVirtualKeyboard::WaylandVirtualKeyboard()
     : display(nullptr), registry(nullptr), seat(nullptr), 
-      keyboard_manager(nullptr), virtual_keyboard(nullptr) {
+      keyboard_manager(nullptr), virtual_keyboard(nullptr), owns_connection(true) {
 }
 
 WaylandVirtualKeyboard::~WaylandVirtualKeyboard() {
@@ -185,11 +68,32 @@ bool WaylandVirtualKeyboard::init() {
     return true;
 }
 
+bool WaylandVirtualKeyboard::init(struct wl_display* shared_display, struct wl_seat* shared_seat,
+                                  struct zwp_virtual_keyboard_manager_v1* manager, int keymap_fd, uint32_t keymap_size) {
+    owns_connection = false;
+    display = shared_display;
+
+    virtual_keyboard = zwp_virtual_keyboard_manager_v1_create_virtual_keyboard(manager, shared_seat);
+    if (!virtual_keyboard) {
+        std::cerr << "Failed to create virtual keyboard" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    // The fd is duplicated into the message, so one memfd serves every keyboard
+    zwp_virtual_keyboard_v1_keymap(virtual_keyboard, XKB_KEYMAP_FORMAT_TEXT_V1, keymap_fd, keymap_size);
+    return true;
+}
+
 void WaylandVirtualKeyboard::cleanup() {
     if (virtual_keyboard) {
         zwp_virtual_keyboard_v1_destroy(virtual_keyboard);
         virtual_keyboard = nullptr;
     }
+    if (!owns_connection) {
+        display = nullptr;
+        return;
+    }
     if (keyboard_manager) {
         zwp_virtual_keyboard_manager_v1_destroy(keyboard_manager);
         keyboard_manager = nullptr;
@@ -208,37 +112,35 @@ void WaylandVirtualKeyboard::cleanup() {
     }
 }
 
-bool WaylandVirtualKeyboard::setup_keymap() {
-    if (!virtual_keyboard) return false;
+int WaylandVirtualKeyboard::create_keymap_fd(uint32_t& size) {
+    // Xkb holds the keymap (from the cache when it can) in a sealed memfd
+    Xkb* xkb = Xkb::self();
+    if (xkb->keymap_fd() < 0) {
+        std::cerr << "No keymap loaded" << std::endl;
+        return -1;
+    }
 
-    size_t keymap_size = strlen(keymap_str) + 1;
-    
-    // Create shared memory file
-    int fd = memfd_create("keymap", MFD_CLOEXEC);
+    int fd = fcntl(xkb->keymap_fd(), F_DUPFD_CLOEXEC, 0);
     if (fd < 0) {
-        std::cerr << "Failed to create memfd" << std::endl;
-        return false;
+        std::cerr << "Failed to duplicate keymap fd" << std::endl;
+        return -1;
     }
 
-    if (ftruncate(fd, keymap_size) < 0) {
-        std::cerr << "Failed to resize memfd" << std::endl;
-        close(fd);
-        return false;
-    }
+    size = static_cast<uint32_t>(xkb->keymap_text().size() + 1);
+    return fd;
+}
 
-    void* data = mmap(nullptr, keymap_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
-        std::cerr << "Failed to mmap keymap" << std::endl;
-        close(fd);
+bool WaylandVirtualKeyboard::setup_keymap() {
+    if (!virtual_keyboard) return false;
+
+    uint32_t keymap_size = 0;
+    int fd = create_keymap_fd(keymap_size);
+    if (fd < 0) {
         return false;
     }
 
-    strcpy(static_cast<char*>(data), keymap_str);
-    munmap(data, keymap_size);
-
-    // Send keymap to compositor
+    // Send keymap to compositor; keysym lookups already use the same map
     zwp_virtual_keyboard_v1_keymap(virtual_keyboard, XKB_KEYMAP_FORMAT_TEXT_V1, fd, keymap_size);
-    Xkb::self()->keyboard_keymap(XKB_KEYMAP_FORMAT_TEXT_V1, fd, keymap_size);
     close(fd);
 
     return true;
@@ -262,52 +164,171 @@ void WaylandVirtualKeyboard::registry_global_remove(void* data, struct wl_regist
 }
 
 void WaylandVirtualKeyboard::send_key(uint32_t time, uint32_t key, uint32_t state) {
-    if (virtual_keyboard) {
-        zwp_virtual_keyboard_v1_key(virtual_keyboard, time, key, state);
-        wl_display_flush(display);
-    }
+    key_out(time, key, state);
+    request_flush();
 }
 
 // https://github.com/KDE/xdg-desktop-portal-kde/blob/master/src/waylandintegration.cpp#L563
 void WaylandVirtualKeyboard::send_keysym(uint32_t time, uint32_t keysym, uint32_t state) {
-    if (virtual_keyboard) {
-        auto keycode = Xkb::self()->keycodeFromKeysym(keysym);
-        if (!keycode) {
-            std::cerr << "Failed to convert keysym into keycode" << keysym;
+    auto keycode = Xkb::self()->keycodeFromKeysym(keysym);
+    if (!keycode) {
+        // Bound to a level-one key of its own, so no modifier is involved
+        uint32_t spare = extension_keycode(keysym);
+        if (!spare) {
+            std::cerr << "Failed to convert keysym into keycode" << keysym << std::endl;
             return;
         }
+        key_out(time, spare, state ? WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED);
+        request_flush();
+        return;
+    }
 
-        auto sendKey = [this, state, time](int keycode) {
-            if (state) {
-                zwp_virtual_keyboard_v1_key(virtual_keyboard, time, keycode, WL_KEYBOARD_KEY_STATE_PRESSED);
-            } else {
-                zwp_virtual_keyboard_v1_key(virtual_keyboard, time, keycode, WL_KEYBOARD_KEY_STATE_RELEASED);
-            }
-        };
-		// The level is always 0 with KDEConnect but I assume this is here for a reason
-        switch (keycode->level) {
-            case 0:
-                break;
-            case 1:
-                sendKey(KEY_LEFTSHIFT);
-                break;
-            case 2:
-                sendKey(KEY_RIGHTALT);
-                break;
-            default:
-                std::cerr << "Unsupported key level" << keycode->level;
-                break;
+    auto sendKey = [this, state, time](int keycode) {
+        if (state) {
+            key_out(time, keycode, WL_KEYBOARD_KEY_STATE_PRESSED);
+        } else {
+            key_out(time, keycode, WL_KEYBOARD_KEY_STATE_RELEASED);
         }
-        sendKey(keycode->code);
-        wl_display_flush(display);
+    };
+    // The level is always 0 with KDEConnect but I assume this is here for a reason
+    switch (keycode->level) {
+        case 0:
+            break;
+        case 1:
+            sendKey(KEY_LEFTSHIFT);
+            break;
+        case 2:
+            sendKey(KEY_RIGHTALT);
+            break;
+        default:
+            std::cerr << "Unsupported key level" << keycode->level;
+            break;
     }
+    sendKey(keycode->code);
+    request_flush();
 }
 
 void WaylandVirtualKeyboard::send_modifiers(uint32_t mods_depressed, uint32_t mods_latched, 
                                           uint32_t mods_locked, uint32_t group) {
+    modifiers_out(mods_depressed, mods_latched, mods_locked, group);
+    request_flush();
+}
+
+void WaylandVirtualKeyboard::end_deferred_flush() {
+    flush_deferred = false;
+    if (flush_pending) {
+        flush_pending = false;
+        commit_keymap();
+        flush();
+    }
+}
+
+void WaylandVirtualKeyboard::request_flush() {
+    if (flush_deferred) {
+        flush_pending = true;
+    } else {
+        commit_keymap();
+        flush();
+    }
+}
+
+void WaylandVirtualKeyboard::key_out(uint32_t time, uint32_t key, uint32_t state) {
+    if (keymap_extension) {
+        keymap_extension->key_state(key, state == WL_KEYBOARD_KEY_STATE_PRESSED);
+    }
+    if (keymap_extension && keymap_extension->stale()) {
+        held.push_back({ false, time, { key, state } });
+        return;
+    }
+    emit_key(time, key, state);
+}
+
+void WaylandVirtualKeyboard::modifiers_out(uint32_t mods_depressed, uint32_t mods_latched,
+                                           uint32_t mods_locked, uint32_t group) {
+    if (keymap_extension && keymap_extension->stale()) {
+        held.push_back({ true, 0, { mods_depressed, mods_latched, mods_locked, group } });
+        return;
+    }
+    emit_modifiers(mods_depressed, mods_latched, mods_locked, group);
+    modifiers[0] = mods_depressed;
+    modifiers[1] = mods_latched;
+    modifiers[2] = mods_locked;
+    modifiers[3] = group;
+}
+
+uint32_t WaylandVirtualKeyboard::extension_keycode(uint32_t keysym) {
+    if (!keymap_extension) {
+        keymap_extension = std::make_unique<KeymapExtension>(Xkb::self()->keymap_text());
+        if (!keymap_extension->usable()) {
+            std::cerr << "⚠️ No spare keycodes in the keymap for keysyms outside it" << std::endl;
+        }
+    }
+
+    uint32_t keycode = 0;
+    KeymapExtension::Result result = keymap_extension->assign(keysym, keycode);
+    if (result == KeymapExtension::Result::STALE) {
+        // More new keysyms than slots since the last upload: upload what the
+        // keys held so far need before rebinding any of their slots
+        commit_keymap();
+        result = keymap_extension->assign(keysym, keycode);
+    }
+    return result == KeymapExtension::Result::BOUND || result == KeymapExtension::Result::REBOUND ? keycode : 0;
+}
+
+void WaylandVirtualKeyboard::commit_keymap() {
+    if (keymap_extension && keymap_extension->stale()) {
+        uint32_t size = 0;
+        int fd = keymap_extension->commit(size);
+        if (fd >= 0) {
+            emit_keymap(fd, size);
+            close(fd);
+            // A new keymap starts from a fresh state in the compositor: restore
+            // the modifiers in effect before the held requests
+            emit_modifiers(modifiers[0], modifiers[1], modifiers[2], modifiers[3]);
+        }
+    }
+
+    for (const HeldRequest& request : held) {
+        const uint32_t* a = request.args;
+        if (request.modifiers) {
+            emit_modifiers(a[0], a[1], a[2], a[3]);
+            std::copy(a, a + 4, modifiers);
+        } else {
+            emit_key(request.time, a[0], a[1]);
+        }
+    }
+    held.clear();
+}
+
+void WaylandVirtualKeyboard::emit_key(uint32_t time, uint32_t key, uint32_t state) {
     if (virtual_keyboard) {
-        zwp_virtual_keyboard_v1_modifiers(virtual_keyboard, mods_depressed, 
+        zwp_virtual_keyboard_v1_key(virtual_keyboard, time, key, state);
+        FlightRecorder::request(flight_session, WaylandRequest::KeyboardKey, time, key, state);
+    }
+}
+
+void WaylandVirtualKeyboard::emit_modifiers(uint32_t mods_depressed, uint32_t mods_latched,
+                                          uint32_t mods_locked, uint32_t group) {
+    if (virtual_keyboard) {
+        zwp_virtual_keyboard_v1_modifiers(virtual_keyboard, mods_depressed,
                                         mods_latched, mods_locked, group);
-        wl_display_flush(display);
+        FlightRecorder::request(flight_session, WaylandRequest::KeyboardModifiers, 0, mods_depressed, mods_latched,
+                                mods_locked, group);
     }
-} 
\ No newline at end of file
+}
+
+void WaylandVirtualKeyboard::emit_keymap(int fd, uint32_t size) {
+    if (virtual_keyboard) {
+        // The fd is duplicated into the message
+        zwp_virtual_keyboard_v1_keymap(virtual_keyboard, XKB_KEYMAP_FORMAT_TEXT_V1, fd, size);
+        FlightRecorder::request(flight_session, WaylandRequest::KeyboardKeymap, 0, size);
+    }
+}
+
+void WaylandVirtualKeyboard::flush() {
+    if (display) {
+        FlightRecorder::request(flight_session, WaylandRequest::Flush, 0);
+        int sent = wl_display_flush(display);
+        PROBE2(wayland_flush, sent, sent < 0 ? errno : 0);
+    }
+}
@@ -1,28 +1,65 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 extern "C" {
 #include <wayland-client.h>
 #include "virtual-keyboard-unstable-v1-client-protocol.h"
 }
 
+class KeymapExtension;
+
 class WaylandVirtualKeyboard {
 public:
     WaylandVirtualKeyboard();
-    ~WaylandVirtualKeyboard();
+    virtual ~WaylandVirtualKeyboard();
     
     bool init();
+    // Create the keyboard on a connection owned by the caller (see DevicePool) and
+    // upload the keymap already written to `keymap_fd`; cleanup() then only
+    // destroys the keyboard itself
+    bool init(struct wl_display* shared_display, struct wl_seat* shared_seat,
+              struct zwp_virtual_keyboard_manager_v1* manager, int keymap_fd, uint32_t keymap_size);
     void cleanup();
     
+    // Write the portal's keymap to a new memfd; returns the fd (owned by the caller) or -1
+    static int create_keymap_fd(uint32_t& size);
+    
     // Keyboard input methods
     void send_key(uint32_t time, uint32_t key, uint32_t state);
+    // A keysym the keymap has no key for is bound to a spare keycode (see
+    // KeymapExtension); the new keymap goes out with the next flush, ahead of
+    // everything sent since, so a burst of new keysyms is one upload
     void send_keysym(uint32_t time, uint32_t keysym, uint32_t state);
     void send_modifiers(uint32_t mods_depressed, uint32_t mods_latched, 
                        uint32_t mods_locked, uint32_t group);
+    
+    // Hold back the flush after each send_* until end_deferred_flush(), which
+    // flushes once if anything was sent in between
+    void begin_deferred_flush() { flush_deferred = true; }
+    void end_deferred_flush();
+    
+    // Session the requests are recorded under in the flight recorder (0: none)
+    void set_flight_session(uint32_t session) { flight_session = session; }
 
     // Registry callback functions (must be public)
     static void registry_global(void* data, struct wl_registry* registry,
                               uint32_t name, const char* interface, uint32_t version);
     static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+
+protected:
+    // The output scheduler replays its queued requests through these
+    friend class OutputScheduler;
+
+    // Wire-level requests, overridable so the request stream can be recorded without a compositor
+    virtual void emit_key(uint32_t time, uint32_t key, uint32_t state);
+    virtual void emit_modifiers(uint32_t mods_depressed, uint32_t mods_latched,
+                                uint32_t mods_locked, uint32_t group);
+    // Replace the keymap with the one in `fd` (which stays the caller's)
+    virtual void emit_keymap(int fd, uint32_t size);
+    virtual void flush();
     
 private:
     struct wl_display* display;
@@ -30,6 +67,29 @@ private:
     struct wl_seat* seat;
     struct zwp_virtual_keyboard_manager_v1* keyboard_manager;
     struct zwp_virtual_keyboard_v1* virtual_keyboard;
+    bool owns_connection;
+    bool flush_deferred = false;
+    bool flush_pending = false;
+    uint32_t flight_session = 0;
+    
+    // Spare keycodes for keysyms outside the keymap, made on first use. While
+    // it has bindings to upload, requests are held back to go out after it.
+    struct HeldRequest {
+        bool modifiers;
+        uint32_t time;
+        uint32_t args[4];
+    };
+    std::unique_ptr<KeymapExtension> keymap_extension;
+    std::vector<HeldRequest> held;
+    uint32_t modifiers[4] = {}; // as last emitted
+    
+    void request_flush();
+    void key_out(uint32_t time, uint32_t key, uint32_t state);
+    void modifiers_out(uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group);
+    // The keycode for a keysym outside the keymap, or 0
+    uint32_t extension_keycode(uint32_t keysym);
+    // Upload pending bindings, then what was held back for them
+    void commit_keymap();
     
     bool setup_keymap();
 }; 
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "wayland_virtual_pointer.h"
+#include "flight_recorder.h"
+#include "probes.h"
 #include <iostream>
 #include <cstring>
+#include <cerrno>
 
 static const struct wl_registry_listener registry_listener = {
     .global = WaylandVirtualPointer::registry_global,
@@ -9,7 +12,7 @@ static const struct wl_registry_listener registry_listener = {
 
 WaylandVirtualPointer::WaylandVirtualPointer()
     : display(nullptr), registry(nullptr), seat(nullptr), 
-      pointer_manager(nullptr), virtual_pointer(nullptr) {
+      pointer_manager(nullptr), virtual_pointer(nullptr), owns_connection(true) {
 }
 
 WaylandVirtualPointer::~WaylandVirtualPointer() {
@@ -52,11 +55,29 @@ bool WaylandVirtualPointer::init() {
     return true;
 }
 
+bool WaylandVirtualPointer::init(struct wl_display* shared_display, struct wl_seat* shared_seat,
+                                 struct zwlr_virtual_pointer_manager_v1* manager) {
+    owns_connection = false;
+    display = shared_display;
+
+    virtual_pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer(manager, shared_seat);
+    if (!virtual_pointer) {
+        std::cerr << "Failed to create virtual pointer" << std::endl;
+        cleanup();
+        return false;
+    }
+    return true;
+}
+
 void WaylandVirtualPointer::cleanup() {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_destroy(virtual_pointer);
         virtual_pointer = nullptr;
     }
+    if (!owns_connection) {
+        display = nullptr;
+        return;
+    }
     if (pointer_manager) {
         zwlr_virtual_pointer_manager_v1_destroy(pointer_manager);
         pointer_manager = nullptr;
@@ -94,58 +115,116 @@ void WaylandVirtualPointer::registry_global_remove(void* data, struct wl_registr
 }
 
 void WaylandVirtualPointer::send_motion(uint32_t time, double dx, double dy) {
+    emit_motion(time, wl_fixed_from_double(dx), wl_fixed_from_double(dy));
+}
+
+void WaylandVirtualPointer::send_motion_absolute(uint32_t time, uint32_t x, uint32_t y, 
+                                               uint32_t x_extent, uint32_t y_extent) {
+    emit_motion_absolute(time, x, y, x_extent, y_extent);
+}
+
+void WaylandVirtualPointer::send_button(uint32_t time, uint32_t button, uint32_t state) {
+    emit_button(time, button, state);
+}
+
+void WaylandVirtualPointer::send_axis(uint32_t time, uint32_t axis, double value) {
+    emit_axis(time, axis, wl_fixed_from_double(value));
+}
+
+void WaylandVirtualPointer::send_axis_source(uint32_t axis_source) {
+    emit_axis_source(axis_source);
+}
+
+void WaylandVirtualPointer::send_axis_discrete(uint32_t time, uint32_t axis, double value, int32_t discrete) {
+    emit_axis_discrete(time, axis, wl_fixed_from_double(value), discrete);
+}
+
+void WaylandVirtualPointer::send_axis_stop(uint32_t time, uint32_t axis) {
+    emit_axis_stop(time, axis);
+}
+
+void WaylandVirtualPointer::send_frame() {
+    emit_frame();
+    request_flush();
+}
+
+void WaylandVirtualPointer::end_deferred_flush() {
+    flush_deferred = false;
+    if (flush_pending) {
+        flush_pending = false;
+        flush();
+    }
+}
+
+void WaylandVirtualPointer::request_flush() {
+    if (flush_deferred) {
+        flush_pending = true;
+    } else {
+        flush();
+    }
+}
+
+void WaylandVirtualPointer::emit_motion(uint32_t time, wl_fixed_t dx, wl_fixed_t dy) {
     if (virtual_pointer) {
-        zwlr_virtual_pointer_v1_motion(virtual_pointer, time, 
-                                     wl_fixed_from_double(dx), 
-                                     wl_fixed_from_double(dy));
+        zwlr_virtual_pointer_v1_motion(virtual_pointer, time, dx, dy);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerMotion, time, dx, dy);
     }
 }
 
-void WaylandVirtualPointer::send_motion_absolute(uint32_t time, uint32_t x, uint32_t y, 
+void WaylandVirtualPointer::emit_motion_absolute(uint32_t time, uint32_t x, uint32_t y,
                                                uint32_t x_extent, uint32_t y_extent) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_motion_absolute(virtual_pointer, time, x, y, x_extent, y_extent);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerMotionAbsolute, time, x, y, x_extent, y_extent);
     }
 }
 
-void WaylandVirtualPointer::send_button(uint32_t time, uint32_t button, uint32_t state) {
+void WaylandVirtualPointer::emit_button(uint32_t time, uint32_t button, uint32_t state) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_button(virtual_pointer, time, button, state);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerButton, time, button, state);
     }
 }
 
-void WaylandVirtualPointer::send_axis(uint32_t time, uint32_t axis, double dx, double dy) {
+void WaylandVirtualPointer::emit_axis(uint32_t time, uint32_t axis, wl_fixed_t value) {
     if (virtual_pointer) {
-        zwlr_virtual_pointer_v1_axis(virtual_pointer, time, axis, wl_fixed_from_double(dx));
+        zwlr_virtual_pointer_v1_axis(virtual_pointer, time, axis, value);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerAxis, time, axis, value);
     }
 }
 
-void WaylandVirtualPointer::send_axis_source(uint32_t axis_source) {
+void WaylandVirtualPointer::emit_axis_source(uint32_t axis_source) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_axis_source(virtual_pointer, axis_source);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerAxisSource, 0, axis_source);
     }
 }
 
-void WaylandVirtualPointer::send_axis_discrete(uint32_t time, int32_t dx, int32_t dy) {
-    std::cout << "send_axis_discrete: dx=" << dx << " dy=" << dy << std::endl;
+void WaylandVirtualPointer::emit_axis_discrete(uint32_t time, uint32_t axis, wl_fixed_t value, int32_t discrete) {
     if (virtual_pointer) {
-        if(dy < 0) {
-            zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(-15), -1);
-        } else if(dy > 0) {
-            zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(15), 1);
-        }
+        zwlr_virtual_pointer_v1_axis_discrete(virtual_pointer, time, axis, value, discrete);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerAxisDiscrete, time, axis, value, discrete);
     }
 }
 
-void WaylandVirtualPointer::send_axis_stop(uint32_t time, uint32_t axis) {
+void WaylandVirtualPointer::emit_axis_stop(uint32_t time, uint32_t axis) {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_axis_stop(virtual_pointer, time, axis);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerAxisStop, time, axis);
     }
 }
 
-void WaylandVirtualPointer::send_frame() {
+void WaylandVirtualPointer::emit_frame() {
     if (virtual_pointer) {
         zwlr_virtual_pointer_v1_frame(virtual_pointer);
-        wl_display_flush(display);
+        FlightRecorder::request(flight_session, WaylandRequest::PointerFrame, 0);
+    }
+}
+
+void WaylandVirtualPointer::flush() {
+    if (display) {
+        FlightRecorder::request(flight_session, WaylandRequest::Flush, 0);
+        int sent = wl_display_flush(display);
+        PROBE2(wayland_flush, sent, sent < 0 ? errno : 0);
     }
-} 
\ No newline at end of file
+}
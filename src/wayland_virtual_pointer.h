@@ -8,25 +8,52 @@ extern "C" {
 class WaylandVirtualPointer {
 public:
     WaylandVirtualPointer();
-    ~WaylandVirtualPointer();
+    virtual ~WaylandVirtualPointer();
     
     bool init();
+    // Create the pointer on a connection owned by the caller (see DevicePool);
+    // cleanup() then only destroys the pointer itself
+    bool init(struct wl_display* shared_display, struct wl_seat* shared_seat,
+              struct zwlr_virtual_pointer_manager_v1* manager);
     void cleanup();
     
     // Pointer input methods
     void send_motion(uint32_t time, double dx, double dy);
     void send_motion_absolute(uint32_t time, uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent);
     void send_button(uint32_t time, uint32_t button, uint32_t state);
-    void send_axis(uint32_t time, uint32_t axis, double dx, double dy);
+    void send_axis(uint32_t time, uint32_t axis, double value);
     void send_axis_source(uint32_t axis_source);
-    void send_axis_discrete(uint32_t time, int32_t discrete_dx, int32_t discrete_dy);
+    void send_axis_discrete(uint32_t time, uint32_t axis, double value, int32_t discrete);
     void send_axis_stop(uint32_t time, uint32_t axis);
     void send_frame();
+    
+    // Hold back the flush after each send_* until end_deferred_flush(), which
+    // flushes once if anything was sent in between
+    void begin_deferred_flush() { flush_deferred = true; }
+    void end_deferred_flush();
+    
+    // Session the requests are recorded under in the flight recorder (0: none)
+    void set_flight_session(uint32_t session) { flight_session = session; }
 
     // Registry callback functions (must be public)
     static void registry_global(void* data, struct wl_registry* registry,
                               uint32_t name, const char* interface, uint32_t version);
     static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name);
+
+protected:
+    // The output scheduler replays its queued requests through these
+    friend class OutputScheduler;
+
+    // Wire-level requests, overridable so the request stream can be recorded without a compositor
+    virtual void emit_motion(uint32_t time, wl_fixed_t dx, wl_fixed_t dy);
+    virtual void emit_motion_absolute(uint32_t time, uint32_t x, uint32_t y, uint32_t x_extent, uint32_t y_extent);
+    virtual void emit_button(uint32_t time, uint32_t button, uint32_t state);
+    virtual void emit_axis(uint32_t time, uint32_t axis, wl_fixed_t value);
+    virtual void emit_axis_source(uint32_t axis_source);
+    virtual void emit_axis_discrete(uint32_t time, uint32_t axis, wl_fixed_t value, int32_t discrete);
+    virtual void emit_axis_stop(uint32_t time, uint32_t axis);
+    virtual void emit_frame();
+    virtual void flush();
     
 private:
     struct wl_display* display;
@@ -34,4 +61,10 @@ private:
     struct wl_seat* seat;
     struct zwlr_virtual_pointer_manager_v1* pointer_manager;
     struct zwlr_virtual_pointer_v1* virtual_pointer;
+    bool owns_connection;
+    bool flush_deferred = false;
+    bool flush_pending = false;
+    uint32_t flight_session = 0;
+    
+    void request_flush();
 }; 
\ No newline at end of file
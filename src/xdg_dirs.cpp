@@ -0,0 +1,31 @@
+#include "xdg_dirs.h"
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+
+std::string xdg_directory(XdgDir base) {
+    const char* variable = "XDG_CONFIG_HOME";
+    const char* fallback = "/.config";
+    if (base == XdgDir::CACHE) {
+        variable = "XDG_CACHE_HOME";
+        fallback = "/.cache";
+    } else if (base == XdgDir::STATE) {
+        variable = "XDG_STATE_HOME";
+        fallback = "/.local/state";
+    }
+
+    // Relative values are invalid per the spec and ignored
+    const char* set = getenv(variable);
+    if (set && set[0] == '/') return std::string(set) + "/hypr-remote";
+    const char* home = getenv("HOME");
+    if (home && home[0] == '/') return std::string(home) + fallback + "/hypr-remote";
+    return "";
+}
+
+bool make_directories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
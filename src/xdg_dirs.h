@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+// The portal's per-user directories under the XDG base directories
+enum class XdgDir {
+    CONFIG,  // $XDG_CONFIG_HOME, or ~/.config
+    CACHE,   // $XDG_CACHE_HOME, or ~/.cache
+    STATE,   // $XDG_STATE_HOME, or ~/.local/state
+};
+
+// <base>/hypr-remote, without creating it; "" if neither the variable nor
+// $HOME is an absolute path
+std::string xdg_directory(XdgDir base);
+
+// Create `path` and any missing parents (mode 0700); false with errno set if
+// one could not be made
+bool make_directories(const std::string& path);
@@ -0,0 +1,114 @@
+#include "xkb.h"
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+extern "C" {
+#include <wayland-client.h>
+}
+
+// Basic US QWERTY keymap, what the portal's keyboards and EIS devices use
+static const char DEFAULT_KEYMAP[] =
+    "xkb_keymap {\n"
+    "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
+    "xkb_types     { include \"complete\" };\n"
+    "xkb_compat    { include \"complete\" };\n"
+    "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
+    "xkb_geometry  { include \"pc(pc105)\" };\n"
+    "};\n";
+
+std::optional<Xkb::Code> Xkb::keycodeFromKeysym(xkb_keysym_t keysym)
+{
+    if (!m_keymap)
+        return {};
+
+    const CompiledKeymap::Entry *entry = m_keymap->find(keysym);
+    if (!entry)
+        return {};
+    return Code{entry->level, entry->keycode};
+}
+
+void Xkb::keyboard_keymap(uint32_t format, int32_t fd, uint32_t size)
+{
+    if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+        std::cerr << "unknown keymap format:" << format;
+        close(fd);
+        return;
+    }
+
+    char *map_str = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
+    if (map_str == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    // The text may or may not count its NUL
+    std::string_view source(map_str, size);
+    if (!source.empty() && source.back() == '\0')
+        source = source.substr(0, source.find('\0'));
+    load(source);
+    munmap(map_str, size);
+    close(fd);
+}
+
+std::string_view Xkb::keymap_text() const
+{
+    return m_keymap ? m_keymap->text() : std::string_view();
+}
+
+bool Xkb::load(std::string_view source)
+{
+    if (!m_cache)
+        return false;
+
+    auto keymap = m_cache->load(source);
+    if (!keymap) {
+        std::cerr << "Failed to compile the keymap" << std::endl;
+        return false;
+    }
+
+    // Sealed, so a client holding the fd cannot change what everyone else reads
+    std::string_view text = keymap->text();
+    int fd = memfd_create("keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        std::cerr << "Failed to create memfd" << std::endl;
+        return false;
+    }
+    if (write(fd, text.data(), text.size() + 1) != static_cast<ssize_t>(text.size() + 1) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        std::cerr << "Failed to write keymap memfd" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    if (m_keymap_fd >= 0)
+        close(m_keymap_fd);
+    m_keymap_fd = fd;
+    m_keymap = std::move(keymap);
+    return true;
+}
+
+Xkb *Xkb::self()
+{
+    static Xkb self;
+    return &self;
+}
+
+Xkb::Xkb()
+{
+    m_ctx.reset(xkb_context_new(XKB_CONTEXT_NO_FLAGS));
+    if (!m_ctx) {
+        std::cerr << "Failed to create xkb context" << std::endl;
+        return;
+    }
+    m_cache = std::make_unique<KeymapCache>(m_ctx.get());
+    load(DEFAULT_KEYMAP);
+}
+
+Xkb::~Xkb()
+{
+    if (m_keymap_fd >= 0)
+        close(m_keymap_fd);
+}
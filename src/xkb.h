@@ -0,0 +1,64 @@
+#pragma once
+
+#include "keymap_cache.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <xkbcommon/xkbcommon.h>
+
+// Taken almost wholesale from https://github.com/KDE/xdg-desktop-portal-kde/blob/master/src/waylandintegration.cpp#L450
+struct XKBStateDeleter {
+    void operator()(struct xkb_state *state) const
+    {
+        return xkb_state_unref(state);
+    }
+};
+struct XKBKeymapDeleter {
+    void operator()(struct xkb_keymap *keymap) const
+    {
+        return xkb_keymap_unref(keymap);
+    }
+};
+struct XKBContextDeleter {
+    void operator()(struct xkb_context *context) const
+    {
+        return xkb_context_unref(context);
+    }
+};
+using ScopedXKBState = std::unique_ptr<struct xkb_state, XKBStateDeleter>;
+using ScopedXKBKeymap = std::unique_ptr<struct xkb_keymap, XKBKeymapDeleter>;
+using ScopedXKBContext = std::unique_ptr<struct xkb_context, XKBContextDeleter>;
+
+class Xkb
+{
+public:
+    struct Code {
+        const uint32_t level;
+        const uint32_t code;
+    };
+    std::optional<Code> keycodeFromKeysym(xkb_keysym_t keysym);
+
+    // Replace the keymap with the one in `fd` (taking ownership of it)
+    void keyboard_keymap(uint32_t format, int32_t fd, uint32_t size);
+
+    // The keymap in effect as normalized text, and a sealed memfd holding that
+    // text NUL-terminated (size() + 1 bytes) for the compositor and EIS clients.
+    // The fd stays owned by Xkb; protocols that send it take their own copy.
+    std::string_view keymap_text() const;
+    int keymap_fd() const { return m_keymap_fd; }
+
+    static Xkb *self();
+
+private:
+    Xkb();
+    ~Xkb();
+
+    // Through the on-disk cache; the current keymap is kept on failure
+    bool load(std::string_view source);
+
+    ScopedXKBContext m_ctx;
+    std::unique_ptr<KeymapCache> m_cache;
+    std::unique_ptr<CompiledKeymap> m_keymap;
+    int m_keymap_fd = -1;
+};
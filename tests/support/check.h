@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// The tests' checks: each prints "ok" or "FAIL" and a line describing it, and
+// main() returns finish_checks() so any failure fails the test.
+
+inline int failures = 0;
+
+inline void expect(bool condition, const char* what) {
+    if (condition) {
+        std::cerr << "ok   " << what << std::endl;
+    } else {
+        std::cerr << "FAIL " << what << std::endl;
+        failures++;
+    }
+}
+
+// Poll `predicate` until it holds; false if it still does not after `timeout_ms`
+template <typename Predicate>
+bool wait_for(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// The exit status: 1 with the failure count, or 0 with `passed`
+inline int finish_checks(const char* passed = "all checks passed", const char* failed = "check(s) failed") {
+    if (failures) {
+        std::cerr << failures << " " << failed << std::endl;
+        return 1;
+    }
+    std::cerr << passed << std::endl;
+    return 0;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <poll.h>
+
+extern "C" {
+#include <libei.h>
+#include "libei-1.0/libeis.h"
+}
+
+// The mirror image of EisTestPair: an in-process EIS server that emits input
+// towards a libei receiver client, so the EI_EVENT_* path can be driven
+// without a compositor. Client-side events are handed to `handler`.
+class EiTestPair {
+public:
+    using ClientHandler = std::function<void(struct ei_event*)>;
+
+    explicit EiTestPair(ClientHandler handler) : handler(std::move(handler)) {
+        server = eis_new(nullptr);
+        if (!server || eis_setup_backend_fd(server) != 0) return;
+
+        int fd = eis_backend_fd_add_client(server);
+        if (fd < 0) return;
+
+        client = ei_new_receiver(nullptr);
+        ei_configure_name(client, "hypr-remote test receiver");
+        if (ei_setup_backend_fd(client, fd) != 0) {
+            ei_unref(client);
+            client = nullptr;
+        }
+    }
+
+    ~EiTestPair() {
+        if (pointer) eis_device_unref(pointer);
+        if (keyboard) eis_device_unref(keyboard);
+        if (client) ei_unref(client);
+        if (server) eis_unref(server);
+    }
+
+    EiTestPair(const EiTestPair&) = delete;
+    EiTestPair& operator=(const EiTestPair&) = delete;
+
+    // Run the handshake until the client has both devices resumed
+    bool connect(int timeout_ms = 2000) {
+        if (!server || !client) return false;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (resumed < 2) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            wait(10);
+            pump_server();
+
+            ei_dispatch(client);
+            struct ei_event* event;
+            while ((event = ei_get_event(client)) != nullptr) {
+                switch (ei_event_get_type(event)) {
+                    case EI_EVENT_SEAT_ADDED:
+                        ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                                  EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_BUTTON,
+                                                  EI_DEVICE_CAP_SCROLL, EI_DEVICE_CAP_KEYBOARD, nullptr);
+                        break;
+                    case EI_EVENT_DEVICE_RESUMED:
+                        resumed++;
+                        break;
+                    default:
+                        break;
+                }
+                ei_event_unref(event);
+            }
+        }
+
+        eis_device_start_emulating(pointer, ++sequence);
+        eis_device_start_emulating(keyboard, ++sequence);
+        return true;
+    }
+
+    // Server-side emission, one frame per logical event
+    void motion(double dx, double dy) {
+        eis_device_pointer_motion(pointer, dx, dy);
+        eis_device_frame(pointer, eis_now(server));
+    }
+    void button(uint32_t button, bool is_press) {
+        eis_device_button_button(pointer, button, is_press);
+        eis_device_frame(pointer, eis_now(server));
+    }
+    void scroll(double dx, double dy) {
+        eis_device_scroll_delta(pointer, dx, dy);
+        eis_device_frame(pointer, eis_now(server));
+    }
+    void scroll_discrete(int32_t dx, int32_t dy) {
+        eis_device_scroll_discrete(pointer, dx, dy);
+        eis_device_frame(pointer, eis_now(server));
+    }
+    void key(uint32_t keycode, bool is_press) {
+        eis_device_keyboard_key(keyboard, keycode, is_press);
+        eis_device_frame(keyboard, eis_now(server));
+    }
+
+    // Hand client-side input events to the handler until `expected` have been
+    // delivered; emulation bookkeeping events are skipped
+    bool deliver(size_t expected, int timeout_ms = 2000) {
+        eis_dispatch(server);
+
+        size_t delivered = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (delivered < expected) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            struct pollfd fds = { .fd = ei_get_fd(client), .events = POLLIN, .revents = 0 };
+            poll(&fds, 1, 10);
+
+            ei_dispatch(client);
+            struct ei_event* event;
+            while ((event = ei_get_event(client)) != nullptr) {
+                enum ei_event_type type = ei_event_get_type(event);
+                if (type != EI_EVENT_DEVICE_START_EMULATING && type != EI_EVENT_DEVICE_STOP_EMULATING) {
+                    handler(event);
+                    delivered++;
+                }
+                ei_event_unref(event);
+            }
+        }
+        return true;
+    }
+
+private:
+    ClientHandler handler;
+    struct eis* server = nullptr;
+    struct ei* client = nullptr;
+    struct eis_device* pointer = nullptr;
+    struct eis_device* keyboard = nullptr;
+    uint32_t sequence = 0;
+    int resumed = 0;
+
+    void wait(int timeout_ms) {
+        struct pollfd fds[2] = {
+            { .fd = eis_get_fd(server), .events = POLLIN, .revents = 0 },
+            { .fd = ei_get_fd(client), .events = POLLIN, .revents = 0 },
+        };
+        poll(fds, 2, timeout_ms);
+    }
+
+    void pump_server() {
+        eis_dispatch(server);
+        struct eis_event* event;
+        while ((event = eis_get_event(server)) != nullptr) {
+            switch (eis_event_get_type(event)) {
+                case EIS_EVENT_CLIENT_CONNECT: {
+                    struct eis_client* eis_client = eis_event_get_client(event);
+                    eis_client_connect(eis_client);
+                    struct eis_seat* seat = eis_client_new_seat(eis_client, "test-seat");
+                    eis_seat_configure_capability(seat, EIS_DEVICE_CAP_POINTER);
+                    eis_seat_configure_capability(seat, EIS_DEVICE_CAP_BUTTON);
+                    eis_seat_configure_capability(seat, EIS_DEVICE_CAP_SCROLL);
+                    eis_seat_configure_capability(seat, EIS_DEVICE_CAP_KEYBOARD);
+                    eis_seat_add(seat);
+                    break;
+                }
+                case EIS_EVENT_SEAT_BIND: {
+                    if (pointer) break;
+                    struct eis_seat* seat = eis_event_get_seat(event);
+
+                    pointer = eis_seat_new_device(seat);
+                    eis_device_configure_name(pointer, "test pointer");
+                    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER);
+                    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_BUTTON);
+                    eis_device_configure_capability(pointer, EIS_DEVICE_CAP_SCROLL);
+                    eis_device_add(pointer);
+                    eis_device_resume(pointer);
+
+                    keyboard = eis_seat_new_device(seat);
+                    eis_device_configure_name(keyboard, "test keyboard");
+                    eis_device_configure_capability(keyboard, EIS_DEVICE_CAP_KEYBOARD);
+                    eis_device_add(keyboard);
+                    eis_device_resume(keyboard);
+                    break;
+                }
+                default:
+                    break;
+            }
+            eis_event_unref(event);
+        }
+    }
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <poll.h>
+
+extern "C" {
+#include <libei.h>
+#include "libei-1.0/libeis.h"
+}
+
+// An in-process EIS server with a libei sender client connected to it over a
+// socketpair, so EIS events can be produced without a remote desktop client.
+// The server side is driven by whatever handles EIS events in production
+// (seat and device setup included); steady-state events are handed back raw.
+class EisTestPair {
+public:
+    using ServerHandler = std::function<void(struct eis_event*)>;
+
+    explicit EisTestPair(ServerHandler handler) : handler(std::move(handler)) {
+        server = eis_new(nullptr);
+        if (!server || eis_setup_backend_fd(server) != 0) return;
+
+        int fd = eis_backend_fd_add_client(server);
+        if (fd < 0) return;
+
+        client = ei_new_sender(nullptr);
+        ei_configure_name(client, "hypr-remote test client");
+        if (ei_setup_backend_fd(client, fd) != 0) {
+            ei_unref(client);
+            client = nullptr;
+        }
+    }
+
+    ~EisTestPair() {
+        if (pointer) ei_device_unref(pointer);
+        if (keyboard) ei_device_unref(keyboard);
+        if (client) ei_unref(client);
+        if (server) eis_unref(server);
+    }
+
+    EisTestPair(const EisTestPair&) = delete;
+    EisTestPair& operator=(const EisTestPair&) = delete;
+
+    // Run the handshake until the server has seen both devices start emulating
+    bool connect(int timeout_ms = 2000) {
+        if (!server || !client) return false;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (emulating < 2) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            wait(10);
+            pump_client();
+
+            eis_dispatch(server);
+            struct eis_event* event;
+            while ((event = eis_get_event(server)) != nullptr) {
+                if (eis_event_get_type(event) == EIS_EVENT_DEVICE_START_EMULATING) emulating++;
+                handler(event);
+                eis_event_unref(event);
+            }
+        }
+        return true;
+    }
+
+    struct ei_device* pointer_device() const { return pointer; }
+    struct ei_device* keyboard_device() const { return keyboard; }
+
+    // Client-side emission, one frame per logical event like a real client
+    void motion(double dx, double dy) {
+        ei_device_pointer_motion(pointer, dx, dy);
+        ei_device_frame(pointer, ei_now(client));
+    }
+    void motion_absolute(double x, double y) {
+        ei_device_pointer_motion_absolute(pointer, x, y);
+        ei_device_frame(pointer, ei_now(client));
+    }
+    void button(uint32_t button, bool is_press) {
+        ei_device_button_button(pointer, button, is_press);
+        ei_device_frame(pointer, ei_now(client));
+    }
+    void scroll(double dx, double dy) {
+        ei_device_scroll_delta(pointer, dx, dy);
+        ei_device_frame(pointer, ei_now(client));
+    }
+    void scroll_discrete(int32_t dx, int32_t dy) {
+        ei_device_scroll_discrete(pointer, dx, dy);
+        ei_device_frame(pointer, ei_now(client));
+    }
+    void key(uint32_t keycode, bool is_press) {
+        ei_device_keyboard_key(keyboard, keycode, is_press);
+        ei_device_frame(keyboard, ei_now(client));
+    }
+    // A motion and a button change the client reports together, in one frame
+    void motion_with_button(double dx, double dy, uint32_t button, bool is_press) {
+        ei_device_pointer_motion(pointer, dx, dy);
+        ei_device_button_button(pointer, button, is_press);
+        ei_device_frame(pointer, ei_now(client));
+    }
+
+    // Collect exactly `expected` server-side events; the caller owns (and must unref) them
+    bool receive(std::vector<struct eis_event*>& out, size_t expected, int timeout_ms = 2000) {
+        ei_dispatch(client);
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (out.size() < expected) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            struct pollfd fds = { .fd = eis_get_fd(server), .events = POLLIN, .revents = 0 };
+            poll(&fds, 1, 10);
+
+            eis_dispatch(server);
+            struct eis_event* event;
+            while ((event = eis_get_event(server)) != nullptr) {
+                out.push_back(event);
+            }
+        }
+        return true;
+    }
+
+    // Feed events straight to the production handler
+    bool deliver(size_t expected, int timeout_ms = 2000) {
+        std::vector<struct eis_event*> events;
+        bool ok = receive(events, expected, timeout_ms);
+        for (auto* event : events) {
+            handler(event);
+            eis_event_unref(event);
+        }
+        return ok;
+    }
+
+    static void release(std::vector<struct eis_event*>& events) {
+        for (auto* event : events) eis_event_unref(event);
+        events.clear();
+    }
+
+private:
+    ServerHandler handler;
+    struct eis* server = nullptr;
+    struct ei* client = nullptr;
+    struct ei_device* pointer = nullptr;
+    struct ei_device* keyboard = nullptr;
+    uint32_t sequence = 0;
+    int emulating = 0;
+
+    void wait(int timeout_ms) {
+        struct pollfd fds[2] = {
+            { .fd = eis_get_fd(server), .events = POLLIN, .revents = 0 },
+            { .fd = ei_get_fd(client), .events = POLLIN, .revents = 0 },
+        };
+        poll(fds, 2, timeout_ms);
+    }
+
+    void pump_client() {
+        ei_dispatch(client);
+        struct ei_event* event;
+        while ((event = ei_get_event(client)) != nullptr) {
+            switch (ei_event_get_type(event)) {
+                case EI_EVENT_SEAT_ADDED:
+                    ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                              EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_POINTER_ABSOLUTE,
+                                              EI_DEVICE_CAP_BUTTON, EI_DEVICE_CAP_SCROLL,
+                                              EI_DEVICE_CAP_KEYBOARD, nullptr);
+                    break;
+                case EI_EVENT_DEVICE_ADDED: {
+                    struct ei_device* device = ei_event_get_device(event);
+                    if (!pointer && ei_device_has_capability(device, EI_DEVICE_CAP_POINTER)) {
+                        pointer = ei_device_ref(device);
+                    } else if (!keyboard && ei_device_has_capability(device, EI_DEVICE_CAP_KEYBOARD)) {
+                        keyboard = ei_device_ref(device);
+                    }
+                    break;
+                }
+                case EI_EVENT_DEVICE_RESUMED:
+                    ei_device_start_emulating(ei_event_get_device(event), ++sequence);
+                    break;
+                default:
+                    break;
+            }
+            ei_event_unref(event);
+        }
+    }
+};
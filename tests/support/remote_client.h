@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <poll.h>
+
+extern "C" {
+#include <libei.h>
+}
+
+// A remote desktop client on the fd ConnectToEIS hands out (Session::connect_eis),
+// for driving a session end to end: handshake with the portal's EIS server,
+// then pointer and keyboard input sent as the client would.
+class RemoteClient {
+public:
+    explicit RemoteClient(int fd) {
+        if (fd < 0) return;
+        context = ei_new_sender(nullptr);
+        ei_configure_name(context, "hypr-remote test remote");
+        if (ei_setup_backend_fd(context, fd) != 0) {
+            ei_unref(context);
+            context = nullptr;
+        }
+    }
+
+    ~RemoteClient() {
+        if (pointer) ei_device_unref(pointer);
+        if (keyboard) ei_device_unref(keyboard);
+        if (context) ei_unref(context);
+    }
+
+    RemoteClient(const RemoteClient&) = delete;
+    RemoteClient& operator=(const RemoteClient&) = delete;
+
+    // Until both of the portal's devices have resumed and we emulate on them
+    bool connect(int timeout_ms = 2000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (context && emulating < 2) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            struct pollfd fds = { .fd = ei_get_fd(context), .events = POLLIN, .revents = 0 };
+            poll(&fds, 1, 10);
+            pump();
+        }
+        return emulating == 2;
+    }
+
+    // One frame per event; the connection is flushed every 64 frames and at the end
+    void motion(size_t frames) {
+        for (size_t i = 0; i < frames; i++) {
+            ei_device_pointer_motion(pointer, i & 1 ? 1.0 : -1.0, 0.5);
+            ei_device_frame(pointer, ei_now(context));
+            if ((i & 63) == 63) ei_dispatch(context);
+        }
+        ei_dispatch(context);
+    }
+
+    void keys(const uint32_t* keycodes, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            ei_device_keyboard_key(keyboard, keycodes[i], true);
+            ei_device_frame(keyboard, ei_now(context));
+            ei_device_keyboard_key(keyboard, keycodes[i], false);
+            ei_device_frame(keyboard, ei_now(context));
+            if ((i & 31) == 31) ei_dispatch(context);
+        }
+        ei_dispatch(context);
+    }
+
+    // Hang up, as a client quitting would
+    void disconnect() {
+        if (pointer) ei_device_unref(pointer);
+        if (keyboard) ei_device_unref(keyboard);
+        if (context) ei_unref(context);
+        pointer = nullptr;
+        keyboard = nullptr;
+        context = nullptr;
+    }
+
+private:
+    struct ei* context = nullptr;
+    struct ei_device* pointer = nullptr;
+    struct ei_device* keyboard = nullptr;
+    uint32_t sequence = 0;
+    int emulating = 0;
+
+    void pump() {
+        ei_dispatch(context);
+        struct ei_event* event;
+        while ((event = ei_get_event(context)) != nullptr) {
+            switch (ei_event_get_type(event)) {
+                case EI_EVENT_SEAT_ADDED:
+                    ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                              EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_BUTTON,
+                                              EI_DEVICE_CAP_SCROLL, EI_DEVICE_CAP_KEYBOARD, nullptr);
+                    break;
+                case EI_EVENT_DEVICE_ADDED: {
+                    struct ei_device* device = ei_event_get_device(event);
+                    if (!pointer && ei_device_has_capability(device, EI_DEVICE_CAP_POINTER)) {
+                        pointer = ei_device_ref(device);
+                    } else if (!keyboard && ei_device_has_capability(device, EI_DEVICE_CAP_KEYBOARD)) {
+                        keyboard = ei_device_ref(device);
+                    }
+                    break;
+                }
+                case EI_EVENT_DEVICE_RESUMED:
+                    ei_device_start_emulating(ei_event_get_device(event), ++sequence);
+                    emulating++;
+                    break;
+                default:
+                    break;
+            }
+            ei_event_unref(event);
+        }
+    }
+};
@@ -0,0 +1,464 @@
+#include "stub_compositor.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C" {
+#include <wayland-server.h>
+#include "wlr-screencopy-unstable-v1-server-protocol.h"
+#include "wlr-data-control-unstable-v1-server-protocol.h"
+}
+
+struct StubCompositor::Impl {
+    struct Frame {
+        Impl* impl = nullptr;
+        struct wl_resource* resource = nullptr;
+        struct wl_resource* buffer = nullptr;
+        bool with_damage = false;
+    };
+
+    // A data control source the client created, with what it offers
+    struct Source {
+        Impl* impl = nullptr;
+        struct wl_resource* resource = nullptr;
+        std::vector<std::string> mime_types;
+    };
+
+    struct wl_display* display = nullptr;
+    struct wl_global* output = nullptr;
+    struct wl_global* manager = nullptr;
+    struct wl_global* seat = nullptr;
+    struct wl_global* data_control = nullptr;
+    int wake_fd = -1;
+    int client_fd = -1;
+    std::thread thread;
+
+    // Shared with the test thread. Damage is kept once for the whole output,
+    // which is right for the one capture at a time these tests run.
+    std::mutex mutex;
+    std::vector<uint32_t> pixels = std::vector<uint32_t>(WIDTH * HEIGHT, 0);
+    std::vector<DamageRect> damage;
+    std::deque<std::function<void()>> jobs;
+    std::atomic<uint64_t> served{0};
+    std::atomic<size_t> waiting_count{0};
+    std::vector<std::string> selection_types;
+    bool client_owns = false;
+
+    // Loop thread only: copy_with_damage requests waiting for a paint
+    std::vector<Frame*> waiting;
+
+    // Loop thread only: the client's data device, and the selection: the
+    // client's source, or else data another app copied
+    struct wl_resource* device = nullptr;
+    Source* client_source = nullptr;
+    std::vector<std::string> copied_types;
+    std::string copied;
+    // Writing the copied data blocks on the reader, so each paste has a thread
+    std::vector<std::thread> writers;
+
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            std::cerr << "Failed to wake the stub compositor" << std::endl;
+        }
+    }
+
+    static int on_wake(int fd, uint32_t, void* data) {
+        Impl* impl = static_cast<Impl*>(data);
+        uint64_t value;
+        while (read(fd, &value, sizeof(value)) > 0) {}
+
+        std::deque<std::function<void()>> run;
+        {
+            std::lock_guard<std::mutex> lock(impl->mutex);
+            run.swap(impl->jobs);
+        }
+        for (auto& job : run) job();
+        return 0;
+    }
+
+    void serve(Frame* frame) {
+        struct wl_shm_buffer* shm = wl_shm_buffer_get(frame->buffer);
+        if (!shm || wl_shm_buffer_get_width(shm) != int32_t(WIDTH) || wl_shm_buffer_get_height(shm) != int32_t(HEIGHT) ||
+            wl_shm_buffer_get_stride(shm) != int32_t(WIDTH * 4) || wl_shm_buffer_get_format(shm) != WL_SHM_FORMAT_XRGB8888) {
+            zwlr_screencopy_frame_v1_send_failed(frame->resource);
+            return;
+        }
+
+        std::vector<DamageRect> sent;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wl_shm_buffer_begin_access(shm);
+            memcpy(wl_shm_buffer_get_data(shm), pixels.data(), pixels.size() * sizeof(uint32_t));
+            wl_shm_buffer_end_access(shm);
+            sent.swap(damage);
+        }
+
+        zwlr_screencopy_frame_v1_send_flags(frame->resource, 0);
+        if (frame->with_damage) {
+            for (const DamageRect& rect : sent) {
+                zwlr_screencopy_frame_v1_send_damage(frame->resource, rect.x, rect.y, rect.width, rect.height);
+            }
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t seconds = now.tv_sec;
+        zwlr_screencopy_frame_v1_send_ready(frame->resource, seconds >> 32, seconds & 0xffffffff, now.tv_nsec);
+        served++;
+    }
+
+    void serve_waiting() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (damage.empty()) return;
+        }
+        std::vector<Frame*> ready;
+        ready.swap(waiting);
+        waiting_count = 0;
+        for (Frame* frame : ready) serve(frame);
+    }
+
+    static void copy(struct wl_resource* resource, struct wl_resource* buffer, bool with_damage) {
+        Frame* frame = static_cast<Frame*>(wl_resource_get_user_data(resource));
+        if (frame->buffer) {
+            wl_resource_post_error(resource, ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED, "frame already copied");
+            return;
+        }
+        frame->buffer = buffer;
+        frame->with_damage = with_damage;
+
+        Impl* impl = frame->impl;
+        bool damaged;
+        {
+            std::lock_guard<std::mutex> lock(impl->mutex);
+            damaged = !impl->damage.empty();
+        }
+        // Like a compositor, hold copy_with_damage until something changes
+        if (with_damage && !damaged) {
+            impl->waiting.push_back(frame);
+            impl->waiting_count = impl->waiting.size();
+            return;
+        }
+        impl->serve(frame);
+    }
+
+    static void frame_destroyed(struct wl_resource* resource) {
+        Frame* frame = static_cast<Frame*>(wl_resource_get_user_data(resource));
+        Impl* impl = frame->impl;
+        auto& waiting = impl->waiting;
+        for (size_t i = 0; i < waiting.size(); i++) {
+            if (waiting[i] == frame) {
+                waiting.erase(waiting.begin() + i);
+                break;
+            }
+        }
+        impl->waiting_count = waiting.size();
+        delete frame;
+    }
+
+    static const struct zwlr_screencopy_frame_v1_interface frame_impl;
+    static const struct zwlr_screencopy_manager_v1_interface manager_impl;
+    static const struct wl_output_interface output_impl;
+
+    static void new_frame(struct wl_client* client, struct wl_resource* manager, uint32_t id) {
+        struct wl_resource* resource =
+            wl_resource_create(client, &zwlr_screencopy_frame_v1_interface, wl_resource_get_version(manager), id);
+        Frame* frame = new Frame;
+        frame->impl = static_cast<Impl*>(wl_resource_get_user_data(manager));
+        frame->resource = resource;
+        wl_resource_set_implementation(resource, &frame_impl, frame, frame_destroyed);
+
+        zwlr_screencopy_frame_v1_send_buffer(resource, WL_SHM_FORMAT_XRGB8888, WIDTH, HEIGHT, WIDTH * 4);
+        if (wl_resource_get_version(resource) >= ZWLR_SCREENCOPY_FRAME_V1_BUFFER_DONE_SINCE_VERSION) {
+            zwlr_screencopy_frame_v1_send_buffer_done(resource);
+        }
+    }
+
+    static void bind_manager(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+        struct wl_resource* resource = wl_resource_create(client, &zwlr_screencopy_manager_v1_interface, version, id);
+        wl_resource_set_implementation(resource, &manager_impl, data, nullptr);
+    }
+
+    static void bind_output(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+        struct wl_resource* resource = wl_resource_create(client, &wl_output_interface, version, id);
+        wl_resource_set_implementation(resource, &output_impl, data, nullptr);
+        wl_output_send_geometry(resource, 0, 0, 340, 190, WL_OUTPUT_SUBPIXEL_UNKNOWN, "hypr-remote", "stub",
+                                WL_OUTPUT_TRANSFORM_NORMAL);
+        wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, WIDTH, HEIGHT, 60000);
+        if (version >= WL_OUTPUT_NAME_SINCE_VERSION) wl_output_send_name(resource, "STUB-1");
+        if (version >= WL_OUTPUT_DONE_SINCE_VERSION) wl_output_send_done(resource);
+    }
+
+    // Tell the client's device what the selection is now
+    void announce() {
+        const std::vector<std::string>& types = client_source ? client_source->mime_types : copied_types;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            selection_types = types;
+            client_owns = client_source != nullptr;
+        }
+        if (!device) return;
+        if (types.empty()) {
+            zwlr_data_control_device_v1_send_selection(device, nullptr);
+            return;
+        }
+        struct wl_resource* offer =
+            wl_resource_create(wl_resource_get_client(device), &zwlr_data_control_offer_v1_interface, 1, 0);
+        wl_resource_set_implementation(offer, &offer_impl, this, nullptr);
+        zwlr_data_control_device_v1_send_data_offer(device, offer);
+        for (const std::string& type : types) zwlr_data_control_offer_v1_send_offer(offer, type.c_str());
+        zwlr_data_control_device_v1_send_selection(device, offer);
+    }
+
+    // Whoever holds the selection writes it as `mime_type` into `fd`, and closes it
+    void transfer(const std::string& mime_type, int fd) {
+        if (client_source) {
+            const auto& types = client_source->mime_types;
+            if (std::find(types.begin(), types.end(), mime_type) != types.end()) {
+                zwlr_data_control_source_v1_send_send(client_source->resource, mime_type.c_str(), fd);
+            }
+            close(fd);
+            return;
+        }
+        if (std::find(copied_types.begin(), copied_types.end(), mime_type) == copied_types.end()) {
+            close(fd);
+            return;
+        }
+        writers.emplace_back([fd, data = copied]() {
+            size_t written = 0;
+            while (written < data.size()) {
+                ssize_t n = write(fd, data.data() + written, data.size() - written);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                written += n;
+            }
+            close(fd);
+        });
+    }
+
+    void replace_client_source(Source* source) {
+        if (client_source && client_source != source) {
+            zwlr_data_control_source_v1_send_cancelled(client_source->resource);
+        }
+        client_source = source;
+    }
+
+    static const struct zwlr_data_control_manager_v1_interface data_control_impl;
+    static const struct zwlr_data_control_device_v1_interface device_impl;
+    static const struct zwlr_data_control_source_v1_interface source_impl;
+    static const struct zwlr_data_control_offer_v1_interface offer_impl;
+
+    static void source_destroyed(struct wl_resource* resource) {
+        Source* source = static_cast<Source*>(wl_resource_get_user_data(resource));
+        Impl* impl = source->impl;
+        if (impl->client_source == source) {
+            impl->client_source = nullptr;
+            impl->announce();
+        }
+        delete source;
+    }
+
+    static void device_destroyed(struct wl_resource* resource) {
+        Impl* impl = static_cast<Impl*>(wl_resource_get_user_data(resource));
+        if (impl->device == resource) impl->device = nullptr;
+    }
+
+    static void bind_data_control(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+        struct wl_resource* resource = wl_resource_create(client, &zwlr_data_control_manager_v1_interface, version, id);
+        wl_resource_set_implementation(resource, &data_control_impl, data, nullptr);
+    }
+
+    // The clipboard only names the seat; it never asks it for anything
+    static void bind_seat(struct wl_client* client, void*, uint32_t version, uint32_t id) {
+        struct wl_resource* resource = wl_resource_create(client, &wl_seat_interface, version, id);
+        wl_resource_set_implementation(resource, nullptr, nullptr, nullptr);
+        wl_seat_send_capabilities(resource, 0);
+    }
+};
+
+const struct zwlr_screencopy_frame_v1_interface StubCompositor::Impl::frame_impl = {
+    .copy = [](struct wl_client*, struct wl_resource* resource, struct wl_resource* buffer) {
+        copy(resource, buffer, false);
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+    .copy_with_damage = [](struct wl_client*, struct wl_resource* resource, struct wl_resource* buffer) {
+        copy(resource, buffer, true);
+    },
+};
+
+const struct zwlr_screencopy_manager_v1_interface StubCompositor::Impl::manager_impl = {
+    .capture_output = [](struct wl_client* client, struct wl_resource* manager, uint32_t id, int32_t,
+                         struct wl_resource*) { new_frame(client, manager, id); },
+    .capture_output_region = [](struct wl_client* client, struct wl_resource* manager, uint32_t id, int32_t,
+                                struct wl_resource*, int32_t, int32_t, int32_t, int32_t) {
+        new_frame(client, manager, id);
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+};
+
+const struct wl_output_interface StubCompositor::Impl::output_impl = {
+    .release = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+};
+
+const struct zwlr_data_control_manager_v1_interface StubCompositor::Impl::data_control_impl = {
+    .create_data_source = [](struct wl_client* client, struct wl_resource* manager, uint32_t id) {
+        Source* source = new Source;
+        source->impl = static_cast<Impl*>(wl_resource_get_user_data(manager));
+        source->resource = wl_resource_create(client, &zwlr_data_control_source_v1_interface, 1, id);
+        wl_resource_set_implementation(source->resource, &source_impl, source, source_destroyed);
+    },
+    .get_data_device = [](struct wl_client* client, struct wl_resource* manager, uint32_t id, struct wl_resource*) {
+        Impl* impl = static_cast<Impl*>(wl_resource_get_user_data(manager));
+        impl->device = wl_resource_create(client, &zwlr_data_control_device_v1_interface,
+                                          wl_resource_get_version(manager), id);
+        wl_resource_set_implementation(impl->device, &device_impl, impl, device_destroyed);
+        impl->announce();
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+};
+
+const struct zwlr_data_control_device_v1_interface StubCompositor::Impl::device_impl = {
+    .set_selection = [](struct wl_client*, struct wl_resource* device, struct wl_resource* source) {
+        Impl* impl = static_cast<Impl*>(wl_resource_get_user_data(device));
+        impl->replace_client_source(source ? static_cast<Source*>(wl_resource_get_user_data(source)) : nullptr);
+        impl->copied_types.clear();
+        impl->copied.clear();
+        impl->announce();
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+    .set_primary_selection = [](struct wl_client*, struct wl_resource*, struct wl_resource*) {},
+};
+
+const struct zwlr_data_control_source_v1_interface StubCompositor::Impl::source_impl = {
+    .offer = [](struct wl_client*, struct wl_resource* resource, const char* mime_type) {
+        static_cast<Source*>(wl_resource_get_user_data(resource))->mime_types.emplace_back(mime_type);
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+};
+
+// Offers are not told apart: receiving from any of them gets the selection as it is now
+const struct zwlr_data_control_offer_v1_interface StubCompositor::Impl::offer_impl = {
+    .receive = [](struct wl_client*, struct wl_resource* offer, const char* mime_type, int32_t fd) {
+        static_cast<Impl*>(wl_resource_get_user_data(offer))->transfer(mime_type, fd);
+    },
+    .destroy = [](struct wl_client*, struct wl_resource* resource) { wl_resource_destroy(resource); },
+};
+
+StubCompositor::StubCompositor() : impl(std::make_unique<Impl>()) {
+    impl->display = wl_display_create();
+    wl_display_init_shm(impl->display);
+    impl->output = wl_global_create(impl->display, &wl_output_interface, 4, impl.get(), Impl::bind_output);
+    impl->manager = wl_global_create(impl->display, &zwlr_screencopy_manager_v1_interface, 3, impl.get(),
+                                     Impl::bind_manager);
+    impl->seat = wl_global_create(impl->display, &wl_seat_interface, 1, impl.get(), Impl::bind_seat);
+    impl->data_control = wl_global_create(impl->display, &zwlr_data_control_manager_v1_interface, 1, impl.get(),
+                                          Impl::bind_data_control);
+
+    impl->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    wl_event_loop_add_fd(wl_display_get_event_loop(impl->display), impl->wake_fd, WL_EVENT_READABLE,
+                         Impl::on_wake, impl.get());
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0) {
+        wl_client_create(impl->display, fds[0]);
+        impl->client_fd = fds[1];
+    }
+
+    impl->thread = std::thread([display = impl->display]() { wl_display_run(display); });
+}
+
+StubCompositor::~StubCompositor() {
+    impl->post([display = impl->display]() { wl_display_terminate(display); });
+    impl->thread.join();
+
+    wl_display_destroy_clients(impl->display);
+    for (auto& writer : impl->writers) writer.join();
+    wl_display_destroy(impl->display);
+    close(impl->wake_fd);
+    if (impl->client_fd >= 0) close(impl->client_fd);
+}
+
+int StubCompositor::take_client_fd() {
+    int fd = impl->client_fd;
+    impl->client_fd = -1;
+    return fd;
+}
+
+void StubCompositor::paint(DamageRect rect, uint32_t color) {
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        for (uint32_t y = rect.y; y < rect.y + rect.height && y < HEIGHT; y++) {
+            for (uint32_t x = rect.x; x < rect.x + rect.width && x < WIDTH; x++) {
+                impl->pixels[y * WIDTH + x] = color;
+            }
+        }
+        impl->damage.push_back(rect);
+    }
+    Impl* state = impl.get();
+    impl->post([state]() { state->serve_waiting(); });
+}
+
+std::vector<uint32_t> StubCompositor::image() {
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->pixels;
+}
+
+uint64_t StubCompositor::frames_served() {
+    return impl->served;
+}
+
+size_t StubCompositor::copies_waiting() {
+    return impl->waiting_count;
+}
+
+void StubCompositor::remove_output() {
+    Impl* state = impl.get();
+    impl->post([state]() {
+        if (!state->output) return;
+        wl_global_destroy(state->output);
+        state->output = nullptr;
+    });
+}
+
+void StubCompositor::set_selection(std::vector<std::string> mime_types, std::string data) {
+    Impl* state = impl.get();
+    impl->post([state, mime_types = std::move(mime_types), data = std::move(data)]() mutable {
+        state->replace_client_source(nullptr);
+        state->copied_types = std::move(mime_types);
+        state->copied = std::move(data);
+        state->announce();
+    });
+}
+
+int StubCompositor::paste(const std::string& mime_type) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+    Impl* state = impl.get();
+    impl->post([state, mime_type, fd = fds[1]]() { state->transfer(mime_type, fd); });
+    return fds[0];
+}
+
+std::vector<std::string> StubCompositor::selection_mime_types() {
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->selection_types;
+}
+
+bool StubCompositor::client_owns_selection() {
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->client_owns;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "frame_sink.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A Wayland compositor with one 64x48 output ("STUB-1"), wl_shm and
+// wlr-screencopy v3, serving frames of a synthetic XRGB8888 image that tests
+// paint into. copy_with_damage waits for the next paint, like a real
+// compositor waits for the next change; copy answers at once. Runs on a
+// thread of its own, connected to its one client over a socketpair.
+//
+// It also has a seat with wlr-data-control v1: tests copy as another app
+// would, paste what the client has copied, and see what the selection holds.
+//
+// The wayland-server side lives in stub_compositor.cpp, so tests can include
+// this next to the client headers.
+class StubCompositor {
+public:
+    static constexpr uint32_t WIDTH = 64;
+    static constexpr uint32_t HEIGHT = 48;
+
+    StubCompositor();
+    ~StubCompositor();
+
+    StubCompositor(const StubCompositor&) = delete;
+    StubCompositor& operator=(const StubCompositor&) = delete;
+
+    // The client's end of the connection, for Screencopy::init(); once
+    int take_client_fd();
+
+    // Fill `rect` with `color`, damaging it for the next frame served
+    void paint(DamageRect rect, uint32_t color);
+    // The image as it is now
+    std::vector<uint32_t> image();
+
+    // Frames copied out to the client, and copies parked until the next paint
+    uint64_t frames_served();
+    size_t copies_waiting();
+
+    // Unplug the output: its global goes away
+    void remove_output();
+
+    // Another app copies `data`, offered as each of `mime_types`; the client's
+    // selection, if it had one, is cancelled
+    void set_selection(std::vector<std::string> mime_types, std::string data);
+    // Another app pastes the selection as `mime_type`: the read end of the
+    // pipe it comes through, which closes at once if the type is not offered
+    int paste(const std::string& mime_type);
+    // What the selection offers, and whether the client holds it
+    std::vector<std::string> selection_mime_types();
+    bool client_owns_selection();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
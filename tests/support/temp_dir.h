@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+// A fresh directory under the system's temporary directory, named after
+// `prefix`, removed with everything in it when the TempDir goes out of scope.
+// False if it could not be created.
+class TempDir {
+public:
+    explicit TempDir(const char* prefix) {
+        std::error_code error;
+        std::filesystem::path base = std::filesystem::temp_directory_path(error);
+        if (error) base = "/tmp";
+        std::string pattern = (base / prefix).string() + "-XXXXXX";
+        if (mkdtemp(pattern.data())) directory = pattern;
+    }
+
+    ~TempDir() {
+        if (directory.empty()) return;
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+        if (error) {
+            std::cerr << "Failed to remove " << directory << ": " << error.message() << std::endl;
+        }
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    explicit operator bool() const { return !directory.empty(); }
+    const std::string& path() const { return directory; }
+
+private:
+    std::string directory;
+};
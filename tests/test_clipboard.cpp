@@ -0,0 +1,243 @@
+// The clipboard against a stub compositor: another app's selection can be
+// read, a large one streams through with the reader setting the pace, a
+// session's selection is pasted through its writes, and a session that goes
+// gives up its selection and its transfers.
+
+#include "clipboard.h"
+#include "stub_compositor.h"
+#include "check.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Everything up to EOF, then closes `fd`
+std::string read_all(int fd) {
+    std::string data;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data.append(chunk, n);
+    }
+    close(fd);
+    return data;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+const std::string SESSION_A = "/org/freedesktop/portal/desktop/session/1_1/a";
+const std::string SESSION_B = "/org/freedesktop/portal/desktop/session/1_1/b";
+
+// What the clipboard tells the portal, as it arrives
+struct Events {
+    struct Transfer {
+        std::string owner;
+        std::string mime_type;
+        uint32_t serial;
+    };
+
+    std::mutex mutex;
+    std::vector<std::string> owners;
+    std::vector<std::string> mime_types;
+    std::vector<Transfer> transfers;
+
+    explicit Events(Clipboard& clipboard) {
+        clipboard.set_handlers(
+            [this](const std::vector<std::string>& offered, const std::string& owner) {
+                std::lock_guard<std::mutex> lock(mutex);
+                owners.push_back(owner);
+                mime_types = offered;
+            },
+            [this](const std::string& owner, const std::string& mime_type, uint32_t serial) {
+                std::lock_guard<std::mutex> lock(mutex);
+                transfers.push_back({ owner, mime_type, serial });
+            });
+    }
+
+    size_t owner_changes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return owners.size();
+    }
+
+    std::string last_owner() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return owners.empty() ? "?" : owners.back();
+    }
+
+    size_t transfer_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return transfers.size();
+    }
+
+    Transfer transfer(size_t index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return transfers.at(index);
+    }
+};
+
+void test_another_apps_selection() {
+    StubCompositor compositor;
+    compositor.set_selection({ "text/plain;charset=utf-8", "text/plain" }, "copied elsewhere");
+    Clipboard clipboard;
+    expect(clipboard.init(compositor.take_client_fd()), "the clipboard connects to the stub compositor");
+    expect(clipboard.mime_types() == std::vector<std::string>{ "text/plain;charset=utf-8", "text/plain" },
+           "the selection at startup is known once connected");
+    Events events(clipboard);
+
+    expect(read_all(clipboard.read(SESSION_A, "text/plain")) == "copied elsewhere",
+           "a session reads the selection as it was copied");
+    expect(clipboard.read(SESSION_A, "image/png") == -1, "a type the selection does not offer cannot be read");
+
+    compositor.set_selection({ "text/html" }, "<b>newer</b>");
+    expect(wait_for([&]() { return events.owner_changes() == 1; }), "a new selection is announced");
+    expect(events.last_owner().empty() && clipboard.mime_types() == std::vector<std::string>{ "text/html" },
+           "it belongs to no session and offers what the app copied");
+    expect(read_all(clipboard.read(SESSION_B, "text/html")) == "<b>newer</b>", "the new selection is read");
+
+    expect(wait_for([&]() { return clipboard.stats().completed == 2; }), "both reads complete");
+    Clipboard::Stats stats = clipboard.stats();
+    expect(stats.active == 0 && stats.failed == 0 && stats.bytes == 16 + 12, "every byte is accounted for");
+    clipboard.cleanup();
+}
+
+void test_large_read() {
+    // 64 MiB that cannot be mistaken for a shifted copy of itself
+    std::string image(64 << 20, '\0');
+    for (size_t i = 0; i < image.size(); i++) image[i] = char((i * 2654435761u) >> 13);
+
+    StubCompositor compositor;
+    compositor.set_selection({ "image/png" }, image);
+    Clipboard clipboard;
+    clipboard.init(compositor.take_client_fd());
+
+    int fd = clipboard.read(SESSION_A, "image/png");
+    expect(fd >= 0, "a large selection can be read");
+    if (fd < 0) return;
+
+    // Nobody reads yet: the pipes fill and the transfer waits on them
+    expect(wait_for([&]() { return clipboard.stats().bytes > 0; }), "the transfer starts");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint64_t buffered = clipboard.stats().bytes;
+    expect(buffered < (4 << 20), "an idle reader holds the transfer back at a few pipe buffers");
+    expect(clipboard.stats().active == 1, "the held-back transfer is still going");
+
+    std::string received = read_all(fd);
+    expect(received.size() == image.size() && received == image, "all 64 MiB arrive intact and in order");
+    expect(wait_for([&]() { return clipboard.stats().completed == 1; }), "the transfer completes");
+    expect(clipboard.stats().bytes == image.size(), "every byte went through the splice pump once");
+    clipboard.cleanup();
+}
+
+void test_session_selection() {
+    StubCompositor compositor;
+    Clipboard clipboard;
+    clipboard.init(compositor.take_client_fd());
+    Events events(clipboard);
+
+    clipboard.set_selection(SESSION_A, { "text/plain", "image/png" });
+    expect(wait_for([&]() { return compositor.client_owns_selection(); }), "a session's selection reaches the compositor");
+    expect(compositor.selection_mime_types() == std::vector<std::string>{ "text/plain", "image/png" },
+           "with the types the session offers");
+    expect(wait_for([&]() { return events.last_owner() == SESSION_A; }), "the session is told it owns the selection");
+
+    // Another app pastes: the owner is asked for the data and writes it
+    int pasted = compositor.paste("image/png");
+    expect(wait_for([&]() { return events.transfer_count() == 1; }), "a paste asks the owner for its data");
+    Events::Transfer first = events.transfer(0);
+    expect(first.owner == SESSION_A && first.mime_type == "image/png", "for the type being pasted");
+    expect(clipboard.write(SESSION_B, first.serial) == -1, "another session cannot answer the paste");
+
+    int writer = clipboard.write(SESSION_A, first.serial);
+    expect(writer >= 0, "the owner gets a pipe to write the paste into");
+    expect(clipboard.write(SESSION_A, first.serial) == -1, "a paste is written once");
+    expect(write_all(writer, "\x89PNG pixels"), "the owner writes its data");
+    close(writer);
+    clipboard.write_done(SESSION_A, first.serial, true);
+    expect(read_all(pasted) == "\x89PNG pixels", "the pasting app gets what the owner wrote");
+
+    // A write that fails leaves the paste empty
+    pasted = compositor.paste("text/plain");
+    expect(wait_for([&]() { return events.transfer_count() == 2; }), "a second paste asks again");
+    uint32_t serial = events.transfer(1).serial;
+    expect(serial != first.serial, "each paste has its own serial");
+    clipboard.write_done(SESSION_A, serial, false);
+    expect(read_all(pasted).empty(), "a failed write ends the paste with nothing");
+    expect(clipboard.write(SESSION_A, serial) == -1, "a failed paste cannot be written any more");
+
+    // Another session reads it: through the compositor and back to the owner
+    int reader = clipboard.read(SESSION_B, "text/plain");
+    expect(reader >= 0 && wait_for([&]() { return events.transfer_count() == 3; }),
+           "a session reading another's selection asks the owner too");
+    writer = clipboard.write(SESSION_A, events.transfer(2).serial);
+    write_all(writer, "shared text");
+    close(writer);
+    expect(read_all(reader) == "shared text", "and gets what the owner wrote");
+
+    // Another app copies: the session's selection is gone
+    compositor.set_selection({ "text/plain" }, "elsewhere");
+    expect(wait_for([&]() { return events.last_owner().empty(); }), "another app's copy replaces the session's");
+    expect(!compositor.client_owns_selection(), "the compositor holds the new selection");
+    clipboard.cleanup();
+}
+
+void test_release() {
+    StubCompositor compositor;
+    Clipboard clipboard;
+    clipboard.init(compositor.take_client_fd());
+    Events events(clipboard);
+
+    clipboard.set_selection(SESSION_A, { "text/plain" });
+    expect(wait_for([&]() { return compositor.client_owns_selection(); }), "the session holds the selection");
+
+    // A paste whose writer never finishes
+    int pasted = compositor.paste("text/plain");
+    expect(wait_for([&]() { return events.transfer_count() == 1; }), "a paste is under way");
+    int writer = clipboard.write(SESSION_A, events.transfer(0).serial);
+    write_all(writer, "partial");
+    expect(wait_for([&]() { return clipboard.stats().bytes == 7; }), "part of it has gone through");
+
+    clipboard.release(SESSION_A);
+    expect(read_all(pasted) == "partial", "a released session's transfer ends where it was");
+    expect(wait_for([&]() { return compositor.selection_mime_types().empty(); }),
+           "a released session's selection is cleared");
+    expect(!compositor.client_owns_selection(), "the client no longer holds the selection");
+    Clipboard::Stats stats = clipboard.stats();
+    expect(stats.active == 0 && stats.failed == 1, "the cut transfer counts as failed");
+    close(writer);
+    clipboard.cleanup();
+}
+
+} // namespace
+
+int main() {
+    // Readers that go away are EPIPE, as in the portal
+    signal(SIGPIPE, SIG_IGN);
+    std::cout.setstate(std::ios::failbit);
+
+    test_another_apps_selection();
+    test_large_read();
+    test_session_selection();
+    test_release();
+
+    return finish_checks();
+}
@@ -0,0 +1,146 @@
+// Device pool: checkout hands every session its own pair, the pool refills in the
+// background, and two sessions' keyboards never see each other's modifiers, even
+// when they share one pair.
+
+#include "portal.h"
+#include "device_pool.h"
+#include "recording_backend.h"
+#include "eis_pair.h"
+#include "check.h"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+bool wait_for_available(DevicePool& pool, size_t expected) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (pool.available() != expected) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void test_checkout_and_refill() {
+    const size_t size = 3;
+    RecordingBackend backend;
+    DevicePool pool(size);
+
+    expect(backend.init() && pool.init(&backend), "pool fills from the backend");
+    expect(pool.available() == size, "pool starts full");
+
+    // One more than the pool holds: the last one is created on demand
+    std::vector<DevicePair> pairs;
+    std::set<const void*> seen;
+    for (size_t i = 0; i < size + 1; i++) {
+        pairs.push_back(pool.checkout());
+        seen.insert(pairs.back().pointer.get());
+        seen.insert(pairs.back().keyboard.get());
+    }
+    bool all_valid = true;
+    for (const auto& pair : pairs) all_valid = all_valid && static_cast<bool>(pair);
+    expect(all_valid, "every checkout yields a pair");
+    expect(seen.size() == 2 * (size + 1), "no two sessions share a device");
+
+    expect(wait_for_available(pool, size), "pool refills in the background");
+
+    for (auto& pair : pairs) pool.release(std::move(pair));
+    pool.cleanup();
+    expect(pool.available() == 0, "cleanup destroys the ready pairs");
+
+    // A pair's log goes with it, but what it recorded still counts
+    size_t before = backend.total();
+    {
+        DevicePair pair = backend.create_pair();
+        pair.pointer->send_button(0, BTN_LEFT, 1);
+        pair.pointer->send_button(0, BTN_LEFT, 0);
+    }
+    expect(backend.total() == before + 2, "a released pair's requests stay in the backend's total");
+}
+
+// Two sessions with their own targets; Ctrl held in one must not reach the other
+void test_modifier_isolation() {
+    RequestLog log_a, log_b;
+    RecordingVirtualPointer pointer_a(log_a), pointer_b(log_b);
+    RecordingVirtualKeyboard keyboard_a(log_a), keyboard_b(log_b);
+    InputTarget target_a{ &pointer_a, &keyboard_a, {} };
+    InputTarget target_b{ &pointer_b, &keyboard_b, {} };
+    Portal portal;
+
+    EisTestPair client_a([&](struct eis_event* event) { portal.handle_eis_event(target_a, event); });
+    EisTestPair client_b([&](struct eis_event* event) { portal.handle_eis_event(target_b, event); });
+    if (!client_a.connect() || !client_b.connect()) {
+        expect(false, "EIS handshake");
+        return;
+    }
+
+    client_a.key(KEY_LEFTCTRL, true);
+    client_b.key(KEY_C, true);
+    client_b.key(KEY_C, false);
+    if (!client_a.deliver(2) || !client_b.deliver(4)) {
+        expect(false, "EIS events arrive");
+        return;
+    }
+
+    bool b_clean = true;
+    for (const auto& entry : log_b.entries) {
+        if (entry.request == WaylandRequest::KeyboardModifiers && entry.args[0] != 0) b_clean = false;
+    }
+    expect(target_a.modifiers.depressed != 0, "session A holds Ctrl");
+    expect(target_b.modifiers.depressed == 0 && b_clean, "session B types without A's Ctrl");
+    expect(log_a.count(WaylandRequest::KeyboardKey) == 1 && log_b.count(WaylandRequest::KeyboardKey) == 2,
+           "keys land on their own session's keyboard");
+}
+
+// Two sessions without pooled pairs write to the same devices, each with its
+// own modifier and frame state
+void test_shared_devices() {
+    RequestLog log;
+    RecordingVirtualPointer pointer(log);
+    RecordingVirtualKeyboard keyboard(log);
+    std::mutex lock;
+    InputTarget target_a{ &pointer, &keyboard, {} };
+    InputTarget target_b{ &pointer, &keyboard, {} };
+    target_a.device_lock = target_b.device_lock = &lock;
+    Portal portal;
+
+    EisTestPair client_a([&](struct eis_event* event) { portal.handle_eis_event(target_a, event); });
+    EisTestPair client_b([&](struct eis_event* event) { portal.handle_eis_event(target_b, event); });
+    if (!client_a.connect() || !client_b.connect()) {
+        expect(false, "EIS handshake");
+        return;
+    }
+
+    client_a.key(KEY_LEFTCTRL, true);
+    client_b.key(KEY_C, true);
+    client_b.key(KEY_C, false);
+    if (!client_a.deliver(2) || !client_b.deliver(4)) {
+        expect(false, "EIS events arrive");
+        return;
+    }
+
+    expect(target_a.modifiers.depressed != 0 && target_b.modifiers.depressed == 0,
+           "sharing devices does not share held modifiers");
+    expect(!target_a.translation.in_frame && !target_b.translation.in_frame, "each client's frame closes its own state");
+    expect(log.count(WaylandRequest::KeyboardKey) == 3, "both clients' keys reach the shared keyboard");
+}
+
+} // namespace
+
+int main() {
+    // Keep the portal's per-event logging out of the test output
+    std::cout.setstate(std::ios::failbit);
+
+    test_checkout_and_refill();
+    test_modifier_isolation();
+    test_shared_devices();
+
+    return finish_checks("Device pool checks passed");
+}
@@ -0,0 +1,233 @@
+// EIS passthrough: a session's input reaches a stand-in compositor EIS server
+// with its values, frames and timestamps intact and nothing is translated; once
+// the compositor side goes away, input falls back to the virtual devices.
+
+#include "portal.h"
+#include "ei_forwarder.h"
+#include "recording_backend.h"
+#include "eis_pair.h"
+#include "check.h"
+#include "temp_dir.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+struct Received {
+    enum eis_event_type type;
+    double a;
+    double b;
+    uint64_t time;
+};
+
+// What the compositor would be: an EIS server on a socket offering one pointer
+// (relative, absolute, button, scroll) and one keyboard, recording the input it gets
+class StandInCompositor {
+public:
+    ~StandInCompositor() { shutdown(); }
+
+    bool listen(const std::string& path) {
+        server = eis_new(nullptr);
+        return server && eis_setup_backend_socket(server, path.c_str()) == 0;
+    }
+
+    void shutdown() {
+        if (server) eis_unref(server);
+        server = nullptr;
+    }
+
+    int fd() const { return server ? eis_get_fd(server) : -1; }
+
+    void pump() {
+        if (!server) return;
+        eis_dispatch(server);
+        struct eis_event* event;
+        while ((event = eis_get_event(server)) != nullptr) {
+            handle(event);
+            eis_event_unref(event);
+        }
+    }
+
+    int emulating = 0;
+    std::vector<Received> received;
+
+private:
+    struct eis* server = nullptr;
+
+    void handle(struct eis_event* event) {
+        enum eis_event_type type = eis_event_get_type(event);
+        switch (type) {
+            case EIS_EVENT_CLIENT_CONNECT: {
+                struct eis_client* client = eis_event_get_client(event);
+                eis_client_connect(client);
+                struct eis_seat* seat = eis_client_new_seat(client, "stand-in seat");
+                eis_seat_configure_capability(seat, EIS_DEVICE_CAP_POINTER);
+                eis_seat_configure_capability(seat, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
+                eis_seat_configure_capability(seat, EIS_DEVICE_CAP_BUTTON);
+                eis_seat_configure_capability(seat, EIS_DEVICE_CAP_SCROLL);
+                eis_seat_configure_capability(seat, EIS_DEVICE_CAP_KEYBOARD);
+                eis_seat_add(seat);
+                eis_seat_unref(seat);
+                break;
+            }
+            case EIS_EVENT_SEAT_BIND: {
+                struct eis_seat* seat = eis_event_get_seat(event);
+                struct eis_device* pointer = eis_seat_new_device(seat);
+                eis_device_configure_name(pointer, "stand-in pointer");
+                eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER);
+                eis_device_configure_capability(pointer, EIS_DEVICE_CAP_POINTER_ABSOLUTE);
+                eis_device_configure_capability(pointer, EIS_DEVICE_CAP_BUTTON);
+                eis_device_configure_capability(pointer, EIS_DEVICE_CAP_SCROLL);
+                struct eis_region* region = eis_device_new_region(pointer);
+                eis_region_set_size(region, 1920, 1080);
+                eis_region_add(region);
+                eis_region_unref(region);
+                eis_device_add(pointer);
+                eis_device_resume(pointer);
+                eis_device_unref(pointer);
+
+                struct eis_device* keyboard = eis_seat_new_device(seat);
+                eis_device_configure_name(keyboard, "stand-in keyboard");
+                eis_device_configure_capability(keyboard, EIS_DEVICE_CAP_KEYBOARD);
+                eis_device_add(keyboard);
+                eis_device_resume(keyboard);
+                eis_device_unref(keyboard);
+                break;
+            }
+            case EIS_EVENT_DEVICE_START_EMULATING:
+                emulating++;
+                break;
+            case EIS_EVENT_POINTER_MOTION:
+                received.push_back({ type, eis_event_pointer_get_dx(event), eis_event_pointer_get_dy(event), 0 });
+                break;
+            case EIS_EVENT_POINTER_MOTION_ABSOLUTE:
+                received.push_back({ type, eis_event_pointer_get_absolute_x(event),
+                                     eis_event_pointer_get_absolute_y(event), 0 });
+                break;
+            case EIS_EVENT_BUTTON_BUTTON:
+                received.push_back({ type, double(eis_event_button_get_button(event)),
+                                     double(eis_event_button_get_is_press(event)), 0 });
+                break;
+            case EIS_EVENT_SCROLL_DELTA:
+                received.push_back({ type, eis_event_scroll_get_dx(event), eis_event_scroll_get_dy(event), 0 });
+                break;
+            case EIS_EVENT_SCROLL_DISCRETE:
+                received.push_back({ type, double(eis_event_scroll_get_discrete_dx(event)),
+                                     double(eis_event_scroll_get_discrete_dy(event)), 0 });
+                break;
+            case EIS_EVENT_KEYBOARD_KEY:
+                received.push_back({ type, double(eis_event_keyboard_get_key(event)),
+                                     double(eis_event_keyboard_get_key_is_press(event)), 0 });
+                break;
+            case EIS_EVENT_FRAME:
+                received.push_back({ type, 0, 0, eis_event_get_time(event) });
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+// Drive the stand-in server and the forwarder until `done` or two seconds pass
+bool pump_until(StandInCompositor& compositor, EiForwarder& forwarder, const std::function<bool()>& done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        struct pollfd fds[2] = {
+            { .fd = compositor.fd(), .events = POLLIN, .revents = 0 },
+            { .fd = forwarder.fd(), .events = POLLIN, .revents = 0 },
+        };
+        poll(fds, 2, 10);
+        compositor.pump();
+        forwarder.dispatch();
+    }
+    return true;
+}
+
+bool near(double a, double b) {
+    return a - b < 1e-6 && b - a < 1e-6;
+}
+
+} // namespace
+
+int main() {
+    // Keep the portal's connection logging out of the test output
+    std::cout.setstate(std::ios::failbit);
+
+    TempDir temp("hypr-remote-eis");
+    if (!temp) {
+        std::cerr << "FAIL could not create a socket directory" << std::endl;
+        return 1;
+    }
+    std::string socket_path = temp.path() + "/eis-0";
+
+    StandInCompositor compositor;
+    EiForwarder forwarder;
+    expect(compositor.listen(socket_path), "stand-in compositor listens");
+    expect(forwarder.connect(socket_path, "hypr-remote test"), "forwarder connects");
+    expect(pump_until(compositor, forwarder, [&]() { return compositor.emulating == 2; }),
+           "forwarder emulates on the compositor's pointer and keyboard");
+
+    // The client side, with the portal's translation as the fallback
+    RequestLog log;
+    RecordingVirtualPointer pointer(log);
+    RecordingVirtualKeyboard keyboard(log);
+    InputTarget target{ &pointer, &keyboard, {} };
+    Portal portal;
+    std::vector<uint64_t> client_frames;
+
+    EisTestPair client([&](struct eis_event* event) {
+        if (eis_event_get_type(event) == EIS_EVENT_FRAME) client_frames.push_back(eis_event_get_time(event));
+        if (!forwarder.forward(event)) portal.handle_eis_event(target, event);
+    });
+    if (!client.connect()) {
+        expect(false, "EIS handshake");
+        return 1;
+    }
+
+    client.motion(3.0, -2.0);
+    client.motion_absolute(100.0, 200.0);
+    client.button(BTN_LEFT, true);
+    client.scroll(0.0, 1.5);
+    client.scroll_discrete(0, 120);
+    client.key(KEY_A, true);
+    expect(client.deliver(12), "client events reach the portal");
+    expect(pump_until(compositor, forwarder, [&]() { return compositor.received.size() >= 12; }),
+           "forwarded events reach the compositor");
+
+    const auto& got = compositor.received;
+    bool values = got.size() == 12 &&
+        got[0].type == EIS_EVENT_POINTER_MOTION && near(got[0].a, 3.0) && near(got[0].b, -2.0) &&
+        got[2].type == EIS_EVENT_POINTER_MOTION_ABSOLUTE && near(got[2].a, 100.0) && near(got[2].b, 200.0) &&
+        got[4].type == EIS_EVENT_BUTTON_BUTTON && got[4].a == BTN_LEFT && got[4].b == 1 &&
+        got[6].type == EIS_EVENT_SCROLL_DELTA && near(got[6].b, 1.5) &&
+        got[8].type == EIS_EVENT_SCROLL_DISCRETE && got[8].b == 120 &&
+        got[10].type == EIS_EVENT_KEYBOARD_KEY && got[10].a == KEY_A && got[10].b == 1;
+    expect(values, "event types and values pass through unchanged");
+
+    bool frames = client_frames.size() == 6 && got.size() == 12;
+    for (size_t i = 0; frames && i < client_frames.size(); i++) {
+        frames = got[2 * i + 1].type == EIS_EVENT_FRAME && got[2 * i + 1].time == client_frames[i];
+    }
+    expect(frames, "each frame keeps the client's timestamp");
+    expect(log.total() == 0, "nothing is translated to virtual device requests");
+
+    // Compositor goes away: the forwarder lets go and translation takes over
+    compositor.shutdown();
+    expect(pump_until(compositor, forwarder, [&]() { return !forwarder.is_connected() && forwarder.fd() < 0; }),
+           "forwarder notices the compositor hanging up");
+    client.motion(1.0, 1.0);
+    expect(client.deliver(2), "client events still arrive");
+    expect(log.count(WaylandRequest::PointerMotion) == 1, "input falls back to the virtual pointer");
+
+    return finish_checks("EIS passthrough checks passed");
+}
@@ -0,0 +1,186 @@
+// EIS workers: sessions spread over the pool, each session's keys reach its
+// devices in the order its client sent them even with several sessions per
+// worker, a client hanging up is noticed on the worker, and closing a session
+// while its client is still sending is safe.
+
+#include "portal.h"
+#include "session.h"
+#include "eis_workers.h"
+#include "output_scheduler.h"
+#include "recording_backend.h"
+#include "remote_client.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+// A session on the workers with recording devices behind the scheduler, and
+// the remote client driving it
+struct Served {
+    RequestLog log;
+    std::unique_ptr<Session> session;
+    std::unique_ptr<RemoteClient> remote;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<bool> gone{false};
+
+    Served(Portal& portal, OutputScheduler& scheduler, EisWorkers& workers, const std::string& handle) {
+        session = std::make_unique<Session>(handle, "test", nullptr);
+        session->attach_devices(scheduler.attach(handle, DevicePair(
+            std::make_unique<RecordingVirtualPointer>(log), std::make_unique<RecordingVirtualKeyboard>(log))));
+        InputTarget* target = &session->input();
+        session->set_event_handler([this, &portal, target](struct eis_event* event) {
+            portal.handle_eis_event(*target, event);
+            if (eis_event_get_type(event) == EIS_EVENT_FRAME) {
+                frames.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        session->set_client_gone_handler([this](Session&) { gone = true; });
+        remote = std::make_unique<RemoteClient>(session->connect_eis(&workers));
+    }
+
+    // Stop serving and write out whatever the scheduler still holds
+    void end(OutputScheduler& scheduler) {
+        session->close();
+        scheduler.detach(session->take_devices());
+    }
+
+    std::vector<uint32_t> pressed() const {
+        std::vector<uint32_t> keys;
+        for (const auto& entry : log.entries) {
+            if (entry.request == WaylandRequest::KeyboardKey && entry.args[1] == 1) {
+                keys.push_back(entry.args[0]);
+            }
+        }
+        return keys;
+    }
+};
+
+void test_ordered_per_session() {
+    Portal portal;
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    scheduler.start();
+    EisWorkers workers(2, &scheduler);
+    workers.start();
+
+    constexpr size_t kSessions = 4;
+    constexpr size_t kKeys = 300;
+    std::vector<std::unique_ptr<Served>> served;
+    bool connected = true;
+    for (size_t i = 0; i < kSessions; i++) {
+        served.push_back(std::make_unique<Served>(portal, scheduler, workers, "/test/session/" + std::to_string(i)));
+        connected = served.back()->remote->connect() && connected;
+    }
+    expect(connected, "every client completes the EIS handshake");
+
+    std::vector<size_t> loads = workers.loads();
+    expect(loads.size() == 2 && loads[0] == 2 && loads[1] == 2, "sessions are spread evenly over the workers");
+
+    // A different run of letters per session, all sent at once
+    std::vector<std::vector<uint32_t>> sent(kSessions);
+    for (size_t i = 0; i < kSessions; i++) {
+        for (size_t k = 0; k < kKeys; k++) sent[i].push_back(KEY_Q + (i * 7 + k * 3) % 10);
+    }
+    std::vector<std::thread> senders;
+    for (size_t i = 0; i < kSessions && connected; i++) {
+        senders.emplace_back([&, i]() { served[i]->remote->keys(sent[i].data(), kKeys); });
+    }
+    for (auto& sender : senders) sender.join();
+
+    bool delivered = connected && wait_for([&]() {
+        for (const auto& s : served) {
+            if (s->frames.load() < 2 * kKeys) return false;
+        }
+        return true;
+    });
+    expect(delivered, "every session translates all of its client's frames");
+
+    bool ordered = true;
+    for (size_t i = 0; i < kSessions; i++) {
+        served[i]->end(scheduler);
+        ordered = ordered && served[i]->pressed() == sent[i];
+    }
+    expect(ordered, "each session's keys reach its own devices in the order sent");
+
+    workers.stop();
+    scheduler.stop();
+}
+
+void test_client_leaves() {
+    Portal portal;
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    scheduler.start();
+    EisWorkers workers(2, &scheduler);
+    workers.start();
+
+    Served staying(portal, scheduler, workers, "/test/session/staying");
+    Served leaving(portal, scheduler, workers, "/test/session/leaving");
+    expect(staying.remote->connect() && leaving.remote->connect(), "both clients connect");
+
+    leaving.remote->disconnect();
+    expect(wait_for([&]() { return leaving.gone.load(); }), "the worker notices the client hanging up");
+    expect(!staying.gone.load(), "the other session is still served");
+
+    std::vector<size_t> loads = workers.loads();
+    expect(loads[0] + loads[1] == 1, "the worker stops serving the session that left");
+
+    staying.remote->motion(100);
+    expect(wait_for([&]() { return staying.frames.load() >= 100; }), "the remaining session still gets its input");
+
+    leaving.end(scheduler);
+    staying.end(scheduler);
+    workers.stop();
+    scheduler.stop();
+}
+
+void test_close_under_traffic() {
+    Portal portal;
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    scheduler.start();
+    EisWorkers workers(1, &scheduler);
+    workers.start();
+
+    Served busy(portal, scheduler, workers, "/test/session/busy");
+    Served neighbour(portal, scheduler, workers, "/test/session/neighbour");
+    expect(busy.remote->connect() && neighbour.remote->connect(), "both clients connect to the one worker");
+
+    std::thread sender([&]() { busy.remote->motion(20000); });
+    expect(wait_for([&]() { return busy.frames.load() > 0; }), "the busy session is being served");
+    busy.end(scheduler);
+    uint64_t after_close = busy.frames.load();
+    sender.join();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    expect(busy.frames.load() == after_close, "a closed session gets no more events");
+    expect(workers.loads()[0] == 1, "closing removes the session from its worker");
+
+    neighbour.remote->motion(100);
+    expect(wait_for([&]() { return neighbour.frames.load() >= 100; }), "the worker keeps serving its other session");
+
+    neighbour.end(scheduler);
+    workers.stop();
+    scheduler.stop();
+}
+
+} // namespace
+
+int main() {
+    // The busy client keeps writing after its session is closed
+    signal(SIGPIPE, SIG_IGN);
+
+    test_ordered_per_session();
+    test_client_leaves();
+    test_close_under_traffic();
+
+    return finish_checks();
+}
@@ -0,0 +1,194 @@
+// Flight recorder: concurrent writers keep the last N records in order, a dump
+// reads back as written, translated events and sessions are recorded under the
+// session they belong to, and a crash leaves a dump behind before the process
+// dies of its signal.
+
+#include "flight_recorder.h"
+#include "recording_backend.h"
+#include "session.h"
+#include "translator.h"
+#include "check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+const size_t CAPACITY = 1024;
+
+std::string temp_path(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir && dir[0] ? dir : "/tmp") + "/hypr-remote-test-" + std::to_string(getpid()) + "-" + name;
+}
+
+std::vector<FlightRecord> read_dump(const std::string& path, FlightDumpHeader& header) {
+    std::vector<FlightRecord> records;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return records;
+    if (fread(&header, sizeof(header), 1, file) == 1) {
+        records.resize(header.count);
+        records.resize(fread(records.data(), sizeof(FlightRecord), records.size(), file));
+    }
+    fclose(file);
+    return records;
+}
+
+bool contiguous(const std::vector<FlightRecord>& records) {
+    for (size_t i = 1; i < records.size(); i++) {
+        if (records[i].sequence != records[i - 1].sequence + 1) return false;
+    }
+    return true;
+}
+
+void test_concurrent_writers() {
+    const int THREADS = 4;
+    const int PER_THREAD = 5000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < PER_THREAD; i++) {
+                FlightRecorder::request(100 + t, WaylandRequest::KeyboardKey, i, KEY_A, i & 1);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<FlightRecord> records = FlightRecorder::snapshot();
+    expect(records.size() == CAPACITY, "the ring keeps exactly its capacity");
+    expect(contiguous(records), "the records kept are the latest, in order");
+
+    bool intact = true;
+    for (const FlightRecord& r : records) {
+        if (r.kind != FlightRecord::REQUEST || r.type != uint8_t(WaylandRequest::KeyboardKey) ||
+            r.session < 100 || r.session >= 100 + THREADS || r.args[0] != KEY_A || r.args[1] != (r.time & 1)) {
+            intact = false;
+        }
+    }
+    expect(intact, "no record is torn between writers");
+}
+
+void test_dump_round_trip() {
+    std::string handle = "/org/freedesktop/portal/desktop/session/1_42/hypr_remote_7";
+    FlightRecorder::session_open(7, handle);
+    FlightRecorder::request(7, WaylandRequest::PointerButton, 1234, BTN_LEFT, 1);
+    FlightRecorder::session_close(7);
+
+    std::string path = temp_path("dump.bin");
+    expect(FlightRecorder::dump(path.c_str()), "the ring dumps to a file");
+
+    FlightDumpHeader header;
+    std::vector<FlightRecord> records = read_dump(path, header);
+    expect(memcmp(header.magic, FlightDumpHeader::MAGIC, sizeof(header.magic)) == 0 &&
+           header.version == FlightDumpHeader::VERSION && header.record_size == sizeof(FlightRecord),
+           "the dump starts with its header");
+    expect(records.size() == CAPACITY && contiguous(records), "the dump holds the whole ring, oldest first");
+
+    std::vector<FlightRecord> snapshot = FlightRecorder::snapshot();
+    expect(records.size() == snapshot.size() && memcmp(records.data(), snapshot.data(),
+                                                       records.size() * sizeof(FlightRecord)) == 0,
+           "the dump matches the ring");
+
+    if (records.size() >= 3) {
+        const FlightRecord& open = records[records.size() - 3];
+        const FlightRecord& button = records[records.size() - 2];
+        const FlightRecord& close = records.back();
+        expect(open.kind == FlightRecord::SESSION_OPEN && open.session == 7 &&
+               memcmp(open.args, handle.data() + handle.size() - sizeof(open.args), sizeof(open.args)) == 0,
+               "a session opening keeps the tail of its handle");
+        expect(button.kind == FlightRecord::REQUEST && button.time == 1234 && button.args[0] == BTN_LEFT &&
+               button.args[1] == 1, "a request keeps its time and arguments");
+        expect(close.kind == FlightRecord::SESSION_CLOSE && close.session == 7, "a session closing is recorded");
+        expect(open.time_ns <= button.time_ns && button.time_ns <= close.time_ns, "timestamps do not go backwards");
+    }
+    unlink(path.c_str());
+}
+
+void test_translated_events() {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+
+    Session session("/org/freedesktop/portal/desktop/session/test/flight", "test", nullptr);
+    InputTarget& target = session.input();
+    target.pointer = &pointer;
+    target.keyboard = &keyboard;
+    expect(session.id() != 0 && target.session == session.id(), "a session's input carries its id");
+
+    Translator<NotifySource>::apply(target, { InputEvent::MOTION, false, 0, 3.0, -2.0 });
+    Translator<EisSource>::apply(target, { InputEvent::KEY, true, KEY_LEFTCTRL });
+
+    std::vector<FlightRecord> records = FlightRecorder::snapshot();
+    std::vector<FlightRecord> events;
+    bool opened = false;
+    for (const FlightRecord& r : records) {
+        if (r.session != session.id()) continue;
+        if (r.kind == FlightRecord::SESSION_OPEN) opened = true;
+        if (r.kind == FlightRecord::EVENT) events.push_back(r);
+    }
+    expect(opened, "creating a session is recorded under its id");
+
+    // Notify* events are frames of their own: motion, frame, then the key
+    expect(events.size() == 3, "every translated event is recorded");
+    if (events.size() == 3) {
+        float x, y;
+        memcpy(&x, &events[0].args[1], sizeof(x));
+        memcpy(&y, &events[0].args[2], sizeof(y));
+        expect(events[0].source == PROBE_SOURCE_DBUS && events[0].type == InputEvent::MOTION && x == 3.0f && y == -2.0f,
+               "a Notify* motion is recorded with its source and deltas");
+        expect(events[1].type == InputEvent::FRAME, "the frame that ends it is recorded too");
+        expect(events[2].source == PROBE_SOURCE_EIS && events[2].type == InputEvent::KEY &&
+               events[2].args[0] == KEY_LEFTCTRL && events[2].pressed, "an EIS key is recorded with its code and state");
+    }
+
+    session.close();
+    std::vector<FlightRecord> after = FlightRecorder::snapshot();
+    expect(!after.empty() && after.back().kind == FlightRecord::SESSION_CLOSE && after.back().session == session.id(),
+           "closing a session is recorded");
+}
+
+void test_crash_dump() {
+    std::string path = temp_path("crash.bin");
+    pid_t child = fork();
+    if (child == 0) {
+        FlightRecorder::install_crash_handler(path);
+        FlightRecorder::request(9, WaylandRequest::KeyboardModifiers, 0, 4, 0, 0, 0);
+        abort();
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "the crashing process still dies of its signal");
+
+    FlightDumpHeader header;
+    std::vector<FlightRecord> records = read_dump(path, header);
+    expect(records.size() == CAPACITY, "a crash dumps the ring");
+    expect(!records.empty() && records.back().session == 9 &&
+           records.back().type == uint8_t(WaylandRequest::KeyboardModifiers) && records.back().args[0] == 4,
+           "the last thing recorded before the crash is in the dump");
+    unlink(path.c_str());
+}
+
+} // namespace
+
+int main() {
+    FlightRecorder::enable(CAPACITY);
+    expect(FlightRecorder::enabled(), "the recorder is on once enabled");
+
+    test_concurrent_writers();
+    test_dump_round_trip();
+    test_translated_events();
+    test_crash_dump();
+
+    return finish_checks();
+}
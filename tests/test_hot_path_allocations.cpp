@@ -0,0 +1,263 @@
+// Allocation-free hot path: once warmed up, translating an event and handing it
+// to the output devices must not touch the heap. operator new and (on glibc)
+// malloc/calloc/realloc are hooked; only calls made while an event is being
+// handled are counted, so libei/libeis dispatch around it does not matter.
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "recording_backend.h"
+#include "eis_pair.h"
+#include "ei_pair.h"
+#include "check.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <xkbcommon/xkbcommon.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<uint64_t> allocations{0};
+
+inline void note_allocation() {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    note_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    note_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    note_allocation();
+    return __libc_realloc(ptr, size);
+}
+}
+#define RAW_MALLOC __libc_malloc
+#else
+#define RAW_MALLOC std::malloc
+#endif
+
+// Counted once here; the underlying allocation bypasses the malloc hook
+void* operator new(size_t size) {
+    note_allocation();
+    if (void* ptr = RAW_MALLOC(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    note_allocation();
+    if (void* ptr = RAW_MALLOC(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// Rounds of events per scenario: the first warms caches and lazily built state
+// (xkb keymap, stream buffers), the second is measured
+constexpr int kRounds = 2;
+constexpr int kEventsPerRound = 64;
+
+class CountingScope {
+public:
+    explicit CountingScope(bool active) : active(active) {
+        if (active) counting.store(true, std::memory_order_relaxed);
+    }
+    ~CountingScope() {
+        if (active) counting.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    bool active;
+};
+
+struct Harness {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+    LibEIHandler handler;
+    Portal portal;
+
+    Harness() {
+        handler.pointer = &pointer;
+        handler.keyboard = &keyboard;
+        portal.set_libei_handler(&handler);
+    }
+};
+
+void check(const std::string& name, uint64_t counted) {
+    if (counted) {
+        std::cerr << "FAIL " << name << ": " << counted << " allocations over "
+                  << kEventsPerRound << " events" << std::endl;
+        failures++;
+    } else {
+        std::cerr << "ok   " << name << ": 0 allocations" << std::endl;
+    }
+}
+
+void fail(const std::string& name, const char* why) {
+    std::cerr << "FAIL " << name << ": " << why << std::endl;
+    failures++;
+}
+
+// `events` is the number of server-side events (input plus frame) per emission
+struct EisScenario {
+    const char* name;
+    size_t events;
+    std::function<void(EisTestPair&, int)> emit;
+};
+
+void run_eis_scenarios() {
+    const EisScenario scenarios[] = {
+        { "eis pointer motion", 2, [](EisTestPair& p, int) { p.motion(3.0, -2.0); } },
+        { "eis absolute motion", 2, [](EisTestPair& p, int i) { p.motion_absolute(i, 2 * i); } },
+        { "eis button", 2, [](EisTestPair& p, int i) { p.button(BTN_LEFT, i % 2 == 0); } },
+        { "eis scroll delta", 2, [](EisTestPair& p, int) { p.scroll(1.0, 1.0); } },
+        { "eis scroll discrete", 2, [](EisTestPair& p, int) { p.scroll_discrete(0, 120); } },
+        { "eis key with modifiers", 2, [](EisTestPair& p, int i) {
+              static const uint32_t keys[] = { KEY_LEFTCTRL, KEY_C, KEY_C, KEY_LEFTCTRL };
+              p.key(keys[i % 4], (i % 4) < 2);
+          } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        bool measuring = false;
+        EisTestPair pair([&](struct eis_event* event) {
+            CountingScope scope(measuring);
+            h.portal.handle_eis_event(h.portal.shared_target(), event);
+        });
+        if (!pair.connect()) {
+            fail(scenario.name, "EIS handshake failed");
+            continue;
+        }
+
+        bool delivered = true;
+        for (int round = 0; round < kRounds && delivered; round++) {
+            measuring = round == kRounds - 1;
+            allocations = 0;
+            for (int i = 0; i < kEventsPerRound; i++) scenario.emit(pair, i);
+            delivered = pair.deliver(kEventsPerRound * scenario.events);
+            h.log.clear();
+        }
+        if (!delivered) {
+            fail(scenario.name, "EIS events did not arrive");
+            continue;
+        }
+        check(scenario.name, allocations.load());
+    }
+}
+
+struct EiScenario {
+    const char* name;
+    size_t events;
+    std::function<void(EiTestPair&, int)> emit;
+};
+
+void run_ei_scenarios() {
+    const EiScenario scenarios[] = {
+        { "ei pointer motion", 2, [](EiTestPair& p, int) { p.motion(3.0, -2.0); } },
+        { "ei button", 2, [](EiTestPair& p, int i) { p.button(BTN_LEFT, i % 2 == 0); } },
+        { "ei scroll delta", 2, [](EiTestPair& p, int) { p.scroll(1.0, 1.0); } },
+        { "ei scroll discrete", 2, [](EiTestPair& p, int) { p.scroll_discrete(0, 120); } },
+        { "ei key", 2, [](EiTestPair& p, int i) { p.key(KEY_A, i % 2 == 0); } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        bool measuring = false;
+        EiTestPair pair([&](struct ei_event* event) {
+            CountingScope scope(measuring);
+            h.handler.handle_event(event);
+        });
+        if (!pair.connect()) {
+            fail(scenario.name, "EI handshake failed");
+            continue;
+        }
+
+        bool delivered = true;
+        for (int round = 0; round < kRounds && delivered; round++) {
+            measuring = round == kRounds - 1;
+            allocations = 0;
+            for (int i = 0; i < kEventsPerRound; i++) scenario.emit(pair, i);
+            delivered = pair.deliver(kEventsPerRound * scenario.events);
+            h.log.clear();
+        }
+        if (!delivered) {
+            fail(scenario.name, "EI events did not arrive");
+            continue;
+        }
+        check(scenario.name, allocations.load());
+    }
+}
+
+// Forwarding behind the Notify* methods, after unmarshalling
+struct NotifyScenario {
+    const char* name;
+    std::function<void(Portal&, InputTarget&, int)> emit;
+};
+
+void run_notify_scenarios() {
+    const NotifyScenario scenarios[] = {
+        { "notify pointer motion", [](Portal& p, InputTarget& t, int) { p.notify_pointer_motion(t, 1.0, 1.0); } },
+        { "notify pointer button", [](Portal& p, InputTarget& t, int i) { p.notify_pointer_button(t, BTN_LEFT, i % 2); } },
+        { "notify keyboard keycode", [](Portal& p, InputTarget& t, int i) { p.notify_keyboard_keycode(t, KEY_A, i % 2); } },
+        { "notify keyboard keysym", [](Portal& p, InputTarget& t, int i) { p.notify_keyboard_keysym(t, XKB_KEY_a, i % 2); } },
+        { "notify pointer axis", [](Portal& p, InputTarget& t, int) { p.notify_pointer_axis(t, 0.0, 10.0); } },
+        { "queued notify batch", [](Portal& p, InputTarget& t, int i) {
+              p.queue_input({ i % 8 == 0 ? Portal::QueuedInput::POINTER_BUTTON : Portal::QueuedInput::POINTER_MOTION,
+                              &t, 1.0, 1.0, BTN_LEFT, static_cast<uint32_t>(i % 16 == 0) });
+              if (i % 16 == 15) p.apply_queued_input();
+          } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        for (int round = 0; round < kRounds; round++) {
+            allocations = 0;
+            CountingScope scope(round == kRounds - 1);
+            for (int i = 0; i < kEventsPerRound; i++) scenario.emit(h.portal, h.portal.shared_target(), i);
+        }
+        check(scenario.name, allocations.load());
+        h.log.clear();
+    }
+}
+
+} // namespace
+
+int main() {
+    // Keep connection-level logging out of the test output
+    std::cout.setstate(std::ios::failbit);
+
+    run_eis_scenarios();
+    run_ei_scenarios();
+    run_notify_scenarios();
+
+    return finish_checks("Hot paths are allocation-free", "hot path(s) allocated");
+}
@@ -0,0 +1,243 @@
+// Input transforms: the config gives each app its own table (or the default),
+// keys are remapped before modifiers are tracked, relative motion follows the
+// gain curve, scroll can be inverted and rescaled, and a table swapped in
+// while input is flowing applies whole, never half, and never to the release
+// of a key pressed before it.
+
+#include "input_transform.h"
+#include "recording_backend.h"
+#include "translator.h"
+#include "check.h"
+#include "temp_dir.h"
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+const char* APP = "org.deskflow.deskflow";
+
+struct Devices {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+    TransformSlot slot;
+    InputTarget target;
+
+    Devices() {
+        target.pointer = &pointer;
+        target.keyboard = &keyboard;
+        target.transform = &slot;
+    }
+
+    const RecordedRequest* last(WaylandRequest request) const {
+        for (auto it = log.entries.rbegin(); it != log.entries.rend(); ++it) {
+            if (it->request == request) return &*it;
+        }
+        return nullptr;
+    }
+};
+
+void write_file(const std::string& path, const std::string& contents) {
+    std::ofstream out(path);
+    out << contents;
+}
+
+void test_config(const std::string& path) {
+    TransformConfig config(path);
+    expect(config.load() && !config.for_app(APP), "without a file there are no transforms");
+
+    write_file(path,
+               "# remote side\n"
+               "[default]\n"
+               "scroll 1 -1\n"
+               "\n"
+               "[app org.deskflow.deskflow]\n"
+               "key 58 29   # Caps Lock is Ctrl\n"
+               "gain 0 1\n"
+               "gain 10 2\n");
+    expect(config.load(), "a valid file loads");
+    auto app = config.for_app(APP);
+    auto other = config.for_app("org.example.other");
+    expect(app && app->key(KEY_CAPSLOCK) == KEY_LEFTCTRL && app->scroll_y == 1.0,
+           "an app with a section gets its own transform");
+    expect(other && other->key(KEY_CAPSLOCK) == KEY_CAPSLOCK && other->scroll_y == -1.0,
+           "other apps get the default");
+
+    write_file(path, "[default]\nkey 58\n");
+    expect(!config.load() && config.for_app(APP) == app, "a malformed file keeps the previous transforms");
+    write_file(path, "gain 0 1\n");
+    expect(!config.load(), "directives belong in a section");
+    write_file(path, "[default]\ngain 4 1\ngain 2 2\n");
+    expect(!config.load(), "gain points must be in order");
+}
+
+void test_key_remap() {
+    Devices devices;
+    auto transform = std::make_shared<InputTransform>();
+    transform->keys[KEY_CAPSLOCK] = KEY_LEFTCTRL;
+    transform->keys[KEY_INSERT] = 0;
+    transform->keys[BTN_SIDE] = BTN_MIDDLE;
+    devices.slot.set(transform);
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::KEY, true, KEY_CAPSLOCK });
+    const RecordedRequest* key = devices.last(WaylandRequest::KeyboardKey);
+    const RecordedRequest* modifiers = devices.last(WaylandRequest::KeyboardModifiers);
+    expect(key && key->args[0] == KEY_LEFTCTRL, "a remapped key goes out as its replacement");
+    expect(modifiers && modifiers->args[0] == (1 << 2) && devices.target.modifiers.locked == 0,
+           "modifiers follow the replacement, not the original");
+
+    size_t before = devices.log.count(WaylandRequest::KeyboardKey);
+    Translator<NotifySource>::apply(devices.target, { InputEvent::KEY, true, KEY_INSERT });
+    expect(devices.log.count(WaylandRequest::KeyboardKey) == before, "a key remapped to 0 is swallowed");
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::BUTTON, true, BTN_SIDE });
+    const RecordedRequest* button = devices.last(WaylandRequest::PointerButton);
+    expect(button && button->args[0] == BTN_MIDDLE, "buttons share the remap table");
+}
+
+// A reload while a key is held must not leave the remapped key stuck down
+void test_reload_while_held() {
+    Devices devices;
+    auto before = std::make_shared<InputTransform>();
+    before->keys[KEY_CAPSLOCK] = KEY_LEFTCTRL;
+    before->keys[BTN_SIDE] = BTN_MIDDLE;
+    devices.slot.set(before);
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::KEY, true, KEY_CAPSLOCK });
+    Translator<NotifySource>::apply(devices.target, { InputEvent::BUTTON, true, BTN_SIDE });
+    auto after = std::make_shared<InputTransform>();
+    after->keys[KEY_CAPSLOCK] = KEY_ESC;
+    devices.slot.set(after);
+    Translator<NotifySource>::apply(devices.target, { InputEvent::KEY, false, KEY_CAPSLOCK });
+    Translator<NotifySource>::apply(devices.target, { InputEvent::BUTTON, false, BTN_SIDE });
+
+    const RecordedRequest* key = devices.last(WaylandRequest::KeyboardKey);
+    const RecordedRequest* button = devices.last(WaylandRequest::PointerButton);
+    expect(key && key->args[0] == KEY_LEFTCTRL && key->args[1] == 0 && devices.target.modifiers.depressed == 0,
+           "a key held across a reload is released as it was pressed");
+    expect(button && button->args[0] == BTN_MIDDLE && button->args[1] == 0, "and so is a button");
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::KEY, true, KEY_CAPSLOCK });
+    key = devices.last(WaylandRequest::KeyboardKey);
+    expect(key && key->args[0] == KEY_ESC, "the next press uses the new table");
+}
+
+void test_gain_curve() {
+    Devices devices;
+    auto transform = std::make_shared<InputTransform>();
+    transform->set_gain_curve({ { 0, 1.0 }, { 4, 1.0 }, { 12, 3.0 } });
+    devices.slot.set(transform);
+
+    auto moved = [&](double dx) {
+        Translator<NotifySource>::apply(devices.target, { InputEvent::MOTION, false, 0, dx, 0.0 });
+        const RecordedRequest* motion = devices.last(WaylandRequest::PointerMotion);
+        return motion ? wl_fixed_to_double(wl_fixed_t(motion->args[0])) : 0.0;
+    };
+    expect(moved(2.0) == 2.0, "small motion keeps its size");
+    expect(std::abs(moved(8.0) - 16.0) < 0.01, "gain is interpolated between points");
+    expect(std::abs(moved(-30.0) + 90.0) < 0.01, "past the last point the gain stays flat");
+    expect(InputTransform::identity().gain(30.0, 40.0) == 1.0, "the identity transform has no gain");
+}
+
+void test_scroll() {
+    Devices devices;
+    auto transform = std::make_shared<InputTransform>();
+    transform->scroll_y = -2.0;
+    transform->scroll_click = 10.0;
+    devices.slot.set(transform);
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::SCROLL, false, 0, 0.0, 1.5 });
+    const RecordedRequest* axis = devices.last(WaylandRequest::PointerAxis);
+    expect(axis && axis->args[0] == WL_POINTER_AXIS_VERTICAL_SCROLL &&
+           wl_fixed_to_double(wl_fixed_t(axis->args[1])) == -3.0, "smooth scroll is inverted and scaled");
+
+    Translator<NotifySource>::apply(devices.target, { InputEvent::SCROLL_DISCRETE, false, 0, 0.0, 120.0 });
+    const RecordedRequest* click = devices.last(WaylandRequest::PointerAxisDiscrete);
+    expect(click && wl_fixed_to_double(wl_fixed_t(click->args[1])) == -20.0 && int32_t(click->args[2]) == -1,
+           "a wheel click uses the configured size and turns the other way");
+}
+
+void test_swap_under_load() {
+    Devices devices;
+    auto double_speed = std::make_shared<InputTransform>();
+    double_speed->set_gain_curve({ { 0, 2.0 } });
+    auto triple_speed = std::make_shared<InputTransform>();
+    triple_speed->set_gain_curve({ { 0, 3.0 } });
+    devices.slot.set(double_speed);
+
+    // The ring source has frames of its own, so only motions are recorded;
+    // the log's reserve bounds how many
+    const size_t EVENTS = 60000;
+    std::atomic<size_t> sent{0};
+    std::thread input([&]() {
+        for (size_t i = 0; i < EVENTS; i++) {
+            Translator<SharedRingSource>::apply(devices.target, { InputEvent::MOTION, false, 0, 1.0, 1.0 });
+            sent.store(i + 1, std::memory_order_relaxed);
+            if (i % 256 == 0) std::this_thread::yield();  // interleave with the swaps even on one core
+        }
+    });
+    for (int swap = 0; sent.load(std::memory_order_relaxed) < EVENTS; swap++) {
+        devices.slot.set(swap % 2 ? double_speed : triple_speed);
+        std::this_thread::yield();
+    }
+    input.join();
+
+    bool whole = true;
+    size_t doubled = 0, tripled = 0;
+    for (const auto& entry : devices.log.entries) {
+        double dx = wl_fixed_to_double(wl_fixed_t(entry.args[0]));
+        double dy = wl_fixed_to_double(wl_fixed_t(entry.args[1]));
+        if (entry.request != WaylandRequest::PointerMotion || dx != dy) whole = false;
+        if (dx == 2.0) doubled++;
+        if (dx == 3.0) tripled++;
+    }
+    expect(whole && doubled + tripled == devices.log.entries.size(),
+           "every event sees one whole table while they are swapped");
+    expect(doubled && tripled, "tables were swapped while input was flowing");
+}
+
+// Replaced tables are freed once no reader is left that could hold them
+void test_replaced_tables_freed() {
+    TransformSlot slot;
+    auto first = std::make_shared<InputTransform>();
+    std::weak_ptr<const InputTransform> watched = first;
+    slot.set(std::move(first));
+    {
+        TransformSlot::Reader reading(&slot);
+        slot.set(std::make_shared<InputTransform>());
+        expect(!watched.expired(), "a table a reader holds outlives its replacement");
+    }
+    slot.set(std::make_shared<InputTransform>());
+    expect(watched.expired(), "and is freed by the next set() with no reader in flight");
+}
+
+} // namespace
+
+int main() {
+    TempDir temp("hypr-remote-transform");
+    if (!temp) {
+        std::cerr << "Failed to create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string& directory = temp.path();
+    std::cout.setstate(std::ios::failbit);
+
+    test_config(directory + "/transforms.conf");
+    test_key_remap();
+    test_reload_while_held();
+    test_gain_curve();
+    test_scroll();
+    test_swap_under_load();
+    test_replaced_tables_freed();
+
+    return finish_checks();
+}
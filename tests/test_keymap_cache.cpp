@@ -0,0 +1,153 @@
+// Keymap cache: a cold load compiles and writes an entry, a warm load maps it
+// with the same text and index, and entries that are corrupt, truncated or
+// compiled against different XKB data are rebuilt instead of used.
+
+#include "keymap_cache.h"
+#include "check.h"
+#include "temp_dir.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char* US_KEYMAP =
+    "xkb_keymap {\n"
+    "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
+    "xkb_types     { include \"complete\" };\n"
+    "xkb_compat    { include \"complete\" };\n"
+    "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
+    "};\n";
+
+const char* DE_KEYMAP =
+    "xkb_keymap {\n"
+    "xkb_keycodes  { include \"evdev+aliases(qwertz)\" };\n"
+    "xkb_types     { include \"complete\" };\n"
+    "xkb_compat    { include \"complete\" };\n"
+    "xkb_symbols   { include \"pc+de+inet(evdev)\" };\n"
+    "};\n";
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::string& content) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << content;
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Keycode and level for `keysym`, or -1s if the keymap has no key for it
+std::pair<int, int> lookup(const CompiledKeymap& keymap, xkb_keysym_t keysym) {
+    const CompiledKeymap::Entry* entry = keymap.find(keysym);
+    return entry ? std::make_pair(int(entry->keycode), int(entry->level)) : std::make_pair(-1, -1);
+}
+
+void test_cold_then_warm(struct xkb_context* context, const std::string& directory) {
+    KeymapCache cache(context, directory + "/keymaps");
+    std::string path = cache.path_for(US_KEYMAP);
+
+    auto cold = cache.load(US_KEYMAP);
+    expect(cold && !cold->from_cache(), "a cold load compiles");
+    expect(exists(path), "the compiled keymap is written to the cache directory");
+    if (!cold) return;
+
+    expect(cold->text().find("xkb_symbols") != std::string_view::npos &&
+           cold->text().find("include") == std::string_view::npos, "the stored text is the normalized keymap");
+    expect(lookup(*cold, XKB_KEY_a) == std::make_pair(30, 0), "a is KEY_A at level 0");
+    expect(lookup(*cold, XKB_KEY_A) == std::make_pair(30, 1), "A is KEY_A at level 1");
+    expect(lookup(*cold, XKB_KEY_Return) == std::make_pair(28, 0), "Return is KEY_ENTER");
+    expect(lookup(*cold, XKB_KEY_Cyrillic_a).first == -1, "a keysym the layout lacks is not found");
+
+    auto warm = cache.load(US_KEYMAP);
+    expect(warm && warm->from_cache(), "a warm load maps the cached entry");
+    if (!warm) return;
+    expect(warm->text() == cold->text(), "the cached text matches the compiled one");
+    expect(warm->entries() == cold->entries(), "the cached index has every entry");
+    bool same = true;
+    for (xkb_keysym_t keysym : {XKB_KEY_a, XKB_KEY_A, XKB_KEY_Return, XKB_KEY_at, XKB_KEY_F12, XKB_KEY_space}) {
+        same = same && lookup(*warm, keysym) == lookup(*cold, keysym);
+    }
+    expect(same, "the cached index answers like the compiled one");
+
+    auto other = cache.load(DE_KEYMAP);
+    expect(other && !other->from_cache() && cache.path_for(DE_KEYMAP) != path,
+           "a different keymap gets an entry of its own");
+    expect(other && lookup(*other, XKB_KEY_z).first == 21, "the German layout has z on KEY_Y");
+}
+
+void test_rebuilds(struct xkb_context* context, const std::string& directory) {
+    KeymapCache cache(context, directory + "/keymaps");
+    std::string path = cache.path_for(US_KEYMAP);
+    cache.load(US_KEYMAP);
+    std::string good = read_file(path);
+
+    std::string corrupt = good;
+    corrupt[corrupt.size() / 2] ^= 0x20;
+    write_file(path, corrupt);
+    auto rebuilt = cache.load(US_KEYMAP);
+    expect(rebuilt && !rebuilt->from_cache(), "a corrupt entry is compiled again");
+    expect(read_file(path) == good, "and replaced with a good one");
+
+    write_file(path, good.substr(0, good.size() - 3));
+    rebuilt = cache.load(US_KEYMAP);
+    expect(rebuilt && !rebuilt->from_cache(), "a truncated entry is compiled again");
+
+    write_file(path, "");
+    rebuilt = cache.load(US_KEYMAP);
+    expect(rebuilt && !rebuilt->from_cache(), "an empty entry is compiled again");
+
+    // A context that also searches another directory compiles from other data
+    struct xkb_context* other_data = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    xkb_context_include_path_append(other_data, directory.c_str());
+    KeymapCache other(other_data, directory + "/keymaps");
+    rebuilt = other.load(US_KEYMAP);
+    expect(rebuilt && !rebuilt->from_cache(), "an entry compiled from different XKB data is stale");
+    rebuilt.reset();
+    xkb_context_unref(other_data);
+
+    auto again = cache.load(US_KEYMAP);
+    expect(again && !again->from_cache(), "which the original data then rebuilds in turn");
+    again = cache.load(US_KEYMAP);
+    expect(again && again->from_cache(), "and maps from then on");
+}
+
+void test_no_directory(struct xkb_context* context) {
+    KeymapCache cache(context, "");
+    auto first = cache.load(US_KEYMAP);
+    auto second = cache.load(US_KEYMAP);
+    expect(first && second && !second->from_cache(), "without a directory every load compiles");
+    expect(!cache.load("xkb_keymap { not a keymap"), "a source that does not compile gives nothing");
+}
+
+} // namespace
+
+int main() {
+    TempDir temp("hypr-remote-keymaps");
+    if (!temp) {
+        std::cerr << "Failed to create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string& directory = temp.path();
+
+    struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!context) {
+        std::cerr << "Failed to create xkb context" << std::endl;
+        return 1;
+    }
+
+    test_cold_then_warm(context, directory);
+    test_rebuilds(context, directory);
+    test_no_directory(context);
+    xkb_context_unref(context);
+
+    return finish_checks();
+}
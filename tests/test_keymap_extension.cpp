@@ -0,0 +1,203 @@
+// Keymap extension: keysyms outside the keymap get spare keycodes that the
+// extended keymap really binds, slots are reused least recently used first but
+// never while held, and a burst of new keysyms costs one keymap upload, sent
+// ahead of the keys that need it. An upload never written still has its fd
+// closed.
+
+#include "keymap_cache.h"
+#include "keymap_extension.h"
+#include "output_scheduler.h"
+#include "recording_backend.h"
+#include "check.h"
+#include "temp_dir.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+const char* US_KEYMAP =
+    "xkb_keymap {\n"
+    "xkb_keycodes  { include \"evdev+aliases(qwerty)\" };\n"
+    "xkb_types     { include \"complete\" };\n"
+    "xkb_compat    { include \"complete\" };\n"
+    "xkb_symbols   { include \"pc+us+inet(evdev)\" };\n"
+    "};\n";
+
+// Keysyms no US key produces
+const xkb_keysym_t GRINNING = 0x1001f600;  // U+1F600
+const xkb_keysym_t ALEPH = 0x10005d0;      // U+05D0
+const xkb_keysym_t SNOWMAN = 0x1002603;    // U+2603
+
+std::unique_ptr<CompiledKeymap> compile(struct xkb_context* context, const std::string& text) {
+    return CompiledKeymap::compile(context, text);
+}
+
+void test_bindings(struct xkb_context* context, const CompiledKeymap& us) {
+    KeymapExtension extension(us.text());
+    expect(extension.usable(), "the US keymap has spare keycodes");
+    expect(us.find(GRINNING) == nullptr, "the US keymap cannot type an emoji");
+
+    uint32_t grinning = 0, aleph = 0, again = 0;
+    expect(extension.assign(GRINNING, grinning) == KeymapExtension::Result::REBOUND && extension.stale(),
+           "a new keysym is bound to a slot, pending an upload");
+    expect(grinning + 8 <= 255, "slots come from the range X11 clients see");
+    extension.assign(ALEPH, aleph);
+    expect(aleph != grinning, "another keysym gets another slot");
+    expect(extension.assign(GRINNING, again) == KeymapExtension::Result::BOUND && again == grinning,
+           "a bound keysym keeps its slot");
+
+    uint32_t size = 0;
+    int fd = extension.commit(size);
+    expect(fd >= 0 && size > us.text().size() && !extension.stale(), "the extended keymap is committed");
+    if (fd >= 0) close(fd);
+
+    auto extended = compile(context, extension.text());
+    expect(extended != nullptr, "the extended keymap compiles");
+    if (!extended) return;
+    const CompiledKeymap::Entry* entry = extended->find(GRINNING);
+    expect(entry && entry->keycode == grinning && entry->level == 0, "the slot types its keysym on level one");
+    entry = extended->find(ALEPH);
+    expect(entry && entry->keycode == aleph, "every bound slot is in the keymap");
+    entry = extended->find(XKB_KEY_a);
+    const CompiledKeymap::Entry* original = us.find(XKB_KEY_a);
+    expect(entry && original && entry->keycode == original->keycode, "the rest of the keymap is untouched");
+}
+
+void test_lru(const CompiledKeymap& us) {
+    KeymapExtension extension(us.text());
+    uint32_t size = 0, first = 0, keycode = 0;
+
+    // Fill every slot, uploading as the portal would
+    for (size_t i = 0; i < KeymapExtension::SLOT_COUNT; i++) {
+        extension.assign(0x1000100 + i, keycode);
+        if (i == 0) first = keycode;
+    }
+    close(extension.commit(size));
+    expect(extension.slots_bound() == KeymapExtension::SLOT_COUNT, "every slot is bound");
+
+    // Touch the oldest so the second oldest goes instead; hold that one down
+    extension.assign(0x1000100, keycode);
+    uint32_t second = 0;
+    extension.assign(0x1000101, second);
+    extension.key_state(second, true);
+
+    uint32_t rebound = 0;
+    expect(extension.assign(SNOWMAN, rebound) == KeymapExtension::Result::REBOUND, "a full table rebinds a slot");
+    expect(rebound != first && rebound != second, "recently used and held slots are kept");
+    uint32_t third = 0;
+    expect(extension.assign(0x1000102, third) == KeymapExtension::Result::REBOUND && third != rebound,
+           "the least recently used keysym lost its slot");
+
+    // With every free slot bound since the last upload, the table must go out first
+    for (size_t i = 0; i < KeymapExtension::SLOT_COUNT; i++) {
+        if (extension.assign(0x1000200 + i, keycode) == KeymapExtension::Result::STALE) {
+            expect(i == KeymapExtension::SLOT_COUNT - 3, "slots bound since the upload are not rebound before it");
+            break;
+        }
+    }
+    close(extension.commit(size));
+    expect(extension.assign(0x1000300, keycode) == KeymapExtension::Result::REBOUND && keycode != second,
+           "after the upload they can be");
+}
+
+void test_burst() {
+    RequestLog log;
+    RecordingVirtualKeyboard keyboard(log);
+
+    // One batch of input, as the portal applies queued Notify* calls
+    const xkb_keysym_t burst[] = { GRINNING, ALEPH, SNOWMAN, 0x10003bb /* λ */, 0x1000416 /* Ж */ };
+    keyboard.begin_deferred_flush();
+    keyboard.send_modifiers(1, 0, 0, 0);
+    for (xkb_keysym_t keysym : burst) {
+        keyboard.send_keysym(0, keysym, 1);
+        keyboard.send_keysym(0, keysym, 0);
+    }
+    keyboard.send_keysym(0, XKB_KEY_a, 1);
+    keyboard.end_deferred_flush();
+
+    size_t keymap_at = log.entries.size(), first_key = log.entries.size();
+    for (size_t i = 0; i < log.entries.size(); i++) {
+        WaylandRequest request = log.entries[i].request;
+        if (request == WaylandRequest::KeyboardKeymap && keymap_at == log.entries.size()) keymap_at = i;
+        if (request == WaylandRequest::KeyboardKey && first_key == log.entries.size()) first_key = i;
+    }
+    expect(log.count(WaylandRequest::KeyboardKeymap) == 1, "a burst of new keysyms is one keymap upload");
+    expect(keymap_at < first_key, "the keymap goes out before the keys that need it");
+    expect(log.count(WaylandRequest::KeyboardKey) == 11 && log.flushes() == 1, "every key follows in one flush");
+    expect(keymap_at + 1 < log.entries.size() && log.entries[keymap_at + 1].request == WaylandRequest::KeyboardModifiers &&
+           log.entries[keymap_at + 1].args[0] == 1, "the modifiers in effect are restored after the upload");
+
+    // Known keysyms cost nothing more; a new one outside a batch is uploaded at once
+    keyboard.send_keysym(0, GRINNING, 1);
+    keyboard.send_keysym(0, GRINNING, 0);
+    expect(log.count(WaylandRequest::KeyboardKeymap) == 1, "a bound keysym needs no upload");
+    keyboard.send_keysym(0, 0x10020ac /* € */, 1);
+    expect(log.count(WaylandRequest::KeyboardKeymap) == 2 && log.entries.back().request == WaylandRequest::Flush,
+           "a new keysym on its own is uploaded with its key");
+
+    // More new keysyms in one batch than there are slots
+    size_t before = log.count(WaylandRequest::KeyboardKeymap);
+    keyboard.begin_deferred_flush();
+    for (size_t i = 0; i < KeymapExtension::SLOT_COUNT + 4; i++) {
+        keyboard.send_keysym(0, 0x1000400 + i, 1);
+        keyboard.send_keysym(0, 0x1000400 + i, 0);
+    }
+    keyboard.end_deferred_flush();
+    expect(log.count(WaylandRequest::KeyboardKeymap) == before + 2,
+           "a batch wider than the slots uploads once more, before any slot is reused");
+}
+
+size_t open_fds() {
+    size_t count = 0;
+    for ([[maybe_unused]] const auto& entry : std::filesystem::directory_iterator("/proc/self/fd")) count++;
+    return count;
+}
+
+// An upload still queued in the output scheduler holds a duplicate of the
+// keymap's fd, which stopping the scheduler closes instead of leaking
+void test_queued_upload() {
+    RequestLog log;
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    DevicePair stand_ins = scheduler.attach(
+        "keymaps", DevicePair(std::make_unique<RecordingVirtualPointer>(log), std::make_unique<RecordingVirtualKeyboard>(log)));
+
+    size_t before = open_fds();
+    stand_ins.keyboard->send_keysym(0, GRINNING, 1);
+    expect(open_fds() == before + 1, "a queued upload holds the keymap's fd");
+    scheduler.stop();
+    expect(open_fds() == before, "stopping closes the fd of an upload never written");
+
+    scheduler.detach(std::move(stand_ins));
+    expect(log.count(WaylandRequest::KeyboardKeymap) == 0 && log.count(WaylandRequest::KeyboardKey) == 1,
+           "the rest is written on detach, without the released upload");
+}
+
+} // namespace
+
+int main() {
+    TempDir temp("hypr-remote-keymap-extension");
+    if (!temp) {
+        std::cerr << "Failed to create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string& directory = temp.path();
+    setenv("XDG_CACHE_HOME", directory.c_str(), 1);
+    std::cout.setstate(std::ios::failbit);
+
+    struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    auto us = compile(context, US_KEYMAP);
+    expect(us != nullptr, "the US keymap compiles");
+    if (us) {
+        test_bindings(context, *us);
+        test_lru(*us);
+    }
+    test_burst();
+    test_queued_upload();
+    xkb_context_unref(context);
+
+    return finish_checks();
+}
@@ -0,0 +1,309 @@
+// Output scheduler: a flooding session gets no more than its quantum per round,
+// even after being held for a while, motion and scroll over the rate limit are
+// merged instead of dropped, keys and buttons are never held, detaching writes
+// out whatever is still queued, the flush window batches several sessions'
+// frames into one flush, and sessions sharing one device pair keep their frames
+// apart.
+
+#include "portal.h"
+#include "output_scheduler.h"
+#include "recording_backend.h"
+#include "check.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+// A session's recording devices behind the scheduler
+struct Client {
+    RequestLog log;
+    DevicePair stand_ins;
+    InputTarget target{};
+    const WaylandVirtualPointer* real_pointer;
+
+    Client(OutputScheduler& scheduler, const char* name) {
+        DevicePair devices(std::make_unique<RecordingVirtualPointer>(log), std::make_unique<RecordingVirtualKeyboard>(log));
+        real_pointer = devices.pointer.get();
+        stand_ins = scheduler.attach(name, std::move(devices));
+        target.pointer = stand_ins.pointer.get();
+        target.keyboard = stand_ins.keyboard.get();
+    }
+
+    // Sum of a wl_fixed argument over every recorded `request`
+    int64_t sum(WaylandRequest request, size_t arg) const {
+        int64_t total = 0;
+        for (const auto& entry : log.entries) {
+            if (entry.request == request) total += int32_t(entry.args[arg]);
+        }
+        return total;
+    }
+};
+
+void drain(OutputScheduler& scheduler) {
+    while (scheduler.dispatch_round()) {}
+}
+
+void test_round_robin() {
+    OutputScheduler::Limits limits;
+    limits.quantum = 4;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client flood(scheduler, "flood");
+    Client quiet(scheduler, "quiet");
+
+    for (int i = 0; i < 100; i++) {
+        portal.notify_pointer_button(flood.target, BTN_LEFT, i % 2);
+    }
+    for (int i = 0; i < 3; i++) {
+        portal.notify_keyboard_keycode(quiet.target, KEY_A, 1);
+    }
+
+    scheduler.dispatch_round();
+    expect(quiet.log.count(WaylandRequest::KeyboardKey) == 3, "the quiet session is served in the first round");
+    expect(flood.log.count(WaylandRequest::PointerButton) == 4, "the flooding session gets one quantum per round");
+
+    drain(scheduler);
+    expect(flood.log.count(WaylandRequest::PointerButton) == 100, "the flood is written in full over later rounds");
+    expect(flood.log.flushes() > 0 && quiet.log.flushes() == 1, "each round flushes the devices it wrote to");
+
+    scheduler.detach(std::move(flood.stand_ins));
+    scheduler.detach(std::move(quiet.stand_ins));
+}
+
+void test_motion_limit() {
+    OutputScheduler::Limits limits;
+    limits.motion_rate = 50;
+    limits.motion_burst = 2;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client client(scheduler, "fast");
+
+    for (int i = 0; i < 20; i++) {
+        portal.notify_pointer_motion(client.target, 1.0, -1.0);
+        scheduler.dispatch_round();
+    }
+    size_t written = client.log.count(WaylandRequest::PointerMotion);
+    expect(written >= 2 && written < 10, "motion beyond the burst is held");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    drain(scheduler);
+    expect(client.sum(WaylandRequest::PointerMotion, 0) == 20 * 256 &&
+           client.sum(WaylandRequest::PointerMotion, 1) == -20 * 256,
+           "held motion is merged, not dropped");
+    expect(client.log.count(WaylandRequest::PointerMotion) == client.log.count(WaylandRequest::PointerFrame),
+           "every merged motion keeps its frame");
+
+    OutputScheduler::Stats stats;
+    scheduler.detach(std::move(client.stand_ins), &stats);
+    expect(stats.throttled > 0 && stats.merged > 0, "holds and merges are counted");
+    expect(stats.frames == client.log.count(WaylandRequest::PointerFrame), "written frames are counted");
+}
+
+void test_scroll_limit() {
+    OutputScheduler::Limits limits;
+    limits.scroll_rate = 1;
+    limits.scroll_burst = 1;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client client(scheduler, "wheel");
+
+    for (int i = 0; i < 10; i++) {
+        portal.notify_pointer_axis(client.target, 2.0, 0.0);
+        scheduler.dispatch_round();
+    }
+    expect(client.log.count(WaylandRequest::PointerAxis) == 1, "scroll beyond the burst is held");
+
+    scheduler.detach(std::move(client.stand_ins));
+    expect(client.log.count(WaylandRequest::PointerAxis) == 2 &&
+           client.sum(WaylandRequest::PointerAxis, 1) == 10 * 2 * 256,
+           "held scroll values are summed and written on detach");
+}
+
+void test_exempt_input() {
+    OutputScheduler::Limits limits;
+    limits.motion_rate = 1;
+    limits.motion_burst = 1;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client client(scheduler, "clicker");
+
+    portal.notify_pointer_motion(client.target, 5.0, 0.0);
+    portal.notify_pointer_motion(client.target, 5.0, 0.0); // merged into the first
+    scheduler.dispatch_round();
+    portal.notify_pointer_motion(client.target, 3.0, 0.0);
+    scheduler.dispatch_round();
+    expect(client.log.count(WaylandRequest::PointerMotion) == 1, "motion over the limit is held");
+
+    // The click must land where the pointer was moved to
+    portal.notify_pointer_button(client.target, BTN_LEFT, 1);
+    for (int i = 0; i < 10; i++) {
+        portal.notify_keyboard_keycode(client.target, KEY_B, i % 2);
+    }
+    scheduler.dispatch_round();
+    const auto& entries = client.log.entries;
+    size_t button = 0;
+    while (button < entries.size() && entries[button].request != WaylandRequest::PointerButton) button++;
+    expect(button < entries.size() && button >= 2 && entries[button - 2].request == WaylandRequest::PointerMotion &&
+           int32_t(entries[button - 2].args[0]) == 3 * 256,
+           "a held motion is released ahead of the button behind it");
+    expect(client.log.count(WaylandRequest::KeyboardKey) == 10, "keys are never rate limited");
+
+    OutputScheduler::Stats stats;
+    DevicePair devices = scheduler.detach(std::move(client.stand_ins), &stats);
+    expect(stats.released == 1, "the early release is counted");
+    expect(devices.pointer.get() == client.real_pointer, "detach hands back the real devices");
+}
+
+// Rounds spent holding a frame do not build up credit for later
+void test_release_after_hold() {
+    OutputScheduler::Limits limits;
+    limits.quantum = 4;
+    limits.motion_rate = 1;
+    limits.motion_burst = 1;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client client(scheduler, "held");
+
+    portal.notify_pointer_motion(client.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    portal.notify_pointer_motion(client.target, 1.0, 0.0);
+    for (int i = 0; i < 50; i++) {
+        scheduler.dispatch_round();
+    }
+    expect(client.log.count(WaylandRequest::PointerMotion) == 1, "the second motion is held for many rounds");
+
+    for (int i = 0; i < 20; i++) {
+        portal.notify_keyboard_keycode(client.target, KEY_A, i % 2);
+    }
+    scheduler.dispatch_round();
+    expect(client.log.count(WaylandRequest::PointerMotion) == 2 && client.log.count(WaylandRequest::KeyboardKey) == 3,
+           "a flow released after a long hold gets one quantum in its round");
+
+    drain(scheduler);
+    expect(client.log.count(WaylandRequest::KeyboardKey) == 20, "the rest follows in later rounds");
+    scheduler.detach(std::move(client.stand_ins));
+}
+
+void test_output_thread() {
+    OutputScheduler::Limits limits;
+    limits.motion_rate = 200;
+    limits.motion_burst = 1;
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client client(scheduler, "threaded");
+    scheduler.start();
+
+    for (int i = 0; i < 1000; i++) {
+        portal.notify_pointer_motion(client.target, 1.0, 0.0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    scheduler.detach(std::move(client.stand_ins));
+    scheduler.stop();
+
+    expect(client.sum(WaylandRequest::PointerMotion, 0) == 1000 * 256, "the output thread writes every delta");
+    expect(client.log.count(WaylandRequest::PointerMotion) < 100, "the output thread merges over-rate motion");
+}
+
+void test_flush_window() {
+    OutputScheduler::Limits limits;
+    limits.flush_window = std::chrono::milliseconds(20);
+    OutputScheduler scheduler(limits);
+    Portal portal;
+    Client a(scheduler, "a");
+    Client b(scheduler, "b");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(a.log.flushes() == 1 && !scheduler.flush_pending(), "with one session sending, every round flushes");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    portal.notify_pointer_motion(b.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(a.log.flushes() == 2 && b.log.flushes() == 1, "a round with every active session in it flushes");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(a.log.count(WaylandRequest::PointerMotion) == 3 && a.log.flushes() == 2 && scheduler.flush_pending(),
+           "one session's frame waits for the others'");
+    portal.notify_pointer_motion(b.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(a.log.flushes() == 3 && b.log.flushes() == 2 && !scheduler.flush_pending(),
+           "the other session's frame closes the window, one flush for both");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(scheduler.flush_pending(), "the next motion opens a window again");
+    portal.notify_pointer_button(a.target, BTN_LEFT, 1);
+    scheduler.dispatch_round();
+    expect(a.log.flushes() == 4 && !scheduler.flush_pending(), "a button ends the window early");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    expect(!scheduler.dispatch_round() && scheduler.flush_pending(), "an open window is not flushed before its time");
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    expect(scheduler.dispatch_round() && a.log.flushes() == 5 && !scheduler.flush_pending(),
+           "the window flushes when it runs out");
+
+    portal.notify_keyboard_keycode(b.target, KEY_A, 1);
+    scheduler.dispatch_round();
+    expect(b.log.flushes() == 3, "a key ends the window early");
+
+    portal.notify_pointer_motion(a.target, 1.0, 0.0);
+    scheduler.dispatch_round();
+    scheduler.detach(std::move(a.stand_ins));
+    expect(a.log.flushes() == 6 && !scheduler.flush_pending(), "detaching flushes what waits for the window");
+    scheduler.detach(std::move(b.stand_ins));
+}
+
+// Two sessions on the shared devices, each with a flow alongside the shared one:
+// a frame one of them finishes never ships the other's half-sent motion
+void test_shared_devices() {
+    OutputScheduler scheduler(OutputScheduler::Limits{});
+    Client shared(scheduler, "shared");
+    DevicePair stand_ins_a = scheduler.attach_alongside("a", shared.stand_ins.pointer.get());
+    DevicePair stand_ins_b = scheduler.attach_alongside("b", shared.stand_ins.pointer.get());
+    expect(stand_ins_a && stand_ins_b, "flows attach alongside the shared devices");
+    expect(!scheduler.attach_alongside("c", nullptr), "nothing attaches alongside an unknown flow");
+
+    stand_ins_a.pointer->send_motion(0, 1.0, 0.0);
+    stand_ins_b.pointer->send_motion(0, 2.0, 0.0);
+    stand_ins_b.pointer->send_frame();
+    drain(scheduler);
+    expect(shared.log.count(WaylandRequest::PointerMotion) == 1 && shared.sum(WaylandRequest::PointerMotion, 0) == wl_fixed_from_double(2.0),
+           "one session's frame leaves the other's open frame alone");
+
+    stand_ins_a.pointer->send_frame();
+    drain(scheduler);
+    expect(shared.log.count(WaylandRequest::PointerMotion) == 2 && shared.log.count(WaylandRequest::PointerFrame) == 2,
+           "each frame reaches the shared devices whole");
+    expect(shared.log.flushes() > 0, "the shared devices are flushed");
+
+    stand_ins_b.keyboard->send_key(0, KEY_A, 1);
+    expect(!scheduler.detach(std::move(stand_ins_b)), "a flow alongside hands back no devices");
+    expect(shared.log.count(WaylandRequest::KeyboardKey) == 1, "detaching writes out the rest to the shared devices");
+    scheduler.detach(std::move(stand_ins_a));
+    scheduler.detach(std::move(shared.stand_ins));
+}
+
+} // namespace
+
+int main() {
+    std::cout.setstate(std::ios::failbit);
+
+    test_round_robin();
+    test_motion_limit();
+    test_scroll_limit();
+    test_exempt_input();
+    test_release_after_hold();
+    test_output_thread();
+    test_flush_window();
+    test_shared_devices();
+
+    return finish_checks("Output scheduler checks passed");
+}
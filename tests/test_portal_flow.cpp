@@ -0,0 +1,216 @@
+// Portal flows: a flow moves between a control thread and the thread that
+// drains completions, a flow waiting on the control thread leaves it to the
+// others, and a flow whose job is dropped, or that throws, frees what it held;
+// with a FlowExit, on the thread it ends on and after answering its call.
+
+#include "portal_flow.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A job queue, run by a thread of its own or drained by the test
+class Queue {
+public:
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
+
+    // Run jobs until stop(), or until the queue is empty when `drain` is set
+    void run(bool drain = false) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (!drain) ready.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) break;
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_one();
+    }
+
+    void clear() {
+        std::deque<std::function<void()>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(jobs);
+        }
+    }
+
+    Hop hop() {
+        return Hop{ [this](ResumeJob resume) { post(std::move(resume)); } };
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+};
+
+// Counts the flows whose frame is gone
+struct Guard {
+    std::atomic<int>& released;
+    ~Guard() { released++; }
+};
+
+struct Trace {
+    std::thread::id started, control, finished;
+    bool done = false;
+};
+
+PortalFlow hop_around(Queue& control, Queue& bus, Trace& trace) {
+    trace.started = std::this_thread::get_id();
+    co_await control.hop();
+    trace.control = std::this_thread::get_id();
+    co_await bus.hop();
+    trace.finished = std::this_thread::get_id();
+    trace.done = true;
+}
+
+void test_hops() {
+    Queue control, bus;
+    std::thread control_thread([&]() { control.run(); });
+    std::thread::id control_id = control_thread.get_id();
+
+    Trace trace;
+    hop_around(control, bus, trace);
+    expect(!trace.done, "a flow returns to its caller at its first hop");
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!trace.done && std::chrono::steady_clock::now() < deadline) {
+        bus.run(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    control.stop();
+    control_thread.join();
+
+    expect(trace.done, "the flow finishes once its jobs have run");
+    expect(trace.started == std::this_thread::get_id() && trace.control == control_id,
+           "it starts on the caller's thread and continues on the control thread");
+    expect(trace.finished == std::this_thread::get_id(), "and ends on the thread draining completions");
+}
+
+// Re-posts itself on the control queue until `ready`, as Portal::control_until does
+PortalFlow wait_for_flag(Queue& control, std::atomic<bool>& ready, std::vector<int>& order, int id) {
+    co_await control.hop();
+    while (!ready) {
+        co_await control.hop();
+    }
+    order.push_back(id);
+}
+
+PortalFlow set_flag(Queue& control, std::atomic<bool>& ready, std::vector<int>& order, int id) {
+    co_await control.hop();
+    order.push_back(id);
+    ready = true;
+}
+
+void test_waiting_flows() {
+    Queue control;
+    std::vector<int> order;
+    std::atomic<bool> ready{false};
+
+    // The first flow waits for the last: with one control thread, only a
+    // waiter that gives the thread back lets the others through
+    wait_for_flag(control, ready, order, 0);
+    for (int i = 1; i < 64; i++) set_flag(control, ready, order, i);
+    control.run(true);
+
+    expect(order.size() == 64, "every flow finishes");
+    expect(!order.empty() && order.back() == 0, "the waiting flow lets the later ones through, then goes on");
+}
+
+PortalFlow held_across_a_hop(Queue& control, std::atomic<int>& released, bool& resumed) {
+    Guard guard{ released };
+    co_await control.hop();
+    resumed = true;
+}
+
+PortalFlow throws_on_control(Queue& control, std::atomic<int>& released) {
+    Guard guard{ released };
+    co_await control.hop();
+    throw std::runtime_error("setup failed");
+}
+
+void test_dropped_and_failed() {
+    std::atomic<int> released{0};
+    bool resumed = false;
+    {
+        Queue control;
+        held_across_a_hop(control, released, resumed);
+        expect(released == 0, "a suspended flow keeps what it holds");
+        control.clear();
+    }
+    expect(!resumed && released == 1, "a flow whose job is dropped is destroyed, not leaked");
+
+    Queue control;
+    throws_on_control(control, released);
+    control.run(true);
+    expect(released == 2, "a flow that throws is logged and freed");
+}
+
+// Ends on `bus` once it has set `answered` on failure, as the portal's flows
+// do; `held` stands for the call, which lives in the frame until it ends
+PortalFlow exits_on_bus(Queue& control, Queue& bus, [[maybe_unused]] std::shared_ptr<Guard> held, bool& answered, bool fail) {
+    co_await FlowExit{ bus.hop().post, [&answered]() { answered = true; } };
+    co_await control.hop();
+    if (fail) throw std::runtime_error("setup failed");
+}
+
+void test_exit() {
+    std::atomic<int> released{0};
+    bool answered = false;
+    Queue control, bus;
+
+    exits_on_bus(control, bus, std::shared_ptr<Guard>(new Guard{ released }), answered, true);
+    control.run(true);
+    expect(released == 0 && !answered, "a flow that throws on the control thread is not freed there");
+    bus.run(true);
+    expect(released == 1 && answered, "it answers its call and is freed on the bus");
+
+    answered = false;
+    exits_on_bus(control, bus, std::shared_ptr<Guard>(new Guard{ released }), answered, false);
+    control.run(true);
+    expect(released == 1, "a flow that returns on the control thread is not freed there either");
+    bus.run(true);
+    expect(released == 2 && !answered, "it is freed on the bus without a failure");
+
+    exits_on_bus(control, bus, std::shared_ptr<Guard>(new Guard{ released }), answered, false);
+    control.clear();
+    expect(released == 3 && answered, "a flow whose job is dropped answers as failed");
+}
+
+} // namespace
+
+int main() {
+    test_hops();
+    test_waiting_flows();
+    test_dropped_and_failed();
+    test_exit();
+
+    return finish_checks();
+}
@@ -0,0 +1,226 @@
+// Wayland request budgets: each scripted input sequence must produce exactly the
+// expected number of virtual-pointer/keyboard requests and display flushes.
+// Any change that amplifies requests (or flushes) fails here.
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "recording_backend.h"
+#include "eis_pair.h"
+#include "ei_pair.h"
+#include "check.h"
+#include <functional>
+#include <iostream>
+#include <string>
+#include <xkbcommon/xkbcommon.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+struct Budget {
+    size_t requests;
+    size_t flushes;
+};
+
+struct Harness {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+    LibEIHandler handler;
+    Portal portal;
+
+    Harness() {
+        handler.pointer = &pointer;
+        handler.keyboard = &keyboard;
+        portal.set_libei_handler(&handler);
+    }
+};
+
+void check(const std::string& name, const RequestLog& log, Budget budget) {
+    size_t requests = log.requests();
+    size_t flushes = log.flushes();
+    if (requests != budget.requests || flushes != budget.flushes) {
+        std::cerr << "FAIL " << name << ": " << requests << " requests / " << flushes
+                  << " flushes, budget is " << budget.requests << " / " << budget.flushes << std::endl;
+        failures++;
+    } else {
+        std::cerr << "ok   " << name << ": " << requests << " requests / " << flushes << " flushes" << std::endl;
+    }
+}
+
+void fail(const std::string& name, const char* why) {
+    std::cerr << "FAIL " << name << ": " << why << std::endl;
+    failures++;
+}
+
+// Each EIS scenario emits on a connected client and delivers `events` server-side
+// events (input plus frames) to Portal::handle_eis_event
+struct EisScenario {
+    const char* name;
+    size_t events;
+    std::function<void(EisTestPair&)> script;
+    Budget budget;
+};
+
+void run_eis_scenarios() {
+    const EisScenario scenarios[] = {
+        { "eis pointer motion", 2, [](EisTestPair& p) { p.motion(3.0, -2.0); }, { 2, 1 } },
+        { "eis absolute motion", 2, [](EisTestPair& p) { p.motion_absolute(100.0, 200.0); }, { 2, 1 } },
+        { "eis button click", 4, [](EisTestPair& p) { p.button(BTN_LEFT, true); p.button(BTN_LEFT, false); }, { 4, 2 } },
+        { "eis scroll delta (one axis)", 2, [](EisTestPair& p) { p.scroll(0.0, 1.0); }, { 3, 1 } },
+        { "eis scroll delta (both axes)", 2, [](EisTestPair& p) { p.scroll(1.0, 1.0); }, { 4, 1 } },
+        { "eis scroll discrete", 2, [](EisTestPair& p) { p.scroll_discrete(0, 120); }, { 3, 1 } },
+        { "eis key press", 2, [](EisTestPair& p) { p.key(KEY_A, true); }, { 1, 1 } },
+        { "eis ctrl+c", 8, [](EisTestPair& p) {
+              p.key(KEY_LEFTCTRL, true); p.key(KEY_C, true);
+              p.key(KEY_C, false); p.key(KEY_LEFTCTRL, false);
+          }, { 6, 6 } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        EisTestPair pair([&h](struct eis_event* event) { h.portal.handle_eis_event(h.portal.shared_target(), event); });
+        if (!pair.connect()) {
+            fail(scenario.name, "EIS handshake failed");
+            continue;
+        }
+
+        h.log.clear();
+        scenario.script(pair);
+        if (!pair.deliver(scenario.events)) {
+            fail(scenario.name, "EIS events did not arrive");
+            continue;
+        }
+        check(scenario.name, h.log, scenario.budget);
+    }
+}
+
+// EI scenarios go through LibEIHandler::handle_event; `events` counts input
+// events plus frames as seen by the receiver
+struct EiScenario {
+    const char* name;
+    size_t events;
+    std::function<void(EiTestPair&)> script;
+    Budget budget;
+};
+
+void run_ei_scenarios() {
+    const EiScenario scenarios[] = {
+        { "ei pointer motion", 2, [](EiTestPair& p) { p.motion(3.0, -2.0); }, { 2, 1 } },
+        { "ei button click", 4, [](EiTestPair& p) { p.button(BTN_LEFT, true); p.button(BTN_LEFT, false); }, { 4, 2 } },
+        { "ei scroll delta (both axes)", 2, [](EiTestPair& p) { p.scroll(1.0, 1.0); }, { 4, 1 } },
+        { "ei scroll discrete", 2, [](EiTestPair& p) { p.scroll_discrete(0, 120); }, { 3, 1 } },
+        { "ei key press", 2, [](EiTestPair& p) { p.key(KEY_A, true); }, { 1, 1 } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        EiTestPair pair([&h](struct ei_event* event) { h.handler.handle_event(event); });
+        if (!pair.connect()) {
+            fail(scenario.name, "EI handshake failed");
+            continue;
+        }
+
+        h.log.clear();
+        scenario.script(pair);
+        if (!pair.deliver(scenario.events)) {
+            fail(scenario.name, "EI events did not arrive");
+            continue;
+        }
+        check(scenario.name, h.log, scenario.budget);
+    }
+}
+
+// Notify* scenarios call the forwarding behind each D-Bus method
+struct NotifyScenario {
+    const char* name;
+    std::function<void(Portal&, InputTarget&)> script;
+    Budget budget;
+};
+
+void run_notify_scenarios() {
+    const NotifyScenario scenarios[] = {
+        { "notify pointer motion", [](Portal& p, InputTarget& t) { p.notify_pointer_motion(t, 3.0, -2.0); }, { 2, 1 } },
+        { "notify pointer button", [](Portal& p, InputTarget& t) {
+              p.notify_pointer_button(t, BTN_LEFT, 1); p.notify_pointer_button(t, BTN_LEFT, 0);
+          }, { 4, 2 } },
+        { "notify keyboard keycode", [](Portal& p, InputTarget& t) { p.notify_keyboard_keycode(t, KEY_A, 1); }, { 1, 1 } },
+        { "notify keyboard keysym", [](Portal& p, InputTarget& t) { p.notify_keyboard_keysym(t, XKB_KEY_a, 1); }, { 1, 1 } },
+        { "notify keyboard keysym (shifted)", [](Portal& p, InputTarget& t) { p.notify_keyboard_keysym(t, XKB_KEY_A, 1); }, { 2, 1 } },
+        { "notify pointer axis (one axis)", [](Portal& p, InputTarget& t) { p.notify_pointer_axis(t, 0.0, 10.0); }, { 3, 1 } },
+        { "notify pointer axis (both axes)", [](Portal& p, InputTarget& t) { p.notify_pointer_axis(t, 10.0, 10.0); }, { 4, 1 } },
+        { "notify motion burst", [](Portal& p, InputTarget& t) {
+              for (int i = 0; i < 10; i++) p.notify_pointer_motion(t, 1.0, 1.0);
+          }, { 20, 10 } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        scenario.script(h.portal, h.portal.shared_target());
+        check(scenario.name, h.log, scenario.budget);
+    }
+}
+
+// Queued Notify* calls as the D-Bus loop applies them after draining the bus
+void run_queued_notify_scenarios() {
+    using Q = Portal::QueuedInput;
+    const NotifyScenario scenarios[] = {
+        { "queued motion burst", [](Portal& p, InputTarget& t) {
+              for (int i = 0; i < 10; i++) p.queue_input({ Q::POINTER_MOTION, &t, 1.0, 1.0 });
+          }, { 2, 1 } },
+        { "queued motion around a click", [](Portal& p, InputTarget& t) {
+              p.queue_input({ Q::POINTER_MOTION, &t, 1.0, 1.0 });
+              p.queue_input({ Q::POINTER_MOTION, &t, 1.0, 1.0 });
+              p.queue_input({ Q::POINTER_BUTTON, &t, 0, 0, BTN_LEFT, 1 });
+              p.queue_input({ Q::POINTER_MOTION, &t, 1.0, 1.0 });
+              p.queue_input({ Q::POINTER_BUTTON, &t, 0, 0, BTN_LEFT, 0 });
+          }, { 8, 1 } },
+        { "queued typing", [](Portal& p, InputTarget& t) {
+              p.queue_input({ Q::KEYBOARD_KEYCODE, &t, 0, 0, KEY_A, 1 });
+              p.queue_input({ Q::KEYBOARD_KEYCODE, &t, 0, 0, KEY_A, 0 });
+              p.queue_input({ Q::POINTER_MOTION, &t, 1.0, 1.0 });
+          }, { 4, 2 } },
+    };
+
+    for (const auto& scenario : scenarios) {
+        Harness h;
+        scenario.script(h.portal, h.portal.shared_target());
+        h.portal.apply_queued_input();
+        check(scenario.name, h.log, scenario.budget);
+    }
+
+    // Motions only merge within one target, and click order is kept per target
+    Harness h;
+    RecordingVirtualPointer other_pointer(h.log);
+    RecordingVirtualKeyboard other_keyboard(h.log);
+    InputTarget other{ &other_pointer, &other_keyboard, {} };
+    InputTarget& shared = h.portal.shared_target();
+    h.portal.queue_input({ Q::POINTER_MOTION, &shared, 1.0, 0.0 });
+    h.portal.queue_input({ Q::POINTER_MOTION, &other, 0.0, 1.0 });
+    h.portal.queue_input({ Q::POINTER_MOTION, &shared, 1.0, 0.0 });
+    h.portal.queue_input({ Q::POINTER_MOTION, &other, 0.0, 1.0 });
+    h.portal.apply_queued_input();
+    check("queued motion from two sessions", h.log, { 4, 2 });
+
+    bool merged = h.log.entries.size() >= 2 && h.log.entries[0].request == WaylandRequest::PointerMotion &&
+        h.log.entries[0].args[0] == static_cast<uint32_t>(wl_fixed_from_double(2.0));
+    if (!merged) {
+        fail("queued motion from two sessions", "motion deltas were not summed per session");
+    }
+}
+
+} // namespace
+
+int main() {
+    // Keep the portal's per-event logging out of the test output
+    std::cout.setstate(std::ios::failbit);
+
+    run_eis_scenarios();
+    run_ei_scenarios();
+    run_notify_scenarios();
+    run_queued_notify_scenarios();
+
+    return finish_checks("All request budgets met", "budget(s) exceeded");
+}
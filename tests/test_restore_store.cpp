@@ -0,0 +1,108 @@
+// Restore tokens: a token restores once and only for the app it was issued
+// to, persistent grants survive a restart while transient ones do not, and a
+// damaged store file loads what it can instead of failing.
+
+#include "restore_store.h"
+#include "check.h"
+#include "temp_dir.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char* APP = "org.deskflow.deskflow";
+
+void test_single_use(const std::string& path) {
+    RestoreStore store(path);
+    expect(store.issue(APP, 3, RestoreStore::PERSIST_NONE).empty(), "no token without persist_mode");
+
+    std::string token = store.issue(APP, 3, RestoreStore::PERSIST_TRANSIENT);
+    expect(token.size() == 32, "a token is 128 random bits in hex");
+    expect(store.issue(APP, 3, RestoreStore::PERSIST_TRANSIENT) != token, "every token is new");
+
+    expect(!store.redeem(token, "org.example.other"), "another app cannot use the token");
+    auto grant = store.redeem(token, APP);
+    expect(grant && grant->types == 3 && grant->persist_mode == RestoreStore::PERSIST_TRANSIENT,
+           "the issuing app gets its selection back");
+    expect(!store.redeem(token, APP), "a token restores only once");
+    expect(!store.redeem("", APP), "an empty token restores nothing");
+}
+
+void test_persistence(const std::string& path) {
+    std::string persistent;
+    std::string transient;
+    {
+        RestoreStore store(path);
+        persistent = store.issue(APP, 1, RestoreStore::PERSIST_PERSISTENT);
+        transient = store.issue(APP, 2, RestoreStore::PERSIST_TRANSIENT);
+    }
+
+    struct stat st;
+    expect(stat(path.c_str(), &st) == 0 && (st.st_mode & 0777) == 0600, "the store is private to the user");
+
+    RestoreStore restarted(path);
+    expect(!restarted.redeem(transient, APP), "transient grants end with the portal");
+    auto grant = restarted.redeem(persistent, APP);
+    expect(grant && grant->types == 1, "persistent grants survive a restart");
+
+    RestoreStore again(path);
+    expect(!again.redeem(persistent, APP), "a redeemed grant is gone from disk too");
+
+    RestoreStore anonymous(path);
+    std::string token = anonymous.issue("", 7, RestoreStore::PERSIST_PERSISTENT);
+    RestoreStore reloaded(path);
+    expect(reloaded.redeem(token, "").has_value(), "clients without an app id keep their grants");
+}
+
+void test_damaged_file(const std::string& path) {
+    std::string token;
+    {
+        RestoreStore store(path);
+        token = store.issue(APP, 3, RestoreStore::PERSIST_PERSISTENT);
+    }
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "not a grant\n" << "0123 2 3 4 short-token\n";
+    }
+    RestoreStore damaged(path);
+    expect(damaged.size() == 1 && damaged.redeem(token, APP), "damaged lines are skipped");
+
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << "something else entirely\n";
+    }
+    RestoreStore foreign(path);
+    expect(foreign.size() == 0, "a file in another format loads nothing");
+    std::string fresh = foreign.issue(APP, 3, RestoreStore::PERSIST_PERSISTENT);
+    RestoreStore rewritten(path);
+    expect(rewritten.redeem(fresh, APP).has_value(), "and is replaced on the next write");
+}
+
+void test_bounded() {
+    RestoreStore store("");
+    for (size_t i = 0; i < RestoreStore::MAX_GRANTS + 10; i++) {
+        store.issue(APP, 3, RestoreStore::PERSIST_TRANSIENT);
+    }
+    expect(store.size() == RestoreStore::MAX_GRANTS, "the store keeps a bounded number of grants");
+}
+
+} // namespace
+
+int main() {
+    TempDir temp("hypr-remote-restore");
+    if (!temp) {
+        std::cerr << "Failed to create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string& directory = temp.path();
+
+    test_single_use(directory + "/single/restore-tokens");
+    test_persistence(directory + "/persist/restore-tokens");
+    test_damaged_file(directory + "/damaged/restore-tokens");
+    test_bounded();
+
+    return finish_checks();
+}
@@ -0,0 +1,179 @@
+// ScreenCast capture against a stub compositor: outputs are listed, the first
+// frame is copied whole, later frames only when something changed and only as
+// much as changed, and a capture stops when its stream goes or its output does.
+
+#include "screencopy.h"
+#include "stub_compositor.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+size_t area(const DamageRect& rect) {
+    return size_t(rect.width) * rect.height * FrameFormat::BYTES_PER_PIXEL;
+}
+
+// Writes frames into a pool of buffers in turn, the way a PipeWire stream does
+// while its consumer holds the others, copying into each only what changed
+// since it was last filled. Checks every filled buffer against the frame.
+class PoolSink : public FrameSink {
+public:
+    explicit PoolSink(size_t buffers) : pool(buffers), held(buffers, 0) {}
+
+    bool configure(const FrameFormat& format) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->format = format;
+        for (auto& buffer : pool) buffer.assign(size_t(format.stride) * format.height, 0);
+        std::fill(held.begin(), held.end(), 0);
+        configures++;
+        return true;
+    }
+
+    void deliver(const CaptureFrame& frame) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        history.add(frame);
+        size_t slot = next++ % pool.size();
+        history.since(held[slot], regions);
+        last_copied = copy_regions(frame, regions, pool[slot].data(), format.stride);
+        held[slot] = frame.sequence;
+        last_damage = frame.damage;
+
+        if (memcmp(pool[slot].data(), frame.data, pool[slot].size()) != 0) mismatches++;
+        latest.assign(reinterpret_cast<const uint32_t*>(frame.data),
+                      reinterpret_cast<const uint32_t*>(frame.data) + format.width * format.height);
+        frames++;
+    }
+
+    void end() override { ended = true; }
+
+    std::mutex mutex;
+    FrameFormat format;
+    int configures = 0;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<bool> ended{false};
+    size_t last_copied = 0;
+    std::vector<DamageRect> last_damage;
+    std::vector<uint32_t> latest;
+    int mismatches = 0;
+
+private:
+    std::vector<std::vector<uint8_t>> pool;
+    std::vector<uint64_t> held;
+    size_t next = 0;
+    DamageHistory history;
+    std::vector<DamageRect> regions;
+};
+
+void test_outputs() {
+    StubCompositor compositor;
+    Screencopy screencopy;
+    expect(screencopy.init(compositor.take_client_fd()), "screencopy connects to the stub compositor");
+
+    std::vector<Screencopy::Output> outputs = screencopy.outputs();
+    expect(outputs.size() == 1, "the stub's one output is listed");
+    if (outputs.size() == 1) {
+        expect(outputs[0].name == "STUB-1", "the output goes by its connector name");
+        expect(outputs[0].width == int32_t(StubCompositor::WIDTH) && outputs[0].height == int32_t(StubCompositor::HEIGHT),
+               "the output has its current mode's size");
+    }
+
+    compositor.remove_output();
+    expect(wait_for([&]() { return screencopy.outputs().empty(); }), "an unplugged output leaves the list");
+    screencopy.cleanup();
+}
+
+void test_damage_only() {
+    StubCompositor compositor;
+    compositor.paint({ 0, 0, StubCompositor::WIDTH, StubCompositor::HEIGHT }, 0x00202020);
+    Screencopy screencopy;
+    screencopy.init(compositor.take_client_fd());
+
+    auto owned = std::make_unique<PoolSink>(2);
+    PoolSink& sink = *owned;
+    std::unique_ptr<CaptureStream> stream = screencopy.start(screencopy.outputs().at(0).id, false, std::move(owned));
+    expect(stream != nullptr, "a capture starts on the output");
+    if (!stream) return;
+
+    expect(wait_for([&]() { return sink.frames == 1; }), "the first frame arrives without waiting for damage");
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        expect(sink.configures == 1 && sink.format.width == StubCompositor::WIDTH, "the sink is configured first");
+        expect(sink.last_copied == size_t(StubCompositor::WIDTH) * StubCompositor::HEIGHT * 4, "the first frame is copied whole");
+        expect(sink.latest == compositor.image(), "the first frame is the compositor's image");
+    }
+
+    expect(wait_for([&]() { return compositor.copies_waiting() == 1; }), "the next copy waits for damage");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    expect(sink.frames == 1 && compositor.frames_served() == 1, "an unchanged screen delivers no frames");
+
+    DamageRect a{ 10, 10, 8, 8 };
+    compositor.paint(a, 0x00ff0000);
+    expect(wait_for([&]() { return sink.frames == 2; }), "a change delivers a frame");
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        expect(sink.last_damage == std::vector<DamageRect>{ a }, "the frame carries the compositor's damage");
+        // The second buffer of the pool has never been filled
+        expect(sink.last_copied == size_t(StubCompositor::WIDTH) * StubCompositor::HEIGHT * 4,
+               "an empty pool buffer is filled whole");
+    }
+
+    DamageRect b{ 40, 30, 4, 4 };
+    compositor.paint(b, 0x0000ff00);
+    expect(wait_for([&]() { return sink.frames == 3; }), "another change delivers another frame");
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        expect(sink.last_copied == area(a) + area(b), "a buffer two frames behind gets both frames' damage only");
+    }
+
+    DamageRect c{ 0, 0, 2, 48 };
+    compositor.paint(c, 0x000000ff);
+    expect(wait_for([&]() { return sink.frames == 4; }), "a third change delivers a third frame");
+    {
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        expect(sink.last_copied == area(b) + area(c), "each buffer catches up on what it missed");
+        expect(sink.latest == compositor.image(), "the latest frame is the compositor's image");
+        expect(sink.mismatches == 0, "every buffer matches its frame after the partial copies");
+    }
+
+    stream.reset();
+    expect(wait_for([&]() { return compositor.copies_waiting() == 0; }), "a destroyed stream withdraws its copy");
+    compositor.paint(a, 0x00ffffff);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    expect(compositor.frames_served() == 4, "a destroyed stream gets no more frames");
+    screencopy.cleanup();
+}
+
+void test_output_removed() {
+    StubCompositor compositor;
+    Screencopy screencopy;
+    screencopy.init(compositor.take_client_fd());
+
+    auto owned = std::make_unique<PoolSink>(2);
+    PoolSink& sink = *owned;
+    std::unique_ptr<CaptureStream> stream = screencopy.start(screencopy.outputs().at(0).id, true, std::move(owned));
+    expect(wait_for([&]() { return sink.frames == 1; }), "a cursor-overlay capture gets its first frame");
+
+    compositor.remove_output();
+    expect(wait_for([&]() { return sink.ended.load(); }), "unplugging the output ends its capture");
+    expect(screencopy.start(stream->output().id, false, std::make_unique<PoolSink>(1)) == nullptr,
+           "a removed output cannot be captured");
+
+    stream.reset();
+    screencopy.cleanup();
+}
+
+} // namespace
+
+int main() {
+    test_outputs();
+    test_damage_only();
+    test_output_removed();
+
+    return finish_checks();
+}
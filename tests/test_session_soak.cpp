@@ -0,0 +1,154 @@
+// Connection-churn soak test: thousands of EIS connect/disconnect cycles must
+// leave thread count, fd count and RSS flat. Each cycle creates a Session,
+// connects a libei client to it, disconnects the client and waits for the
+// session to notice before tearing it down.
+//
+//   test-session-soak [cycles]
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "session.h"
+#include "recording_backend.h"
+#include "check.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <string>
+
+extern "C" {
+#include <libei.h>
+}
+
+namespace {
+
+struct Usage {
+    long threads = 0;
+    long fds = 0;
+    long rss_kb = 0;
+};
+
+long status_field(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t len = strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, len, field) == 0) {
+            return std::strtol(line.c_str() + len, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+long open_fds() {
+    long count = 0;
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') count++;
+        }
+        closedir(dir);
+    }
+    return count - 1; // the directory stream itself
+}
+
+Usage usage() {
+    return Usage{ status_field("Threads:"), open_fds(), status_field("VmRSS:") };
+}
+
+// Connect a libei sender on `fd`, wait until the server has accepted it, then drop it
+bool connect_and_disconnect(int fd) {
+    struct ei* client = ei_new_sender(nullptr);
+    ei_configure_name(client, "hypr-remote soak client");
+    if (ei_setup_backend_fd(client, fd) != 0) {
+        ei_unref(client);
+        return false;
+    }
+
+    bool connected = false;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!connected && std::chrono::steady_clock::now() < deadline) {
+        struct pollfd pfd = { .fd = ei_get_fd(client), .events = POLLIN, .revents = 0 };
+        poll(&pfd, 1, 10);
+        ei_dispatch(client);
+        struct ei_event* event;
+        while ((event = ei_get_event(client)) != nullptr) {
+            if (ei_event_get_type(event) == EI_EVENT_CONNECT) connected = true;
+            ei_event_unref(event);
+        }
+    }
+
+    ei_unref(client);
+    return connected;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const long cycles = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 2000;
+    const long warmup = std::min(100L, cycles / 10);
+    // Allocator arenas and libei's caches may settle a little; anything beyond
+    // this is a per-cycle leak
+    const long rss_slack_kb = 4096;
+
+    std::cout.setstate(std::ios::failbit);
+
+    RequestLog log;
+    RecordingVirtualPointer pointer(log);
+    RecordingVirtualKeyboard keyboard(log);
+    LibEIHandler handler;
+    handler.pointer = &pointer;
+    handler.keyboard = &keyboard;
+    Portal portal;
+    portal.set_libei_handler(&handler);
+
+    Usage baseline;
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        if (cycle == warmup) baseline = usage();
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool gone = false;
+
+        Session session("/org/freedesktop/portal/desktop/session/soak/" + std::to_string(cycle), "soak",
+                        [&portal](struct eis_event* event) { portal.handle_eis_event(portal.shared_target(), event); });
+        session.set_client_gone_handler([&](Session&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            gone = true;
+            cv.notify_one();
+        });
+
+        int fd = session.connect_eis();
+        if (fd < 0) {
+            std::cerr << "FAIL cycle " << cycle << ": connect_eis failed" << std::endl;
+            return 1;
+        }
+        if (!connect_and_disconnect(fd)) {
+            std::cerr << "FAIL cycle " << cycle << ": client never connected" << std::endl;
+            return 1;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!cv.wait_for(lock, std::chrono::seconds(2), [&] { return gone; })) {
+            std::cerr << "FAIL cycle " << cycle << ": session did not see the disconnect" << std::endl;
+            return 1;
+        }
+        lock.unlock();
+        session.close();
+    }
+
+    Usage end = usage();
+    std::cerr << "after " << cycles << " cycles: threads " << baseline.threads << " -> " << end.threads
+              << ", fds " << baseline.fds << " -> " << end.fds
+              << ", rss " << baseline.rss_kb << " kB -> " << end.rss_kb << " kB" << std::endl;
+
+    expect(end.threads == baseline.threads, "the thread count is back where it started");
+    expect(end.fds == baseline.fds, "so is the fd count");
+    expect(end.rss_kb - baseline.rss_kb <= rss_slack_kb, "RSS grew by no more than the slack");
+    return finish_checks("no growth over the soak");
+}
@@ -0,0 +1,252 @@
+// Shared ring ingress: records published by a client reach the session's
+// devices framed and in order, a full ring refuses records instead of
+// overwriting them, invalid or out-of-range records are dropped, and a client
+// closing or overrunning its ring ends the session.
+
+#include "portal.h"
+#include "session.h"
+#include "eis_workers.h"
+#include "shared_ring.h"
+#include "translator.h"
+#include "recording_backend.h"
+#include "check.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+SharedRingRecord record(uint8_t kind, uint32_t code = 0, bool pressed = false, double x = 0, double y = 0) {
+    SharedRingRecord r;
+    r.kind = kind;
+    r.code = code;
+    r.pressed = pressed;
+    r.x = x;
+    r.y = y;
+    return r;
+}
+
+// A session with recording devices, served by `workers` or a thread of its own,
+// and a producer attached to its ring
+struct Served {
+    RequestLog log;
+    std::unique_ptr<Session> session;
+    SharedRingProducer producer;
+    std::atomic<uint64_t> applied{0};
+    std::atomic<bool> gone{false};
+    bool connected = false;
+
+    Served(Portal& portal, EisWorkers* workers, uint32_t capacity = SharedRing::DEFAULT_CAPACITY) {
+        session = std::make_unique<Session>("/test/session/ring", "test", nullptr);
+        session->attach_devices(DevicePair(
+            std::make_unique<RecordingVirtualPointer>(log), std::make_unique<RecordingVirtualKeyboard>(log)));
+        InputTarget* target = &session->input();
+        session->set_record_handler([this, &portal, target](const SharedRingRecord* records, size_t count) {
+            portal.handle_ring_records(*target, records, count);
+            applied.fetch_add(count, std::memory_order_release);
+        });
+        session->set_client_gone_handler([this](Session&) { gone = true; });
+
+        int memfd = -1, doorbell = -1;
+        connected = session->connect_ring(capacity, memfd, doorbell, workers) && producer.attach(memfd, doorbell);
+    }
+
+    // Publish everything, waiting out a full ring
+    void send(const std::vector<SharedRingRecord>& records) {
+        size_t sent = 0;
+        while (sent < records.size()) {
+            size_t n = producer.push(records.data() + sent, records.size() - sent);
+            if (n == 0) std::this_thread::yield();
+            sent += n;
+        }
+    }
+
+    std::vector<uint32_t> pressed() const {
+        std::vector<uint32_t> keys;
+        for (const auto& entry : log.entries) {
+            if (entry.request == WaylandRequest::KeyboardKey && entry.args[1] == 1) {
+                keys.push_back(entry.args[0]);
+            }
+        }
+        return keys;
+    }
+};
+
+void test_records_in_order(EisWorkers* workers, const char* how) {
+    std::cerr << "-- " << how << std::endl;
+    Portal portal;
+    Served served(portal, workers);
+    expect(served.connected, "the client maps the ring");
+
+    // Key presses and releases, a frame each, then motion two events to a frame
+    constexpr size_t kKeys = 2000;
+    std::vector<SharedRingRecord> records;
+    std::vector<uint32_t> sent;
+    for (size_t k = 0; k < kKeys; k++) {
+        uint32_t key = KEY_Q + k % 10;
+        sent.push_back(key);
+        records.push_back(record(SharedRingRecord::KEY, key, true));
+        records.push_back(record(SharedRingRecord::FRAME));
+        records.push_back(record(SharedRingRecord::KEY, key, false));
+        records.push_back(record(SharedRingRecord::FRAME));
+    }
+    for (int i = 0; i < 100; i++) {
+        records.push_back(record(SharedRingRecord::MOTION, 0, false, 1, 0));
+        records.push_back(record(SharedRingRecord::MOTION, 0, false, 0, 1));
+        records.push_back(record(SharedRingRecord::FRAME));
+    }
+    served.send(records);
+    served.producer.close();
+
+    expect(wait_for([&]() { return served.gone.load(); }), "closing the ring ends the session");
+    expect(served.applied.load(std::memory_order_acquire) == records.size(),
+           "every record published before the close is applied");
+    served.session->close();
+
+    expect(served.pressed() == sent, "keys reach the devices in the order published");
+    expect(served.log.count(WaylandRequest::PointerMotion) == 200, "every motion record is sent");
+    expect(served.log.count(WaylandRequest::PointerFrame) == 100, "records up to a FRAME share one pointer frame");
+}
+
+void test_full_ring() {
+    SharedRing ring;
+    expect(ring.create(10), "a ring is created");
+
+    SharedRingProducer producer;
+    bool attached = producer.attach(fcntl(ring.memfd(), F_DUPFD_CLOEXEC, 0), fcntl(ring.doorbell(), F_DUPFD_CLOEXEC, 0));
+    expect(attached, "the producer attaches to it");
+
+    // Capacity is rounded up to the minimum
+    std::vector<SharedRingRecord> records(SharedRing::MIN_CAPACITY + 1, record(SharedRingRecord::FRAME));
+    size_t pushed = producer.push(records.data(), records.size());
+    expect(pushed == SharedRing::MIN_CAPACITY, "a full ring takes no more than its capacity");
+    expect(!producer.push(records[0]), "pushing into a full ring fails instead of overwriting");
+
+    size_t drained = 0;
+    bool open = ring.drain([&](const SharedRingRecord*, size_t count) { drained += count; });
+    expect(open && drained == SharedRing::MIN_CAPACITY, "the portal drains all of it");
+    expect(producer.push(records[0]), "draining makes room again");
+}
+
+void test_invalid_records() {
+    Portal portal;
+    Served served(portal, nullptr);
+    expect(served.connected, "the client maps the ring");
+
+    served.send({
+        record(200, KEY_A, true),
+        record(SharedRingRecord::MOTION, 0, false, NAN, 1),
+        record(SharedRingRecord::MOTION, 0, false, 1, INFINITY),
+        record(SharedRingRecord::KEY, KEY_B, true),
+        record(SharedRingRecord::FRAME),
+    });
+    served.producer.close();
+
+    expect(wait_for([&]() { return served.gone.load(); }), "the session ends after the records");
+    served.session->close();
+    expect(served.log.count(WaylandRequest::PointerMotion) == 0, "motion that is not finite is dropped");
+    expect(served.pressed() == std::vector<uint32_t>{KEY_B}, "records of unknown kinds are dropped");
+}
+
+void test_out_of_range_records() {
+    Portal portal;
+    Served served(portal, nullptr);
+    expect(served.connected, "the client maps the ring");
+
+    served.send({
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, -1, 10),
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, 10, 1e12),
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, 4294967296.0, 10),
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, NAN, 10),
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, Translation::REGION_WIDTH, 10),
+        record(SharedRingRecord::MOTION_ABSOLUTE, 0, false, 100, 200),
+        record(SharedRingRecord::FRAME),
+        record(SharedRingRecord::KEY, 0x10000, true),
+        record(SharedRingRecord::BUTTON, 0xffffffff, true),
+        record(SharedRingRecord::SCROLL_DISCRETE, 0, false, 0, -1e300),
+        record(SharedRingRecord::KEY, KEY_C, true),
+        record(SharedRingRecord::FRAME),
+    });
+    served.producer.close();
+
+    expect(wait_for([&]() { return served.gone.load(); }), "the session ends after the records");
+    served.session->close();
+    const RecordedRequest* position = nullptr;
+    for (const auto& entry : served.log.entries) {
+        if (entry.request == WaylandRequest::PointerMotionAbsolute) position = &entry;
+    }
+    expect(served.log.count(WaylandRequest::PointerMotionAbsolute) == 1 && position &&
+           position->args[0] == 100 && position->args[1] == 200,
+           "absolute positions outside the region are dropped");
+    expect(served.log.count(WaylandRequest::PointerButton) == 0 && served.pressed() == std::vector<uint32_t>{KEY_C},
+           "key and button codes past the remap table are dropped");
+    expect(served.log.count(WaylandRequest::PointerAxisDiscrete) == 0 && served.log.count(WaylandRequest::PointerAxis) == 0,
+           "wheel movement too large to count is dropped");
+}
+
+void test_overrun() {
+    Portal portal;
+    RequestLog log;
+    Session session("/test/session/overrun", "test", nullptr);
+    session.attach_devices(DevicePair(
+        std::make_unique<RecordingVirtualPointer>(log), std::make_unique<RecordingVirtualKeyboard>(log)));
+    InputTarget* target = &session.input();
+    std::atomic<uint64_t> applied{0};
+    std::atomic<bool> gone{false};
+    session.set_record_handler([&](const SharedRingRecord* records, size_t count) {
+        portal.handle_ring_records(*target, records, count);
+        applied += count;
+    });
+    session.set_client_gone_handler([&](Session&) { gone = true; });
+
+    int memfd = -1, doorbell = -1;
+    expect(session.connect_ring(SharedRing::MIN_CAPACITY, memfd, doorbell), "a ring session starts");
+
+    // A client ignoring the portal's head and publishing a lap ahead of it
+    size_t size = SharedRingHeader::RECORDS_OFFSET + SharedRing::MIN_CAPACITY * sizeof(SharedRingRecord);
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    expect(memory != MAP_FAILED, "the client maps the ring itself");
+    if (memory == MAP_FAILED) return;
+    auto* header = static_cast<SharedRingHeader*>(memory);
+    header->tail.store(SharedRing::MIN_CAPACITY + 1, std::memory_order_release);
+    uint64_t one = 1;
+    expect(write(doorbell, &one, sizeof(one)) == sizeof(one), "the client rings the doorbell");
+
+    expect(wait_for([&]() { return gone.load(); }), "writing past the portal's head ends the session");
+    expect(applied.load() == 0, "none of the overrun records are applied");
+    expect(ftruncate(memfd, size / 2) != 0, "the client cannot shrink the sealed ring");
+
+    session.close();
+    munmap(memory, size);
+    close(memfd);
+    close(doorbell);
+}
+
+} // namespace
+
+int main() {
+    EisWorkers workers(1);
+    workers.start();
+
+    test_records_in_order(nullptr, "a thread of its own");
+    test_records_in_order(&workers, "on a worker");
+    test_full_ring();
+    test_invalid_records();
+    test_out_of_range_records();
+    test_overrun();
+
+    workers.stop();
+
+    return finish_checks();
+}
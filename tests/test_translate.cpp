@@ -0,0 +1,198 @@
+// Translation core: the same input sent over EIS, EI and the Notify* methods
+// comes out as the same Wayland requests, with scroll on the right axis,
+// modifiers tracked for every source and one timestamp per frame.
+
+#include "portal.h"
+#include "libei_handler.h"
+#include "recording_backend.h"
+#include "translator.h"
+#include "eis_pair.h"
+#include "ei_pair.h"
+#include "check.h"
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <linux/input-event-codes.h>
+}
+
+namespace {
+
+struct Harness {
+    RequestLog log;
+    RecordingVirtualPointer pointer{log};
+    RecordingVirtualKeyboard keyboard{log};
+    LibEIHandler handler;
+    Portal portal;
+
+    Harness() {
+        handler.pointer = &pointer;
+        handler.keyboard = &keyboard;
+        portal.set_libei_handler(&handler);
+    }
+};
+
+// A request without its timestamp, which differs between runs
+struct Request {
+    WaylandRequest request;
+    uint32_t args[5];
+
+    bool operator==(const Request& other) const {
+        if (request != other.request) return false;
+        for (int i = 0; i < 5; i++) {
+            if (args[i] != other.args[i]) return false;
+        }
+        return true;
+    }
+};
+
+std::vector<Request> requests(const RequestLog& log) {
+    std::vector<Request> out;
+    for (const auto& entry : log.entries) {
+        out.push_back({ entry.request, { entry.args[0], entry.args[1], entry.args[2], entry.args[3], entry.args[4] } });
+    }
+    return out;
+}
+
+const RecordedRequest* find(const RequestLog& log, WaylandRequest request, size_t nth = 0) {
+    for (const auto& entry : log.entries) {
+        if (entry.request == request && nth-- == 0) return &entry;
+    }
+    return nullptr;
+}
+
+// Move, click, scroll down and type Ctrl+C: 8 events, each in a frame of its own
+template <typename Pair>
+void script(Pair& pair) {
+    pair.motion(3.0, -2.0);
+    pair.button(BTN_LEFT, true);
+    pair.button(BTN_LEFT, false);
+    pair.scroll(0.0, 2.5);
+    pair.key(KEY_LEFTCTRL, true);
+    pair.key(KEY_C, true);
+    pair.key(KEY_C, false);
+    pair.key(KEY_LEFTCTRL, false);
+}
+
+void test_same_requests() {
+    Harness eis;
+    EisTestPair eis_pair([&eis](struct eis_event* event) { eis.portal.handle_eis_event(eis.portal.shared_target(), event); });
+    bool eis_ok = eis_pair.connect();
+    eis.log.clear();
+    if (eis_ok) {
+        script(eis_pair);
+        eis_ok = eis_pair.deliver(16);
+    }
+    expect(eis_ok, "EIS events arrive");
+
+    Harness ei;
+    EiTestPair ei_pair([&ei](struct ei_event* event) { ei.handler.handle_event(event); });
+    bool ei_ok = ei_pair.connect();
+    ei.log.clear();
+    if (ei_ok) {
+        script(ei_pair);
+        ei_ok = ei_pair.deliver(16);
+    }
+    expect(ei_ok, "EI events arrive");
+
+    Harness notify;
+    InputTarget& target = notify.portal.shared_target();
+    notify.portal.notify_pointer_motion(target, 3.0, -2.0);
+    notify.portal.notify_pointer_button(target, BTN_LEFT, 1);
+    notify.portal.notify_pointer_button(target, BTN_LEFT, 0);
+    notify.portal.notify_pointer_axis(target, 0.0, 2.5);
+    notify.portal.notify_keyboard_keycode(target, KEY_LEFTCTRL, 1);
+    notify.portal.notify_keyboard_keycode(target, KEY_C, 1);
+    notify.portal.notify_keyboard_keycode(target, KEY_C, 0);
+    notify.portal.notify_keyboard_keycode(target, KEY_LEFTCTRL, 0);
+
+    expect(requests(eis.log) == requests(notify.log), "EIS and Notify* produce the same requests");
+    expect(requests(ei.log) == requests(notify.log), "EI and Notify* produce the same requests");
+
+    const RecordedRequest* axis = find(notify.log, WaylandRequest::PointerAxis);
+    expect(axis && axis->args[0] == WL_POINTER_AXIS_VERTICAL_SCROLL &&
+           axis->args[1] == static_cast<uint32_t>(wl_fixed_from_double(2.5 * Translation::SCROLL_SCALE)),
+           "vertical scroll carries the vertical delta");
+    expect(notify.log.count(WaylandRequest::PointerAxis) == 1, "an axis without movement is not sent");
+
+    const RecordedRequest* held = find(notify.log, WaylandRequest::KeyboardModifiers, 0);
+    const RecordedRequest* released = find(notify.log, WaylandRequest::KeyboardModifiers, 1);
+    expect(notify.log.count(WaylandRequest::KeyboardModifiers) == 2 && held && released &&
+           held->args[0] != 0 && released->args[0] == 0,
+           "modifiers are sent when Ctrl changes them, and only then");
+}
+
+void test_discrete_scroll() {
+    Harness eis;
+    EisTestPair eis_pair([&eis](struct eis_event* event) { eis.portal.handle_eis_event(eis.portal.shared_target(), event); });
+    Harness ei;
+    EiTestPair ei_pair([&ei](struct ei_event* event) { ei.handler.handle_event(event); });
+    if (!eis_pair.connect() || !ei_pair.connect()) {
+        expect(false, "handshakes for discrete scroll");
+        return;
+    }
+    eis.log.clear();
+    ei.log.clear();
+
+    // Two clicks down, then half a click left twice
+    eis_pair.scroll_discrete(0, 2 * Translation::DISCRETE_CLICK);
+    eis_pair.scroll_discrete(-Translation::DISCRETE_CLICK / 2, 0);
+    eis_pair.scroll_discrete(-Translation::DISCRETE_CLICK / 2, 0);
+    ei_pair.scroll_discrete(0, 2 * Translation::DISCRETE_CLICK);
+    ei_pair.scroll_discrete(-Translation::DISCRETE_CLICK / 2, 0);
+    ei_pair.scroll_discrete(-Translation::DISCRETE_CLICK / 2, 0);
+    expect(eis_pair.deliver(6) && ei_pair.deliver(6), "discrete scroll arrives");
+
+    expect(requests(eis.log) == requests(ei.log), "EIS and EI scroll the same way");
+    const RecordedRequest* down = find(eis.log, WaylandRequest::PointerAxisDiscrete, 0);
+    const RecordedRequest* half = find(eis.log, WaylandRequest::PointerAxis, 0);
+    const RecordedRequest* left = find(eis.log, WaylandRequest::PointerAxisDiscrete, 1);
+    expect(down && down->args[0] == WL_POINTER_AXIS_VERTICAL_SCROLL &&
+           down->args[1] == static_cast<uint32_t>(wl_fixed_from_double(2 * Translation::SCROLL_CLICK)) &&
+           static_cast<int32_t>(down->args[2]) == 2,
+           "two clicks scroll two clicks");
+    expect(half && half->args[0] == WL_POINTER_AXIS_HORIZONTAL_SCROLL &&
+           half->args[1] == static_cast<uint32_t>(wl_fixed_from_double(-Translation::SCROLL_CLICK / 2)),
+           "half a click scrolls by half a click, without a click count");
+    expect(left && left->args[0] == WL_POINTER_AXIS_HORIZONTAL_SCROLL &&
+           left->args[1] == static_cast<uint32_t>(wl_fixed_from_double(-Translation::SCROLL_CLICK / 2)) &&
+           static_cast<int32_t>(left->args[2]) == -1,
+           "the second half completes one click left");
+}
+
+void test_frames() {
+    Harness eis;
+    EisTestPair pair([&eis](struct eis_event* event) { eis.portal.handle_eis_event(eis.portal.shared_target(), event); });
+    if (!pair.connect()) {
+        expect(false, "EIS handshake for frames");
+        return;
+    }
+    eis.log.clear();
+
+    pair.motion_with_button(1.0, 1.0, BTN_LEFT, true);
+    expect(pair.deliver(3), "a frame of two events arrives");
+    const RecordedRequest* motion = find(eis.log, WaylandRequest::PointerMotion);
+    const RecordedRequest* button = find(eis.log, WaylandRequest::PointerButton);
+    expect(eis.log.count(WaylandRequest::PointerFrame) == 1 && eis.log.flushes() == 1,
+           "events the client framed together share one Wayland frame");
+    expect(motion && button && motion->time == button->time, "and one timestamp");
+
+    Harness notify;
+    InputTarget& target = notify.portal.shared_target();
+    notify.portal.notify_pointer_motion(target, 1.0, 1.0);
+    notify.portal.notify_pointer_button(target, BTN_LEFT, 1);
+    expect(notify.log.count(WaylandRequest::PointerFrame) == 2, "each Notify* call is a frame of its own");
+}
+
+} // namespace
+
+int main() {
+    // Keep the portal's connection logging out of the test output
+    std::cout.setstate(std::ios::failbit);
+
+    test_same_requests();
+    test_discrete_scroll();
+    test_frames();
+
+    return finish_checks();
+}
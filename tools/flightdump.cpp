@@ -0,0 +1,201 @@
+// hypr-remote-flightdump: reads a flight recorder dump (flight-crash.bin, or
+// one written by Diagnostics.DumpFlightRecorder) and prints it, one record per
+// line, oldest first, with times relative to the first record.
+//
+//   hypr-remote-flightdump ~/.local/state/hypr-remote/flight-crash.bin
+//   hypr-remote-flightdump flight-1760000000.bin --session 3
+//   hypr-remote-flightdump flight-1760000000.bin --session 3 --requests session3.rec
+//
+// --requests writes the Wayland requests in the record backend's file format
+// (--backend record:<path>), so a session's output can be compared against a
+// recorded run or fed to anything that reads those files.
+
+#include "flight_recorder.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// InputEvent kinds, in order (translator.h), and the ones that carry a code
+const char* EVENT_NAMES[] = { "none", "motion", "motion-absolute", "button", "scroll", "scroll-discrete",
+                              "scroll-stop", "key", "keysym", "frame" };
+const uint8_t EVENT_BUTTON = 3, EVENT_KEY = 7, EVENT_KEYSYM = 8;
+// ProbeSource values (probes.h)
+const char* SOURCE_NAMES[] = { "eis", "ei", "dbus", "passthrough", "ring" };
+// WaylandRequest values
+const char* REQUEST_NAMES[] = { "pointer.motion", "pointer.motion_absolute", "pointer.button", "pointer.axis",
+                                "pointer.axis_source", "pointer.axis_discrete", "pointer.axis_stop",
+                                "pointer.frame", "keyboard.key", "keyboard.modifiers", "flush",
+                                "keyboard.keymap" };
+
+template <size_t N>
+const char* name_of(const char* (&names)[N], uint8_t value) {
+    return value < N ? names[value] : "?";
+}
+
+float float_of(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+double fixed_of(uint32_t value) {
+    return int32_t(value) / 256.0;
+}
+
+void print_request(const FlightRecord& r) {
+    std::cout << name_of(REQUEST_NAMES, r.type);
+    switch (static_cast<WaylandRequest>(r.type)) {
+        case WaylandRequest::PointerMotion:
+            std::cout << " dx=" << fixed_of(r.args[0]) << " dy=" << fixed_of(r.args[1]);
+            break;
+        case WaylandRequest::PointerMotionAbsolute:
+            std::cout << " x=" << r.args[0] << " y=" << r.args[1] << " extent=" << r.args[2] << "x" << r.args[3];
+            break;
+        case WaylandRequest::PointerButton:
+        case WaylandRequest::KeyboardKey:
+            std::cout << " code=" << r.args[0] << " state=" << r.args[1];
+            break;
+        case WaylandRequest::PointerAxis:
+            std::cout << " axis=" << r.args[0] << " value=" << fixed_of(r.args[1]);
+            break;
+        case WaylandRequest::PointerAxisSource:
+            std::cout << " source=" << r.args[0];
+            break;
+        case WaylandRequest::PointerAxisDiscrete:
+            std::cout << " axis=" << r.args[0] << " value=" << fixed_of(r.args[1]) << " discrete=" << int32_t(r.args[2]);
+            break;
+        case WaylandRequest::PointerAxisStop:
+            std::cout << " axis=" << r.args[0];
+            break;
+        case WaylandRequest::KeyboardModifiers:
+            std::cout << " depressed=" << r.args[0] << " latched=" << r.args[1] << " locked=" << r.args[2]
+                      << " group=" << r.args[3];
+            break;
+        case WaylandRequest::KeyboardKeymap:
+            std::cout << " size=" << r.args[0];
+            break;
+        default:
+            break;
+    }
+    if (r.time) std::cout << " time=" << r.time;
+}
+
+void print_record(const FlightRecord& r, uint64_t start_ns) {
+    std::cout << std::setw(8) << r.sequence << "  " << std::fixed << std::setprecision(6)
+              << (r.time_ns - start_ns) / 1e9 << "  s" << r.session << "  ";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    switch (r.kind) {
+        case FlightRecord::EVENT:
+            std::cout << name_of(SOURCE_NAMES, r.source) << " " << name_of(EVENT_NAMES, r.type);
+            if (r.type == EVENT_BUTTON || r.type == EVENT_KEY || r.type == EVENT_KEYSYM) {
+                std::cout << " code=" << r.args[0] << (r.pressed ? " pressed" : " released");
+            }
+            if (r.args[1] || r.args[2]) std::cout << " x=" << float_of(r.args[1]) << " y=" << float_of(r.args[2]);
+            break;
+        case FlightRecord::REQUEST:
+            print_request(r);
+            break;
+        case FlightRecord::SESSION_OPEN: {
+            const char* tail = reinterpret_cast<const char*>(r.args);
+            std::cout << "session open ..." << std::string(tail, strnlen(tail, sizeof(r.args)));
+            break;
+        }
+        case FlightRecord::SESSION_CLOSE:
+            std::cout << "session close";
+            break;
+        default:
+            std::cout << "kind " << int(r.kind);
+            break;
+    }
+    std::cout << "\n";
+}
+
+void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " <dump> [--session <id>] [--requests <out>]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string path, requests_path;
+    long session = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--session" && i + 1 < argc) {
+            session = std::strtol(argv[++i], nullptr, 10);
+        } else if (arg == "--requests" && i + 1 < argc) {
+            requests_path = argv[++i];
+        } else if (arg[0] != '-' && path.empty()) {
+            path = arg;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    FlightDumpHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, FlightDumpHeader::MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << path << " is not a flight recorder dump" << std::endl;
+        fclose(in);
+        return 1;
+    }
+    if (header.version != FlightDumpHeader::VERSION || header.record_size != sizeof(FlightRecord)) {
+        std::cerr << path << ": unsupported dump version " << header.version << " (record size "
+                  << header.record_size << ")" << std::endl;
+        fclose(in);
+        return 1;
+    }
+
+    std::vector<FlightRecord> records(header.count);
+    size_t read = fread(records.data(), sizeof(FlightRecord), records.size(), in);
+    fclose(in);
+    if (read != records.size()) {
+        std::cerr << path << ": truncated, " << read << " of " << header.count << " records" << std::endl;
+        records.resize(read);
+    }
+
+    FILE* out = nullptr;
+    if (!requests_path.empty() && !(out = fopen(requests_path.c_str(), "wb"))) {
+        std::cerr << "Cannot write " << requests_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    uint64_t start_ns = records.empty() ? 0 : records.front().time_ns;
+    size_t shown = 0, written = 0;
+    for (const FlightRecord& r : records) {
+        if (session >= 0 && r.session != uint32_t(session)) continue;
+        print_record(r, start_ns);
+        shown++;
+        if (out && r.kind == FlightRecord::REQUEST) {
+            RecordedRequest request{ static_cast<WaylandRequest>(r.type), r.time,
+                                     { r.args[0], r.args[1], r.args[2], r.args[3], r.args[4] } };
+            fwrite(&request, sizeof(request), 1, out);
+            written++;
+        }
+    }
+    std::cout << shown << " of " << records.size() << " records" << std::endl;
+    if (out) {
+        fclose(out);
+        std::cout << written << " requests written to " << requests_path << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,540 @@
+// hypr-remote-loadgen: pushes synthetic input through the portal's real ingress
+// paths. Each client runs CreateSession/SelectDevices/Start on its own D-Bus
+// connection, then either connects a libei sender to the fd from ConnectToEIS,
+// publishes into the ring from ConnectToSharedRing or calls the Notify*
+// methods, and emits a workload at a fixed rate.
+//
+//   hypr-remote-loadgen --clients 4 --workload mixed --duration 10
+//   hypr-remote-loadgen --mode notify --workload typing --no-reply
+//   hypr-remote-loadgen --mode ring --rate 1000000
+//
+// Sent events are counted per client; an event is dropped when it could not be
+// emitted (device not emulating, connection gone, D-Bus error) or when the
+// client fell so far behind schedule that the tick was skipped.
+
+#include "shared_ring.h"
+#include <sdbus-c++/sdbus-c++.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libei.h>
+#include <linux/input-event-codes.h>
+}
+
+using Clock = std::chrono::steady_clock;
+
+static const char* PORTAL_NAME = "org.freedesktop.impl.portal.desktop.hypr-remote";
+static const char* PORTAL_PATH = "/org/freedesktop/portal/desktop";
+static const char* PORTAL_INTERFACE = "org.freedesktop.impl.portal.RemoteDesktop";
+static const char* SESSION_INTERFACE = "org.freedesktop.impl.portal.Session";
+
+// Ticks more than this far behind schedule are skipped and counted as dropped
+static const int MAX_LAG_TICKS = 64;
+
+enum class Mode { EIS, RING, NOTIFY };
+enum class Workload { MOTION, TYPING, SCROLL, MIXED };
+
+// One logical input event per tick
+enum class Action { MOTION, KEY_PRESS, KEY_RELEASE, SCROLL, SCROLL_DISCRETE, IDLE };
+
+struct Options {
+    std::string service = PORTAL_NAME;
+    Mode mode = Mode::EIS;
+    Workload workload = Workload::MOTION;
+    int clients = 1;
+    double rate = 0; // per client; 0 picks the workload's default
+    double duration = 10;
+    bool no_reply = false;
+};
+
+struct Counters {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<bool> ready{false};
+    std::atomic<bool> failed{false};
+};
+
+static double default_rate(Workload workload) {
+    switch (workload) {
+        case Workload::MOTION: return 8000; // 8 kHz gaming mouse
+        case Workload::TYPING: return 200;  // keystroke edges per second within a burst
+        case Workload::SCROLL: return 2000;
+        case Workload::MIXED: return 8000;
+    }
+    return 1000;
+}
+
+// What to emit on tick `n`
+static Action next_action(Workload workload, uint64_t n) {
+    switch (workload) {
+        case Workload::MOTION:
+            return Action::MOTION;
+
+        case Workload::TYPING: {
+            // Bursts of 40 keystrokes (press + release each), then as long idle
+            uint64_t phase = n % 160;
+            if (phase >= 80) return Action::IDLE;
+            return phase % 2 == 0 ? Action::KEY_PRESS : Action::KEY_RELEASE;
+        }
+
+        case Workload::SCROLL:
+            return n % 4 == 3 ? Action::SCROLL_DISCRETE : Action::SCROLL;
+
+        case Workload::MIXED: {
+            // Mostly motion, a keystroke and a scroll every 32 ticks
+            uint64_t phase = n % 32;
+            if (phase == 0) return Action::KEY_PRESS;
+            if (phase == 1) return Action::KEY_RELEASE;
+            if (phase == 16) return Action::SCROLL;
+            return Action::MOTION;
+        }
+    }
+    return Action::IDLE;
+}
+
+// Small circles, so the pointer stays put over a long run
+static void motion_delta(uint64_t n, double& dx, double& dy) {
+    double angle = static_cast<double>(n % 360) * M_PI / 180.0;
+    dx = 2.0 * std::cos(angle);
+    dy = 2.0 * std::sin(angle);
+}
+
+static uint32_t key_for(uint64_t n) {
+    static const uint32_t keys[] = { KEY_H, KEY_E, KEY_L, KEY_L, KEY_O, KEY_SPACE, KEY_W, KEY_O, KEY_R, KEY_L, KEY_D };
+    return keys[(n / 2) % (sizeof(keys) / sizeof(keys[0]))];
+}
+
+// libei sender on a ConnectToEIS fd
+class EiClient {
+public:
+    ~EiClient() {
+        if (pointer) ei_device_unref(pointer);
+        if (keyboard) ei_device_unref(keyboard);
+        if (context) ei_unref(context);
+    }
+
+    bool connect(int fd, const std::string& name, int timeout_ms = 5000) {
+        context = ei_new_sender(nullptr);
+        if (!context) return false;
+        ei_configure_name(context, name.c_str());
+        if (ei_setup_backend_fd(context, fd) != 0) return false;
+
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!pointer_ready || !keyboard_ready) {
+            if (Clock::now() > deadline || disconnected) return false;
+            struct pollfd pfd = { .fd = ei_get_fd(context), .events = POLLIN, .revents = 0 };
+            poll(&pfd, 1, 10);
+            dispatch();
+        }
+        return true;
+    }
+
+    // Handle pause/resume/disconnect without blocking
+    void dispatch() {
+        ei_dispatch(context);
+        struct ei_event* event;
+        while ((event = ei_get_event(context)) != nullptr) {
+            struct ei_device* device = ei_event_get_device(event);
+            switch (ei_event_get_type(event)) {
+                case EI_EVENT_SEAT_ADDED:
+                    ei_seat_bind_capabilities(ei_event_get_seat(event),
+                                              EI_DEVICE_CAP_POINTER, EI_DEVICE_CAP_POINTER_ABSOLUTE,
+                                              EI_DEVICE_CAP_BUTTON, EI_DEVICE_CAP_SCROLL,
+                                              EI_DEVICE_CAP_KEYBOARD, nullptr);
+                    break;
+                case EI_EVENT_DEVICE_ADDED:
+                    if (!pointer && ei_device_has_capability(device, EI_DEVICE_CAP_POINTER)) {
+                        pointer = ei_device_ref(device);
+                    } else if (!keyboard && ei_device_has_capability(device, EI_DEVICE_CAP_KEYBOARD)) {
+                        keyboard = ei_device_ref(device);
+                    }
+                    break;
+                case EI_EVENT_DEVICE_RESUMED:
+                    ei_device_start_emulating(device, ++sequence);
+                    if (device == pointer) pointer_ready = true;
+                    if (device == keyboard) keyboard_ready = true;
+                    break;
+                case EI_EVENT_DEVICE_PAUSED:
+                    if (device == pointer) pointer_ready = false;
+                    if (device == keyboard) keyboard_ready = false;
+                    break;
+                case EI_EVENT_DISCONNECT:
+                    disconnected = true;
+                    pointer_ready = keyboard_ready = false;
+                    break;
+                default:
+                    break;
+            }
+            ei_event_unref(event);
+        }
+    }
+
+    // False if the event could not be emitted
+    bool emit(Action action, uint64_t n) {
+        uint64_t now = ei_now(context);
+        switch (action) {
+            case Action::MOTION: {
+                if (!pointer_ready) return false;
+                double dx, dy;
+                motion_delta(n, dx, dy);
+                ei_device_pointer_motion(pointer, dx, dy);
+                ei_device_frame(pointer, now);
+                return true;
+            }
+            case Action::KEY_PRESS:
+            case Action::KEY_RELEASE:
+                if (!keyboard_ready) return false;
+                ei_device_keyboard_key(keyboard, key_for(n), action == Action::KEY_PRESS);
+                ei_device_frame(keyboard, now);
+                return true;
+            case Action::SCROLL:
+                if (!pointer_ready) return false;
+                ei_device_scroll_delta(pointer, 0.0, 1.0);
+                ei_device_frame(pointer, now);
+                return true;
+            case Action::SCROLL_DISCRETE:
+                if (!pointer_ready) return false;
+                ei_device_scroll_discrete(pointer, 0, 120);
+                ei_device_frame(pointer, now);
+                return true;
+            case Action::IDLE:
+                return true;
+        }
+        return false;
+    }
+
+    bool is_disconnected() const { return disconnected; }
+
+private:
+    struct ei* context = nullptr;
+    struct ei_device* pointer = nullptr;
+    struct ei_device* keyboard = nullptr;
+    uint32_t sequence = 0;
+    bool pointer_ready = false;
+    bool keyboard_ready = false;
+    bool disconnected = false;
+};
+
+// CreateSession -> SelectDevices -> Start on the portal backend interface
+static bool start_session(sdbus::IProxy& portal, const std::string& session, const std::string& request,
+                          const std::string& app_id) {
+    uint32_t response = 1;
+    std::map<std::string, sdbus::Variant> results;
+
+    portal.callMethod("CreateSession").onInterface(PORTAL_INTERFACE)
+        .withArguments(sdbus::ObjectPath(request), sdbus::ObjectPath(session), app_id,
+                       std::map<std::string, sdbus::Variant>{})
+        .storeResultsTo(response, results);
+    if (response != 0) return false;
+
+    std::map<std::string, sdbus::Variant> devices;
+    devices["types"] = sdbus::Variant(static_cast<uint32_t>(3)); // keyboard | pointer
+    portal.callMethod("SelectDevices").onInterface(PORTAL_INTERFACE)
+        .withArguments(sdbus::ObjectPath(request), sdbus::ObjectPath(session), app_id, devices)
+        .storeResultsTo(response, results);
+    if (response != 0) return false;
+
+    portal.callMethod("Start").onInterface(PORTAL_INTERFACE)
+        .withArguments(sdbus::ObjectPath(request), sdbus::ObjectPath(session), app_id, std::string(),
+                       std::map<std::string, sdbus::Variant>{})
+        .storeResultsTo(response, results);
+    return response == 0;
+}
+
+// One frame of ring records per action; false if the ring is full
+static bool publish(SharedRingProducer& ring, Action action, uint64_t n) {
+    SharedRingRecord records[2];
+    records[1].kind = SharedRingRecord::FRAME;
+    SharedRingRecord& record = records[0];
+
+    switch (action) {
+        case Action::MOTION:
+            record.kind = SharedRingRecord::MOTION;
+            motion_delta(n, record.x, record.y);
+            break;
+        case Action::KEY_PRESS:
+        case Action::KEY_RELEASE:
+            record.kind = SharedRingRecord::KEY;
+            record.code = key_for(n);
+            record.pressed = action == Action::KEY_PRESS;
+            break;
+        case Action::SCROLL:
+            record.kind = SharedRingRecord::SCROLL;
+            record.y = 1.0;
+            break;
+        case Action::SCROLL_DISCRETE:
+            record.kind = SharedRingRecord::SCROLL_DISCRETE;
+            record.y = 120;
+            break;
+        case Action::IDLE:
+            return true;
+    }
+    // Both or neither, so a full ring never leaves half a frame behind
+    return ring.push_all(records, 2);
+}
+
+// One Notify* call per action; false on a D-Bus error
+static bool notify(sdbus::IProxy& portal, const sdbus::ObjectPath& session, Action action, uint64_t n,
+                   bool no_reply) {
+    static const std::map<std::string, sdbus::Variant> options;
+    auto send = [&](const char* method, auto&&... args) {
+        auto invoker = portal.callMethod(method);
+        invoker.onInterface(PORTAL_INTERFACE).withArguments(session, options, args...);
+        if (no_reply) invoker.dontExpectReply();
+    };
+
+    switch (action) {
+        case Action::MOTION: {
+            double dx, dy;
+            motion_delta(n, dx, dy);
+            send("NotifyPointerMotion", dx, dy);
+            break;
+        }
+        case Action::KEY_PRESS:
+        case Action::KEY_RELEASE:
+            send("NotifyKeyboardKeycode", static_cast<int32_t>(key_for(n)),
+                 static_cast<uint32_t>(action == Action::KEY_PRESS ? 1 : 0));
+            break;
+        case Action::SCROLL:
+            send("NotifyPointerAxis", 0.0, 1.0);
+            break;
+        case Action::SCROLL_DISCRETE:
+            send("NotifyPointerAxis", 0.0, 15.0);
+            break;
+        case Action::IDLE:
+            break;
+    }
+    return true;
+}
+
+static void run_client(const Options& options, int index, Counters& counters, const std::atomic<bool>& go,
+                       Clock::time_point& end_time) {
+    std::string base = "/org/freedesktop/portal/desktop";
+    std::string tag = "loadgen_" + std::to_string(getpid()) + "_" + std::to_string(index);
+    sdbus::ObjectPath session_handle(base + "/session/" + tag);
+    std::string request_handle = base + "/request/" + tag;
+    std::string app_id = "hypr-remote-loadgen";
+
+    std::unique_ptr<sdbus::IProxy> portal;
+    EiClient ei;
+    SharedRingProducer ring;
+    try {
+        portal = sdbus::createProxy(sdbus::createSessionBusConnection(), options.service, PORTAL_PATH);
+        if (!start_session(*portal, session_handle, request_handle, app_id)) {
+            std::cerr << "Client " << index << ": session setup was refused" << std::endl;
+            counters.failed = true;
+            return;
+        }
+
+        if (options.mode == Mode::EIS) {
+            sdbus::UnixFd fd;
+            portal->callMethod("ConnectToEIS").onInterface(PORTAL_INTERFACE)
+                .withArguments(session_handle, app_id, std::map<std::string, sdbus::Variant>{})
+                .storeResultsTo(fd);
+            if (!ei.connect(fd.release(), app_id + " " + std::to_string(index))) {
+                std::cerr << "Client " << index << ": EIS handshake failed" << std::endl;
+                counters.failed = true;
+                return;
+            }
+        } else if (options.mode == Mode::RING) {
+            sdbus::UnixFd memfd, doorbell;
+            portal->callMethod("ConnectToSharedRing").onInterface(PORTAL_INTERFACE)
+                .withArguments(session_handle, app_id, std::map<std::string, sdbus::Variant>{})
+                .storeResultsTo(memfd, doorbell);
+            if (!ring.attach(memfd.release(), doorbell.release())) {
+                std::cerr << "Client " << index << ": not a shared ring" << std::endl;
+                counters.failed = true;
+                return;
+            }
+        }
+    } catch (const sdbus::Error& e) {
+        std::cerr << "Client " << index << ": " << e.getName() << ": " << e.getMessage() << std::endl;
+        counters.failed = true;
+        return;
+    }
+
+    counters.ready = true;
+    while (!go) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    double rate = options.rate > 0 ? options.rate : default_rate(options.workload);
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    auto next = Clock::now();
+    uint64_t n = 0;
+
+    while (next < end_time) {
+        auto now = Clock::now();
+        if (now < next) {
+            std::this_thread::sleep_until(next);
+        } else if (now - next > period * MAX_LAG_TICKS) {
+            // Too far behind: skip to now rather than bursting to catch up
+            uint64_t skipped = (now - next) / period;
+            counters.dropped += skipped;
+            n += skipped;
+            next += period * skipped;
+        }
+
+        Action action = next_action(options.workload, n);
+        bool ok;
+        if (options.mode == Mode::EIS) {
+            if (n % 64 == 0) ei.dispatch();
+            ok = ei.emit(action, n);
+        } else if (options.mode == Mode::RING) {
+            ok = publish(ring, action, n);
+        } else {
+            try {
+                ok = notify(*portal, session_handle, action, n, options.no_reply);
+            } catch (const sdbus::Error&) {
+                counters.errors++;
+                ok = false;
+            }
+        }
+        if (action != Action::IDLE) {
+            if (ok) counters.sent++;
+            else counters.dropped++;
+        }
+
+        n++;
+        next += period;
+        if (options.mode == Mode::EIS && ei.is_disconnected()) break;
+    }
+
+    // Let the EIS socket drain before the session goes away; the ring's close
+    // ends the session once the portal has applied the rest
+    if (options.mode == Mode::EIS) ei.dispatch();
+    if (options.mode == Mode::RING) ring.close();
+
+    try {
+        auto session = sdbus::createProxy(portal->getConnection(), options.service, session_handle);
+        session->callMethod("Close").onInterface(SESSION_INTERFACE);
+    } catch (const sdbus::Error&) {
+        // The session may already be gone with its EIS client
+    }
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " [options]\n"
+              << "  --clients N          concurrent clients, one session each (default 1)\n"
+              << "  --mode eis|ring|notify  ConnectToEIS + libei, ConnectToSharedRing, or Notify* calls (default eis)\n"
+              << "  --workload W         motion (8 kHz), typing (bursts), scroll (storm), mixed (default motion)\n"
+              << "  --rate HZ            events per second per client (default: per workload)\n"
+              << "  --duration S         seconds to run (default 10)\n"
+              << "  --no-reply           Notify* calls without waiting for replies\n"
+              << "  --service NAME       portal bus name (default " << PORTAL_NAME << ")\n";
+}
+
+static bool parse(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+
+        if (arg == "--no-reply") {
+            options.no_reply = true;
+        } else if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (!(v = value())) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--clients") {
+            options.clients = std::atoi(v);
+        } else if (arg == "--rate") {
+            options.rate = std::atof(v);
+        } else if (arg == "--duration") {
+            options.duration = std::atof(v);
+        } else if (arg == "--service") {
+            options.service = v;
+        } else if (arg == "--mode") {
+            if (strcmp(v, "eis") == 0) options.mode = Mode::EIS;
+            else if (strcmp(v, "ring") == 0) options.mode = Mode::RING;
+            else if (strcmp(v, "notify") == 0) options.mode = Mode::NOTIFY;
+            else return false;
+        } else if (arg == "--workload") {
+            if (strcmp(v, "motion") == 0) options.workload = Workload::MOTION;
+            else if (strcmp(v, "typing") == 0) options.workload = Workload::TYPING;
+            else if (strcmp(v, "scroll") == 0) options.workload = Workload::SCROLL;
+            else if (strcmp(v, "mixed") == 0) options.workload = Workload::MIXED;
+            else return false;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return options.clients > 0 && options.duration > 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Counters> counters(options.clients);
+    std::vector<std::thread> threads;
+    std::atomic<bool> go{false};
+    Clock::time_point end_time;
+
+    for (int i = 0; i < options.clients; i++) {
+        threads.emplace_back(run_client, std::cref(options), i, std::ref(counters[i]), std::cref(go), std::ref(end_time));
+    }
+
+    // Start every client's workload together once all sessions are up
+    for (auto& c : counters) {
+        while (!c.ready && !c.failed) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto start = Clock::now();
+    end_time = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    go = true;
+
+    // Progress once a second
+    uint64_t last = 0;
+    for (auto tick = start + std::chrono::seconds(1); tick < end_time; tick += std::chrono::seconds(1)) {
+        std::this_thread::sleep_until(tick);
+        uint64_t total = 0;
+        for (auto& c : counters) total += c.sent;
+        std::cout << "  " << (total - last) << " events/s" << std::endl;
+        last = total;
+    }
+
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double rate = options.rate > 0 ? options.rate : default_rate(options.workload);
+    uint64_t sent = 0, dropped = 0, errors = 0;
+    int failed = 0;
+    std::cout << std::fixed << std::setprecision(0);
+    for (int i = 0; i < options.clients; i++) {
+        auto& c = counters[i];
+        if (c.failed) {
+            failed++;
+            continue;
+        }
+        std::cout << "client " << i << ": " << c.sent << " sent (" << c.sent / elapsed << "/s), "
+                  << c.dropped << " dropped, " << c.errors << " errors" << std::endl;
+        sent += c.sent;
+        dropped += c.dropped;
+        errors += c.errors;
+    }
+    std::cout << "total: " << sent << " sent in " << std::setprecision(2) << elapsed << " s, "
+              << std::setprecision(0) << sent / elapsed << "/s achieved of "
+              << rate * (options.clients - failed) << "/s target, " << dropped << " dropped, "
+              << errors << " errors";
+    if (failed) std::cout << ", " << failed << " client(s) failed to start";
+    std::cout << std::endl;
+
+    return failed == options.clients ? 1 : 0;
+}